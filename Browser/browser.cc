@@ -5,6 +5,8 @@
 #include <stdlib.h>
 #include "scenes.h"
 #include "skybox.h"
+#include "picker.h"
+#include "collisionGrid.h"
 
 
 // global variables
@@ -13,6 +15,7 @@ const static float angle_step = 1.0f * Constants::degree_to_rad; // angular step
 static Node *displayNode; // the selected node
 static Node *skynode = 0;
 static int   check_cull = 0;
+static bool gpu_pick = false; // pick with the ID buffer (alt-q) instead of rays
 // Animation settings
 // The time in milliseconds between timer ticks
 static int MG_TIMERMSECS = 33;
@@ -176,6 +179,8 @@ static void InitShaders() {
 	mgr->create("bump", "Shaders/bump_shader.vert", "Shaders/bump_shader.frag");
 	mgr->create("sky", "Shaders/sky.vert", "Shaders/sky.frag");
 	mgr->create("Shadow", "Shaders/shadowmap.vert", "Shaders/shadowmap.frag");
+	mgr->create("impostor", "Shaders/impostor.vert", "Shaders/impostor.frag");
+	mgr->create("pick", "Shaders/pick.vert", "Shaders/pick.frag");
 }
 
 static void check_cull_camera() {
@@ -227,6 +232,8 @@ static void Render(Camera *theCamera) {
 
 	// draw the background color
 	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	rs->setCamera(theCamera);
+	rs->resetStats();
 	rs->loadTrfm(RenderState::projection, theCamera->projectionTrfm());
 	rs->loadTrfm(RenderState::modelview, theCamera->viewTrfm());
 	if (check_cull) check_cull_camera();
@@ -243,15 +250,30 @@ static void Render(Camera *theCamera) {
 	Scene::instance()->draw();
 }
 
+// Draw the pending GPU pick (if any), and print the results that are ready
+
+static void Pick(Camera *theCamera) {
+	Picker *picker = Picker::instance();
+	Picker::result_t res;
+	picker->render(theCamera, Scene::instance()->rootNode());
+	while (picker->poll(res)) {
+		printf("gpu pick: node %s at (%d, %d), %zu frames, %.2f ms latency, %.3f ms CPU, %.3f ms GPU\n",
+			   res.node ? res.node->getName().c_str() : "(nothing)", res.x, res.y,
+			   res.frames, res.latency, res.cpuTime, res.gpuTime);
+	}
+	if (picker->busy()) glutPostRedisplay();
+}
+
 static void Display() {
 
 	Camera *theCamera;
 	theCamera = CameraManager::instance()->find("mainCamera");
 	if (!theCamera) return; // no main camera
 
-	Scene::instance()->rootNode()->frustumCull(theCamera); // Frustum Culling
+	Scene::instance()->frustumCull(theCamera); // Frustum Culling
 
 	Render(theCamera);
+	Pick(theCamera);
 	glutSwapBuffers();
 }
 
@@ -272,7 +294,7 @@ static void DisplaySahdow(){
 
 	if (theCamera){
 		glCullFace(GL_FRONT);//Cambiar el culling para reducir problemas al ver las sombras
-		Scene::instance()->rootNode()->frustumCull(theCamera);
+		Scene::instance()->frustumCull(theCamera);
 		RenderState *rs =  RenderState::instance();
 		TextureRT *tex = rs->getSombras();
 		if(tex == 0){
@@ -296,9 +318,10 @@ static void DisplaySahdow(){
 	theCamera = CameraManager::instance()->find("mainCamera");
 	if (!theCamera) return; // no main camera
 
-	Scene::instance()->rootNode()->frustumCull(theCamera); // Frustum Culling
+	Scene::instance()->frustumCull(theCamera); // Frustum Culling
 	
 	Render(theCamera);
+	Pick(theCamera);
 	glutSwapBuffers();
 }
 
@@ -355,6 +378,10 @@ static void Keyboard_alt(unsigned char key) {
 			printf("alt-s\n");
 			RenderState::instance()->print();
 			break;
+		case 'q':
+			gpu_pick = !gpu_pick;
+			printf("alt-q: %s picking\n", gpu_pick ? "GPU" : "ray");
+			break;
 		case 'b':
 			printf("alt-b\n");
 			drawBB = !drawBB;
@@ -364,6 +391,35 @@ static void Keyboard_alt(unsigned char key) {
 			printf("alt-f\n");
 			check_cull = 1 - check_cull;
 			break;
+		case 'd':
+			printf("alt-d\n");
+			rs = RenderState::instance();
+			rs->setLODThreshold(rs->getLODThreshold() > 0.0f ? 0.0f : 0.001f);
+			printf("LODs %s\n", rs->getLODThreshold() > 0.0f ? "on" : "off");
+			break;
+		case 'o':
+			printf("alt-o\n");
+			rs = RenderState::instance();
+			rs->setImpostorDistance(rs->getImpostorDistance() > 0.0f ? 0.0f : 200.0f);
+			printf("impostors %s\n", rs->getImpostorDistance() > 0.0f ? "on" : "off");
+			break;
+		case 'k':
+			printf("alt-k\n");
+			rs = RenderState::instance();
+			rs->setClusterCulling(!rs->getClusterCulling());
+			printf("cluster culling %s\n", rs->getClusterCulling() ? "on" : "off");
+			break;
+		case 'g':
+			printf("alt-g\n");
+			rs = RenderState::instance();
+			rs->setStaticBatching(!rs->getStaticBatching());
+			printf("static batching %s\n", rs->getStaticBatching() ? "on" : "off");
+			break;
+		case 'r':
+			printf("alt-r\n");
+			rs = RenderState::instance();
+			printf("%zu triangles, %zu draw calls\n", rs->getTriangles(), rs->getDrawCalls());
+			break;
 		case '1':
 			printf("alt-1\n");
 			displayNode = displayNode->parent();
@@ -546,8 +602,33 @@ static void SpecialKey (int key, int x, int y) {
 	glutPostRedisplay( );
 }
 
+// Pick the geometry under the mouse (left button)
+
 void mouseClick(int button, int state,
 				int x, int y) {
+	if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) return;
+	Camera *theCamera = CameraManager::instance()->find("mainCamera");
+	if (!theCamera) return;
+	float w = glutGet(GLUT_WINDOW_WIDTH);
+	float h = glutGet(GLUT_WINDOW_HEIGHT);
+	if (gpu_pick) {
+		// answered by Pick() in a later frame
+		Picker::instance()->request(x, h - 1 - y);
+		glutPostRedisplay();
+		return;
+	}
+	// window (upper left is (0,0)) to normalized device coordinates
+	Line ray = theCamera->ray(2.0f * (x + 0.5f) / w - 1.0f, 1.0f - 2.0f * (y + 0.5f) / h);
+	Node::hit_t hit;
+	const Node *node = Scene::instance()->intersectRay(ray, hit);
+	if (!node) {
+		printf("pick: nothing\n");
+		return;
+	}
+	Vector3 P = ray.at(hit.t);
+	printf("pick: node %s, triangle %d (u %.3f, v %.3f), point (%.3f, %.3f, %.3f), distance %.3f\n",
+		   node->getName().c_str(), hit.triangle, hit.u, hit.v,
+		   P[0], P[1], P[2], hit.t * ray.m_d.length());
 }
 
 void mouse(int x, int y) {
@@ -582,6 +663,8 @@ void animate(int value) {
 		t = t + inc_t;
 
 		rs->setTime(t);
+		// keyframe animations (see AnimationManager)
+		AnimationManager::instance()->update(timeSincePrevFrame / 1000.0f);
 
 		glutPostRedisplay();
 	}
@@ -624,6 +707,8 @@ int main(int argc, char** argv) {
 	}
 
 	Scene::instance()->attach(displayNode);
+	// avatar collisions only test the leaves around it
+	CollisionGrid::instance()->build(Scene::instance()->rootNode());
 	// Start the timer (uncomment if you want animations)
 	glutTimerFunc(MG_TIMERMSECS, animate, 0);
 
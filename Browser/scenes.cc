@@ -331,6 +331,10 @@ static Node *create_city (int N, vector<GObject *> & gObj_list) {
 	pair<float, float> coord_center;
 	coord_center.first = (int)(floorf((float) maxX / 2.0f));
 	coord_center.second = (int)(floorf((float) maxY / 2.0f));
+	// most houses are far away: draw them with simplified meshes (unless the
+	// LODs came from the mesh cache)
+	for(size_t i = 0; i < gObj_list.size(); ++i)
+		if (gObj_list[i]->numLODs() < 2) gObj_list[i]->buildLODs();
 	Trfm3D placement;
 	Node *root = nmgr->create("cityroot");
 	root->setTrfm(&placement);
@@ -344,6 +348,10 @@ static Node *create_city (int N, vector<GObject *> & gObj_list) {
 		auxNode->attachGobject( gObj_list[ rand() % gObj_list.size()] ); // get one gObj at random
 		root->addChild(auxNode);
 	}
+	// far away blocks of houses are drawn with one proxy each
+	root->buildHLOD(20 * bbsize);
+	// and the farthest houses with billboards
+	root->buildImpostors();
 	return root;
 }
 
@@ -378,5 +386,7 @@ static Node *create_floor_city(const string & dir, const string &fname) {
 			myNode->addChild(aux); // takes ownership
 		}
 	}
+	// the tiles don't move: draw them merged, in chunks of 3x3 tiles
+	myNode->buildStaticBatch(3.0f * floorsize);
 	return myNode;
 }
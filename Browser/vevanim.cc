@@ -0,0 +1,168 @@
+// vevanim: benchmark of the keyframe animations (see AnimationManager)
+//
+// usage: vevanim [-n nodes] [-c clips] [-k keys] [-f frames]
+//
+// The nodes are split among the clips: every clip animates one group node
+// below the root and the children of the group, with random translation,
+// rotation and scale keys. The clips are played for some frames (at 60
+// frames per second) with one thread and with the thread pool, and
+// compared with setting the TRS of every node through Node::setTRS (one
+// update of the world transformations per node). The poses of the last
+// frame are checked against sampling the clips by binary search, and the
+// world transformations against composing the TRS placements.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "nodeManager.h"
+#include "animationManager.h"
+#include "threadPool.h"
+#include "tools.h"
+
+using std::vector;
+
+typedef std::chrono::steady_clock anim_clock;
+
+static const float duration = 4.0f; // of the clips (seconds)
+static const float dt = 1.0f / 60.0f;
+
+// random key times in [0, duration], the first at 0 and the last at duration
+static vector<float> key_times(size_t keys_n, std::mt19937 & rng) {
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	vector<float> times(keys_n);
+	for(size_t k = 0; k < keys_n; ++k) times[k] = duration * unit(rng);
+	std::sort(times.begin(), times.end());
+	times.front() = 0.0f;
+	times.back() = duration;
+	return times;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-n nodes] [-c clips] [-k keys] [-f frames]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char** argv) {
+
+	size_t nodes_n = 100000;
+	size_t clips_n = 1000;
+	size_t keys_n = 16;
+	size_t frames_n = 100;
+
+	for(int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) nodes_n = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc) clips_n = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-k") && i + 1 < argc) keys_n = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc) frames_n = atol(argv[++i]);
+		else usage(argv[0]);
+	}
+	if (!clips_n || nodes_n < clips_n || keys_n < 2 || !frames_n) usage(argv[0]);
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	NodeManager *nmgr = NodeManager::instance();
+	AnimationManager *amgr = AnimationManager::instance();
+	Node *root = nmgr->create("root");
+	vector<AnimClip *> clips(clips_n);
+	vector<Node *> nodes;
+	char name[64];
+	for(size_t c = 0; c < clips_n; ++c) {
+		sprintf(name, "clip%zu", c);
+		AnimClip *clip = amgr->create(name);
+		clip->setLoop(true);
+		size_t per_clip = nodes_n / clips_n + (c < nodes_n % clips_n);
+		Node *group = 0;
+		for(size_t i = 0; i < per_clip; ++i) {
+			sprintf(name, "n%zu_%zu", c, i);
+			Node *node = nmgr->create(name);
+			if (i == 0) {
+				group = node;
+				root->addChild(group);
+			} else
+				group->addChild(node);
+			nodes.push_back(node);
+			size_t track = clip->addTrack(node);
+			vector<float> times = key_times(keys_n, rng);
+			for(size_t k = 0; k < keys_n; ++k) {
+				Vector3 P(unit(rng), unit(rng), unit(rng));
+				clip->addTransKey(track, times[k], 10.0f * P);
+			}
+			times = key_times(keys_n, rng);
+			for(size_t k = 0; k < keys_n; ++k) {
+				Vector3 axis(2.0f * unit(rng) - 1.0f, 2.0f * unit(rng) - 1.0f, 2.0f * unit(rng) - 1.0f);
+				clip->addRotKey(track, times[k], Quaternion(axis, 6.0f * unit(rng)));
+			}
+			times = key_times(keys_n, rng);
+			for(size_t k = 0; k < keys_n; ++k)
+				clip->addScaleKey(track, times[k], 0.5f + unit(rng));
+		}
+		clips[c] = clip;
+	}
+
+	// with one thread, and with the thread pool
+	double ms[2];
+	for(int parallel = 0; parallel < 2; ++parallel) {
+		for(size_t c = 0; c < clips_n; ++c) amgr->play(clips[c]);
+		anim_clock::time_point t0 = anim_clock::now();
+		for(size_t f = 0; f < frames_n; ++f)
+			amgr->update(dt, parallel != 0);
+		ms[parallel] = elapsed_ms(t0) / frames_n;
+	}
+
+	// the same poses through Node::setTRS (a few frames, it is slow)
+	size_t naive_n = std::min<size_t>(frames_n, 3);
+	vector<size_t> first(clips_n + 1, 0);
+	for(size_t c = 0; c < clips_n; ++c) first[c + 1] = first[c] + clips[c]->numTracks();
+	anim_clock::time_point t0 = anim_clock::now();
+	for(size_t f = 0; f < naive_n; ++f) {
+		float t = fmodf((f + 1) * dt, duration);
+		for(size_t c = 0; c < clips_n; ++c)
+			for(size_t i = 0; i < clips[c]->numTracks(); ++i) {
+				TRS trs(*nodes[first[c] + i]->getTRS());
+				clips[c]->sample(i, t, trs);
+				nodes[first[c] + i]->setTRS(trs);
+			}
+	}
+	double naive_ms = elapsed_ms(t0) / naive_n;
+
+	// one more frame: poses against binary search, world trfms against
+	// composing the TRS placements
+	amgr->update(dt);
+	size_t mismatches = 0;
+	float max_error = 0.0f;
+	for(size_t c = 0; c < clips_n; ++c) {
+		for(size_t i = 0; i < clips[c]->numTracks(); ++i) {
+			const Node *node = clips[c]->getNode(i);
+			TRS trs(*node->getTRS());
+			clips[c]->sample(i, clips[c]->getTime(), trs);
+			const TRS & cur = *node->getTRS();
+			if (trs.position()[0] != cur.position()[0] || trs.rotation().w() != cur.rotation().w() ||
+				trs.scale() != cur.scale()) ++mismatches;
+			TRS WC(*clips[c]->getNode(0)->getTRS()); // (the root is not moved)
+			if (i) WC.add(cur);
+			Trfm3D T;
+			WC.getTrfm(&T);
+			const float *a = T.getGLMatrix();
+			const float *b = node->getPlacementWC()->getGLMatrix();
+			for(int j = 0; j < 16; ++j)
+				max_error = std::max(max_error, fabsf(a[j] - b[j]) / (1.0f + fabsf(a[j])));
+		}
+	}
+
+	printf("%zu nodes, %zu clips, %zu keys per channel\n", nodes.size(), clips_n, keys_n);
+	printf("  update: %.3f ms/frame (1 thread), %.3f ms/frame (%zu threads); "
+		   "Node::setTRS per node: %.3f ms/frame\n",
+		   ms[0], ms[1], ThreadPool::instance()->size(), naive_ms);
+	printf("  %.1f ns per animated node; world trfms max. relative error %.2g\n",
+		   1e6 * ms[1] / nodes.size(), max_error);
+	if (mismatches) {
+		printf("  [E] %zu of %zu nodes differ from sampling by binary search\n", mismatches, nodes.size());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,94 @@
+// vevbake: bake wavefront files into the binary mesh cache
+//
+// usage: vevbake [-f] [-q] path...
+//
+// Every path is either a wavefront (.obj) file or a directory, which is
+// searched recursively for .obj files. Files are baked in parallel. Files
+// whose cache is up-to-date (same content hash) are skipped, unless -f is
+// given.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include "meshCache.h"
+#include "threadPool.h"
+#include "tools.h"
+
+using std::string;
+using std::vector;
+
+typedef std::chrono::steady_clock bake_clock;
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-f] [-q] path...\n", prog);
+	fprintf(stderr, "  path: wavefront (.obj) file or directory\n");
+	fprintf(stderr, "  -f:   bake all files, even if up-to-date\n");
+	fprintf(stderr, "  -q:   only report errors\n");
+	exit(1);
+}
+
+int main(int argc, char** argv) {
+
+	bool force = false;
+	bool quiet = false;
+	vector<std::pair<string, string> > objs;
+
+	for(int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-f")) force = true;
+		else if (!strcmp(argv[i], "-q")) quiet = true;
+		else if (argv[i][0] == '-') usage(argv[0]);
+		else if (is_dir(argv[i])) find_objs(argv[i], objs);
+		else {
+			string path(argv[i]);
+			size_t slash = path.rfind('/');
+			if (slash == string::npos)
+				objs.push_back(std::make_pair(string("./"), path));
+			else
+				objs.push_back(std::make_pair(path.substr(0, slash + 1), path.substr(slash + 1)));
+		}
+	}
+	if (objs.empty()) usage(argv[0]);
+
+	std::mutex print_mutex;
+	size_t baked = 0, skipped = 0, failed = 0;
+	bake_clock::time_point start = bake_clock::now();
+
+	ThreadPool::instance()->parallelFor(objs.size(), 1, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) {
+			const string & dir = objs[i].first;
+			const string & fname = objs[i].second;
+			string path = dir + fname;
+			if (!force && MeshCache::upToDate(dir, fname)) {
+				std::lock_guard<std::mutex> lock(print_mutex);
+				++skipped;
+				if (!quiet) printf("up-to-date %s\n", path.c_str());
+				continue;
+			}
+			MeshCache::stats_t st;
+			bake_clock::time_point t0 = bake_clock::now();
+			bool ok = MeshCache::bake(dir, fname, &st);
+			double ms = elapsed_ms(t0);
+			std::lock_guard<std::mutex> lock(print_mutex);
+			if (!ok) {
+				++failed;
+				fprintf(stderr, "[E] can't bake %s\n", path.c_str());
+				continue;
+			}
+			++baked;
+			if (!quiet)
+				printf("baked %s: %zu meshes, %zu triangles, %zu -> %zu vertices, ACMR %.2f -> %.2f, %zu LODs, %zu clusters (%.1f ms)\n",
+					   path.c_str(), st.meshes, st.triangles, st.corners, st.vertices,
+					   st.acmr_before, st.acmr_after, st.lods, st.clusters, ms);
+		}
+	});
+
+	if (!quiet)
+		printf("%zu baked, %zu up-to-date, %zu failed (%zu threads, %.1f ms)\n",
+			   baked, skipped, failed, ThreadPool::instance()->size(), elapsed_ms(start));
+	return failed ? 1 : 0;
+}
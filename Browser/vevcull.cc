@@ -0,0 +1,257 @@
+// vevcull: benchmark of the bounding volumes of the nodes (BBox, sphere and
+// OBB) for frustum culling and collisions
+//
+// usage: vevcull [-n buildings] [-v views] [-q spheres]
+//
+// A city of thin box-shaped buildings, each rotated by a random angle about
+// the vertical axis, in blocks (one group node per block). For some street
+// level views, every building is tested against the frustum by its BBox
+// alone (as before) and by its bounding volumes (sphere, BBox and OBB, see
+// Node::frustumCull), and compared with clipping its triangles against the
+// frustum. For some spheres (as the avatar) around the buildings, the
+// buildings whose BBox the sphere touches (the candidates for testing
+// their triangles, see Node::checkCollision) are compared with the ones
+// left by the OBB, and with the ones the sphere really touches.
+//
+// Reports the false positives (buildings passing the test but not really
+// visible or touched) of both tests, and the time of the tests and of the
+// triangle tests they lead to. Buildings passing the reference but rejected
+// by the bounding volumes are errors.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "nodeManager.h"
+#include "gObjectManager.h"
+#include "cameraManager.h"
+#include "intersect.h"
+#include "constants.h"
+#include "tools.h"
+
+using std::vector;
+
+typedef std::chrono::steady_clock cull_clock;
+
+static const float block = 100.0f; // size of the blocks
+static const int per_block = 64;   // buildings per block
+static const float radius = 1.0f;  // of the spheres
+
+// a box from (-4, 0, -1) to (4, 30, 1)
+static GObject *building() {
+	TriangleMesh *mesh = new TriangleMesh;
+	for(int i = 0; i < 8; ++i)
+		mesh->addPoint(Vector3(i & 1 ? 4.0f : -4.0f, i & 2 ? 30.0f : 0.0f, i & 4 ? 1.0f : -1.0f));
+	static const int faces[6][4] = {
+		{ 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 }
+	};
+	for(int f = 0; f < 6; ++f) {
+		mesh->addTriangle(faces[f][0], faces[f][1], faces[f][2]);
+		mesh->addTriangle(faces[f][0], faces[f][2], faces[f][3]);
+	}
+	GObject *gobj = GObjectManager::instance()->create("building");
+	gobj->add(mesh);
+	return gobj;
+}
+
+// whether some triangle of the geometry of leaf, clipped against the
+// frustum of cam (in clip coordinates, -w <= x, y, z <= w), is left
+
+static bool visible(Node *leaf, Camera *cam) {
+	Trfm3D T(*cam->projectionTrfm());
+	T.add(cam->viewTrfm());
+	T.add(leaf->getPlacementWC());
+	const float *M = T.getGLMatrix();
+	const GObject *gobj = leaf->getGobject();
+	for(size_t m = 0; m < gobj->size(); ++m) {
+		const TriangleMesh *mesh = gobj->at(m);
+		for(size_t t = 0; t < mesh->numTriangles(); ++t) {
+			vector<double> poly, clipped; // x y z w
+			for(int v = 0; v < 3; ++v) {
+				const float *P = mesh->vCoords(mesh->vIdx(t)[v]);
+				for(int i = 0; i < 4; ++i)
+					poly.push_back(M[i] * P[0] + M[4 + i] * P[1] + M[8 + i] * P[2] + M[12 + i]);
+			}
+			for(int plane = 0; plane < 6 && !poly.empty(); ++plane) {
+				int axis = plane / 2;
+				double sign = plane % 2 ? -1.0 : 1.0;
+				size_t n = poly.size() / 4;
+				clipped.clear();
+				for(size_t i = 0; i < n; ++i) {
+					const double *a = &poly[4 * i];
+					const double *b = &poly[4 * ((i + 1) % n)];
+					double da = a[3] + sign * a[axis];
+					double db = b[3] + sign * b[axis];
+					if (da >= 0.0) clipped.insert(clipped.end(), a, a + 4);
+					if ((da >= 0.0) != (db >= 0.0)) {
+						double u = da / (da - db);
+						for(int k = 0; k < 4; ++k) clipped.push_back(a[k] + u * (b[k] - a[k]));
+					}
+				}
+				poly.swap(clipped);
+			}
+			if (!poly.empty()) return true;
+		}
+	}
+	return false;
+}
+
+// the bounding volumes of a leaf, as Node::frustumCull
+static int cull_hybrid(const Node *leaf, Camera *cam) {
+	int res = cam->checkFrustum(leaf->getSphereWC());
+	if (res) return res;
+	res = cam->checkFrustum(leaf->getContainerWC(), 0);
+	if (res) return res;
+	return cam->checkFrustum(leaf->getOBBWC());
+}
+
+// whether the sphere touches the triangles of leaf (as Node::checkCollision)
+static bool touches(Node *leaf, const BSphere & sphere) {
+	Trfm3D inv(*leaf->getPlacementWC());
+	float scale = inv.getScale();
+	inv.setInverse();
+	return leaf->getGobject()->intersectSphere(inv.transformPoint(sphere.m_centre), sphere.m_radius / scale);
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-n buildings] [-v views] [-q spheres]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char** argv) {
+
+	size_t buildings_n = 10000;
+	size_t views_n = 32;
+	size_t spheres_n = 1000;
+
+	for(int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) buildings_n = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-v") && i + 1 < argc) views_n = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-q") && i + 1 < argc) spheres_n = atol(argv[++i]);
+		else usage(argv[0]);
+	}
+	if (!buildings_n || !views_n || !spheres_n) usage(argv[0]);
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	NodeManager *nmgr = NodeManager::instance();
+	GObject *gobj = building();
+	Node *root = nmgr->create("root");
+	size_t blocks_n = (buildings_n + per_block - 1) / per_block;
+	int side = (int) ceilf(sqrtf((float) blocks_n)); // blocks per side of the city
+	vector<Node *> leaves;
+	char name[64];
+	for(size_t b = 0; b < blocks_n; ++b) {
+		sprintf(name, "block%zu", b);
+		Node *group = nmgr->create(name);
+		Trfm3D T;
+		T.setTrans(Vector3((b % side) * block, 0.0f, (b / side) * block));
+		group->setTrfm(&T);
+		root->addChild(group);
+		for(int i = 0; i < per_block && leaves.size() < buildings_n; ++i) {
+			sprintf(name, "b%zu_%d", b, i);
+			Node *leaf = nmgr->create(name);
+			T.setTrans(Vector3(block * unit(rng), 0.0f, block * unit(rng)));
+			T.addRotY(2.0f * Constants::pi * unit(rng));
+			T.addScale(0.5f + unit(rng));
+			leaf->setTrfm(&T);
+			leaf->attachGobject(gobj);
+			group->addChild(leaf);
+			leaves.push_back(leaf);
+		}
+	}
+	size_t n = leaves.size();
+	float extent = side * block;
+
+	// frustum culling
+	PerspectiveCamera *cam = CameraManager::instance()->createPerspective("cull");
+	cam->init(60.0f * Constants::degree_to_rad, 16.0f / 9.0f, 0.5f, 400.0f);
+	size_t box_visible = 0, hybrid_visible = 0, ref_visible = 0, cull_errors = 0;
+	double box_ms = 0.0, hybrid_ms = 0.0, tree_ms = 0.0;
+	vector<int> box_res(n), hybrid_res(n);
+	for(size_t v = 0; v < views_n; ++v) {
+		Vector3 E(extent * unit(rng), 2.0f, extent * unit(rng));
+		float angle = 2.0f * Constants::pi * unit(rng);
+		cam->lookAt(E, E + Vector3(cosf(angle), 0.0f, sinf(angle)), Vector3::UNIT_Y);
+		cull_clock::time_point t0 = cull_clock::now();
+		for(size_t i = 0; i < n; ++i) box_res[i] = cam->checkFrustum(leaves[i]->getContainerWC(), 0);
+		box_ms += elapsed_ms(t0);
+		t0 = cull_clock::now();
+		for(size_t i = 0; i < n; ++i) hybrid_res[i] = cull_hybrid(leaves[i], cam);
+		hybrid_ms += elapsed_ms(t0);
+		t0 = cull_clock::now();
+		root->frustumCull(cam);
+		tree_ms += elapsed_ms(t0);
+		for(size_t i = 0; i < n; ++i) {
+			bool ref = visible(leaves[i], cam);
+			box_visible += box_res[i] <= 0;
+			hybrid_visible += hybrid_res[i] <= 0;
+			ref_visible += ref;
+			if (ref && (box_res[i] > 0 || hybrid_res[i] > 0)) ++cull_errors;
+		}
+	}
+
+	// collisions: the candidates of every sphere by BBox, and the ones left
+	// by the sphere and OBB of the leaves
+	vector<BSphere> spheres(spheres_n);
+	vector<vector<Node *> > box_cand(spheres_n), hybrid_cand(spheres_n);
+	size_t box_n = 0, hybrid_n = 0, ref_n = 0, coll_errors = 0;
+	for(size_t q = 0; q < spheres_n; ++q) {
+		const Node *near = leaves[rng() % n];
+		Vector3 C = near->getOBBWC()->m_centre + Vector3(12.0f * unit(rng) - 6.0f, 0.0f, 12.0f * unit(rng) - 6.0f);
+		spheres[q] = BSphere(C, radius);
+		for(size_t i = 0; i < n; ++i)
+			if (BSphereBBoxIntersect(&spheres[q], leaves[i]->getContainerWC()) == IINTERSECT)
+				box_cand[q].push_back(leaves[i]);
+		box_n += box_cand[q].size();
+	}
+	cull_clock::time_point t0 = cull_clock::now();
+	size_t box_hits = 0;
+	for(size_t q = 0; q < spheres_n; ++q)
+		for(size_t k = 0; k < box_cand[q].size(); ++k)
+			box_hits += touches(box_cand[q][k], spheres[q]);
+	double box_coll_ms = elapsed_ms(t0);
+	t0 = cull_clock::now();
+	size_t hybrid_hits = 0;
+	for(size_t q = 0; q < spheres_n; ++q)
+		for(size_t k = 0; k < box_cand[q].size(); ++k) {
+			Node *leaf = box_cand[q][k];
+			if (BSphereOBBIntersect(&spheres[q], leaf->getOBBWC()) == IREJECT) continue;
+			hybrid_cand[q].push_back(leaf);
+			hybrid_hits += touches(leaf, spheres[q]);
+		}
+	double hybrid_coll_ms = elapsed_ms(t0);
+	t0 = cull_clock::now();
+	for(size_t q = 0; q < spheres_n; ++q) {
+		hybrid_n += hybrid_cand[q].size();
+		bool hit = false;
+		for(size_t k = 0; k < box_cand[q].size(); ++k)
+			if (touches(box_cand[q][k], spheres[q])) {
+				++ref_n;
+				hit = true;
+			}
+		if (hit != (root->checkCollision(&spheres[q]) != 0)) ++coll_errors;
+	}
+	if (box_hits != ref_n || hybrid_hits != ref_n) ++coll_errors;
+
+	printf("%zu buildings in %zu blocks, %zu views, %zu spheres\n", n, blocks_n, views_n, spheres_n);
+	printf("  frustum: %zu visible per view; BBox: %.1f false positives per view, %.1f ns per building; "
+		   "bounding volumes: %.1f false positives per view, %.1f ns per building\n",
+		   ref_visible / views_n, (double) (box_visible - ref_visible) / views_n, 1e6 * box_ms / (views_n * n),
+		   (double) (hybrid_visible - ref_visible) / views_n, 1e6 * hybrid_ms / (views_n * n));
+	printf("  Node::frustumCull: %.3f ms per view\n", tree_ms / views_n);
+	printf("  collisions: %.2f buildings touched per sphere; BBox: %.2f false candidates per sphere, "
+		   "%.2f us per sphere with the triangle tests; OBB: %.2f false candidates per sphere, "
+		   "%.2f us per sphere\n",
+		   (double) ref_n / spheres_n, (double) (box_n - ref_n) / spheres_n, 1e3 * box_coll_ms / spheres_n,
+		   (double) (hybrid_n - ref_n) / spheres_n, 1e3 * hybrid_coll_ms / spheres_n);
+	if (cull_errors || coll_errors) {
+		printf("  [E] %zu buildings culled but visible, %zu collisions missed\n", cull_errors, coll_errors);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,237 @@
+// vevdyn: benchmark of the dynamic AABB tree (see aabbtree.h) with objects
+// moving every frame
+//
+// usage: vevdyn [-n objects] [-f frames]
+//
+// Boxes of random size move with constant speed inside a cube (bouncing on
+// its sides). Every frame all of them move, their proxies are updated, and
+// box queries (as collisions) and ray queries (as picking) are run. Reports
+// the time of the updates, compared with building the tree again every
+// frame, the time of the queries, and the quality of the tree. The queries
+// of the last frame are checked against testing all the boxes.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "aabbtree.h"
+#include "tools.h"
+
+using std::vector;
+
+typedef std::chrono::steady_clock dyn_clock;
+
+struct object_t {
+	float pos[3];    // center
+	float half[3];   // half size
+	float vel[3];    // motion per frame
+	int proxy;
+};
+
+static void bounds(const object_t & o, float *bmin, float *bmax) {
+	for(int i = 0; i < 3; ++i) {
+		bmin[i] = o.pos[i] - o.half[i];
+		bmax[i] = o.pos[i] + o.half[i];
+	}
+}
+
+static const float margin = 0.1f;
+
+struct box_query_t {
+	float bmin[3], bmax[3];
+	const vector<object_t> *objects;
+	size_t found; // objects whose box (not only the fat box) overlaps
+};
+
+static int visit_box(void *ctx, int proxy, void *data, int inside) {
+	box_query_t *q = (box_query_t *) ctx;
+	float bmin[3], bmax[3];
+	bounds(*(const object_t *) data, bmin, bmax);
+	for(int i = 0; i < 3; ++i)
+		if (bmin[i] > q->bmax[i] || bmax[i] < q->bmin[i]) return 1;
+	++q->found;
+	return 1;
+}
+
+// closest intersection of a ray with the boxes of the objects
+struct ray_query_t {
+	float origin[3], dir[3];
+	const object_t *hit;
+	float t;
+};
+
+static float ray_box(const object_t & o, const float *origin, const float *dir, float tmax) {
+	float bmin[3], bmax[3];
+	bounds(o, bmin, bmax);
+	float tnear = 0.0f, tfar = tmax;
+	for(int i = 0; i < 3; ++i) {
+		if (dir[i] == 0.0f) {
+			if (origin[i] < bmin[i] || origin[i] > bmax[i]) return tmax;
+			continue;
+		}
+		float t0 = (bmin[i] - origin[i]) / dir[i];
+		float t1 = (bmax[i] - origin[i]) / dir[i];
+		if (t0 > t1) std::swap(t0, t1);
+		tnear = std::max(tnear, t0);
+		tfar = std::min(tfar, t1);
+		if (tnear > tfar) return tmax;
+	}
+	return tnear;
+}
+
+static float visit_ray(void *ctx, int proxy, void *data, float tmax) {
+	ray_query_t *q = (ray_query_t *) ctx;
+	const object_t *o = (const object_t *) data;
+	float t = ray_box(*o, q->origin, q->dir, tmax);
+	if (t < tmax) {
+		q->hit = o;
+		q->t = t;
+		return t;
+	}
+	return tmax;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-n objects] [-f frames]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char** argv) {
+
+	size_t objects_n = 10000;
+	size_t frames_n = 100;
+	const size_t queries_n = 1000;
+
+	for(int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) objects_n = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc) frames_n = atol(argv[++i]);
+		else usage(argv[0]);
+	}
+	if (!objects_n || !frames_n) usage(argv[0]);
+
+	// the same density of objects whatever their number
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	float side = 4.0f * cbrtf((float) objects_n);
+	vector<object_t> objects(objects_n);
+	for(size_t i = 0; i < objects_n; ++i) {
+		object_t & o = objects[i];
+		for(int j = 0; j < 3; ++j) {
+			o.half[j] = 0.25f + 0.75f * unit(rng);
+			o.pos[j] = o.half[j] + unit(rng) * (side - 2.0f * o.half[j]);
+			o.vel[j] = 0.1f * (2.0f * unit(rng) - 1.0f);
+		}
+	}
+
+	AABBTree tree;
+	aabbTreeInit(&tree);
+	float bmin[3], bmax[3];
+	dyn_clock::time_point t0 = dyn_clock::now();
+	for(size_t i = 0; i < objects_n; ++i) {
+		bounds(objects[i], bmin, bmax);
+		objects[i].proxy = aabbTreeInsert(&tree, bmin, bmax, margin, &objects[i]);
+	}
+	double insert_ms = elapsed_ms(t0);
+
+	double move_ms = 0.0, rebuild_ms = 0.0, box_ms = 0.0, ray_ms = 0.0;
+	size_t reinserted = 0, found = 0, hits = 0;
+	vector<box_query_t> boxes(queries_n);
+	vector<ray_query_t> rays(queries_n);
+	for(size_t f = 0; f < frames_n; ++f) {
+		for(size_t i = 0; i < objects_n; ++i) {
+			object_t & o = objects[i];
+			for(int j = 0; j < 3; ++j) {
+				o.pos[j] += o.vel[j];
+				if (o.pos[j] - o.half[j] < 0.0f || o.pos[j] + o.half[j] > side) {
+					o.vel[j] = -o.vel[j];
+					o.pos[j] += 2.0f * o.vel[j];
+				}
+			}
+		}
+
+		t0 = dyn_clock::now();
+		for(size_t i = 0; i < objects_n; ++i) {
+			bounds(objects[i], bmin, bmax);
+			reinserted += aabbTreeMove(&tree, objects[i].proxy, bmin, bmax, margin, objects[i].vel);
+		}
+		move_ms += elapsed_ms(t0);
+
+		// a tree built from scratch, as a static structure must be
+		AABBTree fresh;
+		aabbTreeInit(&fresh);
+		t0 = dyn_clock::now();
+		for(size_t i = 0; i < objects_n; ++i) {
+			bounds(objects[i], bmin, bmax);
+			aabbTreeInsert(&fresh, bmin, bmax, margin, &objects[i]);
+		}
+		rebuild_ms += elapsed_ms(t0);
+		aabbTreeFree(&fresh);
+
+		// spheres the size of an avatar, and rays across the cube
+		for(size_t q = 0; q < queries_n; ++q) {
+			box_query_t & b = boxes[q];
+			ray_query_t & r = rays[q];
+			for(int j = 0; j < 3; ++j) {
+				float c = unit(rng) * side;
+				b.bmin[j] = c - 1.0f;
+				b.bmax[j] = c + 1.0f;
+				r.origin[j] = unit(rng) * side;
+				r.dir[j] = 2.0f * unit(rng) - 1.0f;
+			}
+			b.objects = &objects;
+			b.found = 0;
+			r.hit = 0;
+		}
+		t0 = dyn_clock::now();
+		for(size_t q = 0; q < queries_n; ++q) {
+			aabbTreeQueryBox(&tree, boxes[q].bmin, boxes[q].bmax, visit_box, &boxes[q]);
+			found += boxes[q].found;
+		}
+		box_ms += elapsed_ms(t0);
+		t0 = dyn_clock::now();
+		for(size_t q = 0; q < queries_n; ++q) {
+			aabbTreeQueryRay(&tree, rays[q].origin, rays[q].dir, 2.0f * side, visit_ray, &rays[q]);
+			if (rays[q].hit) ++hits;
+		}
+		ray_ms += elapsed_ms(t0);
+	}
+
+	// queries of the last frame, testing all the boxes
+	size_t mismatches = 0;
+	t0 = dyn_clock::now();
+	for(size_t q = 0; q < queries_n; ++q) {
+		box_query_t b = boxes[q];
+		b.found = 0;
+		for(size_t i = 0; i < objects_n; ++i)
+			visit_box(&b, objects[i].proxy, &objects[i], 0);
+		if (b.found != boxes[q].found) ++mismatches;
+		ray_query_t r = rays[q];
+		r.hit = 0;
+		float tmax = 2.0f * side;
+		for(size_t i = 0; i < objects_n; ++i)
+			tmax = visit_ray(&r, objects[i].proxy, &objects[i], tmax);
+		if (r.hit != rays[q].hit && r.t != rays[q].t) ++mismatches; // (ties at t = 0)
+	}
+	double brute_ms = elapsed_ms(t0);
+
+	size_t queries = frames_n * queries_n;
+	printf("%zu objects, %zu frames: tree built in %.2f ms, height %d, area ratio %.1f\n",
+		   objects_n, frames_n, insert_ms, aabbTreeHeight(&tree), aabbTreeAreaRatio(&tree));
+	printf("  update: %.3f ms/frame (%.1f%% of the objects inserted again), "
+		   "building the tree again: %.3f ms/frame\n",
+		   move_ms / frames_n, 100.0 * reinserted / (frames_n * objects_n), rebuild_ms / frames_n);
+	printf("  %.2f us/box query (%.1f objects), %.2f us/ray (%.1f%% hit), "
+		   "%.2f us/query testing all the boxes\n",
+		   1000.0 * box_ms / queries, (double) found / queries, 1000.0 * ray_ms / queries,
+		   100.0 * hits / queries, 1000.0 * brute_ms / (2 * queries_n));
+	aabbTreeFree(&tree);
+	if (mismatches) {
+		printf("  [E] %zu of %zu queries differ from testing all the boxes\n", mismatches, 2 * queries_n);
+		return 1;
+	}
+	return 0;
+}
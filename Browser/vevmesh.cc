@@ -0,0 +1,312 @@
+// vevmesh: benchmark of the mesh processing of TriangleMesh over wavefront files
+//
+// usage: vevmesh [-r runs] [-g corners]... [path...]
+//
+// Every path is either a wavefront (.obj) file or a directory, which is
+// searched recursively for .obj files (obj/ if neither a path nor -g is
+// given). -g adds a synthetic mesh of about that many triangle corners (see
+// jittered_grid), for meshes larger than the ones in obj/. For every
+// mesh, the positions of the corners of its triangles (one per corner, as
+// a triangle soup) are welded with weldVectors (see weld.h) and with the
+// former epsilon sort, and both are timed (best of some runs, one thread).
+// The sort compares with an epsilon, which is not a strict weak ordering,
+// so it may leave some duplicates: both vertex counts are reported.
+//
+// Then the normals of the (welded) mesh are recomputed with
+// TriangleMesh::setFaceted, setSmooth and renormalize, and with the former
+// serial loops (a Vector3 at a time, normals scattered into the vertices),
+// which are timed alike. The normals are checked against the former loops.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "glm.h"
+#include "triangleMesh.h"
+#include "threadPool.h"
+#include "weld.h"
+#include "tools.h"
+#include "constants.h"
+
+using std::string;
+using std::vector;
+
+typedef std::chrono::steady_clock mesh_clock;
+
+// The former welding of TriangleMesh: sort with an epsilon comparison, and
+// merge consecutive coordinates which compare equal. Returns the number of
+// unique coordinates.
+
+static int cmp_3f(const float *V1, const float *V2) {
+	for(int i = 0; i < 3; ++i) {
+		float aux = V1[i] - V2[i];
+		if (!distance_is_zero(aux)) return aux > 0 ? 1 : -1;
+	}
+	return 0;
+}
+
+struct sort_3f_t {
+	sort_3f_t(const float *vertices) : V(vertices) {}
+	bool operator() (int i, int j) { return cmp_3f(&V[3 * i], &V[3 * j]) < 0; }
+	const float *V;
+};
+
+static int weld_sort(const vector<float> & vertices, vector<int> & idxmap) {
+	int n = vertices.size() / 3;
+	vector<int> order(n);
+	for(int i = 0; i < n; ++i) order[i] = i;
+	std::sort(order.begin(), order.end(), sort_3f_t(&vertices[0]));
+	idxmap.resize(n);
+	int last = 0;
+	idxmap[order[0]] = 0;
+	for(int i = 1; i < n; ++i) {
+		if (cmp_3f(&vertices[3 * order[i]], &vertices[3 * order[i - 1]])) ++last;
+		idxmap[order[i]] = last;
+	}
+	return last + 1;
+}
+
+// The former normal loops of TriangleMesh, over copies of its arrays (the
+// x, y, z of renormalize fixed). As TriangleMesh, they allocate new normal
+// arrays every time.
+
+struct normals_t {
+	vector<float> V;  // positions
+	vector<int> I;    // position indices
+	vector<float> N;  // normals
+	vector<int> NI;   // normal indices
+};
+
+static void faceted_loop(normals_t & m) {
+	size_t tris_n = m.I.size() / 3;
+	vector<float>(3 * tris_n).swap(m.N);
+	vector<int>(3 * tris_n).swap(m.NI);
+	for(size_t t = 0; t < tris_n; ++t) {
+		m.NI[3 * t] = m.NI[3 * t + 1] = m.NI[3 * t + 2] = t;
+		Vector3 P0(&m.V[3 * m.I[3 * t]]), P1(&m.V[3 * m.I[3 * t + 1]]), P2(&m.V[3 * m.I[3 * t + 2]]);
+		Vector3 N = crossVectors(P1 - P0, P2 - P0);
+		N.normalize();
+		m.N[3 * t] = N[0];
+		m.N[3 * t + 1] = N[1];
+		m.N[3 * t + 2] = N[2];
+	}
+}
+
+static void renormalize_loop(normals_t & m) {
+	for(size_t i = 0, n = m.N.size() / 3; i < n; ++i) {
+		float *N = &m.N[3 * i];
+		Vector3 aux(N);
+		aux.normalize();
+		N[0] = aux[0];
+		N[1] = aux[1];
+		N[2] = aux[2];
+	}
+}
+
+static void smooth_loop(normals_t & m) {
+	vector<int>(m.I).swap(m.NI);
+	vector<float>(m.V.size(), 0.0f).swap(m.N);
+	for(size_t t = 0, tris_n = m.I.size() / 3; t < tris_n; ++t) {
+		const int *idx = &m.I[3 * t];
+		Vector3 P0(&m.V[3 * idx[0]]), P1(&m.V[3 * idx[1]]), P2(&m.V[3 * idx[2]]);
+		Vector3 N = crossVectors(P1 - P0, P2 - P0);
+		for(int j = 0; j < 3; ++j)
+			for(int k = 0; k < 3; ++k) m.N[3 * idx[j] + k] += N[k];
+	}
+	renormalize_loop(m);
+}
+
+// Read a wavefront file. Leaves the corners of its triangles in soup, and
+// returns its positions as one indexed mesh (0 if it has no triangles).
+
+static TriangleMesh *read_obj(const string & fname, vector<float> & soup) {
+	GLMmodel *m = glmReadOBJ(fname.c_str());
+	TriangleMesh *mesh = 0;
+	soup.clear();
+	for(GLuint i = 0; i < m->numtriangles; ++i)
+		for(int j = 0; j < 3; ++j) {
+			const GLfloat *P = &m->vertices[3 * m->triangles[i].vindices[j]];
+			soup.insert(soup.end(), P, P + 3);
+		}
+	if (m->numtriangles) {
+		// positions of the model, all groups in one mesh
+		mesh = new TriangleMesh();
+		for(GLuint v = 1; v <= m->numvertices; ++v)
+			mesh->addPoint(Vector3(&m->vertices[3 * v]));
+		for(GLuint i = 0; i < m->numtriangles; ++i) {
+			const GLuint *idx = m->triangles[i].vindices;
+			mesh->addTriangle(idx[0] - 1, idx[1] - 1, idx[2] - 1);
+		}
+	}
+	glmDelete(m);
+	return mesh;
+}
+
+// A jittered grid of about n triangle corners: k x k squares of two
+// triangles (6 k^2 corners), on (k + 1)^2 grid points moved by a random
+// offset of up to a quarter of the spacing and given a random height. The
+// grid is the same for the same n. Leaves the corners of the triangles in
+// soup (a grid point repeats exactly in every triangle around it), and
+// returns the grid as an indexed mesh.
+
+static TriangleMesh *jittered_grid(size_t n, vector<float> & soup) {
+	size_t k = std::max<size_t>(1, (size_t) (sqrt(n / 6.0) + 0.5));
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> jitter(-0.25f, 0.25f), height(0.0f, 1.0f);
+	TriangleMesh *mesh = new TriangleMesh();
+	for(size_t y = 0; y <= k; ++y)
+		for(size_t x = 0; x <= k; ++x)
+			mesh->addPoint(Vector3(x + jitter(rng), y + jitter(rng), height(rng)));
+	soup.clear();
+	soup.reserve(18 * k * k);
+	for(size_t y = 0; y < k; ++y)
+		for(size_t x = 0; x < k; ++x) {
+			int p = y * (k + 1) + x;
+			int q[6] = { p, p + 1, p + (int) k + 2, p, p + (int) k + 2, p + (int) k + 1 };
+			mesh->addTriangle(q[0], q[1], q[2]);
+			mesh->addTriangle(q[3], q[4], q[5]);
+			for(int j = 0; j < 6; ++j)
+				soup.insert(soup.end(), mesh->vCoords(q[j]), mesh->vCoords(q[j]) + 3);
+		}
+	return mesh;
+}
+
+// largest difference between the normals of mesh and N
+static float normals_error(const TriangleMesh *mesh, const vector<float> & N) {
+	float err = 0.0f;
+	if (mesh->numNormals() * 3 != N.size()) return HUGE_VALF;
+	for(size_t i = 0, n = mesh->numNormals(); i < n; ++i)
+		for(int k = 0; k < 3; ++k)
+			err = std::max(err, fabsf(mesh->nCoords(i)[k] - N[3 * i + k]));
+	return err;
+}
+
+// best time of some runs of f
+template<class F> static double best_ms(int runs, F f) {
+	double best = 1e30;
+	for(int r = 0; r < runs; ++r) {
+		mesh_clock::time_point t0 = mesh_clock::now();
+		f();
+		best = std::min(best, elapsed_ms(t0));
+	}
+	return best;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-r runs] [-g corners]... [path...]\n", prog);
+	fprintf(stderr, "  path: wavefront (.obj) file or directory (default obj/)\n");
+	fprintf(stderr, "  -g:   add a jittered grid of about that many triangle corners\n");
+	exit(1);
+}
+
+int main(int argc, char** argv) {
+
+	int runs = 5;
+	bool paths = false;
+	vector<std::pair<string, string> > objs; // (directory, file name)
+	vector<size_t> grids; // corners of the jittered grids
+
+	for(int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-r") && i + 1 < argc) runs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-g") && i + 1 < argc) {
+			paths = true;
+			grids.push_back(atol(argv[++i]));
+		}
+		else if (argv[i][0] == '-') usage(argv[0]);
+		else {
+			paths = true;
+			if (is_dir(argv[i])) find_objs(argv[i], objs);
+			else objs.push_back(std::make_pair(string(), string(argv[i])));
+		}
+	}
+	if (!paths) find_objs("obj", objs);
+	if ((objs.empty() && grids.empty()) || runs < 1) usage(argv[0]);
+
+	// the files, then the grids
+	vector<string> names(objs.size());
+	for(size_t f = 0; f < objs.size(); ++f) names[f] = objs[f].first + objs[f].second;
+	for(size_t g = 0; g < grids.size(); ++g) {
+		char name[64];
+		sprintf(name, "jittered grid (-g %zu)", grids[g]);
+		names.push_back(name);
+	}
+	vector<TriangleMesh *> meshes(names.size(), (TriangleMesh *) 0);
+	printf("%-36s %9s %12s %12s %9s %9s\n", "file", "corners", "sort ms", "hash ms",
+		   "sort", "hash");
+	double sort_total = 0.0, hash_total = 0.0;
+	for(size_t f = 0; f < names.size(); ++f) {
+		vector<float> soup;
+		if (f < objs.size())
+			meshes[f] = read_obj(names[f], soup);
+		else
+			meshes[f] = jittered_grid(grids[f - objs.size()], soup);
+		int corners_n = soup.size() / 3;
+		if (!corners_n) continue;
+
+		vector<int> idxmap(corners_n);
+		vector<float> unique(soup.size());
+		double sort_ms = 1e30, hash_ms = 1e30;
+		int sort_n = 0, hash_n = 0;
+		for(int r = 0; r < runs; ++r) {
+			mesh_clock::time_point t0 = mesh_clock::now();
+			sort_n = weld_sort(soup, idxmap);
+			sort_ms = std::min(sort_ms, elapsed_ms(t0));
+			t0 = mesh_clock::now();
+			hash_n = weldVectors(&soup[0], corners_n, 3, Constants::distance_epsilon,
+								 &unique[0], &idxmap[0]);
+			hash_ms = std::min(hash_ms, elapsed_ms(t0));
+		}
+		sort_total += sort_ms;
+		hash_total += hash_ms;
+		printf("%-36s %9d %12.3f %12.3f %9d %9d\n", names[f].c_str(), corners_n, sort_ms, hash_ms,
+			   sort_n, hash_n);
+	}
+	printf("weld total: sort %.2f ms, hash %.2f ms (%.1fx)\n", sort_total, hash_total,
+		   hash_total > 0.0 ? sort_total / hash_total : 0.0);
+
+	// normals: former loops -> TriangleMesh
+	printf("\n%-36s %9s %18s %18s %18s %10s\n", "file", "triangles", "faceted ms",
+		   "smooth ms", "renormalize ms", "max error");
+	double total[3][2] = { { 0.0, 0.0 }, { 0.0, 0.0 }, { 0.0, 0.0 } };
+	size_t mismatches = 0;
+	for(size_t f = 0; f < names.size(); ++f) {
+		TriangleMesh *mesh = meshes[f];
+		if (!mesh) continue;
+		normals_t ref;
+		for(size_t i = 0, n = mesh->numVertices(); i < n; ++i)
+			ref.V.insert(ref.V.end(), mesh->vCoords(i), mesh->vCoords(i) + 3);
+		for(size_t t = 0, n = mesh->numTriangles(); t < n; ++t)
+			ref.I.insert(ref.I.end(), mesh->vIdx(t), mesh->vIdx(t) + 3);
+		double ms[3][2];
+		float err = 0.0f;
+		ms[0][0] = best_ms(runs, [&]() { faceted_loop(ref); });
+		ms[0][1] = best_ms(runs, [&]() { mesh->setFaceted(); });
+		err = std::max(err, normals_error(mesh, ref.N));
+		ms[1][0] = best_ms(runs, [&]() { smooth_loop(ref); });
+		ms[1][1] = best_ms(runs, [&]() { mesh->setSmooth(); });
+		err = std::max(err, normals_error(mesh, ref.N));
+		ms[2][0] = best_ms(runs, [&]() { renormalize_loop(ref); });
+		ms[2][1] = best_ms(runs, [&]() { mesh->renormalize(); });
+		err = std::max(err, normals_error(mesh, ref.N));
+		if (err > 1e-5f) ++mismatches;
+		for(int k = 0; k < 3; ++k)
+			for(int j = 0; j < 2; ++j) total[k][j] += ms[k][j];
+		printf("%-36s %9zu %8.3f -> %6.3f %8.3f -> %6.3f %8.3f -> %6.3f %10.2g\n",
+			   names[f].c_str(), mesh->numTriangles(), ms[0][0], ms[0][1], ms[1][0], ms[1][1],
+			   ms[2][0], ms[2][1], err);
+		delete mesh;
+	}
+	printf("normals total: faceted %.2f -> %.2f ms, smooth %.2f -> %.2f ms, "
+		   "renormalize %.2f -> %.2f ms (%zu threads)\n", total[0][0], total[0][1],
+		   total[1][0], total[1][1], total[2][0], total[2][1], ThreadPool::instance()->size());
+	if (mismatches) {
+		printf("[E] the normals of %zu files differ from the former loops\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
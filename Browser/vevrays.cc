@@ -0,0 +1,235 @@
+// vevrays: ray query benchmark of the triangle BVH (see TriangleMesh::buildBVH)
+//
+// usage: vevrays [-n rays] file.obj...
+//
+// Every file is loaded (positions only), its meshes get a BVH, and random
+// rays are cast against them, from outside the bounding box towards points
+// inside of it. Reports the throughput in millions of rays per second, with
+// one thread and with the thread pool, and checks a subset of the rays
+// against testing all the triangles.
+//
+// The same rays, and the (coherent) rays of a camera looking at the model,
+// are then cast in packets of 4 (see TriangleMesh::intersectRays), and
+// checked against casting them one by one.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "glm.h"
+#include "triangleMesh.h"
+#include "threadPool.h"
+#include "tools.h"
+
+using std::string;
+using std::vector;
+
+typedef std::chrono::steady_clock ray_clock;
+
+// closest intersection with all meshes
+struct ray_hit_t {
+	int mesh;
+	int triangle;
+	float t;
+};
+
+static ray_hit_t cast(const vector<TriangleMesh *> & meshes, const Line & ray) {
+	ray_hit_t hit = { -1, -1, FLT_MAX };
+	Vector3 uvw;
+	for(size_t i = 0; i < meshes.size(); ++i) {
+		int tri = meshes[i]->intersectRay(ray, hit.t, uvw);
+		if (tri == -1) continue;
+		hit.mesh = i;
+		hit.triangle = tri;
+		hit.t = uvw[2];
+	}
+	return hit;
+}
+
+// as cast, for the n <= 4 rays of a packet
+static void cast4(const vector<TriangleMesh *> & meshes, const Line *rays, int n, ray_hit_t *hits) {
+	float tmax[4];
+	int tris[4];
+	Vector3 uvw[4];
+	for(int j = 0; j < n; ++j) {
+		hits[j].mesh = hits[j].triangle = -1;
+		hits[j].t = tmax[j] = FLT_MAX;
+	}
+	for(size_t i = 0; i < meshes.size(); ++i) {
+		meshes[i]->intersectRays(rays, n, tmax, tris, uvw);
+		for(int j = 0; j < n; ++j) {
+			if (tris[j] == -1) continue;
+			hits[j].mesh = i;
+			hits[j].triangle = tris[j];
+			hits[j].t = tmax[j] = uvw[j][2];
+		}
+	}
+}
+
+static double cast_packets(const vector<TriangleMesh *> & meshes, const vector<Line> & rays,
+						   vector<ray_hit_t> & hits) {
+	ray_clock::time_point t0 = ray_clock::now();
+	for(size_t i = 0; i < rays.size(); i += 4)
+		cast4(meshes, &rays[i], (int) std::min<size_t>(4, rays.size() - i), &hits[i]);
+	return elapsed_ms(t0);
+}
+
+static bool same_hit(const ray_hit_t & a, const ray_hit_t & b) {
+	return a.mesh == b.mesh &&
+		(a.triangle == b.triangle || fabsf(a.t - b.t) <= 1e-5f * a.t);
+}
+
+// one mesh per group, with the positions of the model
+static void load(const string & fname, vector<TriangleMesh *> & meshes, BBox & box) {
+	GLMmodel *m = glmReadOBJ(fname.c_str());
+	for(GLMgroup *g = m->groups; g; g = g->next) {
+		if (!g->numtriangles) continue;
+		TriangleMesh *mesh = new TriangleMesh();
+		for(GLuint v = 1; v <= m->numvertices; ++v)
+			mesh->addPoint(Vector3(&m->vertices[3 * v]));
+		for(GLuint i = 0; i < g->numtriangles; ++i) {
+			const GLuint *idx = m->triangles[g->triangles[i]].vindices;
+			mesh->addTriangle(idx[0] - 1, idx[1] - 1, idx[2] - 1);
+		}
+		mesh->includeBBox(box);
+		meshes.push_back(mesh);
+	}
+	glmDelete(m);
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-n rays] file.obj...\n", prog);
+	exit(1);
+}
+
+int main(int argc, char** argv) {
+
+	size_t rays_n = 1000000;
+	vector<string> fnames;
+
+	for(int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) rays_n = atol(argv[++i]);
+		else if (argv[i][0] == '-') usage(argv[0]);
+		else fnames.push_back(argv[i]);
+	}
+	if (fnames.empty() || !rays_n) usage(argv[0]);
+
+	ThreadPool *pool = ThreadPool::instance();
+	for(size_t f = 0; f < fnames.size(); ++f) {
+		vector<TriangleMesh *> meshes;
+		BBox box;
+		load(fnames[f], meshes, box);
+		size_t tris_n = 0, nodes_n = 0;
+		ray_clock::time_point t0 = ray_clock::now();
+		for(size_t i = 0; i < meshes.size(); ++i) {
+			meshes[i]->buildBVH();
+			tris_n += meshes[i]->numTriangles();
+			nodes_n += meshes[i]->numBVHNodes();
+		}
+		double build_ms = elapsed_ms(t0);
+
+		// from a sphere around the box, towards points inside it
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		Vector3 C = 0.5f * (box.m_min + box.m_max);
+		float radius = (box.m_max - box.m_min).length();
+		vector<Line> rays(rays_n);
+		for(size_t i = 0; i < rays_n; ++i) {
+			float z = 2.0f * unit(rng) - 1.0f, phi = 2.0f * M_PI * unit(rng);
+			float r = sqrtf(1.0f - z * z);
+			Vector3 O = C + radius * Vector3(r * cosf(phi), r * sinf(phi), z);
+			Vector3 T;
+			for(int j = 0; j < 3; ++j)
+				T[j] = box.m_min[j] + unit(rng) * (box.m_max[j] - box.m_min[j]);
+			rays[i] = Line(O, T - O);
+		}
+
+		vector<ray_hit_t> hits(rays_n);
+		t0 = ray_clock::now();
+		for(size_t i = 0; i < rays_n; ++i)
+			hits[i] = cast(meshes, rays[i]);
+		double single_ms = elapsed_ms(t0);
+		t0 = ray_clock::now();
+		pool->parallelFor(rays_n, 1024, [&](size_t begin, size_t end) {
+			for(size_t i = begin; i < end; ++i)
+				hits[i] = cast(meshes, rays[i]);
+		});
+		double multi_ms = elapsed_ms(t0);
+		size_t hits_n = 0;
+		for(size_t i = 0; i < rays_n; ++i)
+			if (hits[i].mesh != -1) ++hits_n;
+
+		// in packets: the same rays, and the rays of a camera at the sphere
+		// looking at the centre, 2x2 pixels per packet
+		vector<ray_hit_t> phits(rays_n);
+		double packet_ms = cast_packets(meshes, rays, phits);
+		size_t packet_mismatches = 0;
+		for(size_t i = 0; i < rays_n; ++i)
+			if (!same_hit(hits[i], phits[i])) ++packet_mismatches;
+		size_t side = std::max<size_t>(2, (size_t) sqrtf((float) rays_n) & ~(size_t) 1);
+		vector<Line> camera(side * side);
+		Vector3 eye = C + radius * Vector3(0.6f, 0.48f, 0.64f);
+		Vector3 fwd = C - eye;
+		fwd.normalize();
+		Vector3 right = crossVectors(fwd, Vector3(0.0f, 1.0f, 0.0f));
+		right.normalize();
+		Vector3 up = crossVectors(right, fwd);
+		for(size_t i = 0; i < camera.size(); ++i) {
+			size_t block = i / 4, x = 2 * (block % (side / 2)) + (i & 1);
+			size_t y = 2 * (block / (side / 2)) + ((i >> 1) & 1);
+			float u = 0.4f * (2.0f * (x + 0.5f) / side - 1.0f);
+			float v = 0.4f * (2.0f * (y + 0.5f) / side - 1.0f);
+			camera[i] = Line(eye, fwd + u * right + v * up);
+		}
+		vector<ray_hit_t> chits(camera.size()), cphits(camera.size());
+		t0 = ray_clock::now();
+		for(size_t i = 0; i < camera.size(); ++i)
+			chits[i] = cast(meshes, camera[i]);
+		double camera_ms = elapsed_ms(t0);
+		double camera_packet_ms = cast_packets(meshes, camera, cphits);
+		size_t camera_hits_n = 0;
+		for(size_t i = 0; i < camera.size(); ++i) {
+			if (!same_hit(chits[i], cphits[i])) ++packet_mismatches;
+			if (chits[i].mesh != -1) ++camera_hits_n;
+		}
+
+		// same rays, testing all the triangles (about 10^8 ray-triangle tests)
+		size_t check_n = std::min(rays_n, std::max<size_t>(100, 100000000 / std::max<size_t>(tris_n, 1)));
+		size_t mismatches = 0;
+		for(size_t i = 0; i < meshes.size(); ++i)
+			meshes[i]->clearBVH();
+		t0 = ray_clock::now();
+		for(size_t i = 0; i < check_n; ++i) {
+			ray_hit_t hit = cast(meshes, rays[i]);
+			if (!same_hit(hit, hits[i])) ++mismatches;
+		}
+		double brute_ms = elapsed_ms(t0);
+
+		printf("%s: %zu meshes, %zu triangles, %zu BVH nodes (%zu KB, %.1f ms)\n",
+			   fnames[f].c_str(), meshes.size(), tris_n, nodes_n,
+			   nodes_n * sizeof(BVHNode) / 1024, build_ms);
+		printf("  %zu rays, %.1f%% hit: %.2f Mrays/s (1 thread), %.2f Mrays/s (%zu threads), "
+			   "%.4f Mrays/s (all triangles)\n",
+			   rays_n, 100.0 * hits_n / rays_n, rays_n / single_ms / 1000.0,
+			   rays_n / multi_ms / 1000.0, pool->size(), check_n / brute_ms / 1000.0);
+		printf("  packets of 4 (1 thread): %.2f Mrays/s (same rays), camera %zux%zu, %.1f%% hit: "
+			   "%.2f Mrays/s (one by one), %.2f Mrays/s (packets)\n",
+			   rays_n / packet_ms / 1000.0, side, side, 100.0 * camera_hits_n / camera.size(),
+			   camera.size() / camera_ms / 1000.0, camera.size() / camera_packet_ms / 1000.0);
+		if (mismatches)
+			printf("  [E] %zu of %zu rays differ from testing all the triangles\n", mismatches, check_n);
+		if (packet_mismatches)
+			printf("  [E] %zu of %zu rays differ in packets\n", packet_mismatches,
+				   rays_n + camera.size());
+		for(size_t i = 0; i < meshes.size(); ++i)
+			delete meshes[i];
+		if (mismatches || packet_mismatches) return 1;
+	}
+	return 0;
+}
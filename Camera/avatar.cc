@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "tools.h"
 #include "avatar.h"
 #include "scene.h"
@@ -18,33 +19,66 @@ bool Avatar::walkOrFly(bool walkOrFly) {
 	return walk;
 }
 
-// TODO:
-//
-// AdvanceAvatar: see if avatar can advance 'step' units.
+static const int max_slides = 3;      // contacts handled in one step
+static const float skin_ratio = 0.01f; // distance kept to the geometry (times the radius)
 
-bool Avatar::advance(float step)
-{
+// AdvanceAvatar: advance 'step' units, or until the first contact, and slide
+// along the geometry with the rest of the step. The step is split in
+// beginStep, a sweep and a slide() per contact, and endStep, so that
+// AvatarManager::advance can sweep all the avatars at once.
 
-	Node *rootNode = Scene::instance()->rootNode(); // root node of scene
+void Avatar::beginStep(float step, step_t & s) {
+	s.P0 = m_cam->getPosition();
 	//Comprobar si estoy en modo walk o fly y actuar
 	if (m_walk)
 		m_cam->walk(step);
 	else
 		m_cam->fly(step);
-	//Actualizar la posicion del avatar de la camara
-	this->m_bsph->setPosition(this->m_cam->getPosition());
-	//En caso de que haya colision, tengo que retornar la camara a donde estaba
-	if (rootNode->checkCollision(this->m_bsph)!= 0)
-	{
-		if (m_walk)
-			m_cam->walk(-step);
-		else
-			m_cam->fly(-step);
-		return false;
+	s.d = m_cam->getPosition() - s.P0;
+	m_cam->translate(-1.0f * s.d);
+	s.P = s.P0;
+	s.slides = 0;
+	s.active = s.d.length() > skin_ratio * m_bsph->getRadius();
+	m_bsph->setPosition(s.P);
+}
+
+// the sweep of s.d from s.P found 'res' (0 if none) at 'hit'
+
+void Avatar::slide(step_t & s, const Node *res, const Node::sweep_t & hit) {
+	if (!res) {
+		s.P += s.d;
+		s.active = false;
+	} else {
+		// stop before the contact, and slide along it
+		float skin = skin_ratio * m_bsph->getRadius();
+		float t = std::max(hit.t - skin / s.d.length(), 0.0f);
+		s.P += t * s.d;
+		s.d = (1.0f - t) * s.d;
+		s.d -= s.d.dot(hit.normal) * hit.normal;
+		if (m_walk) s.d[1] = 0.0f;
+		s.active = ++s.slides < max_slides && s.d.length() > skin;
 	}
+	m_bsph->setPosition(s.P);
+}
+
+bool Avatar::endStep(const step_t & s) {
+	if ((s.P - s.P0).isZero()) return false;
+	m_cam->translate(s.P - s.P0);
 	return true;
 }
 
+bool Avatar::advance(float step)
+{
+	step_t s;
+	beginStep(step, s);
+	while(s.active) {
+		Node::sweep_t hit; // (with the static part of the scene and the dynamic leaves)
+		const Node *res = Scene::instance()->sweepSphere(m_bsph, s.d, hit);
+		slide(s, res, hit);
+	}
+	return endStep(s);
+}
+
 
 void Avatar::leftRight(float angle) {
 	if (m_walk)
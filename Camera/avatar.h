@@ -6,6 +6,7 @@
 #include "camera.h"
 #include "bsphere.h"
 #include "trfm3D.h"
+#include "node.h"
 
 class Avatar {
 
@@ -20,6 +21,8 @@ public:
 
 	/**
 	 * Advance the avatar if possible (no collisions). Walk or fly depending on status.
+	 * The avatar stops at the first contact with the geometry, and slides
+	 * along it with the rest of the step.
 	 * return true if avatar moves. false if not
 	 */
 
@@ -49,6 +52,19 @@ private:
 	Avatar(const Avatar &);
 	Avatar &operator=(const Avatar &);
 
+	// a step in progress (see advance)
+	struct step_t {
+		Vector3 P0;  // position before the step
+		Vector3 P;   // position so far
+		Vector3 d;   // motion left
+		int slides;  // contacts handled
+		bool active; // whether the motion left must be swept
+	};
+
+	void beginStep(float step, step_t & s);
+	void slide(step_t & s, const Node *res, const Node::sweep_t & hit);
+	bool endStep(const step_t & s);
+
 	std::string m_name; //!< Name of the Avatar
 	Camera   *m_cam;    //!< Associated camera (not owned)
 	BSphere  *m_bsph;   //!< Bounding sphere
@@ -1,6 +1,8 @@
 #include <cstdio>
 #include <map>
+#include <vector>
 #include "avatarManager.h"
+#include "batchQuery.h"
 
 using std::map;
 using std::string;
@@ -19,7 +21,7 @@ AvatarManager::~AvatarManager() {
 }
 
 Avatar *AvatarManager::create(const std::string &key,
-							  Camera *theCamera, int radius) {
+							  Camera *theCamera, float radius) {
 	map<string, Avatar *>::iterator it = m_hash.find(key);
 	if (it != m_hash.end()) {
 		fprintf(stderr, "[W] duplicate avatar %s\n", key.c_str());
@@ -37,6 +39,44 @@ Avatar *AvatarManager::find(const std::string & key) const {
 	return it->second;
 }
 
+size_t AvatarManager::advance(float step) {
+	std::vector<Avatar *> avatars;
+	std::vector<Avatar::step_t> steps;
+	for(map<string, Avatar *>::iterator it = m_hash.begin(), end = m_hash.end();
+		it != end; ++it) {
+		avatars.push_back(it->second);
+		steps.push_back(Avatar::step_t());
+		it->second->beginStep(step, steps.back());
+	}
+	// one batch per round of contacts, with the avatars still moving
+	std::vector<size_t> moving;
+	std::vector<BSphere> spheres;
+	std::vector<Vector3> d;
+	std::vector<Node::sweep_t> hits;
+	std::vector<const Node *> res;
+	for(;;) {
+		moving.clear();
+		spheres.clear();
+		d.clear();
+		for(size_t i = 0; i < avatars.size(); ++i) {
+			if (!steps[i].active) continue;
+			moving.push_back(i);
+			spheres.push_back(*avatars[i]->m_bsph);
+			d.push_back(steps[i].d);
+		}
+		if (moving.empty()) break;
+		hits.resize(moving.size());
+		res.resize(moving.size());
+		BatchQuery::instance()->sweepSphere(&spheres[0], &d[0], moving.size(), &hits[0], &res[0]);
+		for(size_t k = 0; k < moving.size(); ++k)
+			avatars[moving[k]]->slide(steps[moving[k]], res[k], hits[k]);
+	}
+	size_t moved = 0;
+	for(size_t i = 0; i < avatars.size(); ++i)
+		if (avatars[i]->endStep(steps[i])) ++moved;
+	return moved;
+}
+
 void AvatarManager::print() const {
 	for(map<string, Avatar *>::const_iterator it = m_hash.begin(), end = m_hash.end();
 		it != end; ++it)
@@ -20,7 +20,7 @@ public:
 	 *
 	 */
 	Avatar *create(const std::string &name,
-				   Camera *theCamera, int radius);
+				   Camera *theCamera, float radius);
 
 	/**
 	 * Get a registered avatar
@@ -28,6 +28,16 @@ public:
 	 * Return the avatar or 0 if not found
 	 */
 	Avatar *find(const std::string & name) const;
+
+	/**
+	 * Advance all the avatars, as Avatar::advance. The collisions of all of
+	 * them are swept at once (see BatchQuery), so this is much faster than
+	 * advancing them one by one for crowds.
+	 *
+	 * return the number of avatars which moved
+	 */
+	size_t advance(float step);
+
 	void print() const;
 
 	// iterate over all objects
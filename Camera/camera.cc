@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cmath>
+#include <algorithm>
 #include "camera.h"
 #include "constants.h"
 #include "tools.h"
@@ -210,6 +211,30 @@ float Camera::getNear() const { return m_near; }
 Vector3 Camera::getPosition() const { return m_E; }
 Vector3 Camera::getDirection() const { return -1.0f * m_D; }
 
+float Camera::projectedSize(float size, float distance) const {
+	float height = fabs(m_top - m_bottom); // viewport height at the near plane
+	if (m_type == perspective)
+		height *= std::max(distance, m_near) / m_near;
+	return height > 0.0f ? size / height : 0.0f;
+}
+
+// Inverse of the projections of Trfm3D::setFrustum and Trfm3D::setOrtho
+// (note the latter flips y), and of the view transformation. R and U are
+// orthogonal, but not unit when Up is not perpendicular to the view
+// direction (see updateFrame).
+
+Line Camera::ray(float x, float y) const {
+	Vector3 R = (1.0f / m_R.dot(m_R)) * m_R;
+	Vector3 U = (1.0f / m_U.dot(m_U)) * m_U;
+	float cx = 0.5f * ((m_right - m_left) * x + m_right + m_left);
+	if (m_type == orthographic) {
+		float cy = 0.5f * ((m_bottom - m_top) * y + m_bottom + m_top);
+		return Line(m_E + cx * R + cy * U - m_near * m_D, -1.0f * m_D);
+	}
+	float cy = 0.5f * ((m_top - m_bottom) * y + m_top + m_bottom);
+	return Line(m_E, cx * R + cy * U - m_near * m_D);
+}
+
 ////////////////////////////////////////////////
 // trfm transformations
 
@@ -270,6 +295,12 @@ void  Camera::panX(float step) {
 
 }
 
+void Camera::translate(const Vector3 & d) {
+	m_E += d;
+	m_At += d;
+	setViewTrfm();
+}
+
 void  Camera::panY(float step) {
 	m_E += step * m_U;
 	m_At += step * m_U;
@@ -355,6 +386,26 @@ int Camera::checkFrustum(const BBox *theBBox,
 	return intersecta; 
 }
 
+int Camera::checkFrustum(const BSphere *theBSphere) {
+	int res = -1;
+	for(int i = 0; i < 6; ++i) {
+		int r = BSpherePlaneIntersect(theBSphere, m_fPlanes[i]);
+		if (r == +IREJECT) return 1;
+		if (r == IINTERSECT) res = 0;
+	}
+	return res;
+}
+
+int Camera::checkFrustum(const OBB *theOBB) {
+	int res = -1;
+	for(int i = 0; i < 6; ++i) {
+		int r = OBBPlaneIntersect(theOBB, m_fPlanes[i]);
+		if (r == +IREJECT) return 1;
+		if (r == IINTERSECT) res = 0;
+	}
+	return res;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////
 // No tocar a partir de aqui
 
@@ -8,7 +8,10 @@
 #include "vector3.h"
 #include "plane.h"
 #include "bbox.h"
+#include "bsphere.h"
+#include "obb.h"
 #include "trfm3D.h"
+#include "line.h"
 
 class Camera {
 
@@ -67,6 +70,20 @@ public:
 	Vector3 getPosition() const;  //!< Get camera position in world coordinates.
 	Vector3 getDirection() const; //!< Get camera direction (the vector the camera is aiming at) in world coordinates
 
+	/**
+	 * Fraction of the viewport height covered by an object of size 'size'
+	 * at distance 'distance' from the camera.
+	 */
+	float projectedSize(float size, float distance) const;
+
+	/**
+	 * Ray (in world coordinates) through a point of the viewport, given in
+	 * normalized device coordinates (-1..1, y up). It starts at the near
+	 * plane (orthographic) or at the camera position (perspective), with
+	 * parameter 1 at the near plane.
+	 */
+	Line ray(float x, float y) const;
+
 	////////////////////////////////////////////////
 	// trfm transformations
 
@@ -85,6 +102,7 @@ public:
 	void walk(float step); // Move the camera "step" units. Walk mode.
 	void panX(float step ); // Pan camera left/right
 	void panY(float step ); // Pan camera up/down
+	void translate(const Vector3 & d); // Move the camera (and the point it looks at) by d
 
 	////////////////////////////////////////////////
 	// Rotation
@@ -116,6 +134,13 @@ public:
 
 	int checkFrustum(const BBox *theBBox, unsigned int *planesBitM);
 
+	/**
+	 * As above, for a BSphere (cheaper) and for an OBB (tighter than the
+	 * BBox of a rotated box). Both in world coordinates.
+	 */
+	int checkFrustum(const BSphere *theBSphere);
+	int checkFrustum(const OBB *theOBB);
+
 	friend class CameraManager;
 
 	virtual void print();
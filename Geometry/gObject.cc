@@ -1,9 +1,11 @@
 #include <iterator>
+#include <algorithm>
 #include <cstdio>
 #include <string>
 #include "tools.h"
 #include "gObject.h"
 #include "triangleMeshGL.h"
+#include "meshCache.h"
 
 using std::list;
 using std::string;
@@ -27,43 +29,147 @@ GObject *GObject::createFromWavefront(const string & DirName, const string & Fil
 	list<TriangleMesh *> auxlist;
 
 	newGObject = new GObject(getFilename(DirName, FileName));
+	// use the baked meshes (and bounding box) if there is a cache file
+	if (MeshCache::read(DirName, FileName, auxlist, newGObject->m_container)) {
+		for(list<TriangleMesh *>::iterator it = auxlist.begin(), end = auxlist.end();
+			it != end; ++it) {
+			newGObject->insert(*it);
+		}
+		return newGObject; // (with baked BVHs)
+	}
 	TriangleMesh::CreateTMeshObj(DirName, FileName, auxlist);
 	for(list<TriangleMesh *>::iterator it = auxlist.begin(), end = auxlist.end();
 		it != end; ++it) {
+		(*it)->buildClusters();
 		newGObject->add(*it);
 	}
+	newGObject->buildBVH();
 	return newGObject;
 }
 
 void GObject::add(TriangleMesh *oneMesh) {
+	insert(oneMesh);
+	oneMesh->includeBBox(m_container);
+}
+
+void GObject::insert(TriangleMesh *oneMesh) {
 
 	if(oneMesh->getMaterial()->isTransp()) {
 		m_meshes_transp.push_back(oneMesh);
 	} else {
 		m_meshes.push_back(oneMesh);
 	}
-	updateContainer();
 }
 
 const std::string & GObject::getName() const { return m_name; }
 
-void GObject::draw() {
-	drawOpaque();
-	drawTransparent();
+void GObject::draw(size_t lod) {
+	drawOpaque(lod);
+	drawTransparent(lod);
 }
 
-void GObject::drawOpaque() {
+void GObject::drawOpaque(size_t lod) {
 	for(list<TriangleMesh *>::const_iterator it = m_meshes.begin(), end = m_meshes.end();
 		it != end; ++it) {
-		TriangleMeshGL::draw(*it);
+		TriangleMeshGL::draw((*it)->getLOD(lod));
+	}
+}
+
+void GObject::drawTransparent(size_t lod) {
+	for(list<TriangleMesh *>::const_iterator it = m_meshes_transp.begin(), end = m_meshes_transp.end();
+		it != end; ++it) {
+		TriangleMeshGL::draw((*it)->getLOD(lod));
 	}
 }
 
-void GObject::drawTransparent() {
+void GObject::buildLODs() {
+	for(list<TriangleMesh *>::iterator it = m_meshes.begin(), end = m_meshes.end();
+		it != end; ++it) {
+		(*it)->buildLODs();
+	}
+	for(list<TriangleMesh *>::iterator it = m_meshes_transp.begin(), end = m_meshes_transp.end();
+		it != end; ++it) {
+		(*it)->buildLODs();
+	}
+}
+
+void GObject::buildBVH() {
+	for(list<TriangleMesh *>::iterator it = m_meshes.begin(), end = m_meshes.end();
+		it != end; ++it) {
+		(*it)->buildBVH();
+	}
+	for(list<TriangleMesh *>::iterator it = m_meshes_transp.begin(), end = m_meshes_transp.end();
+		it != end; ++it) {
+		(*it)->buildBVH();
+	}
+}
+
+const TriangleMesh *GObject::intersectRay(const Line & ray, float tmax, int & triangle, Vector3 & uvw) const {
+	const TriangleMesh *res = 0;
+	const list<TriangleMesh *> *lists[2] = { &m_meshes, &m_meshes_transp };
+	for(int l = 0; l < 2; ++l) {
+		for(list<TriangleMesh *>::const_iterator it = lists[l]->begin(), end = lists[l]->end();
+			it != end; ++it) {
+			int tri = (*it)->intersectRay(ray, tmax, uvw);
+			if (tri == -1) continue;
+			tmax = uvw[2];
+			triangle = tri;
+			res = *it;
+		}
+	}
+	return res;
+}
+
+bool GObject::intersectSphere(const Vector3 & C, float radius) const {
+	const list<TriangleMesh *> *lists[2] = { &m_meshes, &m_meshes_transp };
+	for(int l = 0; l < 2; ++l) {
+		for(list<TriangleMesh *>::const_iterator it = lists[l]->begin(), end = lists[l]->end();
+			it != end; ++it) {
+			if ((*it)->intersectSphere(C, radius) != -1) return true;
+		}
+	}
+	return false;
+}
+
+const TriangleMesh *GObject::sweepSphere(const Vector3 & C, const Vector3 & d, float radius,
+										 float tmax, float & t, Vector3 & N) const {
+	const TriangleMesh *res = 0;
+	const list<TriangleMesh *> *lists[2] = { &m_meshes, &m_meshes_transp };
+	for(int l = 0; l < 2; ++l) {
+		for(list<TriangleMesh *>::const_iterator it = lists[l]->begin(), end = lists[l]->end();
+			it != end; ++it) {
+			if ((*it)->sweepSphere(C, d, radius, tmax, t, N) == -1) continue;
+			tmax = t;
+			res = *it;
+		}
+	}
+	return res;
+}
+
+size_t GObject::numLODs() const {
+	size_t res = 1;
+	for(list<TriangleMesh *>::const_iterator it = m_meshes.begin(), end = m_meshes.end();
+		it != end; ++it) {
+		res = std::max(res, (*it)->numLODs());
+	}
+	for(list<TriangleMesh *>::const_iterator it = m_meshes_transp.begin(), end = m_meshes_transp.end();
+		it != end; ++it) {
+		res = std::max(res, (*it)->numLODs());
+	}
+	return res;
+}
+
+float GObject::lodError(size_t lod) const {
+	float res = 0.0f;
+	for(list<TriangleMesh *>::const_iterator it = m_meshes.begin(), end = m_meshes.end();
+		it != end; ++it) {
+		res = std::max(res, (*it)->lodError(lod));
+	}
 	for(list<TriangleMesh *>::const_iterator it = m_meshes_transp.begin(), end = m_meshes_transp.end();
 		it != end; ++it) {
-		TriangleMeshGL::draw(*it);
+		res = std::max(res, (*it)->lodError(lod));
 	}
+	return res;
 }
 
 const BBox * GObject::getContainer() {
@@ -157,7 +263,7 @@ size_t GObject::size() const {
 
 const TriangleMesh *GObject::at(size_t idx) const {
 	const std::list<TriangleMesh *> *ptr = &m_meshes;
-	if (idx > m_meshes.size()) {
+	if (idx >= m_meshes.size()) {
 		ptr = &m_meshes_transp;
 		idx -= m_meshes.size();
 	}
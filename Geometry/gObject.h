@@ -25,17 +25,43 @@ public:
 
 	const std::string & getName() const;
 
-	// Draw the geometry object using current modelview matrix
+	// Draw the geometry object using current modelview matrix. 'lod' selects
+	// the level of detail of the meshes (0 is full detail)
 
-	void draw();
+	void draw(size_t lod = 0);
 
 	// Draw opaque meshes of the geometry object using current modelview matrix
 
-	void drawOpaque();
+	void drawOpaque(size_t lod = 0);
 
 	// Draw transparent meshes of the geometry object using current modelview matrix
 
-	void drawTransparent();
+	void drawTransparent(size_t lod = 0);
+
+	// Levels of detail (see TriangleMesh::buildLODs)
+	void buildLODs(); //!< Build LODs of all meshes
+	size_t numLODs() const; //!< Number of LODs (of the mesh with most LODs)
+	float lodError(size_t lod) const; //!< Error of LOD 'lod' (max. over all meshes)
+
+	// Ray and sphere queries (see TriangleMesh::buildBVH)
+	void buildBVH(); //!< Build the BVH of all meshes
+	/**
+	 * Closest intersection of 'ray' with the meshes, with parameter in (0, tmax)
+	 *
+	 * @return the mesh intersected (0 if none). 'triangle' and 'uvw' as in
+	 * TriangleMesh::intersectRay
+	 */
+	const TriangleMesh *intersectRay(const Line & ray, float tmax, int & triangle, Vector3 & uvw) const;
+	//! Whether the sphere (C, radius) intersects the meshes
+	bool intersectSphere(const Vector3 & C, float radius) const;
+	/**
+	 * First contact of the sphere (C, radius) moving to C + tmax * d
+	 *
+	 * @return the mesh touched (0 if none). 't' and 'N' as in
+	 * TriangleMesh::sweepSphere
+	 */
+	const TriangleMesh *sweepSphere(const Vector3 & C, const Vector3 & d, float radius,
+									float tmax, float & t, Vector3 & N) const;
 
 	const BBox *getContainer(); //!< Get bounding box of GObject
 
@@ -66,6 +92,7 @@ public:
 private:
 
 	void updateContainer(); //!< recalculate bounding box
+	void insert(TriangleMesh *oneMesh); //!< add mesh (without updating bounding box)
 
 	/**
 	 * Create a geometry object given a wavefront file
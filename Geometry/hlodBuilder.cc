@@ -0,0 +1,354 @@
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include "hlodBuilder.h"
+#include "gObjectManager.h"
+#include "materialManager.h"
+#include "textureManager.h"
+#include "imageManager.h"
+#include "threadPool.h"
+
+using std::vector;
+using std::map;
+using std::pair;
+using std::make_pair;
+using std::string;
+
+// Atlas tiles are atlas_tile x atlas_tile texels. Texture coordinates are
+// mapped to the tile without a border of atlas_pad texels, which repeat the
+// edge of the tile (so that filtering doesn't bleed into other tiles)
+
+static const int atlas_tile = 128;
+static const int atlas_pad = 4;
+
+// proxy LODs whose errors are closer than this factor are merged
+static const float hlod_error_step = 1.25f;
+
+// tex coords further than this out of [0, 1] are taken as repeating textures
+static const float uv_eps = 1e-3f;
+
+static int next_power_of_2(int n) {
+	int p = 1;
+	while (p < n) p *= 2;
+	return p;
+}
+
+// one tile of the atlas: the texture of a material (times its diffuse
+// color), or its average color if 'solid'
+
+struct tile_t {
+	const Material *mat;
+	bool solid;
+};
+
+// whether all tex coords of mesh are in [0, 1]
+
+static bool uv_inside(const TriangleMesh *mesh) {
+	for(size_t i = 0; i < mesh->numTexCoords(); ++i) {
+		const float *st = mesh->texCoords(i);
+		if (st[0] < -uv_eps || st[0] > 1.0f + uv_eps ||
+			st[1] < -uv_eps || st[1] > 1.0f + uv_eps) return false;
+	}
+	return true;
+}
+
+// RGB image of a material (0 if none)
+
+static const Image *material_image(const Material *mat) {
+	if (!mat->hasTexture()) return 0;
+	const Image *img = mat->getTexture()->getImage();
+	if (!img || !img->getData() ||
+		img->getSize() != (size_t) img->getWidth() * img->getHeight() * 3) return 0;
+	return img;
+}
+
+// average color of the texels x in [x0, x1), y in [y0, y1) of img
+
+static void average_texels(const Image *img, int x0, int x1, int y0, int y1, float rgb[3]) {
+	const unsigned char *data = img->getData();
+	int w = img->getWidth();
+	double sum[3] = { 0.0, 0.0, 0.0 };
+	for(int y = y0; y < y1; ++y) {
+		const unsigned char *row = data + 3 * (y * w + x0);
+		for(int x = x0; x < x1; ++x, row += 3) {
+			sum[0] += row[0];
+			sum[1] += row[1];
+			sum[2] += row[2];
+		}
+	}
+	double n = (double) (x1 - x0) * (y1 - y0);
+	for(int i = 0; i < 3; ++i) rgb[i] = (float) (sum[i] / n);
+}
+
+// Bake tile into atlas (of width atlas_w) at tile position (tx, ty). Colors
+// are multiplied by 'scale'.
+
+static void bake_tile(const tile_t & tile, const float scale[3],
+					  unsigned char *atlas, int atlas_w, int tx, int ty) {
+	const Image *img = material_image(tile.mat);
+	float solid[3] = { 255.0f, 255.0f, 255.0f };
+	if (img && tile.solid)
+		average_texels(img, 0, img->getWidth(), 0, img->getHeight(), solid);
+	int inner = atlas_tile - 2 * atlas_pad;
+	for(int y = 0; y < atlas_tile; ++y) {
+		int iy = std::min(std::max(y - atlas_pad, 0), inner - 1);
+		for(int x = 0; x < atlas_tile; ++x) {
+			int ix = std::min(std::max(x - atlas_pad, 0), inner - 1);
+			float rgb[3] = { solid[0], solid[1], solid[2] };
+			if (img && !tile.solid) {
+				// box filter the texels under the atlas texel
+				int w = img->getWidth();
+				int h = img->getHeight();
+				int x0 = ix * w / inner;
+				int y0 = iy * h / inner;
+				average_texels(img, x0, std::max((ix + 1) * w / inner, x0 + 1),
+							   y0, std::max((iy + 1) * h / inner, y0 + 1), rgb);
+			}
+			unsigned char *dst = atlas + 3 * ((ty * atlas_tile + y) * atlas_w + tx * atlas_tile + x);
+			for(int i = 0; i < 3; ++i)
+				dst[i] = (unsigned char) std::min(rgb[i] * scale[i] + 0.5f, 255.0f);
+		}
+	}
+}
+
+// a mesh of the members
+
+struct mesh_info_t {
+	bool solid;   // whether the mesh uses the color of its tile (not its texture)
+	size_t tile;  // tile of the atlas
+	float extent; // max. size of the mesh along an axis
+};
+
+// one mesh of a member of a cluster
+
+struct part_t {
+	const TriangleMesh *mesh;
+	const mesh_info_t *info;
+	const Trfm3D *T;  // placement of the member
+	float scale;      // scale of T
+};
+
+HLODBuilder::HLODBuilder(const std::string & name) : m_name(name) {}
+
+HLODBuilder::~HLODBuilder() {}
+
+size_t HLODBuilder::addCluster() {
+	cluster_t cluster;
+	cluster.proxy = 0;
+	cluster.error = 0.0f;
+	m_clusters.push_back(cluster);
+	return m_clusters.size() - 1;
+}
+
+void HLODBuilder::add(size_t cluster, const GObject *gobj, const Trfm3D *T) {
+	member_t member;
+	member.gobj = gobj;
+	member.T.clone(T);
+	m_clusters[cluster].members.push_back(member);
+}
+
+// Append the (indexed) mesh, transformed by T, to dst. Tex coords are mapped
+// to the rectangle 'tile' (u, v, width, height) of the atlas, or to its
+// center if 'solid'. The mesh keeps its vertex cache order.
+
+void HLODBuilder::append(TriangleMesh *dst, const TriangleMesh *mesh, const Trfm3D & T,
+						 const float tile[4], bool solid) {
+	int offset = dst->numVertices();
+	size_t vertex_n = mesh->numVertices();
+	if (!vertex_n) return;
+	dst->m_vCoords.resize(3 * (offset + vertex_n));
+	dst->m_nCoords.resize(3 * (offset + vertex_n));
+	float *P = &dst->m_vCoords[3 * offset];
+	float *N = &dst->m_nCoords[3 * offset];
+	T.transformPoints(mesh->vCoords(0), P, vertex_n);
+	T.transformNormals(mesh->nCoords(0), N, vertex_n);
+	for(size_t i = 0; i < vertex_n; ++i, N += 3) {
+		Vector3 V(N);
+		V.normalize();
+		N[0] = V[0];
+		N[1] = V[1];
+		N[2] = V[2];
+		float s = 0.5f, t = 0.5f;
+		if (!solid) {
+			const float *st = mesh->texCoords(i);
+			s = std::min(std::max(st[0], 0.0f), 1.0f);
+			t = std::min(std::max(st[1], 0.0f), 1.0f);
+		}
+		dst->m_texCoords.push_back(tile[0] + s * tile[2]);
+		dst->m_texCoords.push_back(tile[1] + t * tile[3]);
+	}
+	for(size_t i = 0; i < mesh->m_vIndices.size(); ++i)
+		dst->m_vIndices.push_back(offset + mesh->m_vIndices[i]);
+	dst->m_vbo_uptodate = 0;
+}
+
+GObject *HLODBuilder::getProxy(size_t cluster) const { return m_clusters[cluster].proxy; }
+float HLODBuilder::getError(size_t cluster) const { return m_clusters[cluster].error; }
+
+void HLODBuilder::build() {
+
+	// Find the clusters which can have a proxy, the distinct meshes of their
+	// members and the tiles of the atlas
+	vector<tile_t> tiles;
+	map<pair<const Material *, bool>, size_t> tile_idx;
+	map<const TriangleMesh *, mesh_info_t> meshes;
+	vector<bool> valid(m_clusters.size(), false);
+	Vector3 diffuse(0.0f, 0.0f, 0.0f); // diffuse color of the proxies
+	const Material *main_mat = 0; // material of most triangles
+	map<const Material *, size_t> mat_triangles;
+	for(size_t c = 0; c < m_clusters.size(); ++c) {
+		const vector<member_t> & members = m_clusters[c].members;
+		bool ok = !members.empty();
+		for(size_t m = 0; ok && m < members.size(); ++m) {
+			const GObject *gobj = members[m].gobj;
+			ok = gobj->numLODs() > 1;
+			for(size_t i = 0; ok && i < gobj->size(); ++i) {
+				const TriangleMesh *mesh = gobj->at(i);
+				ok = !mesh->getMaterial()->isTransp() && mesh->numNormals() && mesh->isIndexed();
+			}
+		}
+		if (!ok) continue;
+		valid[c] = true;
+		for(size_t m = 0; m < members.size(); ++m) {
+			const GObject *gobj = members[m].gobj;
+			for(size_t i = 0; i < gobj->size(); ++i) {
+				const TriangleMesh *mesh = gobj->at(i);
+				const Material *mat = mesh->getMaterial();
+				size_t & n = mat_triangles[mat];
+				n += mesh->numTriangles();
+				if (!main_mat || n > mat_triangles[main_mat]) main_mat = mat;
+				if (meshes.count(mesh)) continue;
+				mesh_info_t & info = meshes[mesh];
+				info.solid = !material_image(mat) || !mesh->numTexCoords() || !uv_inside(mesh);
+				BBox box;
+				mesh->includeBBox(box);
+				info.extent = 0.0f;
+				for(int j = 0; j < 3; ++j)
+					info.extent = std::max(info.extent, box.m_max[j] - box.m_min[j]);
+				map<pair<const Material *, bool>, size_t>::iterator it =
+					tile_idx.insert(make_pair(make_pair(mat, info.solid), tiles.size())).first;
+				info.tile = it->second;
+				if (info.tile == tiles.size()) {
+					tile_t tile = { mat, info.solid };
+					tiles.push_back(tile);
+					for(int j = 0; j < 3; ++j)
+						diffuse[j] = std::max(diffuse[j], mat->getDiffuse()[j]);
+				}
+			}
+		}
+	}
+	if (tiles.empty()) return;
+
+	// Bake the atlas. The diffuse colors of the materials are baked in the
+	// tiles (relative to the diffuse color of the proxies).
+	int cols = next_power_of_2((int) ceilf(sqrtf((float) tiles.size())));
+	int rows = next_power_of_2((int) ((tiles.size() + cols - 1) / cols));
+	int atlas_w = cols * atlas_tile;
+	int atlas_h = rows * atlas_tile;
+	vector<unsigned char> atlas(3 * atlas_w * atlas_h, 0);
+	for(size_t t = 0; t < tiles.size(); ++t) {
+		const Vector3 & kd = tiles[t].mat->getDiffuse();
+		float scale[3];
+		for(int j = 0; j < 3; ++j)
+			scale[j] = diffuse[j] > 0.0f ? kd[j] / diffuse[j] : 0.0f;
+		bake_tile(tiles[t], scale, &atlas[0], atlas_w, t % cols, t / cols);
+	}
+	string atlas_name = m_name + "#hlod#atlas";
+	Image *img = ImageManager::instance()->create(atlas_name, atlas_w, atlas_h, &atlas[0]);
+	Material *mat = MaterialManager::instance()->create("hlod", m_name);
+	mat->setDiffuse(diffuse);
+	mat->setSpecular(main_mat->getSpecular(), main_mat->getShininess());
+	mat->setTexture(TextureManager::instance()->create(atlas_name, img));
+
+	// Build the proxy meshes (in parallel)
+	vector<TriangleMesh *> proxies(m_clusters.size(), 0);
+	ThreadPool::instance()->parallelFor(m_clusters.size(), 1, [&](size_t begin, size_t end) {
+		for(size_t c = begin; c < end; ++c) {
+			if (!valid[c]) continue;
+			cluster_t & cluster = m_clusters[c];
+			// meshes of the members
+			vector<part_t> parts;
+			for(size_t m = 0; m < cluster.members.size(); ++m) {
+				const GObject *gobj = cluster.members[m].gobj;
+				const Trfm3D & T = cluster.members[m].T;
+				// errors are in object space
+				float scale = 0.0f;
+				for(int j = 0; j < 3; ++j) {
+					Vector3 axis(j == 0, j == 1, j == 2);
+					scale = std::max(scale, T.transformVector(axis).length());
+				}
+				for(size_t i = 0; i < gobj->size(); ++i) {
+					part_t part;
+					part.mesh = gobj->at(i);
+					part.T = &T;
+					part.scale = scale;
+					part.info = &meshes.find(part.mesh)->second;
+					parts.push_back(part);
+				}
+			}
+			// The errors of the proxy LODs. The texels of the atlas are bigger
+			// than the original ones, so the error of the proxy is never 0.
+			float min_error = 0.0f;
+			vector<float> part_errors;
+			for(size_t p = 0; p < parts.size(); ++p) {
+				const part_t & part = parts[p];
+				for(size_t l = 1; l < part.mesh->numLODs(); ++l)
+					part_errors.push_back(part.scale * part.mesh->lodError(l));
+				if (!part.info->solid)
+					min_error = std::max(min_error, part.scale * part.info->extent / (atlas_tile - 2 * atlas_pad));
+			}
+			std::sort(part_errors.begin(), part_errors.end());
+			vector<float> errors(1, min_error);
+			for(size_t e = 0; e < part_errors.size(); ++e)
+				if (part_errors[e] > errors.back() * hlod_error_step)
+					errors.push_back(part_errors[e]);
+			// proxy LOD k merges the coarsest LOD of every part with error
+			// below errors[k]
+			vector<TriangleMesh *> merged(errors.size());
+			for(size_t k = 0; k < errors.size(); ++k) {
+				merged[k] = new TriangleMesh();
+				merged[k]->m_type = TriangleMesh::texcoords;
+				merged[k]->assignMaterial(mat, mat);
+				for(size_t p = 0; p < parts.size(); ++p) {
+					const part_t & part = parts[p];
+					size_t l = 0;
+					while (l + 1 < part.mesh->numLODs() &&
+						   part.scale * part.mesh->lodError(l + 1) <= errors[k]) ++l;
+					size_t t = part.info->tile;
+					float tile[4] = {
+						(float) ((t % cols) * atlas_tile + atlas_pad) / atlas_w,
+						(float) ((t / cols) * atlas_tile + atlas_pad) / atlas_h,
+						(float) (atlas_tile - 2 * atlas_pad) / atlas_w,
+						(float) (atlas_tile - 2 * atlas_pad) / atlas_h };
+					append(merged[k], part.mesh->getLOD(l), *part.T, tile, part.info->solid);
+				}
+				merged[k]->m_nIndices = merged[k]->m_vIndices;
+				merged[k]->m_texIndices = merged[k]->m_vIndices;
+			}
+			// the members are now one mesh, which may simplify a bit further
+			TriangleMesh *coarsest = merged.back();
+			coarsest->buildLODs(2);
+			if (coarsest->m_lods.size()) {
+				merged.push_back(coarsest->m_lods[0]);
+				errors.push_back(errors.back() + coarsest->m_lodErrors[0]);
+				coarsest->m_lods.clear();
+				coarsest->m_lodErrors.clear();
+			}
+			TriangleMesh *proxy = merged[0];
+			proxy->m_lods.assign(merged.begin() + 1, merged.end());
+			proxy->m_lodErrors.assign(errors.begin() + 1, errors.end());
+			proxies[c] = proxy;
+			cluster.error = errors[0];
+		}
+	});
+
+	// Register the proxies
+	for(size_t c = 0; c < m_clusters.size(); ++c) {
+		if (!proxies[c]) continue;
+		char buf[32];
+		sprintf(buf, "#hlod#%zu", c);
+		m_clusters[c].proxy = GObjectManager::instance()->create(m_name + buf);
+		m_clusters[c].proxy->add(proxies[c]);
+	}
+}
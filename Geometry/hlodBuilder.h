@@ -0,0 +1,64 @@
+// -*-C++-*-
+#pragma once
+
+/**
+ * @brief Build HLOD (hierarchical level of detail) proxies
+ *
+ * A proxy is one geometry object which replaces a whole cluster of placed
+ * geometry objects when the cluster is far away, so that the cluster is
+ * drawn with a single draw call. LOD k of the proxy merges, for every
+ * member, its coarsest LOD (see TriangleMesh::buildLODs) whose error is
+ * below the error of LOD k. The coarsest LOD of the proxy is simplified once
+ * more as a whole.
+ *
+ * The proxies of a builder share one material, whose texture is an atlas
+ * baked from the textures and diffuse colors of the materials of the
+ * members.
+ *
+ * Note: clusters with transparent meshes, or whose members have no LODs,
+ * get no proxy. Members with LODs are indexed (see TriangleMesh::buildLODs).
+ */
+
+#include <string>
+#include <vector>
+#include "gObject.h"
+#include "trfm3D.h"
+
+class HLODBuilder {
+
+public:
+	HLODBuilder(const std::string & name);
+	~HLODBuilder();
+
+	size_t addCluster(); //!< Add an empty cluster. Return its index.
+
+	// Add 'gobj', placed by 'T' (relative to the proxy), to a cluster
+	void add(size_t cluster, const GObject *gobj, const Trfm3D *T);
+
+	// Build the atlas and the proxies of all clusters
+	void build();
+
+	GObject *getProxy(size_t cluster) const; //!< Proxy of cluster (0 if none)
+	float getError(size_t cluster) const; //!< Distance between the proxy and the members
+
+private:
+	HLODBuilder(const HLODBuilder &);
+	HLODBuilder & operator=(const HLODBuilder &);
+
+	static void append(TriangleMesh *dst, const TriangleMesh *mesh, const Trfm3D & T,
+					   const float tile[4], bool solid);
+
+	struct member_t {
+		const GObject *gobj;
+		Trfm3D T;
+	};
+
+	struct cluster_t {
+		std::vector<member_t> members;
+		GObject *proxy;
+		float error;
+	};
+
+	std::string m_name;
+	std::vector<cluster_t> m_clusters;
+};
@@ -0,0 +1,426 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "meshCache.h"
+#include "materialManager.h"
+#include "vcache.h"
+#include "glm.h"
+#include "tools.h"
+
+using std::vector;
+using std::list;
+using std::string;
+
+// Cache file layout:
+//
+// header: "VEVB", version (uint32), source hash (uint64), number of meshes
+//         (uint32), bounding box (6 floats)
+// mesh:   type (uint32), material, bounding box (6 floats), geometry, number
+//         of LODs (uint32, besides the mesh itself) and, for each LOD, its
+//         error (float) and geometry, then the BVH of the mesh: number of
+//         nodes (uint32), the nodes (BVHNode) and, if there are nodes, the
+//         triangle order (uint32, one per triangle)
+// geometry: number of vertices and triangles (uint32), vertex positions,
+//         normals, tex. coords (if type & texcoords), tangents and
+//         bitangents (if type & bump), triangle indices (uint32), number of
+//         clusters (uint32) and, for each cluster, its first triangle and
+//         number of triangles (uint32) and bounds (8 floats)
+// material: library, name, texture map, bump map (strings), diffuse (4
+//         floats), specular (4 floats), shininess (float). An empty library
+//         means the default material.
+// string: length (uint32) followed by the characters
+//
+// Meshes are always indexed, so all the attributes have one entry per vertex.
+
+static const char cache_magic[4] = { 'V', 'E', 'V', 'B' };
+static const uint32_t cache_version = 4;
+
+// FNV-1a hash
+static uint64_t hash_bytes(uint64_t h, const char *data, size_t n) {
+	for(size_t i = 0; i < n; ++i) {
+		h ^= (unsigned char) data[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static bool read_file(const string & fname, vector<char> & content) {
+	FILE *fh = fopen(fname.c_str(), "rb");
+	if (!fh) return false;
+	char buf[65536];
+	size_t n;
+	content.clear();
+	while((n = fread(buf, 1, sizeof(buf), fh)) > 0)
+		content.insert(content.end(), buf, buf + n);
+	fclose(fh);
+	return true;
+}
+
+string MeshCache::filename(const string & DirName, const string & FileName) {
+	return getFilename(DirName, FileName) + ".vbk";
+}
+
+uint64_t MeshCache::sourceHash(const string & DirName, const string & FileName) {
+	vector<char> obj;
+	if (!read_file(getFilename(DirName, FileName), obj)) return 0;
+	uint64_t h = hash_bytes(0xcbf29ce484222325ULL, obj.size() ? &obj[0] : 0, obj.size());
+	// hash material libraries too ("mtllib name" lines)
+	obj.push_back('\0');
+	for(const char *line = &obj[0]; *line; ) {
+		const char *end = strchr(line, '\n');
+		if (!end) end = line + strlen(line);
+		while (line < end && (*line == ' ' || *line == '\t')) ++line;
+		char lib[256];
+		if (!strncmp(line, "mtllib", 6) && sscanf(line + 6, " %255s", lib) == 1) {
+			vector<char> mtl;
+			h = hash_bytes(h, lib, strlen(lib));
+			if (read_file(getFilename(DirName, lib), mtl) && mtl.size())
+				h = hash_bytes(h, &mtl[0], mtl.size());
+		}
+		line = *end ? end + 1 : end;
+	}
+	return h ? h : 1; // 0 means "no source"
+}
+
+// Read the header of a cache file. Return the source hash (0 if not a valid
+// cache file)
+static uint64_t read_header(FILE *fh, uint32_t & meshes_n, BBox & box) {
+	char magic[4];
+	uint32_t version;
+	uint64_t hash;
+	float coords[6];
+	if (fread(magic, sizeof(magic), 1, fh) != 1 ||
+		memcmp(magic, cache_magic, sizeof(magic)) ||
+		fread(&version, sizeof(version), 1, fh) != 1 ||
+		version != cache_version ||
+		fread(&hash, sizeof(hash), 1, fh) != 1 ||
+		fread(&meshes_n, sizeof(meshes_n), 1, fh) != 1 ||
+		fread(coords, sizeof(coords), 1, fh) != 1)
+		return 0;
+	box = BBox(Vector3(coords[0], coords[1], coords[2]),
+			   Vector3(coords[3], coords[4], coords[5]));
+	return hash;
+}
+
+bool MeshCache::upToDate(const string & DirName, const string & FileName) {
+	FILE *fh = fopen(filename(DirName, FileName).c_str(), "rb");
+	if (!fh) return false;
+	uint32_t meshes_n;
+	BBox box;
+	uint64_t hash = read_header(fh, meshes_n, box);
+	fclose(fh);
+	return hash && hash == sourceHash(DirName, FileName);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Bake
+
+static void put_string(FILE *fh, const char *str) {
+	uint32_t n = str ? strlen(str) : 0;
+	fwrite(&n, sizeof(n), 1, fh);
+	fwrite(str, 1, n, fh);
+}
+
+static void put_floats(FILE *fh, const vector<float> & v) {
+	if (v.size()) fwrite(&v[0], sizeof(float), v.size(), fh);
+}
+
+static void put_bbox(FILE *fh, const BBox & box) {
+	float coords[6] = { box.m_min[0], box.m_min[1], box.m_min[2],
+						box.m_max[0], box.m_max[1], box.m_max[2] };
+	fwrite(coords, sizeof(coords), 1, fh);
+}
+
+void MeshCache::writeGeometry(FILE *fh, const TriangleMesh *mesh) {
+	uint32_t counts[2] = { (uint32_t) mesh->numVertices(), (uint32_t) mesh->numTriangles() };
+	fwrite(counts, sizeof(counts), 1, fh);
+	put_floats(fh, mesh->m_vCoords);
+	put_floats(fh, mesh->m_nCoords);
+	if (mesh->m_type & TriangleMesh::texcoords)
+		put_floats(fh, mesh->m_texCoords);
+	if (mesh->m_type & TriangleMesh::bump) {
+		put_floats(fh, mesh->m_tgtCoords);
+		put_floats(fh, mesh->m_btgtCoords);
+	}
+	if (mesh->m_vIndices.size())
+		fwrite(&mesh->m_vIndices[0], sizeof(int), mesh->m_vIndices.size(), fh);
+	uint32_t clusters_n = mesh->numClusters();
+	fwrite(&clusters_n, sizeof(clusters_n), 1, fh);
+	for(size_t i = 0; i < clusters_n; ++i) {
+		const TriangleMesh::cluster_t & cluster = mesh->m_clusters[i];
+		uint32_t range[2] = { (uint32_t) cluster.first, (uint32_t) cluster.count };
+		fwrite(range, sizeof(range), 1, fh);
+		fwrite(cluster.bounds, sizeof(cluster.bounds), 1, fh);
+	}
+}
+
+bool MeshCache::bake(const string & DirName, const string & FileName, stats_t *stats) {
+
+	string obj_fullname = getFilename(DirName, FileName);
+	uint64_t hash = sourceHash(DirName, FileName);
+	if (!hash) {
+		fprintf(stderr, "[E] MeshCache::bake: can't read %s\n", obj_fullname.c_str());
+		return false;
+	}
+	stats_t st;
+	memset(&st, 0, sizeof(st));
+
+	// process meshes
+	GLMmodel *m = glmReadOBJ(obj_fullname.c_str());
+	vector<TriangleMesh *> meshes;
+	vector<GLMmaterial *> materials;
+	BBox box;
+	for(GLMgroup *g = m->groups; g; g = g->next) {
+		if (!g->numtriangles) continue;
+		GLMmaterial *mat = g->material ? &(m->materials[g->material]) : 0;
+		TriangleMesh *mesh = new TriangleMesh(g->numtriangles, g->triangles, m,
+											  mat && mat->bumpmap);
+		mesh->weld();
+		if (mesh->m_type & TriangleMesh::bump)
+			mesh->tangentTMesh(); // TBN of welded mesh
+		mesh->setIndexed();
+		st.corners += mesh->m_vIndices.size();
+		st.acmr_before += mesh->numTriangles() *
+			vertexCacheMissRatio(&mesh->m_vIndices[0], mesh->numTriangles(), mesh->numVertices(), 16);
+		mesh->optimizeVertexCache();
+		mesh->buildLODs();
+		mesh->buildClusters(); // reorders LOD 0 (for the vertex cache too)
+		mesh->buildBVH(); // of the final triangle order
+		st.acmr_after += mesh->numTriangles() *
+			vertexCacheMissRatio(&mesh->m_vIndices[0], mesh->numTriangles(), mesh->numVertices(), 16);
+		st.triangles += mesh->numTriangles();
+		st.vertices += mesh->numVertices();
+		st.lods += mesh->numLODs() - 1;
+		st.clusters += mesh->numClusters();
+		mesh->includeBBox(box);
+		meshes.push_back(mesh);
+		materials.push_back(mat);
+	}
+	st.meshes = meshes.size();
+	if (st.triangles) {
+		st.acmr_before /= st.triangles;
+		st.acmr_after /= st.triangles;
+	}
+
+	// write them to a temporary file, and replace the cache file when done
+	string fname = filename(DirName, FileName);
+	string tmpname = fname + ".tmp";
+	FILE *fh = fopen(tmpname.c_str(), "wb");
+	bool ok = fh != 0;
+	if (!fh) {
+		fprintf(stderr, "[E] MeshCache::bake: can't write %s\n", tmpname.c_str());
+	} else {
+		uint32_t meshes_n = meshes.size();
+		fwrite(cache_magic, sizeof(cache_magic), 1, fh);
+		fwrite(&cache_version, sizeof(cache_version), 1, fh);
+		fwrite(&hash, sizeof(hash), 1, fh);
+		fwrite(&meshes_n, sizeof(meshes_n), 1, fh);
+		put_bbox(fh, box);
+		for(size_t i = 0; i < meshes.size(); ++i) {
+			TriangleMesh *mesh = meshes[i];
+			GLMmaterial *mat = materials[i];
+			uint32_t type = mesh->m_type;
+			fwrite(&type, sizeof(type), 1, fh);
+			put_string(fh, mat ? m->mtllibname : 0);
+			put_string(fh, mat ? mat->name : 0);
+			put_string(fh, mat ? mat->texturemap : 0);
+			put_string(fh, mat ? mat->bumpmap : 0);
+			GLMmaterial nomat;
+			if (!mat) {
+				memset(&nomat, 0, sizeof(nomat));
+				mat = &nomat;
+			}
+			fwrite(mat->diffuse, sizeof(mat->diffuse), 1, fh);
+			fwrite(mat->specular, sizeof(mat->specular), 1, fh);
+			fwrite(&mat->shininess, sizeof(mat->shininess), 1, fh);
+			BBox mesh_box;
+			mesh->includeBBox(mesh_box);
+			put_bbox(fh, mesh_box);
+			writeGeometry(fh, mesh);
+			uint32_t lods_n = mesh->numLODs() - 1;
+			fwrite(&lods_n, sizeof(lods_n), 1, fh);
+			for(size_t lod = 1; lod <= lods_n; ++lod) {
+				float error = mesh->lodError(lod);
+				fwrite(&error, sizeof(error), 1, fh);
+				writeGeometry(fh, mesh->getLOD(lod));
+			}
+			uint32_t nodes_n = mesh->numBVHNodes();
+			fwrite(&nodes_n, sizeof(nodes_n), 1, fh);
+			if (nodes_n) {
+				fwrite(&mesh->m_bvh[0], sizeof(BVHNode), nodes_n, fh);
+				fwrite(&mesh->m_bvhOrder[0], sizeof(int), mesh->m_bvhOrder.size(), fh);
+			}
+		}
+		ok = !ferror(fh);
+		ok = !fclose(fh) && ok;
+		if (!ok || rename(tmpname.c_str(), fname.c_str())) {
+			fprintf(stderr, "[E] MeshCache::bake: can't write %s\n", fname.c_str());
+			remove(tmpname.c_str());
+			ok = false;
+		}
+	}
+
+	for(size_t i = 0; i < meshes.size(); ++i)
+		delete meshes[i];
+	glmDelete(m);
+	if (stats) *stats = st;
+	return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Read
+
+static bool get_string(FILE *fh, string & str) {
+	uint32_t n;
+	if (fread(&n, sizeof(n), 1, fh) != 1) return false;
+	str.resize(n);
+	return !n || fread(&str[0], 1, n, fh) == n;
+}
+
+static bool get_floats(FILE *fh, vector<float> & v, size_t n) {
+	vector<float>(n).swap(v);
+	return !n || fread(&v[0], sizeof(float), n, fh) == n;
+}
+
+TriangleMesh *MeshCache::readGeometry(FILE *fh, uint32_t type) {
+	uint32_t counts[2];
+	if (fread(counts, sizeof(counts), 1, fh) != 1)
+		return 0;
+	TriangleMesh *mesh = new TriangleMesh();
+	size_t vertex_n = counts[0];
+	size_t corners_n = 3 * (size_t) counts[1];
+	mesh->m_type = static_cast<TriangleMesh::type_t>(type);
+	bool ok = get_floats(fh, mesh->m_vCoords, 3 * vertex_n) &&
+		get_floats(fh, mesh->m_nCoords, 3 * vertex_n);
+	if (ok && (type & TriangleMesh::texcoords))
+		ok = get_floats(fh, mesh->m_texCoords, 2 * vertex_n);
+	if (ok && (type & TriangleMesh::bump))
+		ok = get_floats(fh, mesh->m_tgtCoords, 3 * vertex_n) &&
+			get_floats(fh, mesh->m_btgtCoords, 3 * vertex_n);
+	vector<int>(corners_n).swap(mesh->m_vIndices);
+	if (ok && corners_n)
+		ok = fread(&mesh->m_vIndices[0], sizeof(int), corners_n, fh) == corners_n;
+	for(size_t i = 0; ok && i < corners_n; ++i)
+		ok = mesh->m_vIndices[i] >= 0 && (size_t) mesh->m_vIndices[i] < vertex_n;
+	uint32_t clusters_n = 0;
+	ok = ok && fread(&clusters_n, sizeof(clusters_n), 1, fh) == 1;
+	// clusters must cover the triangles, in order
+	uint32_t first = 0;
+	for(uint32_t i = 0; ok && i < clusters_n; ++i) {
+		uint32_t range[2];
+		TriangleMesh::cluster_t cluster;
+		ok = fread(range, sizeof(range), 1, fh) == 1 &&
+			fread(cluster.bounds, sizeof(cluster.bounds), 1, fh) == 1 &&
+			range[0] == first && range[1] > 0 && range[1] <= counts[1] - first;
+		if (ok) {
+			cluster.first = range[0];
+			cluster.count = range[1];
+			mesh->m_clusters.push_back(cluster);
+			first += range[1];
+		}
+	}
+	ok = ok && (!clusters_n || first == counts[1]);
+	if (!ok) {
+		delete mesh;
+		return 0;
+	}
+	mesh->m_nIndices = mesh->m_vIndices;
+	if (type & TriangleMesh::texcoords)
+		mesh->m_texIndices = mesh->m_vIndices;
+	if (type & TriangleMesh::bump) {
+		mesh->m_tgtIndices = mesh->m_vIndices;
+		mesh->m_btgtIndices = mesh->m_vIndices;
+	}
+	mesh->m_vbo_uptodate = 0;
+	return mesh;
+}
+
+// Read the BVH of a mesh (see bvhValid)
+
+bool MeshCache::readBVH(FILE *fh, TriangleMesh *mesh) {
+	uint32_t nodes_n;
+	size_t tris_n = mesh->numTriangles();
+	if (fread(&nodes_n, sizeof(nodes_n), 1, fh) != 1) return false;
+	if (!nodes_n) return true;
+	if (!tris_n || nodes_n > 2 * tris_n - 1) return false;
+	vector<BVHNode>(nodes_n).swap(mesh->m_bvh);
+	vector<int>(tris_n).swap(mesh->m_bvhOrder);
+	return fread(&mesh->m_bvh[0], sizeof(BVHNode), nodes_n, fh) == nodes_n &&
+		fread(&mesh->m_bvhOrder[0], sizeof(int), tris_n, fh) == tris_n &&
+		bvhValid(&mesh->m_bvh[0], nodes_n, &mesh->m_bvhOrder[0], tris_n);
+}
+
+TriangleMesh *MeshCache::readMesh(FILE *fh, const string & DirName) {
+	uint32_t type;
+	string lib, name, texturemap, bumpmap;
+	GLMmaterial mat;
+	float coords[6];
+	uint32_t lods_n;
+	memset(&mat, 0, sizeof(mat));
+	if (fread(&type, sizeof(type), 1, fh) != 1 ||
+		!get_string(fh, lib) || !get_string(fh, name) ||
+		!get_string(fh, texturemap) || !get_string(fh, bumpmap) ||
+		fread(mat.diffuse, sizeof(mat.diffuse), 1, fh) != 1 ||
+		fread(mat.specular, sizeof(mat.specular), 1, fh) != 1 ||
+		fread(&mat.shininess, sizeof(mat.shininess), 1, fh) != 1 ||
+		fread(coords, sizeof(coords), 1, fh) != 1)
+		return 0;
+	TriangleMesh *mesh = readGeometry(fh, type);
+	if (!mesh) return 0;
+	bool ok = fread(&lods_n, sizeof(lods_n), 1, fh) == 1;
+	for(uint32_t i = 0; ok && i < lods_n; ++i) {
+		float error;
+		TriangleMesh *lod = 0;
+		ok = fread(&error, sizeof(error), 1, fh) == 1 &&
+			(lod = readGeometry(fh, type)) != 0;
+		if (ok) {
+			mesh->m_lods.push_back(lod);
+			mesh->m_lodErrors.push_back(error);
+		}
+	}
+	ok = ok && readBVH(fh, mesh);
+	if (!ok) {
+		delete mesh;
+		return 0;
+	}
+	// material (of the mesh and its LODs)
+	if (lib.size()) {
+		mat.name = &name[0];
+		mat.texturemap = texturemap.size() ? &texturemap[0] : 0;
+		mat.bumpmap = bumpmap.size() ? &bumpmap[0] : 0;
+		Material *material = TriangleMesh::createMaterial(&mat, DirName, lib);
+		mesh->assignMaterial(material, material);
+	}
+	return mesh;
+}
+
+bool MeshCache::read(const string & DirName, const string & FileName,
+					 list<TriangleMesh *> & l, BBox & box) {
+	string fname = filename(DirName, FileName);
+	FILE *fh = fopen(fname.c_str(), "rb");
+	if (!fh) return false;
+	uint32_t meshes_n;
+	uint64_t hash = read_header(fh, meshes_n, box);
+	uint64_t source = sourceHash(DirName, FileName);
+	if (!hash || (source && source != hash)) {
+		fprintf(stderr, "[W] ignoring outdated cache file %s\n", fname.c_str());
+		fclose(fh);
+		return false;
+	}
+	list<TriangleMesh *> meshes;
+	for(uint32_t i = 0; i < meshes_n; ++i) {
+		TriangleMesh *mesh = readMesh(fh, DirName);
+		if (!mesh) {
+			fprintf(stderr, "[W] ignoring corrupt cache file %s\n", fname.c_str());
+			for(list<TriangleMesh *>::iterator it = meshes.begin(), end = meshes.end();
+				it != end; ++it)
+				delete *it;
+			fclose(fh);
+			return false;
+		}
+		meshes.push_back(mesh);
+	}
+	fclose(fh);
+	l.splice(l.end(), meshes);
+	return true;
+}
@@ -0,0 +1,80 @@
+// -*-C++-*-
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <list>
+#include <stdint.h>
+#include "bbox.h"
+#include "triangleMesh.h"
+
+/**
+ * @brief Binary cache of baked (preprocessed) wavefront files
+ *
+ * Baking a wavefront file ("obj/cubes/cubo.obj") reads it, welds, indexes
+ * and reorders the meshes for the vertex cache, generates tangents, bounds,
+ * LODs, clusters and BVHs, and writes the result to a cache file next to it
+ * ("obj/cubes/cubo.obj.vbk"). Loading a baked file just reads the arrays
+ * back, so no mesh processing is done at startup.
+ *
+ * Cache files store a content hash of the wavefront file and of its material
+ * libraries. A cache file is stale (and ignored) when its source changes. If
+ * the source is missing, the cache file is always used, so that deployments
+ * can ship baked files only.
+ *
+ * Note: cache files are written in host byte order.
+ *
+ * Baking does not need an OpenGL context and can be run from any thread.
+ */
+
+class MeshCache {
+
+public:
+
+	struct stats_t {
+		size_t meshes;     // number of meshes
+		size_t triangles;  // number of triangles
+		size_t corners;    // number of triangle corners (vertices before indexing)
+		size_t vertices;   // number of vertices after indexing
+		size_t lods;       // number of LODs (besides the meshes themselves)
+		size_t clusters;   // number of clusters (see TriangleMesh::buildClusters)
+		float acmr_before; // average cache miss ratio before optimization
+		float acmr_after;  // average cache miss ratio after optimization
+	};
+
+	// Name of the cache file of a wavefront file
+	static std::string filename(const std::string & DirName, const std::string & FileName);
+
+	// Content hash of a wavefront file and its material libraries (0 if the
+	// file does not exist)
+	static uint64_t sourceHash(const std::string & DirName, const std::string & FileName);
+
+	// Whether the cache file of a wavefront file exists and is up-to-date
+	static bool upToDate(const std::string & DirName, const std::string & FileName);
+
+	/**
+	 * Bake a wavefront file and write its cache file.
+	 *
+	 * @return false if the cache file could not be written
+	 */
+	static bool bake(const std::string & DirName, const std::string & FileName,
+					 stats_t *stats = 0);
+
+	/**
+	 * Read the meshes of a wavefront file from its cache file. Materials (and
+	 * textures) are created as when reading the wavefront file.
+	 *
+	 * Leave the meshes in list 'l' and their bounding box in 'box'
+	 *
+	 * @return false if there is no valid, up-to-date cache file
+	 */
+	static bool read(const std::string & DirName, const std::string & FileName,
+					 std::list<TriangleMesh *> & l, BBox & box);
+
+private:
+	static void writeGeometry(FILE *fh, const TriangleMesh *mesh);
+	static TriangleMesh *readGeometry(FILE *fh, uint32_t type);
+	static bool readBVH(FILE *fh, TriangleMesh *mesh);
+	static TriangleMesh *readMesh(FILE *fh, const std::string & DirName);
+};
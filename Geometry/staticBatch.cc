@@ -0,0 +1,183 @@
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include "staticBatch.h"
+#include "gObjectManager.h"
+#include "renderState.h"
+#include "threadPool.h"
+
+using std::vector;
+using std::map;
+using std::pair;
+using std::make_pair;
+using std::string;
+
+// bytes of a VBO vertex (see TriangleMeshGL)
+static const size_t vbo_vertex_bytes = 14 * sizeof(float);
+
+// how an attribute is transformed
+enum coords_t { coords_point, coords_vector, coords_plain };
+
+// Append the coordinates of an attribute (transformed by T) and its indices
+// (offset by the coordinates already in dst)
+
+static void append_attrib(vector<float> & dstCoords, vector<int> & dstIndices,
+						  const vector<float> & coords, const vector<int> & indices,
+						  int dim, const Trfm3D & T, coords_t kind) {
+	size_t offset = dstCoords.size();
+	dstCoords.insert(dstCoords.end(), coords.begin(), coords.end());
+	size_t n = coords.size() / dim;
+	if (n && kind != coords_plain) {
+		float *V = &dstCoords[offset];
+		if (kind == coords_point) T.transformPoints(V, V, n);
+		else {
+			T.transformNormals(V, V, n);
+			for(size_t i = 0; i < n; ++i, V += 3) {
+				Vector3 N(V);
+				N.normalize();
+				V[0] = N[0];
+				V[1] = N[1];
+				V[2] = N[2];
+			}
+		}
+	}
+	for(size_t i = 0; i < indices.size(); ++i)
+		dstIndices.push_back(offset / dim + indices[i]);
+}
+
+StaticBatch::StaticBatch(const string & name, float chunkSize) :
+	m_name(name),
+	m_chunkSize(chunkSize) {
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+StaticBatch::~StaticBatch() {}
+
+void StaticBatch::add(const GObject *gobj, const Trfm3D & T) {
+	member_t member;
+	member.gobj = gobj;
+	member.T.clone(T);
+	m_members.push_back(member);
+}
+
+// Normals, tangents and bitangents are transformed as normals (placements
+// are rotations, translations and uniform scales).
+
+void StaticBatch::append(TriangleMesh *dst, const TriangleMesh *mesh, const Trfm3D & T) {
+	append_attrib(dst->m_vCoords, dst->m_vIndices, mesh->m_vCoords, mesh->m_vIndices,
+				  3, T, coords_point);
+	append_attrib(dst->m_nCoords, dst->m_nIndices, mesh->m_nCoords, mesh->m_nIndices,
+				  3, T, coords_vector);
+	append_attrib(dst->m_texCoords, dst->m_texIndices, mesh->m_texCoords, mesh->m_texIndices,
+				  2, T, coords_plain);
+	append_attrib(dst->m_tgtCoords, dst->m_tgtIndices, mesh->m_tgtCoords, mesh->m_tgtIndices,
+				  3, T, coords_vector);
+	append_attrib(dst->m_btgtCoords, dst->m_btgtIndices, mesh->m_btgtCoords, mesh->m_btgtIndices,
+				  3, T, coords_vector);
+}
+
+size_t StaticBatch::gpuBytes(const TriangleMesh *mesh) {
+	size_t corners_n = mesh->m_vIndices.size();
+	if (mesh->isIndexed())
+		return mesh->numVertices() * vbo_vertex_bytes + corners_n * sizeof(GLuint);
+	return corners_n * vbo_vertex_bytes;
+}
+
+void StaticBatch::build() {
+
+	// Group the meshes by chunk and by material (and attributes in use)
+	typedef pair<pair<const Material *, const Material *>, int> mesh_key_t;
+	typedef pair<int, int> chunk_key_t;
+	map<chunk_key_t, map<mesh_key_t, vector<pair<const TriangleMesh *, const Trfm3D *> > > > chunks;
+	map<const TriangleMesh *, bool> sources;
+	for(size_t m = 0; m < m_members.size(); ++m) {
+		const GObject *gobj = m_members[m].gobj;
+		const Trfm3D & T = m_members[m].T;
+		BBox box;
+		for(size_t i = 0; i < gobj->size(); ++i)
+			gobj->at(i)->includeBBox(box);
+		if (!gobj->size()) continue;
+		Vector3 C = T.transformPoint(0.5f * (box.m_min + box.m_max));
+		chunk_key_t cell((int) floorf(C[0] / m_chunkSize), (int) floorf(C[2] / m_chunkSize));
+		for(size_t i = 0; i < gobj->size(); ++i) {
+			const TriangleMesh *mesh = gobj->at(i);
+			if (!mesh->numTriangles()) continue;
+			int attribs = (mesh->m_nIndices.size() ? 1 : 0) |
+				(mesh->m_texIndices.size() ? 2 : 0) |
+				(mesh->m_tgtIndices.size() ? 4 : 0) |
+				(mesh->m_btgtIndices.size() ? 8 : 0);
+			mesh_key_t key(make_pair(mesh->getMaterial(true), mesh->getMaterial(false)), attribs);
+			chunks[cell][key].push_back(make_pair(mesh, &T));
+			if (!sources[mesh]) {
+				sources[mesh] = true;
+				m_stats.sourceBytes += gpuBytes(mesh);
+			}
+			++m_stats.sources;
+		}
+		++m_stats.objects;
+	}
+
+	// Merge every group into one mesh (in parallel)
+	typedef vector<pair<const TriangleMesh *, const Trfm3D *> > group_t;
+	vector<const group_t *> groups;
+	vector<TriangleMesh *> merged;
+	vector<size_t> chunk_of; // chunk of every group
+	for(map<chunk_key_t, map<mesh_key_t, group_t> >::const_iterator it = chunks.begin(),
+			end = chunks.end(); it != end; ++it) {
+		for(map<mesh_key_t, group_t>::const_iterator git = it->second.begin(),
+				gend = it->second.end(); git != gend; ++git) {
+			const TriangleMesh *first = git->second.front().first;
+			TriangleMesh *mesh = new TriangleMesh();
+			mesh->m_type = first->m_type;
+			mesh->assignMaterial(first->m_materialFront, first->m_materialBack);
+			groups.push_back(&git->second);
+			merged.push_back(mesh);
+			chunk_of.push_back(m_chunks.size());
+		}
+		char buf[64];
+		sprintf(buf, "#batch#%d#%d", it->first.first, it->first.second);
+		m_chunks.push_back(GObjectManager::instance()->create(m_name + buf));
+	}
+	ThreadPool::instance()->parallelFor(groups.size(), 1, [&](size_t begin, size_t end) {
+		for(size_t g = begin; g < end; ++g) {
+			const group_t & group = *groups[g];
+			TriangleMesh *mesh = merged[g];
+			for(size_t i = 0; i < group.size(); ++i)
+				append(mesh, group[i].first, *group[i].second);
+			mesh->setIndexed();
+			mesh->optimizeVertexCache();
+			mesh->buildClusters();
+			mesh->m_vbo_uptodate = 0;
+		}
+	});
+	for(size_t g = 0; g < merged.size(); ++g) {
+		m_chunks[chunk_of[g]]->add(merged[g]);
+		m_stats.triangles += merged[g]->numTriangles();
+		m_stats.bytes += gpuBytes(merged[g]);
+	}
+	m_stats.chunks = m_chunks.size();
+	m_stats.meshes = merged.size();
+	m_members.clear();
+}
+
+void StaticBatch::draw(const Trfm3D *T) {
+	RenderState *rs = RenderState::instance();
+	Camera *cam = rs->getCamera();
+	BBox box;
+	rs->push(RenderState::modelview);
+	rs->addTrfm(RenderState::modelview, T);
+	rs->loadTrfm(RenderState::model, T);
+	for(size_t i = 0; i < m_chunks.size(); ++i) {
+		GObject *chunk = m_chunks[i];
+		if (cam) {
+			box.clone(chunk->getContainer());
+			box.transform(T);
+			if (cam->checkFrustum(&box, 0) == 1) continue; // outside
+		}
+		chunk->draw(0);
+	}
+	rs->pop(RenderState::modelview);
+}
+
+const StaticBatch::stats_t & StaticBatch::getStats() const { return m_stats; }
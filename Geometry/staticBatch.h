@@ -0,0 +1,72 @@
+// -*-C++-*-
+#pragma once
+
+/**
+ * @brief Static batches of placed geometry objects
+ *
+ * A static batch merges the meshes of many placed geometry objects into a
+ * few big meshes, so that a static part of the scene is drawn with a few
+ * draw calls. Meshes are pre-transformed by their placement, and merged by
+ * material, in chunks of chunkSize x chunkSize (in the XZ plane) which are
+ * frustum culled one by one. Merged meshes are indexed, optimized for the
+ * vertex cache and split in clusters (see TriangleMesh::buildClusters).
+ *
+ * The tradeoff is memory: every placement of an object gets its own copy of
+ * the vertices, and LODs are not kept (merged meshes are full detail).
+ */
+
+#include <string>
+#include <vector>
+#include "gObject.h"
+#include "trfm3D.h"
+
+class StaticBatch {
+
+public:
+
+	struct stats_t {
+		size_t objects;     // placed geometry objects
+		size_t sources;     // placed meshes (draw calls without the batch)
+		size_t chunks;      // number of chunks
+		size_t meshes;      // merged meshes (draw calls if all chunks are visible)
+		size_t triangles;   // number of triangles
+		size_t bytes;       // GPU memory of the merged meshes (VBO + IBO)
+		size_t sourceBytes; // GPU memory of the (distinct) source meshes
+	};
+
+	StaticBatch(const std::string & name, float chunkSize);
+	~StaticBatch();
+
+	// Add 'gobj', placed by 'T' (relative to the batch)
+	void add(const GObject *gobj, const Trfm3D & T);
+
+	// Merge the meshes of all objects
+	void build();
+
+	/**
+	 * Draw the chunks inside the frustum of the current camera
+	 *
+	 * @param T placement of the batch (local to world)
+	 */
+	void draw(const Trfm3D *T);
+
+	const stats_t & getStats() const;
+
+private:
+	StaticBatch(const StaticBatch &);
+	StaticBatch & operator=(const StaticBatch &);
+
+	static void append(TriangleMesh *dst, const TriangleMesh *mesh, const Trfm3D & T);
+	static size_t gpuBytes(const TriangleMesh *mesh);
+
+	struct member_t {
+		const GObject *gobj;
+		Trfm3D T;
+	};
+
+	std::string m_name;
+	float m_chunkSize;
+	std::vector<member_t> m_members;
+	std::vector<GObject *> m_chunks; // (owned by GObjectManager)
+	stats_t m_stats;
+};
@@ -7,10 +7,17 @@
 #include <algorithm>
 #include <cstdio>
 #include <cmath>
-#include <map>
+#include <cfloat>
+#include <stdint.h>
 #include "triangleMesh.h"
 #include "glm.h"
+#include "weld.h"
+#include "vcache.h"
+#include "simplify.h"
+#include "cluster.h"
 #include "tools.h"
+#include "constants.h"
+#include "threadPool.h"
 #include "materialManager.h"
 #include "textureManager.h"
 
@@ -21,7 +28,6 @@
 
 using std::vector;
 using std::list;
-using std::map;
 using std::pair;
 using std::string;
 
@@ -36,31 +42,6 @@ static void tangentTriangle(const float v0[3], const float v1[3], const float v2
 							const float uv0[2], const float uv1[2], const float uv2[2],
 							Vector3 & T, Vector3 & B, Vector3 & N);
 
-// semantics of strcmp. 0 if equal.
-
-static int cmp_3f(const float *V1,
-				  const float *V2) {
-
-	float aux;
-	aux = V1[0] - V2[0];
-	if (!distance_is_zero(aux)) return aux > 0 ? 1 : -1;
-	aux = V1[1] - V2[1];
-	if (!distance_is_zero(aux)) return aux > 0 ? 1 : -1;
-	aux = V1[2] - V2[2];
-	if (!distance_is_zero(aux)) return aux > 0 ? 1 : -1;
-	return 0;
-}
-
-static int cmp_2f(const float *V1,
-				  const float *V2) {
-	float aux;
-	aux = V1[0] - V2[0];
-	if (!distance_is_zero(aux)) return aux > 0 ? 1 : -1;
-	aux = V1[1] - V2[1];
-	if (!distance_is_zero(aux)) return aux > 0 ? 1 : -1;
-	return 0;
-}
-
 TriangleMesh::TriangleMesh() :
 	m_type(trm),
 	m_materialFront(MaterialManager::instance()->getDefault()),
@@ -68,12 +49,16 @@ TriangleMesh::TriangleMesh() :
 	m_hasTex(false), m_isTransp(false),
 	m_vbo_uptodate(true),
 	m_vbo_id(0),
+	m_ibo_id(0),
 	m_vao_id(0) {}
 
 TriangleMesh::~TriangleMesh() {
+	clearLODs();
 	// reclaim openGL buffers
 	if (m_vbo_id)
 		glDeleteBuffers(1, &m_vbo_id);
+	if (m_ibo_id)
+		glDeleteBuffers(1, &m_ibo_id);
 	if (m_vao_id)
 		glDeleteVertexArrays(1, &m_vao_id);
 }
@@ -81,6 +66,8 @@ TriangleMesh::~TriangleMesh() {
 void TriangleMesh::assignMaterial(Material *front, Material *back) {
 	m_materialFront = front;
 	m_materialBack = back;
+	for(size_t i = 0; i < m_lods.size(); ++i)
+		m_lods[i]->assignMaterial(front, back);
 }
 
 int TriangleMesh::addPoint(const Vector3 & P) {
@@ -215,23 +202,11 @@ size_t TriangleMesh::numBitangents() const { return m_btgtCoords.size() / 3; } /
 
 // Construct tmesh from glm struct
 
-struct tmesh_vcoords3_sort_t {
-	tmesh_vcoords3_sort_t(const float *vertices) : V(vertices) {};
-	bool operator() (int i, int j) {
-		int aux = cmp_3f(&V[ 3*i ], &V[ 3*j ]);
-		return aux < 0;
-	}
-	const float *V;
-};
-
-struct tmesh_vcoords2_sort_t {
-	tmesh_vcoords2_sort_t(const float *vertices) : V(vertices) {};
-	bool operator() (int i, int j) {
-		int aux = cmp_2f(&V[ 2*i ], &V[ 2*j] );
-		return aux < 0;
-	}
-	const float *V;
-};
+// Weld coordinates (2D or 3D) closer than Constants::distance_epsilon, leaving
+// the unique coordinates in new_vertices and the mapping old->new in idxmap.
+//
+// Uses a spatial hash (see weld.h), so it is linear in the number of vertices.
+// The result is deterministic for a given input order.
 
 static void copy_unique_coords_fast(const float * vertices,
 									int numvertices, int s,
@@ -239,34 +214,11 @@ static void copy_unique_coords_fast(const float * vertices,
 									vector<int> & idxmap) {
 	assert(s == 2 || s == 3);
 	if(!numvertices) return;
-	vector<int>(numvertices, -1).swap(idxmap);
-	vector<int> newIdx(numvertices);
-	for(int i = 0; i < numvertices; i++) newIdx[i] = i;
-	if (s == 2) {
-		sort(newIdx.begin(), newIdx.end(), tmesh_vcoords2_sort_t(vertices));
-	} else {
-		sort(newIdx.begin(), newIdx.end(), tmesh_vcoords3_sort_t(vertices));
-	}
-
-	const float *last_vertex = &vertices[newIdx[0] * s];
-	// insert first vertex
-	int last_index = 0;
-	for(int c = 0; c < s; ++c) {
-		new_vertices.push_back(*(last_vertex + c));
-	}
-	idxmap[ newIdx[0] ] = last_index;
-	for(int i = 1; i < numvertices; i++) {
-		const float *cur_vertex = &vertices[ newIdx[i] * s ];
-		int cmp = (s == 2) ? cmp_2f(cur_vertex, last_vertex) : cmp_3f(cur_vertex, last_vertex);
-		if(cmp) {
-			last_index++;
-			for(int c = 0; c < s; ++c) {
-				new_vertices.push_back(*(cur_vertex + c));
-			}
-			last_vertex = cur_vertex;
-		}
-		idxmap[ newIdx[i] ] = last_index;
-	}
+	vector<int>(numvertices).swap(idxmap);
+	vector<float> unique(numvertices * s);
+	int unique_n = weldVectors(vertices, numvertices, s, Constants::distance_epsilon,
+							   &unique[0], &idxmap[0]);
+	new_vertices.insert(new_vertices.end(), unique.begin(), unique.begin() + unique_n * s);
 }
 
 int TriangleMesh::removeDoubles() {
@@ -316,6 +268,400 @@ int TriangleMesh::removeDoubles() {
 	return res;
 }
 
+size_t TriangleMesh::attributes(attrib_t attrs[5]) {
+	attrib_t all[5] = {
+		{ &m_vCoords, 3, &m_vIndices },
+		{ &m_nCoords, 3, &m_nIndices },
+		{ &m_texCoords, 2, &m_texIndices },
+		{ &m_tgtCoords, 3, &m_tgtIndices },
+		{ &m_btgtCoords, 3, &m_btgtIndices }
+	};
+	size_t n = 0;
+	for(int i = 0; i < 5; ++i) {
+		if (all[i].indices->empty()) continue;
+		attrs[n++] = all[i];
+	}
+	return n;
+}
+
+// Weld the coordinates of one attribute, dropping the unused ones.
+// Return the number of coordinates removed.
+
+static int weld_attribute(vector<float> & coords, int dim, vector<int> & indices) {
+	size_t coords_n = coords.size() / dim;
+	vector<int> used(coords_n, -1);
+	vector<float> packed;
+	int used_n = 0;
+	for(size_t i = 0, m = indices.size(); i < m; ++i) {
+		int c = indices[i];
+		if (used[c] != -1) continue;
+		used[c] = used_n++;
+		packed.insert(packed.end(), &coords[dim * c], &coords[dim * c] + dim);
+	}
+	vector<float> unique;
+	vector<int> idxmap;
+	copy_unique_coords_fast(packed.size() ? &packed[0] : 0, used_n, dim, unique, idxmap);
+	for(size_t i = 0, m = indices.size(); i < m; ++i)
+		indices[i] = idxmap[ used[ indices[i] ] ];
+	coords.swap(unique);
+	return coords_n - coords.size() / dim;
+}
+
+int TriangleMesh::weld() {
+	attrib_t attrs[5];
+	size_t attrs_n = attributes(attrs);
+	int res = 0;
+	for(size_t i = 0; i < attrs_n; ++i) {
+		int removed = weld_attribute(*attrs[i].coords, attrs[i].dim, *attrs[i].indices);
+		if (i == 0) res = removed; // vertices
+	}
+	m_vbo_uptodate = 0;
+	return res;
+}
+
+bool TriangleMesh::isIndexed() const {
+	size_t vertex_n = numVertices();
+	if (m_nIndices != m_vIndices || numNormals() != vertex_n) return false;
+	if (m_type & TriangleMesh::texcoords) {
+		if (m_texIndices != m_vIndices || numTexCoords() != vertex_n) return false;
+	}
+	if (m_type & TriangleMesh::bump) {
+		if (m_tgtIndices != m_vIndices || numTangents() != vertex_n) return false;
+		if (m_btgtIndices != m_vIndices || numBitangents() != vertex_n) return false;
+	}
+	return true;
+}
+
+void TriangleMesh::setIndexed() {
+	attrib_t attrs[5];
+	size_t attrs_n = attributes(attrs);
+	size_t corners_n = m_vIndices.size();
+	// sort corners by their indices, so that equal corners are contiguous
+	vector<int> order(corners_n);
+	for(size_t c = 0; c < corners_n; ++c) order[c] = c;
+	std::sort(order.begin(), order.end(), [&](int a, int b) {
+			for(size_t i = 0; i < attrs_n; ++i) {
+				int ia = (*attrs[i].indices)[a];
+				int ib = (*attrs[i].indices)[b];
+				if (ia != ib) return ia < ib;
+			}
+			return a < b;
+		});
+	// the representative of each corner is the first equal corner
+	vector<int> rep(corners_n);
+	for(size_t k = 0; k < corners_n; ++k) {
+		int c = order[k];
+		rep[c] = c;
+		if (k == 0) continue;
+		int prev = order[k - 1];
+		size_t i = 0;
+		while (i < attrs_n && (*attrs[i].indices)[c] == (*attrs[i].indices)[prev]) ++i;
+		if (i == attrs_n) rep[c] = rep[prev];
+	}
+	// number the new vertices in order of first use
+	vector<int> newidx(corners_n, -1);
+	vector<int> indices(corners_n);
+	int vertex_n = 0;
+	for(size_t c = 0; c < corners_n; ++c) {
+		int r = rep[c];
+		if (newidx[r] == -1) newidx[r] = vertex_n++;
+		indices[c] = newidx[r];
+	}
+	for(size_t i = 0; i < attrs_n; ++i) {
+		int dim = attrs[i].dim;
+		vector<float> coords(vertex_n * dim);
+		for(size_t c = 0; c < corners_n; ++c) {
+			const float *src = &(*attrs[i].coords)[ dim * (*attrs[i].indices)[c] ];
+			std::copy(src, src + dim, &coords[ dim * indices[c] ]);
+		}
+		attrs[i].coords->swap(coords);
+		*attrs[i].indices = indices;
+	}
+	m_vbo_uptodate = 0;
+}
+
+void TriangleMesh::optimizeVertexCache() {
+	if (!numTriangles()) return;
+	if (!isIndexed()) setIndexed();
+	::optimizeVertexCache(&m_vIndices[0], numTriangles(), numVertices());
+	clearClusters(); // triangles moved
+	clearBVH();
+	// renumber vertices in order of first use, so that vertex fetches are
+	// (mostly) sequential too
+	size_t vertex_n = numVertices();
+	vector<int> newidx(vertex_n, -1);
+	int used_n = 0;
+	for(size_t c = 0, m = m_vIndices.size(); c < m; ++c) {
+		int &v = m_vIndices[c];
+		if (newidx[v] == -1) newidx[v] = used_n++;
+		v = newidx[v];
+	}
+	attrib_t attrs[5];
+	size_t attrs_n = attributes(attrs);
+	for(size_t i = 0; i < attrs_n; ++i) {
+		int dim = attrs[i].dim;
+		vector<float> coords(used_n * dim);
+		for(size_t v = 0; v < vertex_n; ++v) {
+			if (newidx[v] == -1) continue;
+			const float *src = &(*attrs[i].coords)[dim * v];
+			std::copy(src, src + dim, &coords[ dim * newidx[v] ]);
+		}
+		attrs[i].coords->swap(coords);
+		*attrs[i].indices = m_vIndices;
+	}
+	m_vbo_uptodate = 0;
+}
+
+// Coarsest LODs have at least this number of triangles
+static const int lod_min_triangles = 16;
+
+void TriangleMesh::buildLODs(size_t levels, float ratio) {
+	clearLODs();
+	if (!numTriangles()) return;
+	if (!isIndexed()) setIndexed();
+	int numtriangles = numTriangles();
+	int prev_n = numtriangles;
+	vector<int> indices(m_vIndices.size());
+	vector<float> positions(m_vCoords.size());
+	// every LOD is simplified from LOD 0, so that errors don't accumulate
+	for(size_t l = 1; l < levels && prev_n * ratio >= lod_min_triangles; ++l) {
+		float error;
+		int n = simplifyMesh(&indices[0], &m_vIndices[0], numtriangles,
+							 &m_vCoords[0], numVertices(),
+							 (int) (prev_n * ratio), FLT_MAX, &error, &positions[0]);
+		// stop when the mesh can't be simplified (much) further
+		if (!n || n > prev_n - prev_n / 8) break;
+		TriangleMesh *lod = new TriangleMesh();
+		lod->m_type = m_type;
+		lod->m_materialFront = m_materialFront;
+		lod->m_materialBack = m_materialBack;
+		lod->m_hasTex = m_hasTex;
+		lod->m_isTransp = m_isTransp;
+		lod->m_vCoords = positions;
+		lod->m_vIndices.assign(indices.begin(), indices.begin() + 3 * n);
+		lod->m_nCoords = m_nCoords;
+		if (!m_nIndices.empty()) lod->m_nIndices = lod->m_vIndices;
+		lod->m_texCoords = m_texCoords;
+		if (!m_texIndices.empty()) lod->m_texIndices = lod->m_vIndices;
+		lod->m_tgtCoords = m_tgtCoords;
+		if (!m_tgtIndices.empty()) lod->m_tgtIndices = lod->m_vIndices;
+		lod->m_btgtCoords = m_btgtCoords;
+		if (!m_btgtIndices.empty()) lod->m_btgtIndices = lod->m_vIndices;
+		// drop the unused vertices
+		lod->optimizeVertexCache();
+		lod->m_vbo_uptodate = 0;
+		m_lods.push_back(lod);
+		m_lodErrors.push_back(error);
+		prev_n = n;
+	}
+}
+
+void TriangleMesh::clearLODs() {
+	for(size_t i = 0; i < m_lods.size(); ++i)
+		delete m_lods[i];
+	m_lods.clear();
+	m_lodErrors.clear();
+}
+
+size_t TriangleMesh::numLODs() const { return m_lods.size() + 1; }
+
+TriangleMesh *TriangleMesh::getLOD(size_t lod) {
+	if (!lod || m_lods.empty()) return this;
+	return m_lods[std::min(lod, m_lods.size()) - 1];
+}
+
+const TriangleMesh *TriangleMesh::getLOD(size_t lod) const {
+	if (!lod || m_lods.empty()) return this;
+	return m_lods[std::min(lod, m_lods.size()) - 1];
+}
+
+float TriangleMesh::lodError(size_t lod) const {
+	if (!lod || m_lodErrors.empty()) return 0.0f;
+	return m_lodErrors[std::min(lod, m_lodErrors.size()) - 1];
+}
+
+// Triangles are grouped in clusters (see cluster.h), and moved so that
+// every cluster is contiguous. Indexed meshes are also reordered for the
+// vertex cache within each cluster.
+
+void TriangleMesh::buildClusters(size_t maxTriangles) {
+	clearClusters();
+	clearBVH(); // triangles move
+	int tris_n = numTriangles();
+	if (!tris_n) return;
+	vector<int> order(tris_n);
+	vector<int> starts(tris_n + 1);
+	int clusters_n = clusterMesh(&order[0], &starts[0], &m_vIndices[0], tris_n,
+								 &m_vCoords[0], numVertices(), maxTriangles);
+	bool indexed = isIndexed();
+	attrib_t attrs[5];
+	size_t attrs_n = attributes(attrs);
+	for(size_t i = 0; i < attrs_n; ++i) {
+		vector<int> & indices = *attrs[i].indices;
+		vector<int> sorted(indices.size());
+		for(int t = 0; t < tris_n; ++t)
+			std::copy(&indices[3 * order[t]], &indices[3 * order[t]] + 3, &sorted[3 * t]);
+		indices.swap(sorted);
+	}
+	m_clusters.resize(clusters_n);
+	vector<int> local(numVertices(), -1);
+	vector<int> global;
+	for(int c = 0; c < clusters_n; ++c) {
+		cluster_t & cluster = m_clusters[c];
+		cluster.first = starts[c];
+		cluster.count = starts[c + 1] - starts[c];
+		if (!indexed) continue;
+		// vertex cache optimization of the cluster, with its vertices
+		// renumbered from 0
+		int *idx = &m_vIndices[3 * cluster.first];
+		global.clear();
+		for(int k = 0; k < 3 * cluster.count; ++k) {
+			if (local[idx[k]] == -1) {
+				local[idx[k]] = global.size();
+				global.push_back(idx[k]);
+			}
+			idx[k] = local[idx[k]];
+		}
+		::optimizeVertexCache(idx, cluster.count, global.size());
+		for(int k = 0; k < 3 * cluster.count; ++k)
+			idx[k] = global[idx[k]];
+		for(size_t v = 0; v < global.size(); ++v)
+			local[global[v]] = -1;
+	}
+	if (indexed) {
+		for(size_t i = 1; i < attrs_n; ++i)
+			*attrs[i].indices = m_vIndices;
+	}
+	updateClusterBounds();
+	m_vbo_uptodate = 0;
+}
+
+void TriangleMesh::updateClusterBounds() {
+	for(size_t c = 0; c < m_clusters.size(); ++c) {
+		cluster_t & cluster = m_clusters[c];
+		clusterBounds(cluster.bounds, &m_vIndices[3 * cluster.first], cluster.count,
+					  &m_vCoords[0]);
+	}
+}
+
+void TriangleMesh::clearClusters() {
+	m_clusters.clear();
+}
+
+void TriangleMesh::buildBVH() {
+	size_t tris_n = numTriangles();
+	clearBVH();
+	if (!tris_n) return;
+	m_bvh.resize(2 * tris_n - 1);
+	m_bvhOrder.resize(tris_n);
+	int nodes_n = bvhBuild(&m_bvh[0], &m_bvhOrder[0], &m_vIndices[0], tris_n, &m_vCoords[0]);
+	m_bvh.resize(nodes_n);
+	std::vector<BVHNode>(m_bvh).swap(m_bvh); // trim
+}
+
+void TriangleMesh::clearBVH() {
+	m_bvh.clear();
+	m_bvhOrder.clear();
+}
+
+size_t TriangleMesh::numBVHNodes() const {
+	// triangles added after building the BVH
+	if (m_bvhOrder.size() != numTriangles()) return 0;
+	return m_bvh.size();
+}
+
+int TriangleMesh::intersectRay(const Line & ray, float tmax, Vector3 & uvw) const {
+	float O[3] = { ray.m_O[0], ray.m_O[1], ray.m_O[2] };
+	float D[3] = { ray.m_d[0], ray.m_d[1], ray.m_d[2] };
+	float hit[3];
+	int tri = -1;
+	if (numBVHNodes()) {
+		tri = bvhIntersect(&m_bvh[0], &m_bvhOrder[0], &m_vIndices[0], &m_vCoords[0],
+						   O, D, tmax, hit);
+	} else {
+		for(size_t i = 0, tris_n = numTriangles(); i < tris_n; ++i) {
+			const int *idx = &m_vIndices[3 * i];
+			if (rayTriangle(&m_vCoords[3 * idx[0]], &m_vCoords[3 * idx[1]], &m_vCoords[3 * idx[2]],
+							O, D, tmax, hit)) {
+				tmax = hit[2];
+				tri = i;
+			}
+		}
+	}
+	if (tri != -1) uvw = Vector3(hit[0], hit[1], hit[2]);
+	return tri;
+}
+
+void TriangleMesh::intersectRays(const Line *rays, size_t n, const float *tmax, int *tris,
+								 Vector3 *uvw) const {
+	if (!numBVHNodes()) {
+		for(size_t i = 0; i < n; ++i) tris[i] = intersectRay(rays[i], tmax[i], uvw[i]);
+		return;
+	}
+	float O[4][3], D[4][3], T[4], hit[4][3];
+	for(size_t i = 0; i < n; i += 4) {
+		int m = (int) std::min<size_t>(4, n - i);
+		for(int j = 0; j < m; ++j) {
+			for(int k = 0; k < 3; ++k) {
+				O[j][k] = rays[i + j].m_O[k];
+				D[j][k] = rays[i + j].m_d[k];
+			}
+			T[j] = tmax[i + j];
+		}
+		bvhIntersect4(&m_bvh[0], &m_bvhOrder[0], &m_vIndices[0], &m_vCoords[0], m, O, D, T,
+					  hit, tris + i);
+		for(int j = 0; j < m; ++j)
+			if (tris[i + j] != -1) uvw[i + j] = Vector3(hit[j][0], hit[j][1], hit[j][2]);
+	}
+}
+
+int TriangleMesh::intersectSphere(const Vector3 & C, float radius) const {
+	float P[3] = { C[0], C[1], C[2] };
+	if (numBVHNodes())
+		return bvhSphere(&m_bvh[0], &m_bvhOrder[0], &m_vIndices[0], &m_vCoords[0], P, radius);
+	for(size_t i = 0, tris_n = numTriangles(); i < tris_n; ++i) {
+		const int *idx = &m_vIndices[3 * i];
+		if (sphereTriangle(&m_vCoords[3 * idx[0]], &m_vCoords[3 * idx[1]], &m_vCoords[3 * idx[2]],
+						   P, radius))
+			return i;
+	}
+	return -1;
+}
+
+int TriangleMesh::sweepSphere(const Vector3 & C, const Vector3 & d, float radius, float tmax,
+							  float & t, Vector3 & N) const {
+	float P[3] = { C[0], C[1], C[2] };
+	float D[3] = { d[0], d[1], d[2] };
+	float hit[4];
+	int tri = -1;
+	if (numBVHNodes()) {
+		tri = bvhSweepSphere(&m_bvh[0], &m_bvhOrder[0], &m_vIndices[0], &m_vCoords[0],
+							 P, D, radius, tmax, hit);
+	} else {
+		for(size_t i = 0, tris_n = numTriangles(); i < tris_n; ++i) {
+			const int *idx = &m_vIndices[3 * i];
+			if (sweepSphereTriangle(&m_vCoords[3 * idx[0]], &m_vCoords[3 * idx[1]],
+									&m_vCoords[3 * idx[2]], P, D, radius, tmax, hit)) {
+				tmax = hit[0];
+				tri = i;
+			}
+		}
+	}
+	if (tri != -1) {
+		t = hit[0];
+		N = Vector3(hit[1], hit[2], hit[3]);
+	}
+	return tri;
+}
+
+size_t TriangleMesh::numClusters() const {
+	if (m_clusters.empty()) return 0;
+	const cluster_t & last = m_clusters.back();
+	// triangles added after building the clusters
+	if ((size_t) (last.first + last.count) != numTriangles()) return 0;
+	return m_clusters.size();
+}
+
 /*!
 
   Creates a new triangle mesh given a model previously readed by glm.
@@ -323,23 +669,20 @@ int TriangleMesh::removeDoubles() {
   \param n: number of triangles
   \param triangles: array of n triangles
   \param model: glm model (where the actual vertices, normals, textures coordinates are)
-  \param front: fronfacing materiak
-  \param back: backfacing materiak
-  \param type: type of mesh (trm, tex, bump)
+  \param bump: whether the material of the mesh has a bump map
 
   \return a pointer to the new created triangle mesh
 
 */
 
 // Create a triangle mesh given a glm model
-TriangleMesh::TriangleMesh(int numtriangles, GLuint *triangles, GLMmodel *model,
-						   Material *front, Material *back)
-	: m_materialFront(front), m_materialBack(back)
+TriangleMesh::TriangleMesh(int numtriangles, GLuint *triangles, GLMmodel *model, bool bump)
+	: m_materialFront(0), m_materialBack(0),
+	  m_hasTex(false), m_isTransp(false)
 {
 	int type = TriangleMesh::trm;
 	if (model->numtexcoords) type |= TriangleMesh::texcoords;
-	if (front && front->hasBump()) type |= TriangleMesh::bump;
-	if (back && back->hasBump()) type |= TriangleMesh::bump;
+	if (bump) type |= TriangleMesh::bump;
 	m_type = static_cast<type_t>(type);
 
 	vector<float>(&model->vertices[3], &model->vertices[3] + model->numvertices * 3).swap(m_vCoords);
@@ -380,11 +723,12 @@ TriangleMesh::TriangleMesh(int numtriangles, GLuint *triangles, GLMmodel *model,
 	}
 	// OpenGL VBO init
 	m_vbo_id = 0;
+	m_ibo_id = 0;
 	m_vao_id = 0;
 	m_vbo_uptodate = 0;
 }
 
-static Material *create_mat(GLMmodel * m, GLMmaterial * mat, const string & DirName, const string & libname) {
+Material *TriangleMesh::createMaterial(const GLMmaterial * mat, const string & DirName, const string & libname) {
 	string mtl_fullname = getFilename(DirName, libname);
 	Material *newMaterial = MaterialManager::instance()->create(mtl_fullname, string(mat->name));
 	//newMaterial->setAmbient(&mat->ambient[0]);
@@ -425,10 +769,11 @@ void TriangleMesh::CreateTMeshObj(const string & DirName, const string & FileNam
 		if (g->numtriangles) {
 			Material *mat = default_mat;
 			if (g->material)
-				mat = create_mat(m, &(m->materials[g->material]), DirName, string(m->mtllibname));
+				mat = createMaterial(&(m->materials[g->material]), DirName, string(m->mtllibname));
 			// Create and store the surface (triangleMesh)
 			TriangleMesh *surface = new TriangleMesh(g->numtriangles,
-													 g->triangles, m, mat, mat);
+													 g->triangles, m, mat->hasBump());
+			surface->assignMaterial(mat, mat);
 			surfaces.push_back(surface);
 		}
 		g = g->next;
@@ -450,51 +795,215 @@ static Vector3 normalTriangle(const Vector3 & v0, const Vector3 & v1, const Vect
 	return n;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Normal pipeline
+//
+// Shared by setFaceted, setSmooth and renormalize:
+//
+// - face normals are computed into flat arrays (packed and normalized for
+//   setFaceted, one array per coordinate for the vertex normals)
+// - vertex normals gather the face normals of their incident triangles
+// - normals are normalized in batches
+//
+// All stages run in parallel on the thread pool. Loops work on plain float
+// arrays so that the compiler can vectorize them. Vertex normals gather
+// triangles in ascending order, so results don't depend on the number of
+// threads. With one thread (or a small mesh) they are scattered instead, in
+// the same order, which skips building the vertex -> triangle table.
+
+struct face_normals_t {
+	vector<float> x, y, z;
+};
+
+// Grain of the vertex normals. Meshes with fewer vertices are not split.
+static const size_t vertex_grain = 8192;
+
+// Unnormalized face normal of triangle t: (P1 - P0) x (P2 - P0)
+static inline void face_normal(const float *V, const int *I, size_t t, float *n) {
+	const float *P0 = V + 3 * I[3 * t];
+	const float *P1 = V + 3 * I[3 * t + 1];
+	const float *P2 = V + 3 * I[3 * t + 2];
+	float ux = P1[0] - P0[0], uy = P1[1] - P0[1], uz = P1[2] - P0[2];
+	float vx = P2[0] - P0[0], vy = P2[1] - P0[1], vz = P2[2] - P0[2];
+	n[0] = uy * vz - uz * vy;
+	n[1] = uz * vx - ux * vz;
+	n[2] = ux * vy - uy * vx;
+}
+
+// Normalize N as Vector3::normalize (with eps = Vector3::epsilon)
+static inline void normalize3(float *N, float eps) {
+	float mod2 = N[0] * N[0] + N[1] * N[1] + N[2] * N[2];
+	bool ok = mod2 > eps;
+	float mod = ok ? 1.0f / sqrtf(mod2) : 0.0f;
+	N[0] = ok ? N[0] * mod : 0.0f;
+	N[1] = ok ? N[1] * mod : 0.0f;
+	N[2] = ok ? N[2] * mod : 1.0f;
+}
+
+// Unit face normals of all triangles, packed (x, y, z) in N, and the
+// normal indices of their corners (triangle t uses normal t) in NI
+static void faceted_normals(const vector<float> & vCoords, const vector<int> & vIndices,
+							float *N, int *NI) {
+	const float *V = vCoords.size() ? &vCoords[0] : 0;
+	const int *I = vIndices.size() ? &vIndices[0] : 0;
+	const float eps = Vector3::epsilon;
+	ThreadPool::instance()->parallelFor(vIndices.size() / 3, 8192, [=](size_t begin, size_t end) {
+		for(size_t t = begin; t < end; ++t) {
+			face_normal(V, I, t, N + 3 * t);
+			normalize3(N + 3 * t, eps);
+			NI[3 * t] = NI[3 * t + 1] = NI[3 * t + 2] = t;
+		}
+	});
+}
+
+// Unnormalized face normals of all triangles
+static void face_normals(const vector<float> & vCoords, const vector<int> & vIndices,
+						 face_normals_t & F) {
+	size_t triang_n = vIndices.size() / 3;
+	F.x.resize(triang_n);
+	F.y.resize(triang_n);
+	F.z.resize(triang_n);
+	const float *V = vCoords.size() ? &vCoords[0] : 0;
+	const int *I = vIndices.size() ? &vIndices[0] : 0;
+	float *fx = F.x.size() ? &F.x[0] : 0;
+	float *fy = F.y.size() ? &F.y[0] : 0;
+	float *fz = F.z.size() ? &F.z[0] : 0;
+	ThreadPool::instance()->parallelFor(triang_n, 8192, [=](size_t begin, size_t end) {
+		for(size_t t = begin; t < end; ++t) {
+			float n[3];
+			face_normal(V, I, t, n);
+			fx[t] = n[0];
+			fy[t] = n[1];
+			fz[t] = n[2];
+		}
+	});
+}
+
+// Normalize n packed (x, y, z) vectors in place (same semantics as
+// Vector3::normalize)
+static void normalize_aos(float *V, size_t n) {
+	const float eps = Vector3::epsilon;
+	ThreadPool::instance()->parallelFor(n, 16384, [=](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) normalize3(V + 3 * i, eps);
+	});
+}
+
+// Add face normals to the vertices of their triangles, leaving the
+// (unnormalized) vertex normals packed in N.
+//
+// The vertex -> triangle incidence is built with a counting sort, so every
+// vertex gathers its triangles independently. Without threads to share the
+// work, triangles scatter their normal to their vertices instead.
+static void vertex_normals(const vector<float> & vCoords, const vector<int> & vIndices,
+						   size_t vertex_n, vector<float> & N) {
+	size_t corners_n = vIndices.size();
+	if (ThreadPool::instance()->size() == 1 || vertex_n <= vertex_grain) {
+		vector<float>(vertex_n * 3, 0.0f).swap(N);
+		for(size_t t = 0; t < corners_n / 3; ++t) {
+			float n[3];
+			face_normal(&vCoords[0], &vIndices[0], t, n);
+			for(int j = 0; j < 3; ++j) {
+				float *out = &N[3 * vIndices[3 * t + j]];
+				out[0] += n[0];
+				out[1] += n[1];
+				out[2] += n[2];
+			}
+		}
+		return;
+	}
+	face_normals_t F;
+	face_normals(vCoords, vIndices, F);
+	vector<int> start(vertex_n + 1, 0);
+	for(size_t c = 0; c < corners_n; ++c) ++start[ vIndices[c] + 1 ];
+	for(size_t i = 0; i < vertex_n; ++i) start[i + 1] += start[i];
+	vector<int> triangles(corners_n);
+	vector<int> fill(start.begin(), start.end() - 1);
+	for(size_t c = 0; c < corners_n; ++c) triangles[ fill[ vIndices[c] ]++ ] = c / 3;
+	vector<float>(vertex_n * 3).swap(N);
+	if (!vertex_n) return;
+	const int *S = &start[0];
+	const int *T = triangles.size() ? &triangles[0] : 0;
+	const float *fx = F.x.size() ? &F.x[0] : 0;
+	const float *fy = F.y.size() ? &F.y[0] : 0;
+	const float *fz = F.z.size() ? &F.z[0] : 0;
+	float *out = &N[0];
+	ThreadPool::instance()->parallelFor(vertex_n, vertex_grain, [=](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) {
+			float x = 0.0f, y = 0.0f, z = 0.0f;
+			for(int k = S[i]; k < S[i + 1]; ++k) {
+				x += fx[ T[k] ];
+				y += fy[ T[k] ];
+				z += fz[ T[k] ];
+			}
+			out[3 * i] = x;
+			out[3 * i + 1] = y;
+			out[3 * i + 2] = z;
+		}
+	});
+}
+
 // renormalize all mesh normals
 void TriangleMesh::renormalize() {
-	for(int i = 0, m = numNormals(); i < m; i++) {
-		float *N = nCoords(i);
-		Vector3 aux(N);
-		aux.normalize();
-		N[0] = aux[0];
-		N[0] = aux[1];
-		N[0] = aux[2];
-	}
+	if (numNormals())
+		normalize_aos(&m_nCoords[0], numNormals());
 	if (m_type & TriangleMesh::bump) {
 		tangentTMesh(); // recalculate TBN
 	}
 	m_vbo_uptodate = 0;
 }
 
-struct bthash_t {
-	typedef pair<int, int > key_type;
-
-	bthash_t(TriangleMesh & tmesh) : m_tgtN(0) {
-		pair<map<key_type, int>::iterator, bool> P;
-		int *Pidx, *Nidx;
-		int triang_n = tmesh.numTriangles();
-		for(int t = 0; t < triang_n; ++t) {
-			Pidx = tmesh.vIdx(t);
-			Nidx = tmesh.nIdx(t);
-			for(int j = 0; j < 3; j++) {
-				key_type key = std::make_pair(Pidx[j], Nidx[j]);
-				P = m_hash.insert(std::make_pair(key, m_tgtN));
-				if (P.second) // inserted
-					m_tgtN++;
-			}
-		}
+// Tangent space indices
+//
+// There is one tangent (and bitangent) for each unique (vertex, normal) pair
+// of the triangle corners. Pairs are packed into 64-bit keys and sorted
+// together with the corner index, so corners sharing a tangent end up
+// contiguous (and in corner order) in the sorted array.
+
+struct tgt_corner_t {
+	uint64_t key;  // (vertex index << 32) | normal index
+	int corner;    // 3 * triangle + j
+	bool operator<(const tgt_corner_t & o) const {
+		return key < o.key || (key == o.key && corner < o.corner);
 	}
+};
 
-	int find(int k1, int k2) {
-		map<key_type, int>::iterator it = m_hash.find(std::make_pair(k1, k2));
-		if (it == m_hash.end()) return -1;
-		return it->second;
-	}
-	map<key_type, int> m_hash;
-	int m_tgtN; // number of tangents
+struct tgt_groups_t {
+	tgt_groups_t(const vector<int> & vIndices, const vector<int> & nIndices);
+
+	vector<tgt_corner_t> m_corners; // sorted corners
+	vector<int> m_start;      // corners of group g are m_corners[m_start[g] .. m_start[g+1]]
+	vector<int> m_groupTgt;   // tangent index of each group
+	vector<int> m_cornerTgt;  // tangent index of each corner
 };
 
-static void add_vec(vector<float> &V, int idx, float p[3]) {
+tgt_groups_t::tgt_groups_t(const vector<int> & vIndices, const vector<int> & nIndices) {
+	size_t corners_n = vIndices.size();
+	m_corners.resize(corners_n);
+	for(size_t c = 0; c < corners_n; ++c) {
+		m_corners[c].key = (uint64_t(uint32_t(vIndices[c])) << 32) | uint32_t(nIndices[c]);
+		m_corners[c].corner = c;
+	}
+	std::sort(m_corners.begin(), m_corners.end());
+	// unique keys: one group per tangent
+	vector<int> cornerGroup(corners_n);
+	for(size_t i = 0; i < corners_n; ++i) {
+		if (i == 0 || m_corners[i].key != m_corners[i - 1].key)
+			m_start.push_back(i);
+		cornerGroup[ m_corners[i].corner ] = m_start.size() - 1;
+	}
+	vector<int>(m_start.size(), -1).swap(m_groupTgt);
+	m_start.push_back(corners_n);
+	// number tangents by first appearance (in corner order)
+	m_cornerTgt.resize(corners_n);
+	int tgtN = 0;
+	for(size_t c = 0; c < corners_n; ++c) {
+		int & tgt = m_groupTgt[ cornerGroup[c] ];
+		if (tgt == -1) tgt = tgtN++;
+		m_cornerTgt[c] = tgt;
+	}
+}
+
+static void add_vec(vector<float> &V, int idx, const Vector3 & p) {
 
 	V[idx * 3] = p[0];
 	V[idx * 3 + 1] = p[1];
@@ -529,59 +1038,50 @@ static void add_vec(vector<float> &V, int idx, float p[3]) {
 
 void TriangleMesh::tangentTMesh() {
 
-	bthash_t bthash(*this);
-	int triang_n = numTriangles();
-	int tgtN = bthash.m_tgtN;
-	vector<int>().swap(m_tgtIndices);
-	m_tgtIndices.reserve(triang_n * 3);
-	vector<int>().swap(m_btgtIndices);
-	m_btgtIndices.reserve(triang_n * 3);
+	ThreadPool *pool = ThreadPool::instance();
+	tgt_groups_t groups(m_vIndices, m_nIndices);
+	size_t triang_n = numTriangles();
+	size_t tgtN = groups.m_groupTgt.size();
+	m_tgtIndices = groups.m_cornerTgt;
+	m_btgtIndices = groups.m_cornerTgt;
 	vector<float>(tgtN * 3, 0.0).swap(m_tgtCoords);
 	vector<float>(tgtN * 3, 0.0).swap(m_btgtCoords);
-	float *P0, *P1, *P2, *Tex0, *Tex1, *Tex2;
-	Vector3 T, B, N;
-	for(int t = 0; t < triang_n; ++t) {
-		// Vertices
-		P0 = vCoords(m_vIndices[ t * 3 ]);
-		P1 = vCoords(m_vIndices[ t * 3 + 1 ]);
-		P2 = vCoords(m_vIndices[ t * 3 + 2 ]);
-		// Textures
-		Tex0 = texCoords(m_texIndices[ t * 3 ]);
-		Tex1 = texCoords(m_texIndices[ t * 3 + 1 ]);
-		Tex2 = texCoords(m_texIndices[ t * 3 + 2 ]);
-		tangentTriangle(P0, P1, P2,
-						Tex0, Tex1, Tex2,
-						T, B, N);
-		for(int j = 0; j < 3; j++) {
-			int idx = bthash.find(m_vIndices[ t * 3 + j],
-								  m_nIndices[ t * 3 + j]);
-			assert(idx != -1);
-			// add tangents
-			m_tgtCoords[idx * 3] += T[0];
-			m_tgtCoords[idx * 3 + 1] += T[1];
-			m_tgtCoords[idx * 3 + 2] += T[2];
-			m_tgtIndices.push_back(idx);
-			// add bitangents
-			m_btgtCoords[idx * 3] += B[0];
-			m_btgtCoords[idx * 3 + 1] += B[1];
-			m_btgtCoords[idx * 3 + 2] += B[2];
-			m_btgtIndices.push_back(idx);
+
+	// 1st phase: T, B of every triangle
+	vector<float> triT(triang_n * 3);
+	vector<float> triB(triang_n * 3);
+	pool->parallelFor(triang_n, 4096, [&](size_t begin, size_t end) {
+		Vector3 T, B, N;
+		for(size_t t = begin; t != end; ++t) {
+			tangentTriangle(vCoords(m_vIndices[ t * 3 ]),
+							vCoords(m_vIndices[ t * 3 + 1 ]),
+							vCoords(m_vIndices[ t * 3 + 2 ]),
+							texCoords(m_texIndices[ t * 3 ]),
+							texCoords(m_texIndices[ t * 3 + 1 ]),
+							texCoords(m_texIndices[ t * 3 + 2 ]),
+							T, B, N);
+			add_vec(triT, t, T);
+			add_vec(triB, t, B);
 		}
-	}
-	// normalize T,B
-	size_t numVecs = m_tgtCoords.size() / 3;
-	for(size_t i = 0; i < numVecs; i++) {
-		Vector3 T(&m_tgtCoords[i * 3]);
-		T.normalize();
-		m_tgtCoords[i * 3] = T[0];
-		m_tgtCoords[i * 3 + 1] = T[1];
-		m_tgtCoords[i * 3 + 2] = T[2];
-		Vector3 B(&m_btgtCoords[i * 3]);
-		B.normalize();
-		m_btgtCoords[i * 3] = B[0];
-		m_btgtCoords[i * 3 + 1] = B[1];
-		m_btgtCoords[i * 3 + 2] = B[2];
-	}
+	});
+
+	// 2nd phase: each tangent gathers the corners of its group (in corner
+	// order, so the result does not depend on the number of threads) and
+	// normalizes
+	pool->parallelFor(tgtN, 4096, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i != end; ++i) {
+			Vector3 T, B;
+			for(int c = groups.m_start[i]; c != groups.m_start[i + 1]; ++c) {
+				int t = groups.m_corners[c].corner / 3;
+				T += Vector3(&triT[ t * 3 ]);
+				B += Vector3(&triB[ t * 3 ]);
+			}
+			T.normalize();
+			B.normalize();
+			add_vec(m_tgtCoords, groups.m_groupTgt[i], T);
+			add_vec(m_btgtCoords, groups.m_groupTgt[i], B);
+		}
+	});
 	//gram_schmidt();
 	/* // Calculate handedness */
 	/* // if (dot(cross(n, t), b) < 0.0f) t = -t */
@@ -601,22 +1101,10 @@ void TriangleMesh::setFaceted() {
 	size_t numtriangles = numTriangles();
 	vector<float>(3 * numtriangles).swap(m_nCoords);
 	vector<int>(3 * numtriangles).swap(m_nIndices);
-	for (size_t t = 0; t < numtriangles; ++t) {
-		int i0 = m_vIndices[3 * t];
-		int i1 = m_vIndices[3 * t + 1];
-		int i2 = m_vIndices[3 * t + 2];
-		// Calculate face normal
-		Vector3 N = normalTriangle(Vector3(vCoords(i0)),
-									Vector3(vCoords(i1)),
-									Vector3(vCoords(i2)));
-		m_nCoords[3 * t] = N[0];
-		m_nCoords[3 * t + 1] = N[1];
-		m_nCoords[3 * t + 2] = N[2];
-		m_nIndices[3 * t] = t;
-		m_nIndices[3 * t + 1] = t;
-		m_nIndices[3 * t + 2] = t;
-	}
+	if (numtriangles) faceted_normals(m_vCoords, m_vIndices, &m_nCoords[0], &m_nIndices[0]);
 	m_vbo_uptodate = 0;
+	for(size_t i = 0; i < m_lods.size(); ++i)
+		m_lods[i]->setFaceted();
 }
 
 static void tangentTriangle(const float v0[3], const float v1[3], const float v2[3],
@@ -656,39 +1144,13 @@ static void tangentTriangle(const float v0[3], const float v1[3], const float v2
 // http://www.iquilezles.org/www/articles/normals/normals.htm
 
 void TriangleMesh::setSmooth() {
-	int   *T;
-	float *P0, *P1, *P2;
-	float *NN;
-
-	// Init new normals
-	vector<int>(m_vIndices).swap(m_nIndices);
-	vector<float>(m_vCoords.size(), 0.0f).swap(m_nCoords);
 	// Accumulate face normals to compute vertex normals
-	int triang_n = numTriangles();
-	for(int t = 0; t < triang_n; ++t) {
-		int i0 = m_vIndices[ t * 3];
-		int i1 = m_vIndices[ t * 3 + 1];
-		int i2 = m_vIndices[ t * 3 + 2];
-		P0 = vCoords(i0);
-		P1 = vCoords(i1);
-		P2 = vCoords(i2);
-		Vector3 N(unormalTriangle(P0, P1, P2));
-		//T = TriangNidxTMesh(thisMesh, i);
-		// i0
-		m_nCoords[i0 * 3    ] += N[0];
-		m_nCoords[i0 * 3 + 1] += N[1];
-		m_nCoords[i0 * 3 + 2] += N[2];
-		// i1
-		m_nCoords[i1 * 3    ] += N[0];
-		m_nCoords[i1 * 3 + 1] += N[1];
-		m_nCoords[i1 * 3 + 2] += N[2];
-		// i2
-		m_nCoords[i2 * 3    ] += N[0];
-		m_nCoords[i2 * 3 + 1] += N[1];
-		m_nCoords[i2 * 3 + 2] += N[2];
-	}
+	vertex_normals(m_vCoords, m_vIndices, numVertices(), m_nCoords);
+	m_nIndices = m_vIndices;
 	// Normalize vertex normals
 	renormalize();
+	for(size_t i = 0; i < m_lods.size(); ++i)
+		m_lods[i]->setSmooth();
 }
 
 void TriangleMesh::includeBBox(BBox & box) const {
@@ -702,28 +1164,28 @@ void TriangleMesh::includeBBox(BBox * box) const {
 	includeBBox(*box);
 }
 
+// Normals are transformed as normals (no translation), and tangents are
+// recomputed by renormalize()
+
 void TriangleMesh::applyTrfm(const Trfm3D * trfm) {
-	int i;
-	float *v;
-	int points_n, normals_n;
-	for (int i = 0, N = numVertices();
-		 i < N; ++i) {
-		float *P = vCoords(i);
-		Vector3 aux = trfm->transformPoint(P);
-		P[0] = aux[0];
-		P[1] = aux[1];
-		P[2] = aux[2];
-	}
-	for (int i = 0, N = numNormals();
-		 i < N; ++i) {
-		float *P = nCoords(i);
-		Vector3 aux = trfm->transformPoint(P);
-		P[0] = aux[0];
-		P[1] = aux[1];
-		P[2] = aux[2];
-	}
+	if (numVertices())
+		trfm->transformPoints(&m_vCoords[0], &m_vCoords[0], numVertices(), 3, true);
+	if (numNormals())
+		trfm->transformNormals(&m_nCoords[0], &m_nCoords[0], numNormals(), 3, true);
 	renormalize();
+	updateClusterBounds();
+	if (numBVHNodes()) buildBVH();
 	m_vbo_uptodate = 0;
+	// LOD errors scale with the largest axis scale
+	float scale = 0.0f;
+	for(int i = 0; i < 3; ++i) {
+		Vector3 axis(i == 0, i == 1, i == 2);
+		scale = std::max(scale, trfm->transformVector(axis).length());
+	}
+	for(size_t i = 0; i < m_lods.size(); ++i) {
+		m_lods[i]->applyTrfm(trfm);
+		m_lodErrors[i] *= scale;
+	}
 }
 
 const Material *TriangleMesh::getMaterial(bool front) const {
@@ -739,6 +1201,8 @@ Material *TriangleMesh::getMaterial(bool front) {
 void TriangleMesh::setMaterial(Material *mat, bool front) {
 	if (front) m_materialFront = mat;
 	else m_materialBack = mat;
+	for(size_t i = 0; i < m_lods.size(); ++i)
+		m_lods[i]->setMaterial(mat, front);
 }
 
 void TriangleMesh::print() const {
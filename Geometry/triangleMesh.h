@@ -10,6 +10,8 @@
 #include "material.h"
 #include "bbox.h"
 #include "glm.h"
+#include "bvh.h"
+#include "line.h"
 
 class TriangleMesh {
 
@@ -93,6 +95,52 @@ public:
 	void setFaceted(); // Recalculate all normals to create a faceted mesh
 	void setSmooth(); // Recalculate all normals to create a smooth mesh
 	int removeDoubles(); // Merge vertices sharing position (a-la blender function)
+	int weld(); // Merge duplicated coordinates and remove unused ones. Return number of vertices removed.
+
+	// Indexing
+	void setIndexed(); // Make all attributes share the same indices (one vertex per distinct corner)
+	bool isIndexed() const; // Whether all attributes share the same indices
+	void optimizeVertexCache(); // Reorder triangles and vertices for the GPU vertex cache (sets mesh indexed)
+
+	// Levels of detail. LOD 0 is the mesh itself, and LOD i + 1 a simplified
+	// version of it with about 'ratio' times the triangles of LOD i. LODs
+	// keep the attribute seams (normals, tex coords) of the mesh.
+	void buildLODs(size_t levels = 4, float ratio = 0.5f); // (re)build the LODs (sets mesh indexed)
+	void clearLODs(); // remove all LODs but LOD 0
+	size_t numLODs() const; // number of LODs, including LOD 0
+	TriangleMesh *getLOD(size_t lod); // get LOD (clamped to the coarsest one)
+	const TriangleMesh *getLOD(size_t lod) const;
+	float lodError(size_t lod) const; // distance between the surfaces of LOD and LOD 0 (clamped)
+
+	// Clusters (meshlets): groups of up to 'maxTriangles' nearby triangles,
+	// contiguous in the index arrays, with a bounding sphere and a normal
+	// cone, so that they are culled one by one when drawn (see
+	// TriangleMeshGL). Adding or reordering triangles invalidates them.
+	void buildClusters(size_t maxTriangles = 128); // (re)build the clusters (reorders triangles)
+	void clearClusters();
+	size_t numClusters() const; // number of (valid) clusters. 0 if none
+
+	// Ray and sphere queries. The BVH (see bvh.h) makes them logarithmic in the number
+	// of triangles. Without it, all triangles are tested. Changing the
+	// positions or the order of the triangles invalidates it.
+	void buildBVH(); // (re)build the BVH of the triangles
+	void clearBVH();
+	size_t numBVHNodes() const; // number of nodes of the (valid) BVH. 0 if none
+	// Closest intersection of 'ray' with the triangles, with parameter in
+	// (0, tmax). Return the triangle (-1 if none), and leave in uvw the
+	// barycentric coordinates and the parameter (see IntersectTriangleRay).
+	int intersectRay(const Line & ray, float tmax, Vector3 & uvw) const;
+	// As intersectRay, for n rays, in packets of 4 (see bvhIntersect4): tris[i]
+	// and uvw[i] are the result of rays[i] with tmax[i]. Faster for coherent
+	// rays (neighbour pixels, samples of a light...).
+	void intersectRays(const Line *rays, size_t n, const float *tmax, int *tris, Vector3 *uvw) const;
+	// A triangle the sphere (C, radius) intersects (-1 if none)
+	int intersectSphere(const Vector3 & C, float radius) const;
+	// First contact of the sphere (C, radius) moving to C + tmax * d. Return
+	// the triangle (-1 if none), and leave in t and N the parameter and the
+	// normal of the contact (see sweepSphereTriangle).
+	int sweepSphere(const Vector3 & C, const Vector3 & d, float radius, float tmax,
+					float & t, Vector3 & N) const;
 
 	// change BBox to include Tmesh vertices
 	void includeBBox(BBox * box) const;
@@ -108,17 +156,33 @@ public:
 	void print() const;
 
 	friend class TriangleMeshGL;
+	friend class MeshCache;
+	friend class HLODBuilder;
+	friend class StaticBatch;
 
 private:
 
-	// Create a triangle mesh given a glm model
-	TriangleMesh(int numtriangles, GLuint *triangles, GLMmodel *model,
-				 Material *front, Material *back);
+	// Create a triangle mesh given a glm model. Materials are not assigned.
+	TriangleMesh(int numtriangles, GLuint *triangles, GLMmodel *model, bool bump);
 	TriangleMesh(const TriangleMesh & o);
 	TriangleMesh & operator=(const TriangleMesh & o);
 
+	// Create (or get) the material of a glm model
+	static Material *createMaterial(const GLMmaterial * mat,
+									const std::string & DirName, const std::string & libname);
+
 	void tangentTMesh(); // Calculate TBN
 
+	// one attribute of the mesh: coordinates (dim floats each) and the
+	// indices of the triangle corners
+	struct attrib_t {
+		std::vector<float> *coords;
+		int dim;
+		std::vector<int> *indices;
+	};
+	size_t attributes(attrib_t attrs[5]); // get attributes in use. Return how many.
+	void updateClusterBounds();
+
 	//! one material (not owned)
 	type_t m_type;
 	Material *m_materialFront;
@@ -141,6 +205,22 @@ private:
 	bool     m_vbo_uptodate; // whether the VAO/VBO are up-to-date
 	// VBO
 	GLuint  m_vbo_id; // Vertex Buffer Object id
+	GLuint  m_ibo_id; // Index Buffer Object id (only for indexed meshes)
 	// VAO
 	GLuint  m_vao_id; // Vertex Array Object
+
+	std::vector<TriangleMesh *> m_lods; // LODs 1, 2, ... (owned)
+	std::vector<float> m_lodErrors;     // error of LODs 1, 2, ...
+
+	// a cluster: triangles first .. first + count - 1, bounding sphere
+	// (center, radius) and normal cone (axis, cutoff). See cluster.h
+	struct cluster_t {
+		int first;
+		int count;
+		float bounds[8];
+	};
+	std::vector<cluster_t> m_clusters;
+
+	std::vector<BVHNode> m_bvh;   // BVH nodes
+	std::vector<int> m_bvhOrder;  // triangles of the BVH leaves
 };
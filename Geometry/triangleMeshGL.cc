@@ -1,3 +1,5 @@
+#include <cmath>
+#include <vector>
 #include "triangleMeshGL.h"
 #include "renderState.h" // For rendering state
 #include "shader.h"
@@ -14,24 +16,31 @@ struct Vbo_vertex {
 
 #define VBO_BUFFER_OFFSET(i) ((char *)NULL + (i))
 
+// Indexed meshes upload one VBO vertex per mesh vertex plus an index buffer,
+// and are drawn with glDrawElements. Other meshes upload one VBO vertex per
+// triangle corner, and are drawn with glDrawArrays.
+
 void TriangleMeshGL::init_opengl_vbo(TriangleMesh * thisMesh) {
 
 	float *v;
 
 	// free previous VBO/VAO
 	glDeleteBuffers(1, &thisMesh->m_vbo_id);
+	glDeleteBuffers(1, &thisMesh->m_ibo_id);
 	glDeleteVertexArrays(1, &thisMesh->m_vao_id);
-	size_t vIndices_n = thisMesh->m_vIndices.size();
+	thisMesh->m_ibo_id = 0;
+	bool indexed = thisMesh->numTriangles() && thisMesh->isIndexed();
+	size_t vIndices_n = indexed ? thisMesh->numVertices() : thisMesh->m_vIndices.size();
 	Vbo_vertex *buffer = new Vbo_vertex[ vIndices_n ];
 	for(size_t i = 0; i < vIndices_n; ++i) {
-		v = thisMesh->vCoords( thisMesh->m_vIndices[i] );
+		v = thisMesh->vCoords( indexed ? i : thisMesh->m_vIndices[i] );
 		buffer[i].v[0] = v[0];
 		buffer[i].v[1] = v[1];
 		buffer[i].v[2] = v[2];
 	}
 
 	for(size_t i = 0; i < vIndices_n; ++i) {
-		v = thisMesh->nCoords( thisMesh->m_nIndices[i] );
+		v = thisMesh->nCoords( indexed ? i : thisMesh->m_nIndices[i] );
 		buffer[i].n[0] = v[0];
 		buffer[i].n[1] = v[1];
 		buffer[i].n[2] = v[2];
@@ -39,17 +48,17 @@ void TriangleMeshGL::init_opengl_vbo(TriangleMesh * thisMesh) {
 	if(thisMesh->m_type & TriangleMesh::texcoords) {
 		for(size_t i = 0; i < vIndices_n; ++i) {
 			// textures
-			v = thisMesh->texCoords( thisMesh->m_texIndices[i] );
+			v = thisMesh->texCoords( indexed ? i : thisMesh->m_texIndices[i] );
 			buffer[i].t[0] = v[0];
 			buffer[i].t[1] = v[1];
 			if(thisMesh->m_type & TriangleMesh::bump) {
 				// TBN: tangents
-				v = thisMesh->tgtCoords( thisMesh->m_tgtIndices[i] );
+				v = thisMesh->tgtCoords( indexed ? i : thisMesh->m_tgtIndices[i] );
 				buffer[i].tbn_t[0] = v[0];
 				buffer[i].tbn_t[1] = v[1];
 				buffer[i].tbn_t[2] = v[2];
 				// TBN: bitangents
-				v = thisMesh->btgtCoords( thisMesh->m_btgtIndices[i] );
+				v = thisMesh->btgtCoords( indexed ? i : thisMesh->m_btgtIndices[i] );
 				buffer[i].tbn_b[0] = v[0];
 				buffer[i].tbn_b[1] = v[1];
 				buffer[i].tbn_b[2] = v[2];
@@ -69,6 +78,15 @@ void TriangleMeshGL::init_opengl_vbo(TriangleMesh * thisMesh) {
 				 vIndices_n * sizeof(Vbo_vertex),
 				 buffer,
 				 GL_STATIC_DRAW);
+	if (indexed) {
+		// create and upload the index buffer (bound to the VAO)
+		glGenBuffers(1, &thisMesh->m_ibo_id);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, thisMesh->m_ibo_id);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+					 thisMesh->m_vIndices.size() * sizeof(GLuint),
+					 &thisMesh->m_vIndices[0],
+					 GL_STATIC_DRAW);
+	}
 	// Attribute specification
 	// 0-11 (vertex-position) 12-23 (normal) 24-31 (texture coord) 32-43 (TBN tangent)
 	// 44-55 (TBN bitangent) 
@@ -120,8 +138,131 @@ void TriangleMeshGL::draw(TriangleMesh * thisMesh) {
 	shaderProgram->beforeDraw();
 
 	glBindVertexArray(thisMesh->m_vao_id);
-	glDrawArrays(GL_TRIANGLES,
-				 0,
-				 thisMesh->m_vIndices.size());
+	if (rs->getClusterCulling() && thisMesh->numClusters())
+		draw_clusters(thisMesh);
+	else {
+		rs->addDrawCall(thisMesh->numTriangles());
+		if (thisMesh->m_ibo_id)
+			glDrawElements(GL_TRIANGLES,
+						   thisMesh->m_vIndices.size(),
+						   GL_UNSIGNED_INT,
+						   (GLvoid *) 0);
+		else
+			glDrawArrays(GL_TRIANGLES,
+						 0,
+						 thisMesh->m_vIndices.size());
+	}
 	glBindVertexArray(0);
 }
+
+// Solve A x = b, where A is the upper 3x3 of the column-major matrix M (by
+// Cramer's rule). Return false if A is singular.
+
+static bool solve_linear3(const GLfloat *M, const float b[3], float x[3]) {
+	const GLfloat *c0 = M, *c1 = M + 4, *c2 = M + 8;
+	float det = c0[0] * (c1[1] * c2[2] - c1[2] * c2[1]) -
+		c1[0] * (c0[1] * c2[2] - c0[2] * c2[1]) +
+		c2[0] * (c0[1] * c1[2] - c0[2] * c1[1]);
+	if (det == 0.0f) return false;
+	x[0] = (b[0] * (c1[1] * c2[2] - c1[2] * c2[1]) -
+			c1[0] * (b[1] * c2[2] - b[2] * c2[1]) +
+			c2[0] * (b[1] * c1[2] - b[2] * c1[1])) / det;
+	x[1] = (c0[0] * (b[1] * c2[2] - b[2] * c2[1]) -
+			b[0] * (c0[1] * c2[2] - c0[2] * c2[1]) +
+			c2[0] * (c0[1] * b[2] - c0[2] * b[1])) / det;
+	x[2] = (c0[0] * (c1[1] * b[2] - c1[2] * b[1]) -
+			c1[0] * (c0[1] * b[2] - c0[2] * b[1]) +
+			b[0] * (c0[1] * c1[2] - c0[2] * c1[1])) / det;
+	return true;
+}
+
+// Clusters are culled in model coordinates: against the frustum planes of
+// the modelview_projection matrix (bounding sphere), and against the eye
+// (normal cone), when back (or front) faces are culled. Consecutive visible
+// clusters are merged into one range, and all ranges are drawn with one
+// glMultiDraw call.
+
+void TriangleMeshGL::draw_clusters(TriangleMesh * thisMesh) {
+
+	static std::vector<GLsizei> counts;
+	static std::vector<GLint> firsts;
+	static std::vector<const GLvoid *> offsets;
+	RenderState *rs = RenderState::instance();
+	float planes[6][4];
+	float eye[4]; // eye position (w = 1) or direction to the eye (w = 0)
+	float facing = 0.0f; // 1 if back faces are culled, -1 if front, 0 if none
+
+	// frustum planes (Gribb & Hartmann), inside if dot(plane, P) >= 0
+	const GLfloat *M = rs->getGLMatrix(RenderState::modelview_projection);
+	for(int i = 0; i < 3; ++i) {
+		for(int j = 0; j < 4; ++j) {
+			planes[2 * i][j] = M[4 * j + 3] + M[4 * j + i];
+			planes[2 * i + 1][j] = M[4 * j + 3] - M[4 * j + i];
+		}
+	}
+	for(int i = 0; i < 6; ++i) {
+		float len = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] +
+						  planes[i][2] * planes[i][2]);
+		if (len > 0.0f)
+			for(int j = 0; j < 4; ++j) planes[i][j] /= len;
+	}
+	if (glIsEnabled(GL_CULL_FACE)) {
+		GLint mode;
+		glGetIntegerv(GL_CULL_FACE_MODE, &mode);
+		if (mode == GL_BACK) facing = 1.0f;
+		else if (mode == GL_FRONT) facing = -1.0f;
+	}
+	if (facing != 0.0f) {
+		// the eye is at the origin of the view, and looks to -Z
+		const GLfloat *MV = rs->getGLMatrix(RenderState::modelview);
+		eye[3] = rs->getGLMatrix(RenderState::projection)[11] == 0.0f ? 0.0f : 1.0f;
+		float b[3] = { 0.0f, 0.0f, 1.0f };
+		if (eye[3] != 0.0f)
+			for(int i = 0; i < 3; ++i) b[i] = -MV[12 + i];
+		if (!solve_linear3(MV, b, eye)) facing = 0.0f;
+		if (eye[3] == 0.0f) {
+			float len = sqrtf(eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2]);
+			for(int i = 0; i < 3; ++i) eye[i] /= len;
+		}
+	}
+
+	counts.clear();
+	firsts.clear();
+	offsets.clear();
+	size_t triangles = 0;
+	int end = -1; // end of the last range
+	for(std::vector<TriangleMesh::cluster_t>::const_iterator it = thisMesh->m_clusters.begin(),
+			it_end = thisMesh->m_clusters.end(); it != it_end; ++it) {
+		const float *b = it->bounds;
+		bool culled = false;
+		for(int i = 0; i < 6 && !culled; ++i)
+			culled = planes[i][0] * b[0] + planes[i][1] * b[1] + planes[i][2] * b[2] +
+				planes[i][3] < -b[3];
+		if (!culled && facing != 0.0f && b[7] < 1.0f) {
+			// C - E (or the view direction) dotted with the axis
+			float d[3];
+			for(int i = 0; i < 3; ++i)
+				d[i] = eye[3] == 0.0f ? -eye[i] : b[i] - eye[i];
+			float len = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+			float dot = facing * (d[0] * b[4] + d[1] * b[5] + d[2] * b[6]);
+			culled = eye[3] == 0.0f ? dot >= b[7] : dot >= b[7] * len + b[3];
+		}
+		if (culled) continue;
+		triangles += it->count;
+		if (it->first == end) {
+			counts.back() += 3 * it->count;
+		} else {
+			counts.push_back(3 * it->count);
+			firsts.push_back(3 * it->first);
+			offsets.push_back((const GLvoid *) (3 * it->first * sizeof(GLuint)));
+		}
+		end = it->first + it->count;
+	}
+	if (counts.empty()) return;
+	rs->addDrawCall(triangles);
+	if (thisMesh->m_ibo_id)
+		glMultiDrawElements(GL_TRIANGLES, &counts[0], GL_UNSIGNED_INT,
+							&offsets[0], counts.size());
+	else
+		glMultiDrawArrays(GL_TRIANGLES, &firsts[0], &counts[0], counts.size());
+}
@@ -9,4 +9,5 @@ public:
 	static void draw(TriangleMesh * thisMesh);
 private:
 	static void init_opengl_vbo(TriangleMesh * thisMesh);
+	static void draw_clusters(TriangleMesh * thisMesh); // draw the visible clusters
 };
@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <cassert>
+#include "affine3D.h"
+
+Affine3D::Affine3D() : Trfm3D() {}
+
+Affine3D::Affine3D(const Affine3D & T) : Trfm3D(T) {}
+
+Affine3D::Affine3D(const Trfm3D & T) : Trfm3D(T) {
+	assert(isAffine(T));
+	checkAffine("Affine3D");
+}
+
+void Affine3D::swap(Affine3D & T) { Trfm3D::swap(T); }
+
+// Compute this*add and leave the result in this. The last row of both is
+// (0, 0, 0, 1), so that
+//
+//   res_j = M_0 * T_0j + M_1 * T_1j + M_2 * T_2j          (j < 3)
+//   res_3 = M_0 * T_03 + M_1 * T_13 + M_2 * T_23 + M_3
+//
+// and the last row of the result is (0, 0, 0, 1) again.
+
+void Affine3D::add(const Affine3D & T) {
+	assert(isAffine(*this) && isAffine(T));
+#ifdef TRFM_SSE
+	__m128 c0 = _mm_load_ps(m_m);
+	__m128 c1 = _mm_load_ps(m_m + 4);
+	__m128 c2 = _mm_load_ps(m_m + 8);
+	for(int j = 0; j < 4; ++j) {
+		const float *t = T.m_m + 4 * j;
+		__m128 r = _mm_mul_ps(c0, _mm_set1_ps(t[0]));
+		r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(t[1])));
+		r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(t[2])));
+		if (j == 3) r = _mm_add_ps(r, _mm_load_ps(m_m + 12));
+		_mm_store_ps(m_m + 4 * j, r);
+	}
+#else
+	float M[12];
+	for(int j = 0; j < 3; ++j)
+		for(int i = 0; i < 3; ++i) M[3 * j + i] = m_m[4 * j + i];
+	for(int j = 0; j < 4; ++j) {
+		const float *t = T.m_m + 4 * j;
+		for(int i = 0; i < 3; ++i)
+			m_m[4 * j + i] = M[i] * t[0] + M[3 + i] * t[1] + M[6 + i] * t[2] + (j == 3 ? m_m[12 + i] : 0.0f);
+	}
+#endif
+	m_scl *= T.m_scl;
+}
+
+void Affine3D::add(const Affine3D * T) { add(*T); }
+
+void Affine3D::add(const Trfm3D & T) {
+	assert(isAffine(T));
+	Trfm3D::add(T);
+	checkAffine("add");
+}
+
+void Affine3D::add(const Trfm3D * T) { add(*T); }
+
+void Affine3D::clone(const Affine3D & T) {
+	assert(isAffine(T));
+	Trfm3D::clone(T);
+}
+
+void Affine3D::clone(const Affine3D * T) { clone(*T); }
+
+void Affine3D::clone(const Trfm3D & T) {
+	assert(isAffine(T));
+	Trfm3D::clone(T);
+	checkAffine("clone");
+}
+
+void Affine3D::clone(const Trfm3D * T) { clone(*T); }
+
+bool Affine3D::isAffine(const Trfm3D & T) {
+	const float *m = T.getGLMatrix();
+	return m[3] == 0.0f && m[7] == 0.0f && m[11] == 0.0f && m[15] == 1.0f;
+}
+
+// drop the last row of a projective trfm
+
+void Affine3D::checkAffine(const char *func) {
+	if (isAffine(*this)) return;
+	fprintf(stderr, "[W] Affine3D::%s: projective trfm, last row dropped\n", func);
+	m_m[3] = m_m[7] = m_m[11] = 0.0f;
+	m_m[15] = 1.0f;
+}
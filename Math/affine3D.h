@@ -0,0 +1,71 @@
+// -*-C++-*-
+
+#pragma once
+
+#include "trfm3D.h"
+
+/*! \file affine3D.h
+
+  Affine transformations (rotations, translations and uniform scales)
+
+  The last row of the matrix is (0, 0, 0, 1), so an Affine3D is a 3x4
+  matrix. It keeps the memory layout of Trfm3D (an OpenGL matrix), and can be
+  used wherever a Trfm3D is expected (drawing, the matrix stacks...).
+
+  The last row is only a convention, not enforced by the type: Affine3D is a
+  public Trfm3D, and through a Trfm3D pointer or reference setFrustum,
+  addFrustum or swap still reach it. Hiding them below only keeps them off
+  the Affine3D interface. clone and add assert that their source (and, for
+  the affine kernel, this) is affine.
+
+  Composing two Affine3D picks the affine kernel at compile time, which skips
+  the last row (12 products per column pair instead of 16):
+
+  <code>
+  Affine3D A, B;
+  A.add(B);  // affine kernel
+  Trfm3D P;
+  P.add(A);  // projective kernel, P may be a projection
+  </code>
+
+  Projections (setFrustum, addFrustum) are not available. A Trfm3D cloned or
+  added into an Affine3D must be affine. With NDEBUG, the last row of a
+  projective one is dropped (with a warning).
+*/
+
+class Affine3D : public Trfm3D {
+
+public:
+	// Init with unit transformation
+	Affine3D();
+	Affine3D(const Affine3D & T);
+	explicit Affine3D(const Trfm3D & T);
+	void swap(Affine3D & T);
+
+	/*! Transformation composition : add one trfm onto another one
+	  this = this * add */
+
+	void add(const Affine3D & T);
+	void add(const Affine3D * T);
+	void add(const Trfm3D & T); // T must be affine
+	void add(const Trfm3D * T);
+
+	// clone transformation from T
+	void clone(const Affine3D & T);
+	void clone(const Affine3D * T);
+	void clone(const Trfm3D & T); // T must be affine
+	void clone(const Trfm3D * T);
+
+	//! Whether a Trfm3D is affine (its last row is 0, 0, 0, 1)
+	static bool isAffine(const Trfm3D & T);
+
+private:
+	void swap(Trfm3D & T);
+	void setFrustum(float left, float right,
+					float bottom, float top,
+					float near, float far);
+	void addFrustum(float left, float right,
+					float top, float bottom,
+					float near, float far);
+	void checkAffine(const char *func);
+};
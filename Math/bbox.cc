@@ -21,12 +21,6 @@ BBox::BBox(const Vector3 & min, const Vector3 & max) : m_min(min), m_max(max) {
 	m_vbo_uptodate = 0;
 }
 
-void BBox::clone(const BBox * source) {
-	m_min = source->m_min;
-	m_max = source->m_max;
-	m_vbo_uptodate = 0;
-}
-
 void BBox::init() {
 	BBox().swap(*this);
 }
@@ -39,22 +33,6 @@ void BBox::swap(BBox & rhs) {
 	std::swap(m_vbo_uptodate, rhs.m_vbo_uptodate);
 }
 
-void BBox::add(const Vector3 & P) {
-	m_min[0] = fmin(m_min[0], P[0]);
-	m_min[1] = fmin(m_min[1], P[1]);
-	m_min[2] = fmin(m_min[2], P[2]);
-	m_max[0] = fmax(m_max[0], P[0]);
-	m_max[1] = fmax(m_max[1], P[1]);
-	m_max[2] = fmax(m_max[2], P[2]);
-	m_vbo_uptodate = 0;
-}
-
-void BBox::include(const BBox *bbb ) {
-	add(bbb->m_min);
-	add(bbb->m_max);
-	m_vbo_uptodate = 0;
-}
-
 /* Given a trfm3D transformation, calculate the new axis aligned BBox
 
    Algorithm based on:
@@ -70,9 +48,7 @@ void BBox::transform(const Trfm3D * T) {
 	float  Bmin[3], Bmax[3];
 	int    i, j;
 
-	static float M[16]; // OpenGL matrix. Column-major mode !
-
-	T->getGLMatrix(&M[0]); // Copy transf. to array
+	const float *M = T->getGLMatrix(); // OpenGL matrix. Column-major mode !
 
 	/*Copy box geomBox into a min array and a max array for easy reference.*/
 
@@ -116,6 +92,150 @@ void BBox::transform(const Trfm3D * T) {
 	m_vbo_uptodate = 0;
 }
 
+/* The same for an affine trfm, with the centre and half sizes of the box:
+
+   c' = M * c + tr
+   e' = |M| * e
+
+   which needs no branches. */
+
+void BBox::transform(const Affine3D * T) {
+
+	if (m_min[0] > m_max[0]) return; // the void BBox stays void
+	const float *M = T->getGLMatrix(); // column-major
+	float c[3], e[3];
+	for(int j = 0; j < 3; j++) {
+		float lo = m_min[j], hi = m_max[j];
+		c[j] = 0.5f * (lo + hi);
+		e[j] = 0.5f * (hi - lo);
+	}
+	for(int i = 0; i < 3; i++) {
+		float C = M[i] * c[0] + M[i + 4] * c[1] + M[i + 8] * c[2] + M[i + 12];
+		float E = fabsf(M[i]) * e[0] + fabsf(M[i + 4]) * e[1] + fabsf(M[i + 8]) * e[2];
+		m_min[i] = C - E;
+		m_max[i] = C + E;
+	}
+	m_vbo_uptodate = 0;
+}
+
+
+/* Batched transform of SoA boxes, with the centre and half sizes as above.
+
+   With SSE, 4 boxes are transformed at a time: the columns of their 4
+   matrices are transposed, so that every register holds one element of
+   the 4 matrices. */
+
+#ifdef TRFM_SSE
+static const __m128 sign_mask = _mm_set1_ps(-0.0f);
+#endif
+
+static void transform_one(const BBox::soa_t & src, const Trfm3D *T, size_t i,
+						  const BBox::soa_t & dst) {
+	const float *M = T->getGLMatrix();
+	if (src.min[0][i] > src.max[0][i]) { // the void BBox stays void
+		for(int k = 0; k < 3; k++) {
+			dst.min[k][i] = src.min[k][i];
+			dst.max[k][i] = src.max[k][i];
+		}
+		return;
+	}
+	float c[3], e[3];
+	for(int j = 0; j < 3; j++) {
+		float lo = src.min[j][i], hi = src.max[j][i];
+		c[j] = 0.5f * (lo + hi);
+		e[j] = 0.5f * (hi - lo);
+	}
+	for(int k = 0; k < 3; k++) {
+		float C = M[k] * c[0] + M[k + 4] * c[1] + M[k + 8] * c[2] + M[k + 12];
+		float E = fabsf(M[k]) * e[0] + fabsf(M[k + 4]) * e[1] + fabsf(M[k + 8]) * e[2];
+		dst.min[k][i] = C - E;
+		dst.max[k][i] = C + E;
+	}
+}
+
+void BBox::transform(const soa_t & src, const Trfm3D *const *T, size_t n,
+					 const soa_t & dst) {
+	size_t i = 0;
+#ifdef TRFM_SSE
+	for(; i + 4 <= n; i += 4) {
+		__m128 m[4][3]; // m[j][k]: element (k, j) of the 4 matrices
+		for(int j = 0; j < 4; j++) {
+			__m128 r0 = _mm_load_ps(T[i]->getGLMatrix() + 4 * j);
+			__m128 r1 = _mm_load_ps(T[i + 1]->getGLMatrix() + 4 * j);
+			__m128 r2 = _mm_load_ps(T[i + 2]->getGLMatrix() + 4 * j);
+			__m128 r3 = _mm_load_ps(T[i + 3]->getGLMatrix() + 4 * j);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			m[j][0] = r0;
+			m[j][1] = r1;
+			m[j][2] = r2;
+		}
+		__m128 c[3], e[3];
+		for(int j = 0; j < 3; j++) {
+			__m128 lo = _mm_loadu_ps(src.min[j] + i);
+			__m128 hi = _mm_loadu_ps(src.max[j] + i);
+			c[j] = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(lo, hi));
+			e[j] = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(hi, lo));
+		}
+		__m128 lo0 = _mm_loadu_ps(src.min[0] + i);
+		__m128 empty = _mm_cmpgt_ps(lo0, _mm_loadu_ps(src.max[0] + i));
+		__m128 rmin[3], rmax[3];
+		for(int k = 0; k < 3; k++) {
+			__m128 C = m[3][k], E = _mm_setzero_ps();
+			for(int j = 0; j < 3; j++) {
+				C = _mm_add_ps(C, _mm_mul_ps(m[j][k], c[j]));
+				E = _mm_add_ps(E, _mm_mul_ps(_mm_andnot_ps(sign_mask, m[j][k]), e[j]));
+			}
+			// the void BBox stays void
+			rmin[k] = _mm_or_ps(_mm_and_ps(empty, _mm_loadu_ps(src.min[k] + i)),
+								_mm_andnot_ps(empty, _mm_sub_ps(C, E)));
+			rmax[k] = _mm_or_ps(_mm_and_ps(empty, _mm_loadu_ps(src.max[k] + i)),
+								_mm_andnot_ps(empty, _mm_add_ps(C, E)));
+		}
+		for(int k = 0; k < 3; k++) {
+			_mm_storeu_ps(dst.min[k] + i, rmin[k]);
+			_mm_storeu_ps(dst.max[k] + i, rmax[k]);
+		}
+	}
+#endif
+	for(; i < n; i++) transform_one(src, T[i], i, dst);
+}
+
+void BBox::include(const soa_t & boxes, size_t n) {
+	float lo[3], hi[3];
+	for(int k = 0; k < 3; k++) {
+		lo[k] = m_min[k];
+		hi[k] = m_max[k];
+	}
+	size_t i = 0;
+#ifdef TRFM_SSE
+	if (n >= 4) {
+		for(int k = 0; k < 3; k++) {
+			__m128 vlo = _mm_loadu_ps(boxes.min[k]);
+			__m128 vhi = _mm_loadu_ps(boxes.max[k]);
+			for(i = 4; i + 4 <= n; i += 4) {
+				vlo = _mm_min_ps(vlo, _mm_loadu_ps(boxes.min[k] + i));
+				vhi = _mm_max_ps(vhi, _mm_loadu_ps(boxes.max[k] + i));
+			}
+			alignas(16) float l[4], h[4];
+			_mm_store_ps(l, vlo);
+			_mm_store_ps(h, vhi);
+			for(int j = 0; j < 4; j++) {
+				lo[k] = std::min(lo[k], l[j]);
+				hi[k] = std::max(hi[k], h[j]);
+			}
+		}
+	}
+#endif
+	for(; i < n; i++)
+		for(int k = 0; k < 3; k++) {
+			lo[k] = std::min(lo[k], boxes.min[k][i]);
+			hi[k] = std::max(hi[k], boxes.max[k][i]);
+		}
+	m_min = Vector3(lo[0], lo[1], lo[2]);
+	m_max = Vector3(hi[0], hi[1], hi[2]);
+	m_vbo_uptodate = 0;
+}
+
 
 void BBox::print() const {
 	printf("(%.2f %.2f %.2f), (%.2f %.2f %.2f)", m_min[0], m_min[1], m_min[2], m_max[0], m_max[1], m_max[2]);
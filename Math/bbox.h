@@ -10,8 +10,10 @@
     #include <GL/glut.h>
 #endif
 #include <stdio.h>
+#include <cmath>
 #include "vector3.h"
 #include "trfm3D.h"
+#include "affine3D.h"
 
 class BBox {
 
@@ -50,6 +52,29 @@ public:
 	 * transform by a trfm
 	 */
 	void transform(const Trfm3D * T);
+	void transform(const Affine3D * T); // cheaper, no copy of the matrix
+
+	/**
+	 * Boxes stored as SoA (for the batched functions below): coordinate k of
+	 * box i is min[k][i] and max[k][i]. The arrays belong to the caller.
+	 */
+	struct soa_t {
+		float *min[3];
+		float *max[3];
+	};
+
+	/**
+	 * Transform n boxes at once: box i of dst is box i of src transformed by
+	 * T[i] (as transform(); only the affine part of T[i] is used). dst may be
+	 * src. No allocation and no shared state, so several threads may call it.
+	 */
+	static void transform(const soa_t & src, const Trfm3D *const *T, size_t n,
+						  const soa_t & dst);
+
+	/**
+	 * Include n boxes at once
+	 */
+	void include(const soa_t & boxes, size_t n);
 
 
 	void print() const;
@@ -62,3 +87,30 @@ public:
 	GLuint  m_idxvbo_id; // Index Vertex Buffer Object id
 	int     m_vbo_uptodate;
 };
+
+inline void BBox::clone(const BBox * source) {
+	m_min = source->m_min;
+	m_max = source->m_max;
+	m_vbo_uptodate = 0;
+}
+
+inline void BBox::add(const Vector3 & P) {
+	m_min[0] = std::min(m_min[0], P[0]);
+	m_min[1] = std::min(m_min[1], P[1]);
+	m_min[2] = std::min(m_min[2], P[2]);
+	m_max[0] = std::max(m_max[0], P[0]);
+	m_max[1] = std::max(m_max[1], P[1]);
+	m_max[2] = std::max(m_max[2], P[2]);
+	m_vbo_uptodate = 0;
+}
+
+// (the void BBox includes nothing)
+
+inline void BBox::include(const BBox *bbb ) {
+	for(int k = 0; k < 3; k++) {
+		m_min[k] = std::min(m_min[k], bbb->m_min[k]);
+		m_max[k] = std::max(m_max[k], bbb->m_max[k]);
+	}
+	m_vbo_uptodate = 0;
+}
+
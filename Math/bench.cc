@@ -0,0 +1,953 @@
+// Benchmark and randomized test of the math core (Vector3, Plane, BBox,
+// BSphere, OBB, Trfm3D and the primitives of intersect.cc). Only uses the
+// public API, so that the same file builds against an older tree (see the
+// bench-compare target of the Makefile).
+//
+// usage: bench [-s seed] [-n elements] [-r runs] [-csv] [-check | -nocheck]
+//
+// First checks every primitive over the random data against a reference
+// implementation in double precision (cases which are too close to a
+// decision boundary for float to be reliable are skipped), then times every
+// kernel: the best time per operation of several runs, the throughput and a
+// checksum of the results (equal checksums: same results). -check only runs
+// the checks, -nocheck only the timings. The exit status is 1 if some check
+// fails.
+//
+// With -csv the output is one record per line, the first field telling its
+// kind:
+//
+//   check,<name>,<cases>,<skipped>,<failures>
+//   bench,<kernel>,<ns_per_op>,<mops_per_s>,<checksum>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <vector>
+#include <chrono>
+#include "vector3.h"
+#include "plane.h"
+#include "line.h"
+#include "bbox.h"
+#include "bsphere.h"
+#include "obb.h"
+#include "trfm3D.h"
+#include "intersect.h"
+#include "constants.h"
+
+using std::vector;
+
+static int N = 1 << 16; // elements per run
+static int runs = 7;
+static bool csv = false;
+
+static const float range = 20.0f; // of the random coordinates
+static const int trfms_n = 256;
+
+static float frand(float lo, float hi) {
+	return lo + (hi - lo) * (rand() / (float) RAND_MAX);
+}
+
+static Vector3 vrand(float lo, float hi) {
+	return Vector3(frand(lo, hi), frand(lo, hi), frand(lo, hi));
+}
+
+// random rotation, translation and scale
+static void trfm_rand(Trfm3D & T) {
+	T.setRotVec(vrand(-1.0f, 1.0f), frand(-3.0f, 3.0f));
+	T.addTrans(vrand(-range, range));
+	T.addScale(frand(0.5f, 2.0f));
+}
+
+struct data_t {
+	vector<Vector3> P;
+	vector<Vector3> normals; // unit length
+	vector<float> packed; // P as x y z x y z ...
+	vector<BBox> boxes;
+	vector<BSphere> spheres;
+	vector<OBB> obbs; // box i placed by trfm i % trfms_n
+	vector<Plane> planes;
+	vector<Line> rays; // the direction is not unit length
+	vector<Vector3> tris; // triangle i is tris[3i], tris[3i + 1], tris[3i + 2]
+	vector<float> soa[2][3]; // boxes as SoA: soa[0] the min, soa[1] the max
+	vector<float> packets; // rays 4j..4j + 3 as packet j: origin[3][4], inv[3][4]
+	vector<Trfm3D> T;
+};
+
+static void data_init(data_t & d) {
+	d.P.resize(N);
+	d.normals.resize(N);
+	d.packed.resize(3 * N);
+	d.boxes.resize(N);
+	d.spheres.resize(N);
+	d.obbs.resize(N);
+	d.rays.resize(N);
+	d.tris.resize(3 * N);
+	d.T.resize(trfms_n);
+	for(int i = 0; i < N; ++i) {
+		d.P[i] = vrand(-range, range);
+		for(int k = 0; k < 3; ++k) d.packed[3 * i + k] = d.P[i][k];
+		d.normals[i] = vrand(-1.0f, 1.0f);
+		d.normals[i].normalize();
+		Vector3 C = vrand(-range, range);
+		Vector3 E = vrand(0.1f, 10.0f);
+		d.boxes[i].m_min = C - E;
+		d.boxes[i].m_max = C + E;
+		d.spheres[i] = BSphere(vrand(-range, range), frand(0.1f, 10.0f));
+		// a triangle, and a ray aimed around it (about half of them hit)
+		Vector3 A = vrand(-range, range);
+		for(int k = 0; k < 3; ++k) d.tris[3 * i + k] = A + vrand(-5.0f, 5.0f);
+		Vector3 O = vrand(-2.0f * range, 2.0f * range);
+		Vector3 G = (d.tris[3 * i] + d.tris[3 * i + 1] + d.tris[3 * i + 2]) * (1.0f / 3.0f);
+		d.rays[i] = Line(O, G + vrand(-3.0f, 3.0f) - O);
+	}
+	for(int j = 0; j < 6; ++j) {
+		d.planes.push_back(Plane(vrand(-1.0f, 1.0f), frand(-range, range)));
+		d.planes.back().normalize();
+	}
+	for(int j = 0; j < trfms_n; ++j) trfm_rand(d.T[j]);
+	for(int i = 0; i < N; ++i) d.obbs[i].set(&d.boxes[i], &d.T[i % trfms_n]);
+	for(int k = 0; k < 3; ++k) {
+		d.soa[0][k].resize(N);
+		d.soa[1][k].resize(N);
+		for(int i = 0; i < N; ++i) {
+			d.soa[0][k][i] = d.boxes[i].m_min[k];
+			d.soa[1][k][i] = d.boxes[i].m_max[k];
+		}
+	}
+	d.packets.resize(24 * (N / 4));
+	for(int j = 0; j < N / 4; ++j)
+		for(int l = 0; l < 4; ++l)
+			for(int k = 0; k < 3; ++k) {
+				d.packets[24 * j + 4 * k + l] = d.rays[4 * j + l].m_O[k];
+				d.packets[24 * j + 12 + 4 * k + l] = 1.0f / d.rays[4 * j + l].m_d[k];
+			}
+}
+
+// boxes i.. of d as SoA
+static BBox::soa_t soa_at(data_t & d, int i) {
+	BBox::soa_t b;
+	for(int k = 0; k < 3; ++k) {
+		b.min[k] = &d.soa[0][k][i];
+		b.max[k] = &d.soa[1][k][i];
+	}
+	return b;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Checks
+
+// relative tolerance of the results in float (the reference is exact
+// enough), and distance to a decision boundary below which a case is
+// skipped (relative to the magnitude of the values involved)
+static const double tolerance = 1e-4;
+static const double ambiguity = 1e-5;
+
+static bool ambiguous(double margin, double scale) {
+	return fabs(margin) <= ambiguity * (1.0 + scale);
+}
+
+static bool near(double a, double b, double scale) {
+	return fabs(a - b) <= tolerance * (1.0 + scale);
+}
+
+struct check_t {
+	const char *name;
+	size_t cases, skipped, failures;
+};
+
+static vector<check_t> checks;
+
+static check_t & check_begin(const char *name) {
+	check_t c = { name, 0, 0, 0 };
+	checks.push_back(c);
+	return checks.back();
+}
+
+// count a case, reporting the first failures
+static void check_case(check_t & c, bool ok, int i, const char *what) {
+	++c.cases;
+	if (ok) return;
+	if (c.failures < 3)
+		fprintf(stderr, "[E] check %s: element %d: %s\n", c.name, i, what);
+	++c.failures;
+}
+
+static void dvec(const Vector3 & V, double *v) {
+	for(int k = 0; k < 3; ++k) v[k] = V[k];
+}
+
+static double ddot(const double *a, const double *b) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void dcross(const double *a, const double *b, double *r) {
+	r[0] = a[1] * b[2] - a[2] * b[1];
+	r[1] = a[2] * b[0] - a[0] * b[2];
+	r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double dlength(const double *a) { return sqrt(ddot(a, a)); }
+
+// r = M * (v, w), M column-major
+static void dtransform(const float *M, const double *v, double w, double *r) {
+	for(int i = 0; i < 3; ++i)
+		r[i] = M[i] * v[0] + M[4 + i] * v[1] + M[8 + i] * v[2] + M[12 + i] * w;
+}
+
+static double mscale(const float *M) {
+	double s = 0.0;
+	for(int i = 0; i < 16; ++i) s = std::max(s, (double) fabsf(M[i]));
+	return s;
+}
+
+static void checkVector(data_t & d) {
+	check_t & c = check_begin("vector_ops");
+	for(int i = 0; i + 1 < N; ++i) {
+		const Vector3 & A = d.P[i];
+		const Vector3 & B = d.P[i + 1];
+		double a[3], b[3], r[3];
+		dvec(A, a);
+		dvec(B, b);
+		double s = dlength(a) * dlength(b);
+		check_case(c, near(A.dot(B), ddot(a, b), s), i, "dot");
+		Vector3 X = crossVectors(A, B);
+		dcross(a, b, r);
+		bool ok = true;
+		for(int k = 0; k < 3; ++k) ok = ok && near(X[k], r[k], s);
+		check_case(c, ok, i, "cross");
+		check_case(c, near(A.length(), dlength(a), dlength(a)), i, "length");
+		Vector3 U(A);
+		ok = near(U.normalize(), dlength(a), dlength(a));
+		for(int k = 0; k < 3; ++k) ok = ok && near(U[k], a[k] / dlength(a), 1.0);
+		check_case(c, ok, i, "normalize");
+		Vector3 S = (A - B) * 0.5f + B;
+		ok = true;
+		for(int k = 0; k < 3; ++k) ok = ok && near(S[k], 0.5 * (a[k] + b[k]), s);
+		check_case(c, ok, i, "add/sub/scale");
+	}
+}
+
+// reference side of a point: the signed distance against the epsilon of
+// Plane::whichSide (0 for ambiguous)
+static int ref_side(const Plane & pl, const double *p, double scale, bool & amb) {
+	double n[3];
+	dvec(pl.m_n, n);
+	double s = ddot(n, p) - pl.m_d;
+	double eps = Constants::distance_epsilon;
+	if (ambiguous(fabs(s) - eps, scale)) amb = true;
+	return s > eps ? 1 : (s < -eps ? -1 : 0);
+}
+
+static void checkWhichSide(data_t & d) {
+	check_t & c = check_begin("plane_whichSide");
+	for(int i = 0; i < N; ++i) {
+		for(size_t j = 0; j < d.planes.size(); ++j) {
+			double p[3];
+			dvec(d.P[i], p);
+			bool amb = false;
+			int ref = ref_side(d.planes[j], p, range + fabs(d.planes[j].m_d), amb);
+			if (amb) { ++c.skipped; continue; }
+			check_case(c, d.planes[j].whichSide(d.P[i]) == ref, i, "side");
+		}
+	}
+}
+
+// the signed distances of a normalized plane are the ones of the plane
+// before, divided by the length of its normal (also for short normals, as
+// the ones of the frustum planes)
+static void checkPlaneNormalize(data_t & d) {
+	check_t & c = check_begin("plane_normalize");
+	for(int i = 0; i + 1 < N; ++i) {
+		float len = i % 2 ? 1e-3f : 10.0f;
+		Plane pl(d.normals[i] * len, frand(-range, range) * len);
+		double n[3], p[3];
+		dvec(pl.m_n, n);
+		dvec(d.P[i], p);
+		double ref = (ddot(n, p) - pl.m_d) / dlength(n);
+		check_case(c, near(pl.signedDistance(d.P[i]), ref, 2.0 * range), i, "signed distance");
+	}
+}
+
+static void checkBBoxBBox(data_t & d) {
+	check_t & c = check_begin("bbox_bbox_intersect");
+	for(int i = 0; i < N; ++i) {
+		const BBox & a = d.boxes[i];
+		const BBox & b = d.boxes[N - 1 - i];
+		// the boxes overlap iff their intervals on the three axes overlap
+		int ref = IINTERSECT;
+		for(int k = 0; k < 3; ++k)
+			if (std::max(a.m_min[k], b.m_min[k]) > std::min(a.m_max[k], b.m_max[k]))
+				ref = IREJECT;
+		check_case(c, BBoxBBoxIntersect(&a, &b) == ref, i, intersect_string(ref));
+	}
+}
+
+// reference: the sides of the 8 corners of the box
+static void checkBBoxPlane(data_t & d) {
+	check_t & c = check_begin("bbox_plane_intersect");
+	for(int i = 0; i < N; ++i) {
+		const BBox & box = d.boxes[i];
+		for(size_t j = 0; j < d.planes.size(); ++j) {
+			bool amb = false;
+			int pos = 0, neg = 0;
+			for(int corner = 0; corner < 8; ++corner) {
+				double p[3];
+				for(int k = 0; k < 3; ++k)
+					p[k] = (corner >> k & 1) ? box.m_max[k] : box.m_min[k];
+				int side = ref_side(d.planes[j], p, 2.0 * range + fabs(d.planes[j].m_d), amb);
+				pos += side > 0;
+				neg += side < 0;
+			}
+			if (amb) { ++c.skipped; continue; }
+			int ref = pos == 8 ? +IREJECT : (neg == 8 ? -IREJECT : IINTERSECT);
+			check_case(c, BBoxPlaneIntersect(&box, &d.planes[j]) == ref, i, intersect_string(ref));
+		}
+	}
+}
+
+static void checkBSphereBSphere(data_t & d) {
+	check_t & c = check_begin("bsphere_bsphere_intersect");
+	for(int i = 0; i < N; ++i) {
+		const BSphere & a = d.spheres[i];
+		const BSphere & b = d.spheres[N - 1 - i];
+		double ca[3], cb[3], v[3];
+		dvec(a.m_centre, ca);
+		dvec(b.m_centre, cb);
+		for(int k = 0; k < 3; ++k) v[k] = ca[k] - cb[k];
+		double margin = dlength(v) - ((double) a.m_radius + b.m_radius);
+		if (ambiguous(margin, 2.0 * range)) { ++c.skipped; continue; }
+		int ref = margin > 0.0 ? IREJECT : IINTERSECT;
+		check_case(c, BSphereBSphereIntersect(&a, &b) == ref, i, intersect_string(ref));
+	}
+}
+
+static void checkBSpherePlane(data_t & d) {
+	check_t & c = check_begin("bsphere_plane_intersect");
+	for(int i = 0; i < N; ++i) {
+		const BSphere & sph = d.spheres[i];
+		for(size_t j = 0; j < d.planes.size(); ++j) {
+			double p[3], n[3];
+			dvec(sph.m_centre, p);
+			dvec(d.planes[j].m_n, n);
+			double s = ddot(n, p) - d.planes[j].m_d;
+			double scale = range + fabs(d.planes[j].m_d);
+			if (ambiguous(fabs(s) - sph.m_radius, scale)) { ++c.skipped; continue; }
+			int ref = IINTERSECT;
+			if (fabs(s) > sph.m_radius) ref = s > 0.0 ? +IREJECT : -IREJECT;
+			check_case(c, BSpherePlaneIntersect(&sph, &d.planes[j]) == ref, i, intersect_string(ref));
+		}
+	}
+}
+
+// reference: distance from the centre to the closest point of the box
+static void checkBSphereBBox(data_t & d) {
+	check_t & c = check_begin("bsphere_bbox_intersect");
+	for(int i = 0; i < N; ++i) {
+		const BSphere & sph = d.spheres[i];
+		const BBox & box = d.boxes[i];
+		double dist2 = 0.0;
+		for(int k = 0; k < 3; ++k) {
+			double x = sph.m_centre[k];
+			double q = std::min(std::max(x, (double) box.m_min[k]), (double) box.m_max[k]);
+			dist2 += (x - q) * (x - q);
+		}
+		double margin = sqrt(dist2) - sph.m_radius;
+		if (ambiguous(margin, 2.0 * range)) { ++c.skipped; continue; }
+		int ref = margin > 0.0 ? IREJECT : IINTERSECT;
+		check_case(c, BSphereBBoxIntersect(&sph, &box) == ref, i, intersect_string(ref));
+	}
+}
+
+// reference: the sides of the 8 transformed corners of the box
+static void checkOBBPlane(data_t & d) {
+	check_t & c = check_begin("obb_plane_intersect");
+	for(int i = 0; i < N; ++i) {
+		const float *M = d.T[i % trfms_n].getGLMatrix();
+		const BBox & box = d.boxes[i];
+		for(size_t j = 0; j < d.planes.size(); ++j) {
+			bool amb = false;
+			int pos = 0, neg = 0;
+			for(int corner = 0; corner < 8; ++corner) {
+				double p[3], r[3];
+				for(int k = 0; k < 3; ++k)
+					p[k] = (corner >> k & 1) ? box.m_max[k] : box.m_min[k];
+				dtransform(M, p, 1.0, r);
+				int side = ref_side(d.planes[j], r, mscale(M) * 8.0 * range + fabs(d.planes[j].m_d), amb);
+				pos += side > 0;
+				neg += side < 0;
+			}
+			if (amb) { ++c.skipped; continue; }
+			int ref = pos == 8 ? +IREJECT : (neg == 8 ? -IREJECT : IINTERSECT);
+			check_case(c, OBBPlaneIntersect(&d.obbs[i], &d.planes[j]) == ref, i, intersect_string(ref));
+		}
+	}
+}
+
+// reference: distance from the centre (in the local coordinates of the
+// box) to the closest point of the box, times the scale
+static void checkBSphereOBB(data_t & d) {
+	check_t & c = check_begin("bsphere_obb_intersect");
+	for(int i = 0; i < N; ++i) {
+		const Trfm3D & T = d.T[i % trfms_n];
+		const float *M = T.getGLMatrix();
+		const BSphere & sph = d.spheres[i];
+		const BBox & box = d.boxes[i];
+		double s = T.getScale(), v[3], dist2 = 0.0;
+		for(int k = 0; k < 3; ++k) v[k] = sph.m_centre[k] - (double) M[12 + k];
+		for(int k = 0; k < 3; ++k) {
+			double x = (M[4 * k] * v[0] + M[4 * k + 1] * v[1] + M[4 * k + 2] * v[2]) / (s * s);
+			double q = std::min(std::max(x, (double) box.m_min[k]), (double) box.m_max[k]);
+			dist2 += (x - q) * (x - q);
+		}
+		double margin = s * sqrt(dist2) - sph.m_radius;
+		if (ambiguous(margin, mscale(M) * 4.0 * range)) { ++c.skipped; continue; }
+		int ref = margin > 0.0 ? IREJECT : IINTERSECT;
+		check_case(c, BSphereOBBIntersect(&sph, &d.obbs[i]) == ref, i, intersect_string(ref));
+	}
+}
+
+// reference: Moller-Trumbore in double
+static void checkTriangleRay(data_t & d) {
+	check_t & c = check_begin("triangle_ray_intersect");
+	for(int i = 0; i < N; ++i) {
+		const Vector3 *tri = &d.tris[3 * i];
+		const Line & l = d.rays[i];
+		double p0[3], p1[3], p2[3], o[3], dir[3], e1[3], e2[3], s[3], p[3], q[3];
+		dvec(tri[0], p0);
+		dvec(tri[1], p1);
+		dvec(tri[2], p2);
+		dvec(l.m_O, o);
+		dvec(l.m_d, dir);
+		for(int k = 0; k < 3; ++k) {
+			e1[k] = p1[k] - p0[k];
+			e2[k] = p2[k] - p0[k];
+			s[k] = o[k] - p0[k];
+		}
+		dcross(dir, e2, p);
+		dcross(s, e1, q);
+		double a = ddot(e1, p);
+		double conditioning = dlength(e1) * dlength(p);
+		// nearly parallel rays are ill-conditioned in float
+		if (fabs(a) < 1e-3 * conditioning ||
+			ambiguous(fabs(a) - Constants::distance_epsilon, conditioning)) { ++c.skipped; continue; }
+		double u = ddot(s, p) / a;
+		double v = ddot(q, dir) / a;
+		double t = ddot(e2, q) / a;
+		double b = 1e2 * ambiguity; // u and v are in [0, 1]
+		if (fabs(u) < b || fabs(u - 1.0) < b || fabs(v) < b || fabs(u + v - 1.0) < b) {
+			++c.skipped;
+			continue;
+		}
+		int ref = (u < 0.0 || u > 1.0 || v < 0.0 || u + v > 1.0) ? IREJECT : IINTERSECT;
+		Vector3 uvw;
+		int res = IntersectTriangleRay(tri[0], tri[1], tri[2], &l, uvw);
+		bool ok = res == ref;
+		if (ok && ref == IINTERSECT)
+			ok = near(uvw[0], u, 1e2) && near(uvw[1], v, 1e2) && near(uvw[2], t, 1e2 * fabs(t));
+		check_case(c, ok, i, ref == IINTERSECT ? "hit (or its u, v, t)" : "miss");
+	}
+}
+
+// reference: slab test in double, ray parameter in [0, tmax]
+static void checkBBoxRay(data_t & d) {
+	check_t & c = check_begin("bbox_ray_intersect");
+	const float tmax = 1.5f;
+	for(int i = 0; i < N; ++i) {
+		const BBox & box = d.boxes[i];
+		const Line & l = d.rays[i];
+		double t0 = 0.0, t1 = tmax, scale = 0.0;
+		for(int k = 0; k < 3; ++k) {
+			double a = (box.m_min[k] - (double) l.m_O[k]) / l.m_d[k];
+			double b = (box.m_max[k] - (double) l.m_O[k]) / l.m_d[k];
+			t0 = std::max(t0, std::min(a, b));
+			t1 = std::min(t1, std::max(a, b));
+			scale = std::max(scale, std::max(fabs(a), fabs(b)));
+		}
+		if (ambiguous(t1 - t0, scale)) { ++c.skipped; continue; }
+		int ref = t0 > t1 ? IREJECT : IINTERSECT;
+		float tnear = -1.0f;
+		int res = IntersectBBoxRay(&box, &l, tmax, tnear);
+		bool ok = res == ref;
+		if (ok && ref == IINTERSECT) ok = near(tnear, t0, scale);
+		check_case(c, ok, i, ref == IINTERSECT ? "hit (or its tnear)" : "miss");
+	}
+}
+
+// reference: IntersectBBoxRay (the same operations, so the same results).
+// Chunks of 1 to 16 boxes, so that the remainders are tested too.
+static void checkBBoxesRay(data_t & d) {
+	check_t & c = check_begin("bbox_ray_batch");
+	const float tmax = 1.5f;
+	float tnear[16];
+	for(int i = 0, j = 0; i < N; ++j) {
+		int n = std::min(1 + j % 16, N - i);
+		const Line & l = d.rays[j % N];
+		int hits = IntersectBBoxesRay(soa_at(d, i), n, &l, tmax, tnear), ref_hits = 0;
+		for(int b = 0; b < n; ++b, ++i) {
+			float t;
+			bool hit = IntersectBBoxRay(&d.boxes[i], &l, tmax, t) == IINTERSECT;
+			if (hit) ++ref_hits;
+			check_case(c, hit ? tnear[b] == t : tnear[b] == FLT_MAX, i,
+					   hit ? "hit (or its tnear)" : "miss");
+		}
+		if (hits != ref_hits) check_case(c, false, i, "number of hits");
+	}
+}
+
+// reference: IntersectBBoxRay for each ray of the packet. The last ray is
+// left out of every other packet.
+static void checkBBoxRay4(data_t & d) {
+	check_t & c = check_begin("bbox_ray_packet");
+	const float tmax = 1.5f;
+	for(int j = 0; j < N / 4; ++j) {
+		float tm[4] = { tmax, tmax, tmax, j % 2 ? -1.0f : tmax }, tnear[4];
+		const float (*p)[4] = (const float (*)[4]) &d.packets[24 * j];
+		unsigned int mask = IntersectBBoxRay4(&d.boxes[j], p, p + 3, tm, tnear);
+		for(int l = 0; l < 4; ++l) {
+			float t;
+			bool hit = tm[l] >= 0.0f &&
+				IntersectBBoxRay(&d.boxes[j], &d.rays[4 * j + l], tmax, t) == IINTERSECT;
+			bool ok = ((mask >> l) & 1) == (hit ? 1u : 0u);
+			if (ok && hit) ok = tnear[l] == t;
+			check_case(c, ok, 4 * j + l, hit ? "hit (or its tnear)" : "miss");
+		}
+	}
+}
+
+static void checkBBoxInclude(data_t & d) {
+	check_t & c = check_begin("bbox_include");
+	BBox box;
+	double lo[3], hi[3];
+	for(int k = 0; k < 3; ++k) {
+		lo[k] = 1e30;
+		hi[k] = -1e30;
+	}
+	for(int i = 0; i < N; ++i) {
+		box.include(&d.boxes[i]);
+		box.add(d.P[i]);
+		for(int k = 0; k < 3; ++k) {
+			lo[k] = std::min(lo[k], std::min((double) d.boxes[i].m_min[k], (double) d.P[i][k]));
+			hi[k] = std::max(hi[k], std::max((double) d.boxes[i].m_max[k], (double) d.P[i][k]));
+		}
+		bool ok = true;
+		for(int k = 0; k < 3; ++k) ok = ok && box.m_min[k] == lo[k] && box.m_max[k] == hi[k];
+		check_case(c, ok, i, "bounds");
+	}
+}
+
+// reference: the product of the matrices in double
+static void checkTrfmCompose(data_t & d) {
+	check_t & c = check_begin("trfm_compose");
+	for(int i = 0; i < trfms_n; ++i) {
+		const Trfm3D & A = d.T[i];
+		const Trfm3D & B = d.T[(i + 1) % trfms_n];
+		Trfm3D R(A);
+		R.add(B);
+		const float *a = A.getGLMatrix();
+		const float *b = B.getGLMatrix();
+		const float *r = R.getGLMatrix();
+		double scale = mscale(a) * mscale(b);
+		bool ok = near(R.getScale(), (double) A.getScale() * B.getScale(), 1.0);
+		for(int j = 0; j < 4; ++j)
+			for(int k = 0; k < 4; ++k) {
+				double x = 0.0;
+				for(int m = 0; m < 4; ++m) x += (double) a[4 * m + k] * b[4 * j + m];
+				ok = ok && near(r[4 * j + k], x, scale);
+			}
+		check_case(c, ok, i, "A * B");
+	}
+}
+
+// T * inverse(T) is the identity
+static void checkTrfmInverse(data_t & d) {
+	check_t & c = check_begin("trfm_inverse");
+	for(int i = 0; i < trfms_n; ++i) {
+		const Trfm3D & T = d.T[i];
+		Trfm3D I(T);
+		I.setInverse();
+		const float *a = T.getGLMatrix();
+		const float *b = I.getGLMatrix();
+		double scale = mscale(a) * mscale(b);
+		bool ok = true;
+		for(int j = 0; j < 4; ++j)
+			for(int k = 0; k < 4; ++k) {
+				double x = 0.0;
+				for(int m = 0; m < 4; ++m) x += (double) a[4 * m + k] * b[4 * j + m];
+				ok = ok && near(x, j == k ? 1.0 : 0.0, scale);
+			}
+		check_case(c, ok, i, "T * inverse(T) != I");
+	}
+}
+
+static void checkTrfmTransform(data_t & d) {
+	check_t & c = check_begin("trfm_point_vector_normal");
+	for(int i = 0; i < N; ++i) {
+		const Trfm3D & T = d.T[i % trfms_n];
+		const float *M = T.getGLMatrix();
+		double scale = mscale(M) * range * 4.0;
+		double p[3], r[3], n[3];
+		dvec(d.P[i], p);
+		Vector3 X = T.transformPoint(d.P[i]);
+		dtransform(M, p, 1.0, r);
+		bool ok = true;
+		for(int k = 0; k < 3; ++k) ok = ok && near(X[k], r[k], scale);
+		check_case(c, ok, i, "point");
+		X = T.transformVector(d.P[i]);
+		dtransform(M, p, 0.0, r);
+		ok = true;
+		for(int k = 0; k < 3; ++k) ok = ok && near(X[k], r[k], scale);
+		check_case(c, ok, i, "vector");
+		// the normals of a similarity keep their direction, and unit length
+		dvec(d.normals[i], n);
+		X = T.transformNormal(d.normals[i]);
+		dtransform(M, n, 0.0, r);
+		double len = dlength(r);
+		ok = true;
+		for(int k = 0; k < 3; ++k) ok = ok && near(X[k], r[k] / len, 1.0);
+		check_case(c, ok, i, "normal");
+	}
+}
+
+static void checkTrfmArray(data_t & d) {
+	check_t & c = check_begin("trfm_points_array");
+	const Trfm3D & T = d.T[0];
+	const float *M = T.getGLMatrix();
+	double scale = mscale(M) * range * 4.0;
+	vector<float> out(3 * N);
+	T.transformPoints(&d.packed[0], &out[0], N);
+	for(int i = 0; i < N; ++i) {
+		double p[3], r[3];
+		dvec(d.P[i], p);
+		dtransform(M, p, 1.0, r);
+		bool ok = true;
+		for(int k = 0; k < 3; ++k) ok = ok && near(out[3 * i + k], r[k], scale);
+		check_case(c, ok, i, "point");
+	}
+}
+
+// reference: the box of the 8 transformed corners
+static void checkBBoxTransform(data_t & d) {
+	check_t & c = check_begin("bbox_transform");
+	for(int i = 0; i < N; ++i) {
+		const Trfm3D & T = d.T[i % trfms_n];
+		const float *M = T.getGLMatrix();
+		double scale = mscale(M) * range * 8.0;
+		double lo[3] = { 1e30, 1e30, 1e30 }, hi[3] = { -1e30, -1e30, -1e30 };
+		for(int corner = 0; corner < 8; ++corner) {
+			double p[3], r[3];
+			for(int k = 0; k < 3; ++k)
+				p[k] = (corner >> k & 1) ? d.boxes[i].m_max[k] : d.boxes[i].m_min[k];
+			dtransform(M, p, 1.0, r);
+			for(int k = 0; k < 3; ++k) {
+				lo[k] = std::min(lo[k], r[k]);
+				hi[k] = std::max(hi[k], r[k]);
+			}
+		}
+		BBox box;
+		box.clone(&d.boxes[i]);
+		box.transform(&T);
+		bool ok = true;
+		for(int k = 0; k < 3; ++k)
+			ok = ok && near(box.m_min[k], lo[k], scale) && near(box.m_max[k], hi[k], scale);
+		check_case(c, ok, i, "bounds");
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Kernels (they return a checksum)
+
+static double kVector(data_t & d) {
+	Vector3 acc;
+	for(int i = 0; i + 1 < N; ++i) {
+		const Vector3 & a = d.P[i];
+		const Vector3 & b = d.P[i + 1];
+		acc += (a - b) * a.dot(b) + crossVectors(a, b) * 0.001f;
+	}
+	return acc[0] + acc[1] + acc[2];
+}
+
+static double kNormalize(data_t & d) {
+	double sum = 0.0;
+	for(int i = 0; i < N; ++i) {
+		Vector3 V(d.P[i]);
+		sum += V.normalize();
+	}
+	return sum;
+}
+
+static double kWhichSide(data_t & d) {
+	int sum = 0;
+	for(int i = 0; i < N; ++i)
+		for(size_t j = 0; j < d.planes.size(); ++j)
+			sum += d.planes[j].whichSide(d.P[i]);
+	return sum;
+}
+
+static double kBBoxBBox(data_t & d) {
+	int sum = 0;
+	for(int i = 0; i < N; ++i)
+		sum += BBoxBBoxIntersect(&d.boxes[i], &d.boxes[N - 1 - i]);
+	return sum;
+}
+
+static double kBBoxPlane(data_t & d) {
+	int sum = 0;
+	for(int i = 0; i < N; ++i)
+		for(size_t j = 0; j < d.planes.size(); ++j)
+			sum += BBoxPlaneIntersect(&d.boxes[i], &d.planes[j]);
+	return sum;
+}
+
+static double kBSphereBSphere(data_t & d) {
+	int sum = 0;
+	for(int i = 0; i < N; ++i)
+		sum += BSphereBSphereIntersect(&d.spheres[i], &d.spheres[N - 1 - i]);
+	return sum;
+}
+
+static double kBSpherePlane(data_t & d) {
+	int sum = 0;
+	for(int i = 0; i < N; ++i)
+		for(size_t j = 0; j < d.planes.size(); ++j)
+			sum += BSpherePlaneIntersect(&d.spheres[i], &d.planes[j]);
+	return sum;
+}
+
+static double kBSphereBBox(data_t & d) {
+	int sum = 0;
+	for(int i = 0; i < N; ++i)
+		sum += BSphereBBoxIntersect(&d.spheres[i], &d.boxes[i]);
+	return sum;
+}
+
+static double kOBBPlane(data_t & d) {
+	int sum = 0;
+	for(int i = 0; i < N; ++i)
+		for(size_t j = 0; j < d.planes.size(); ++j)
+			sum += OBBPlaneIntersect(&d.obbs[i], &d.planes[j]);
+	return sum;
+}
+
+static double kBSphereOBB(data_t & d) {
+	int sum = 0;
+	for(int i = 0; i < N; ++i)
+		sum += BSphereOBBIntersect(&d.spheres[i], &d.obbs[i]);
+	return sum;
+}
+
+static double kTriangleRay(data_t & d) {
+	double sum = 0.0;
+	Vector3 uvw;
+	for(int i = 0; i < N; ++i)
+		if (IntersectTriangleRay(d.tris[3 * i], d.tris[3 * i + 1], d.tris[3 * i + 2],
+								 &d.rays[i], uvw) == IINTERSECT)
+			sum += uvw[2];
+	return sum;
+}
+
+static double kBBoxRay(data_t & d) {
+	double sum = 0.0;
+	float tnear;
+	for(int i = 0; i < N; ++i)
+		if (IntersectBBoxRay(&d.boxes[i], &d.rays[i], 1.5f, tnear) == IINTERSECT)
+			sum += tnear;
+	return sum;
+}
+
+// ray i against boxes 8i..8i + 7
+static double kBBoxesRay(data_t & d) {
+	double sum = 0.0;
+	float tnear[8];
+	for(int i = 0; 8 * i + 8 <= N; ++i) {
+		sum += IntersectBBoxesRay(soa_at(d, 8 * i), 8, &d.rays[i], 1.5f, tnear);
+		sum += tnear[i & 7] == FLT_MAX ? 0.0f : tnear[i & 7];
+	}
+	return sum;
+}
+
+// packet j against box j
+static double kBBoxRay4(data_t & d) {
+	double sum = 0.0;
+	float tmax[4] = { 1.5f, 1.5f, 1.5f, 1.5f }, tnear[4];
+	for(int j = 0; j < N / 4; ++j) {
+		const float (*p)[4] = (const float (*)[4]) &d.packets[24 * j];
+		unsigned int mask = IntersectBBoxRay4(&d.boxes[j], p, p + 3, tmax, tnear);
+		if (mask & 1) sum += tnear[0];
+		sum += mask;
+	}
+	return sum;
+}
+
+static double kInclude(data_t & d) {
+	BBox box;
+	for(int i = 0; i < N; ++i) box.include(&d.boxes[i]);
+	for(int i = 0; i < N; ++i) box.add(d.P[i]);
+	return box.m_min[0] + box.m_max[0] + box.m_min[1] + box.m_max[1];
+}
+
+static double kCompose(data_t & d) {
+	Trfm3D T;
+	double sum = 0.0;
+	for(int i = 0; i < N; ++i) {
+		T.clone(d.T[i % trfms_n]);
+		T.add(d.T[(i + 1) % trfms_n]);
+		sum += T.getGLMatrix()[12];
+	}
+	return sum;
+}
+
+static double kInverse(data_t & d) {
+	Trfm3D T;
+	double sum = 0.0;
+	for(int i = 0; i < N; ++i) {
+		T.clone(d.T[i % trfms_n]);
+		T.setInverse();
+		sum += T.getGLMatrix()[12];
+	}
+	return sum;
+}
+
+static double kTransformPoint(data_t & d) {
+	const Trfm3D & T = d.T[0];
+	Vector3 acc;
+	for(int i = 0; i < N; ++i) {
+		acc += T.transformPoint(d.P[i]);
+		acc += T.transformVector(d.P[i]);
+	}
+	return acc[0] + acc[1] + acc[2];
+}
+
+static double kTransformNormal(data_t & d) {
+	const Trfm3D & T = d.T[0];
+	Vector3 acc;
+	for(int i = 0; i < N; ++i) acc += T.transformNormal(d.normals[i]);
+	return acc[0] + acc[1] + acc[2];
+}
+
+static double kTransformPoints(data_t & d) {
+	static vector<float> out;
+	out.resize(3 * N);
+	d.T[0].transformPoints(&d.packed[0], &out[0], N);
+	double sum = 0.0;
+	for(int i = 0; i < N; i += 64) sum += out[3 * i];
+	return sum;
+}
+
+static double kBBoxTransform(data_t & d) {
+	double sum = 0.0;
+	BBox box;
+	for(int i = 0; i < N; ++i) {
+		box.clone(&d.boxes[i]);
+		box.transform(&d.T[0]);
+		sum += box.m_min[0] + box.m_max[2];
+	}
+	return sum;
+}
+
+struct kernel_t {
+	const char *name;
+	double (*run)(data_t & d);
+	int ops; // operations per run
+};
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-s seed] [-n elements] [-r runs] [-csv] [-check | -nocheck]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	int seed = 1;
+	bool do_checks = true, do_bench = true;
+	for(int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc) N = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc) runs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-csv")) csv = true;
+		else if (!strcmp(argv[i], "-check")) do_bench = false;
+		else if (!strcmp(argv[i], "-nocheck")) do_checks = false;
+		else usage(argv[0]);
+	}
+	if (N < 2 || runs < 1) usage(argv[0]);
+	srand(seed);
+	data_t d;
+	data_init(d);
+
+	size_t failures = 0;
+	if (do_checks) {
+		checkVector(d);
+		checkWhichSide(d);
+		checkPlaneNormalize(d);
+		checkBBoxBBox(d);
+		checkBBoxPlane(d);
+		checkBSphereBSphere(d);
+		checkBSpherePlane(d);
+		checkBSphereBBox(d);
+		checkOBBPlane(d);
+		checkBSphereOBB(d);
+		checkTriangleRay(d);
+		checkBBoxRay(d);
+		checkBBoxesRay(d);
+		checkBBoxRay4(d);
+		checkBBoxInclude(d);
+		checkTrfmCompose(d);
+		checkTrfmInverse(d);
+		checkTrfmTransform(d);
+		checkTrfmArray(d);
+		checkBBoxTransform(d);
+		if (!csv) printf("%-26s %10s %10s %10s\n", "check", "cases", "skipped", "failures");
+		for(size_t k = 0; k < checks.size(); ++k) {
+			const check_t & c = checks[k];
+			if (csv)
+				printf("check,%s,%zu,%zu,%zu\n", c.name, c.cases, c.skipped, c.failures);
+			else
+				printf("%-26s %10zu %10zu %10zu%s\n", c.name, c.cases, c.skipped, c.failures,
+					   c.failures ? "  FAILED" : "");
+			failures += c.failures;
+		}
+	}
+
+	if (do_bench) {
+		kernel_t kernels[] = {
+			{ "vector_ops", kVector, N - 1 },
+			{ "vector_normalize", kNormalize, N },
+			{ "plane_whichSide", kWhichSide, 6 * N },
+			{ "bbox_bbox_intersect", kBBoxBBox, N },
+			{ "bbox_plane_intersect", kBBoxPlane, 6 * N },
+			{ "bsphere_bsphere_intersect", kBSphereBSphere, N },
+			{ "bsphere_plane_intersect", kBSpherePlane, 6 * N },
+			{ "bsphere_bbox_intersect", kBSphereBBox, N },
+			{ "obb_plane_intersect", kOBBPlane, 6 * N },
+			{ "bsphere_obb_intersect", kBSphereOBB, N },
+			{ "triangle_ray_intersect", kTriangleRay, N },
+			{ "bbox_ray_intersect", kBBoxRay, N },
+			{ "bbox_ray_batch", kBBoxesRay, N / 8 * 8 },
+			{ "bbox_ray_packet", kBBoxRay4, N / 4 * 4 },
+			{ "bbox_include", kInclude, 2 * N },
+			{ "trfm_compose", kCompose, N },
+			{ "trfm_inverse", kInverse, N },
+			{ "trfm_point_vector", kTransformPoint, 2 * N },
+			{ "trfm_normal", kTransformNormal, N },
+			{ "trfm_points_array", kTransformPoints, N },
+			{ "bbox_transform", kBBoxTransform, N },
+		};
+		if (!csv) printf("%-26s %10s %10s %18s\n", "kernel", "ns/op", "Mops/s", "checksum");
+		for(size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+			double best = 1e30, sum = 0.0;
+			for(int r = 0; r < runs; ++r) {
+				std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+				sum = kernels[k].run(d);
+				std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+				double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / kernels[k].ops;
+				if (ns < best) best = ns;
+			}
+			if (csv)
+				printf("bench,%s,%.4f,%.3f,%.9g\n", kernels[k].name, best, 1e3 / best, sum);
+			else
+				printf("%-26s %10.3f %10.1f %18.6g\n", kernels[k].name, best, 1e3 / best, sum);
+		}
+	}
+	return failures ? 1 : 0;
+}
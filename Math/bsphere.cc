@@ -27,3 +27,16 @@ void BSphere::setPosition(const Vector3 & newpos) {
 	m_centre = newpos;
 }
 void BSphere::setRadius(float r) { m_radius = r; }
+
+void BSphere::include(const BSphere *other) {
+	Vector3 d(other->m_centre - m_centre);
+	float dist = d.length();
+	if (dist + other->m_radius <= m_radius) return; // other is inside
+	if (dist + m_radius <= other->m_radius) { // this is inside other
+		*this = *other;
+		return;
+	}
+	float r = 0.5f * (dist + m_radius + other->m_radius);
+	m_centre += d * ((r - m_radius) / dist);
+	m_radius = r;
+}
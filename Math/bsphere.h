@@ -20,6 +20,10 @@ public:
 	void setPosition(const Vector3 & newpos); // Place an existing BSphere at newpos
 	void setRadius(float r);
 
+	// Modify the BSphere so that it also includes other (the smallest such
+	// sphere)
+	void include(const BSphere *other);
+
 	Vector3  m_centre;
 	float    m_radius;
 };
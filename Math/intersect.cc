@@ -1,5 +1,11 @@
 #include <cmath>
+#include <cfloat>
+#include <algorithm>
 #include "intersect.h"
+#ifdef __AVX__
+#include <immintrin.h>
+#define INTERSECT_AVX
+#endif
 #include "constants.h"
 #include "tools.h"
 
@@ -154,6 +160,33 @@ int BSphereBBoxIntersect(const BSphere *sphere, const BBox *box) {
 }
 
 
+// the distance from the centre to the plane against the projection of the
+// box on the normal (the plane is normalized first, as in
+// BSpherePlaneIntersect)
+
+int OBBPlaneIntersect(const OBB *obb, Plane *pl) {
+	float s = pl->signedDistance(obb->m_centre);
+	float r = 0.0f;
+	for(int i = 0; i < 3; ++i)
+		r += obb->m_half[i] * fabsf(pl->m_n.dot(obb->m_axes[i]));
+	if (s - r > Constants::distance_epsilon) return +IREJECT;
+	if (s + r < -Constants::distance_epsilon) return -IREJECT;
+	return IINTERSECT;
+}
+
+// distance from the centre of the sphere to the closest point of the box,
+// along the axes of the box
+
+int BSphereOBBIntersect(const BSphere *sphere, const OBB *obb) {
+	Vector3 d(sphere->m_centre - obb->m_centre);
+	float dist = 0.0f;
+	for(int i = 0; i < 3; ++i) {
+		float out = fabsf(d.dot(obb->m_axes[i])) - obb->m_half[i];
+		if (out > 0.0f) dist += out * out;
+	}
+	return dist <= sphere->m_radius * sphere->m_radius ? IINTERSECT : IREJECT;
+}
+
 int IntersectTriangleRay(const Vector3 & P0,
 						 const Vector3 & P1,
 						 const Vector3 & P2,
@@ -171,13 +204,151 @@ int IntersectTriangleRay(const Vector3 & P0,
 	if (lu < 0.0 || lu > 1.0) return IREJECT;
 	Vector3 q(crossVectors(s, e1));
 	float lv = f * q.dot(l->m_d);
-	if (lv < 0.0 || lv > 1.0) return IREJECT;
+	if (lv < 0.0 || lu + lv > 1.0) return IREJECT;
 	uvw[0] = lu;
 	uvw[1] = lv;
 	uvw[2] = f * e2.dot(q);
 	return IINTERSECT;
 }
 
+// slab test: clip the parameter interval of the ray with the three slabs of
+// the box (a zero direction component gives +-inf, which works too)
+
+int IntersectBBoxRay(const BBox *theBBox,
+					 const Line *l,
+					 float tmax,
+					 float & tnear) {
+	float tmin = 0.0f;
+	for(int i = 0; i < 3; ++i) {
+		float inv = 1.0f / l->m_d[i];
+		float t0 = (theBBox->m_min[i] - l->m_O[i]) * inv;
+		float t1 = (theBBox->m_max[i] - l->m_O[i]) * inv;
+		if (t0 > t1) std::swap(t0, t1);
+		if (t0 > tmin) tmin = t0;
+		if (t1 < tmax) tmax = t1;
+		if (tmin > tmax) return IREJECT;
+	}
+	tnear = tmin;
+	return IINTERSECT;
+}
+
+/* Batched slab tests, with the same operations as IntersectBBoxRay (so the
+   same results), min and max instead of the swap and the early exit.
+
+   One ray against many boxes: the ray is broadcast, and every register
+   holds one coordinate of 8 (AVX) or 4 (SSE) boxes. */
+
+static int bboxes_ray(const BBox::soa_t & boxes, size_t i, size_t n, const float *O,
+					  const float *inv, float tmax, float *tnear) {
+	int hits = 0;
+	for(; i < n; ++i) {
+		float tn = 0.0f, tf = tmax;
+		for(int k = 0; k < 3; ++k) {
+			float t0 = (boxes.min[k][i] - O[k]) * inv[k];
+			float t1 = (boxes.max[k][i] - O[k]) * inv[k];
+			tn = std::max(tn, std::min(t0, t1));
+			tf = std::min(tf, std::max(t0, t1));
+		}
+		tnear[i] = tn <= tf ? tn : FLT_MAX;
+		if (tn <= tf) ++hits;
+	}
+	return hits;
+}
+
+static int bits(unsigned int mask) {
+	int n = 0;
+	for(; mask; mask &= mask - 1) ++n;
+	return n;
+}
+
+int IntersectBBoxesRay(const BBox::soa_t & boxes,
+					   size_t n,
+					   const Line *l,
+					   float tmax,
+					   float *tnear) {
+	float O[3], inv[3];
+	for(int k = 0; k < 3; ++k) {
+		O[k] = l->m_O[k];
+		inv[k] = 1.0f / l->m_d[k];
+	}
+	size_t i = 0;
+	int hits = 0;
+#ifdef INTERSECT_AVX
+	for(; i + 8 <= n; i += 8) {
+		__m256 tn = _mm256_setzero_ps();
+		__m256 tf = _mm256_set1_ps(tmax);
+		for(int k = 0; k < 3; ++k) {
+			__m256 o = _mm256_set1_ps(O[k]);
+			__m256 v = _mm256_set1_ps(inv[k]);
+			__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(boxes.min[k] + i), o), v);
+			__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(boxes.max[k] + i), o), v);
+			tn = _mm256_max_ps(tn, _mm256_min_ps(t0, t1));
+			tf = _mm256_min_ps(tf, _mm256_max_ps(t0, t1));
+		}
+		__m256 in = _mm256_cmp_ps(tn, tf, _CMP_LE_OQ);
+		_mm256_storeu_ps(tnear + i, _mm256_blendv_ps(_mm256_set1_ps(FLT_MAX), tn, in));
+		hits += bits(_mm256_movemask_ps(in));
+	}
+#endif
+#ifdef TRFM_SSE
+	for(; i + 4 <= n; i += 4) {
+		__m128 tn = _mm_setzero_ps();
+		__m128 tf = _mm_set1_ps(tmax);
+		for(int k = 0; k < 3; ++k) {
+			__m128 o = _mm_set1_ps(O[k]);
+			__m128 v = _mm_set1_ps(inv[k]);
+			__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(boxes.min[k] + i), o), v);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(boxes.max[k] + i), o), v);
+			tn = _mm_max_ps(tn, _mm_min_ps(t0, t1));
+			tf = _mm_min_ps(tf, _mm_max_ps(t0, t1));
+		}
+		__m128 in = _mm_cmple_ps(tn, tf);
+		_mm_storeu_ps(tnear + i, _mm_or_ps(_mm_and_ps(in, tn),
+										   _mm_andnot_ps(in, _mm_set1_ps(FLT_MAX))));
+		hits += bits(_mm_movemask_ps(in));
+	}
+#endif
+	return hits + bboxes_ray(boxes, i, n, O, inv, tmax, tnear);
+}
+
+/* A packet of rays against one box: the box is broadcast, and every
+   register holds one coordinate of the 4 rays. */
+
+unsigned int IntersectBBoxRay4(const BBox *theBBox,
+							   const float (*origin)[4],
+							   const float (*inv)[4],
+							   const float *tmax,
+							   float *tnear) {
+#ifdef TRFM_SSE
+	__m128 tn = _mm_setzero_ps();
+	__m128 tf = _mm_loadu_ps(tmax);
+	for(int k = 0; k < 3; ++k) {
+		__m128 o = _mm_loadu_ps(origin[k]);
+		__m128 v = _mm_loadu_ps(inv[k]);
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(theBBox->m_min[k]), o), v);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(theBBox->m_max[k]), o), v);
+		tn = _mm_max_ps(tn, _mm_min_ps(t0, t1));
+		tf = _mm_min_ps(tf, _mm_max_ps(t0, t1));
+	}
+	_mm_storeu_ps(tnear, tn);
+	return _mm_movemask_ps(_mm_cmple_ps(tn, tf));
+#else
+	unsigned int mask = 0;
+	for(int i = 0; i < 4; ++i) {
+		float tn = 0.0f, tf = tmax[i];
+		for(int k = 0; k < 3; ++k) {
+			float t0 = (theBBox->m_min[k] - origin[k][i]) * inv[k][i];
+			float t1 = (theBBox->m_max[k] - origin[k][i]) * inv[k][i];
+			tn = std::max(tn, std::min(t0, t1));
+			tf = std::min(tf, std::max(t0, t1));
+		}
+		tnear[i] = tn;
+		if (tn <= tf) mask |= 1u << i;
+	}
+	return mask;
+#endif
+}
+
 /* IREJECT 1 */
 /* IINTERSECT 0 */
 
@@ -7,6 +7,7 @@
 #include "bbox.h"
 #include "bsphere.h"
 #include "line.h"
+#include "obb.h"
 
 #define IREJECT 1
 #define IINTERSECT 0
@@ -67,6 +68,26 @@ int BSpherePlaneIntersect(const BSphere *oneBSphere, Plane *oneBBox );
  */
 int BSphereBBoxIntersect(const BSphere *oneBSphere, const BBox *oneBBox );
 
+/**
+ * Check whether an OBB intersects with a plane
+ *
+ * @param theOBB pointer to OBB
+ * @param thePlane pointer to plane
+ *
+ * @return
+ *  +IREJECT OBB is outside the plane
+ *  -IREJECT OBB is inside the plane
+ *  IINTERSECT OBB intersects the plane
+ */
+int OBBPlaneIntersect(const OBB *theOBB, Plane *thePlane);
+
+/**
+ * Check whether a BSphere intersects with an OBB
+ *
+ * @return IINTERSECT: intersect; IREJECT: don't intersect
+ */
+int BSphereOBBIntersect(const BSphere *oneBSphere, const OBB *theOBB);
+
 /**
  * Find whether a line (ray) intersects with a triangle defined by three points (P0, P1, P2).
  *
@@ -84,4 +105,47 @@ int IntersectTriangleRay(const Vector3 & P0,
 						 const Line *l,
 						 Vector3 & uvw);
 
+/**
+ * Find whether a line (ray) intersects with a BBox, with parameter in (0, tmax)
+ *
+ * returns: IREJECT: don't intersect; IINTERSECT: intersect; If IINTERSECT,
+ *  tnear is the parameter where the ray enters the box (0 if it starts
+ *  inside)
+ */
+
+int IntersectBBoxRay(const BBox *theBBox,
+					 const Line *l,
+					 float tmax,
+					 float & tnear);
+
+/**
+ * Slab test of one ray against n boxes stored as SoA (see BBox::soa_t), as
+ * IntersectBBoxRay, several boxes at a time (8 with AVX, 4 with SSE).
+ *
+ * returns: the number of boxes the ray intersects. tnear[i] is the
+ *  parameter where the ray enters box i, or FLT_MAX if it misses it.
+ */
+
+int IntersectBBoxesRay(const BBox::soa_t & boxes,
+					   size_t n,
+					   const Line *l,
+					   float tmax,
+					   float *tnear);
+
+/**
+ * Slab test of a packet of 4 rays against one box: ray i starts at
+ * (origin[0][i], origin[1][i], origin[2][i]), the inverse of its direction
+ * is (inv[0][i], inv[1][i], inv[2][i]), and it counts with parameter in
+ * [0, tmax[i]] (a negative tmax leaves the ray out).
+ *
+ * returns: a mask with bit i set if ray i intersects the box. tnear[i] is
+ *  the parameter where ray i enters it.
+ */
+
+unsigned int IntersectBBoxRay4(const BBox *theBBox,
+							   const float (*origin)[4],
+							   const float (*inv)[4],
+							   const float *tmax,
+							   float *tnear);
+
 const char *intersect_string(int intersect);
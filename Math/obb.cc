@@ -0,0 +1,32 @@
+#include <cstdio>
+#include "obb.h"
+
+OBB::OBB() : m_centre(Vector3::ZERO), m_half(Vector3::ZERO) {
+	m_axes[0] = Vector3::UNIT_X;
+	m_axes[1] = Vector3::UNIT_Y;
+	m_axes[2] = Vector3::UNIT_Z;
+}
+
+OBB::OBB(const BBox *box, const Trfm3D *T) { set(box, T); }
+
+void OBB::set(const BBox *box, const Trfm3D *T) {
+	m_axes[0] = T->transformVector(Vector3::UNIT_X);
+	m_axes[1] = T->transformVector(Vector3::UNIT_Y);
+	m_axes[2] = T->transformVector(Vector3::UNIT_Z);
+	if (box->m_min[0] > box->m_max[0]) { // void BBox
+		m_centre = T->transformPoint(Vector3::ZERO);
+		for(int i = 0; i < 3; ++i) m_axes[i].normalize();
+		m_half = Vector3::ZERO;
+		return;
+	}
+	m_centre = T->transformPoint((box->m_min + box->m_max) * 0.5f);
+	for(int i = 0; i < 3; ++i)
+		m_half[i] = 0.5f * (box->m_max[i] - box->m_min[i]) * m_axes[i].normalize();
+}
+
+float OBB::radius() const { return m_half.length(); }
+
+void OBB::print() const {
+	printf("centre (%.2f %.2f %.2f), half (%.2f %.2f %.2f)", m_centre[0], m_centre[1], m_centre[2],
+		   m_half[0], m_half[1], m_half[2]);
+}
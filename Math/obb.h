@@ -0,0 +1,40 @@
+// -*-C++-*-
+
+#pragma once
+
+#include "vector3.h"
+#include "bbox.h"
+#include "trfm3D.h"
+
+/**
+ * @brief Oriented bounding box
+ *
+ * A BBox in local coordinates placed in world coordinates by a
+ * transformation (rotations, translations and uniform scales). Unlike
+ * transforming the BBox (see BBox::transform), it does not grow when the
+ * transformation rotates.
+ */
+
+class OBB {
+
+public:
+
+	OBB(); // empty (a point at the origin)
+	OBB(const BBox *box, const Trfm3D *T);
+
+	/**
+	 * Set the OBB to the box 'box' (in local coordinates) placed by T
+	 */
+	void set(const BBox *box, const Trfm3D *T);
+
+	/**
+	 * Radius of the smallest sphere centred at m_centre including the OBB
+	 */
+	float radius() const;
+
+	void print() const;
+
+	Vector3 m_centre;
+	Vector3 m_axes[3]; // unit length
+	Vector3 m_half;    // half size along every axis
+};
@@ -2,7 +2,9 @@
 
 #pragma once
 
+#include <cmath>
 #include "vector3.h"
+#include "constants.h"
 
 /*!
   \file plane.h
@@ -83,3 +85,24 @@ public:
 	//! whether the plane is normalized
 	bool  m_isNorm;
 };
+
+// Note: don't check for zero. Use DISTANCE_EPSILON instead
+
+inline int Plane::whichSide(const Vector3 & P) {
+	float result = m_n.dot(P) - m_d;
+	if (result < -Constants::distance_epsilon ) return -1; // // onNegativeSide (inside)
+	if (result > Constants::distance_epsilon ) return +1;  //onPossitiveSide (outside)
+	return 0; // onPlane
+}
+
+// Note: first, normalize plane if necessary
+
+inline float Plane::signedDistance(const Vector3 & P) {
+	if (!m_isNorm)
+		normalize();
+	return m_n.dot(P) - m_d;
+}
+
+inline float Plane::distance(const Vector3 & P) {
+	return fabs(signedDistance(P));
+}
@@ -1,567 +1,347 @@
+#include <cstdio>
+#include <cmath>
 #include "quaternion.h"
-#include "tools.h"
-#include <stddef.h>
+#include "constants.h"
 
 // cutoff for sine near zero
-static float ms_fEpsilon = 1e-03;
-
-void DestroyQuaternion(Quaternion **theQuat) {
-	if (theQuat == NULL) return;
-	Quaternion *thisQuat = *theQuat;
-	if (!thisQuat) return;
-	free (thisQuat);
-	*theQuat = NULL;
-}
-
-Quaternion *CreateQuaternion(float x, float y, float z, float w) {
-	Quaternion *newQuat;
+static const float ms_fEpsilon = 1e-03;
 
-	newQuat = malloc( sizeof(*newQuat) * 1 );
-	newQuat->w = w;
-	newQuat->x = x;
-	newQuat->y = y;
-	newQuat->z = z;
+const Quaternion Quaternion::IDENTITY;
 
-	return newQuat;
+Quaternion::Quaternion() {
+	m_v[0] = m_v[1] = m_v[2] = 0.0f;
+	m_v[3] = 1.0f;
 }
 
-Quaternion *CreateQuaternionCopy(Quaternion *theQuat) {
-	return CreateQuaternion(theQuat->x, theQuat->y, theQuat->z, theQuat->w);
+Quaternion::Quaternion(float w, float x, float y, float z) {
+	m_v[0] = x;
+	m_v[1] = y;
+	m_v[2] = z;
+	m_v[3] = w;
 }
 
-// K matrix (from Ogre)
-//
-// | 00-r1X 01-r2X 02-r3X |
-// | 10-r1Y 11-r2Y 12-r3Y |
-// | 20-r1Y 21-r2Y 22-r3Y |
-
-#define T00 (T->r1X)
-#define T01 (T->r2X)
-#define T02 (T->r3X)
+Quaternion::Quaternion(const Vector3 & axis, float angle) {
+	Vector3 V(axis);
+	V.normalize();
+	float s = sinf(0.5f * angle);
+	m_v[0] = V[0] * s;
+	m_v[1] = V[1] * s;
+	m_v[2] = V[2] * s;
+	m_v[3] = cosf(0.5f * angle);
+}
 
-#define T10 (T->r1Y)
-#define T11 (T->r2Y)
-#define T12 (T->r3Y)
+// K matrix (from Ogre): element (row i, column j) of the rotation part of
+// the (column-major) OpenGL matrix of T, without the scale
 
-#define T20 (T->r1Z)
-#define T21 (T->r2Z)
-#define T22 (T->r3Z)
+#define K(i, j) (m[4 * (j) + (i)] * inv_s)
 
-Quaternion *CreateQuaternionFromTrfm3D(trfm3D *T) {
+Quaternion::Quaternion(const Trfm3D & T) {
 
 	// Algorithm in Ken Shoemake's article in 1987 SIGGRAPH course notes
 	// article "Quaternion Calculus and Fast Animation".
 
-	Quaternion *Q;
-	float fTrace;
-	float fRoot;
-	size_t s_iNext[3] = { 1, 2, 0 };
-	float *apkQuat[3];
-	float k_ii, k_jj, k_kk;
-	float k_kj, k_jk, k_ij, k_ji, k_ik, k_ki;
-	int   i, j, k;
-
-	Q = CreateQuaternion(0, 0, 0, 1);
+	static const int s_iNext[3] = { 1, 2, 0 };
+	const float *m = T.getGLMatrix();
+	float inv_s = 1.0f / T.getScale();
 
-	apkQuat[0] = &Q->x;
-	apkQuat[1] = &Q->y;
-	apkQuat[2] = &Q->z;
-
-	fTrace = T00 + T11 + T22;
-	if (fTrace > 0.0) {
+	float fTrace = K(0, 0) + K(1, 1) + K(2, 2);
+	if (fTrace > 0.0f) {
 		// |w| > 1/2, may as well choose w > 1/2
-		fRoot = sqrtf(fTrace + 1.0f);  // 2w
-		Q->w = 0.5f * fRoot;
+		float fRoot = sqrtf(fTrace + 1.0f);  // 2w
+		m_v[3] = 0.5f * fRoot;
 		fRoot = 0.5f / fRoot;  // 1/(4w)
-		Q->x = (T21 - T12) * fRoot;
-		Q->y = (T02 - T20) * fRoot;
-		Q->z = (T10 - T01) * fRoot;
+		m_v[0] = (K(2, 1) - K(1, 2)) * fRoot;
+		m_v[1] = (K(0, 2) - K(2, 0)) * fRoot;
+		m_v[2] = (K(1, 0) - K(0, 1)) * fRoot;
 	} else {
-		// i = 0; j = 1; k = 2;
-		i = 0;
-		k_ii = T00; k_jj = T11; k_kk = T22;
-		k_ij = T01; k_ji = T10;
-		k_ik = T02; k_ki = T20;
-		k_jk = T12; k_kj = T21;
-		if (T11 > T00) {
-			// i = 1; j = 2; k = 0;
-			i = 1;
-			k_ii = T11; k_jj = T22; k_kk = T00;
-			k_ij = T12; k_ji = T21;
-			k_ik = T10; k_ki = T01;
-			k_jk = T20; k_kj = T02;
-		}
-		if (T22 > k_ii) {
-			// i = 2; j = 0; k = 1;
-			i = 2;
-			k_ii = T22; k_jj = T00; k_kk = T11;
-			k_ij = T20; k_ji = T02;
-			k_ik = T21; k_ki = T12;
-			k_jk = T01; k_kj = T10;
-		}
-		j = s_iNext[i];
-		k = s_iNext[j];
-		fRoot = sqrtf(k_ii - k_jj - k_kk + 1.0f);
-		*apkQuat[i] = 0.5f * fRoot;
+		// |w| <= 1/2
+		int i = 0;
+		if (K(1, 1) > K(0, 0)) i = 1;
+		if (K(2, 2) > K(i, i)) i = 2;
+		int j = s_iNext[i];
+		int k = s_iNext[j];
+		float fRoot = sqrtf(K(i, i) - K(j, j) - K(k, k) + 1.0f);
+		m_v[i] = 0.5f * fRoot;
 		fRoot = 0.5f / fRoot;
-		Q->w = (k_kj - k_jk) * fRoot;
-		*apkQuat[j] = (k_ji + k_ij) * fRoot;
-		*apkQuat[k] = (k_ki + k_ik) * fRoot;
+		m_v[3] = (K(k, j) - K(j, k)) * fRoot;
+		m_v[j] = (K(j, i) + K(i, j)) * fRoot;
+		m_v[k] = (K(k, i) + K(i, k)) * fRoot;
 	}
-	return Q;
-}
-
-void QuaternionToTrfm3D(const Quaternion *Q, trfm3D *T) {
-
-	float fTx  = Q->x + Q->x;
-	float fTy  = Q->y + Q->y;
-	float fTz  = Q->z + Q->z;
-	float fTwx = fTx * Q->w;
-	float fTwy = fTy * Q->w;
-	float fTwz = fTz * Q->w;
-	float fTxx = fTx * Q->x;
-	float fTxy = fTy * Q->x;
-	float fTxz = fTz * Q->x;
-	float fTyy = fTy * Q->y;
-	float fTyz = fTz * Q->y;
-	float fTzz = fTz * Q->z;
-
-	T00 = 1.0f - (fTyy + fTzz);
-	T01 = fTxy - fTwz;
-	T02 = fTxz + fTwy;
-	T10 = fTxy + fTwz;
-	T11 = 1.0f - (fTxx + fTzz);
-	T12 = fTyz - fTwx;
-	T20 = fTxz - fTwy;
-	T21 = fTyz + fTwx;
-	T22 = 1.0f - (fTxx + fTyy);
-}
-
-#undef T00
-#undef T01
-#undef T02
-#undef T10
-#undef T11
-#undef T12
-#undef T20
-#undef T21
-#undef T22
-
-// tgt = src + tgt
-void AddQuaternion(const Quaternion *src, Quaternion *tgt) {
-	tgt->x += src->x;
-	tgt->y += src->y;
-	tgt->z += src->z;
-	tgt->w += src->w;
 }
 
-// tgt = src - tgt
-void SubstractQuaternion(const Quaternion *src, Quaternion *tgt) {
-	tgt->x -= src->x;
-	tgt->y -= src->y;
-	tgt->z -= src->z;
-	tgt->w -= src->w;
-}
+#undef K
 
-void  QuaternionScalarProduct(Quaternion *tgt, float scalar) {
-	tgt->x *= scalar;
-	tgt->y *= scalar;
-	tgt->z *= scalar;
-	tgt->w *= scalar;
-}
+float Quaternion::w() const { return m_v[3]; }
+float Quaternion::x() const { return m_v[0]; }
+float Quaternion::y() const { return m_v[1]; }
+float Quaternion::z() const { return m_v[2]; }
 
-// tgt = src * tgt
-void  QuaternionProduct(const Quaternion *src, Quaternion *tgt) {
+Quaternion Quaternion::operator*(const Quaternion & rhs) const {
 
 	// NOTE:  Multiplication is not generally commutative, so in most
-	// cases src*tgt != tgt*src
-
-	float x, y, z, w;
-
-	w = src->w * tgt->w - src->x * tgt->x - src->y * tgt->y - src->z * tgt->z;
-	x = src->w * tgt->x + src->x * tgt->w + src->y * tgt->z - src->z * tgt->y;
-	y = src->w * tgt->y + src->y * tgt->w + src->z * tgt->x - src->x * tgt->z;
-	z = src->w * tgt->z + src->z * tgt->w + src->x * tgt->y - src->y * tgt->x;
-
-	tgt->x = x;
-	tgt->y = y;
-	tgt->z = z;
-	tgt->w = w;
+	// cases this*rhs != rhs*this
+
+	const float *a = m_v;
+	const float *b = rhs.m_v;
+	return Quaternion(a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2],
+					  a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1],
+					  a[3] * b[1] + a[1] * b[3] + a[2] * b[0] - a[0] * b[2],
+					  a[3] * b[2] + a[2] * b[3] + a[0] * b[1] - a[1] * b[0]);
 }
 
-float QuaternionDot(const Quaternion *A, const Quaternion *B) {
-
-	return A->x * B->x +
-		A->y * B->y +
-		A->z + B->z +
-		A->w + B->w;
+void Quaternion::operator*=(const Quaternion & rhs) {
+	*this = *this * rhs;
 }
 
-float QuaternionNorm(const Quaternion *A) {
-
-	return QuaternionDot(A, A);
+float Quaternion::dot(const Quaternion & rhs) const {
+	return m_v[0] * rhs.m_v[0] + m_v[1] * rhs.m_v[1] +
+		m_v[2] * rhs.m_v[2] + m_v[3] * rhs.m_v[3];
 }
 
-/// Normalizes this quaternion, and returns the previous length
-float QuaternionNormalize(Quaternion *theQuat) {
-
-	float len, factor;
-
-	len = QuaternionNorm(theQuat);
-	factor = 1.0f / sqrtf(len);
-	QuaternionScalarProduct(theQuat, factor);
+float Quaternion::norm() const { return dot(*this); }
 
+float Quaternion::normalize() {
+	float len = sqrtf(norm());
+	float factor = 1.0f / len;
+	for(int i = 0; i < 4; ++i) m_v[i] *= factor;
 	return len;
 }
 
-// tgt = src^{-1}
-// note: apply to non-zero quaternion
-void QuaternionInverse(const Quaternion *src, Quaternion *tgt) {
-
-	float fNorm, fInvNorm;
-
-	fNorm = QuaternionNorm(src);
-	if ( fNorm > 0.0 ) {
-		fInvNorm = 1.0f / fNorm;
-		tgt->x = -src->x * fInvNorm;
-		tgt->y = -src->y * fInvNorm;
-		tgt->z = -src->z * fInvNorm;
-		tgt->w =  src->w * fInvNorm;
-	} else {
-		// return an invalid result to flag the error
-		tgt->x = 0;
-		tgt->y = 0;
-		tgt->z = 0;
-		tgt->w = 0;
+Quaternion Quaternion::inverse() const {
+	float fNorm = norm();
+	if (fNorm > 0.0f) {
+		float fInvNorm = 1.0f / fNorm;
+		return Quaternion(m_v[3] * fInvNorm, -m_v[0] * fInvNorm,
+						  -m_v[1] * fInvNorm, -m_v[2] * fInvNorm);
 	}
+	// return an invalid result to flag the error
+	return Quaternion(0.0f, 0.0f, 0.0f, 0.0f);
 }
 
-// tgt = src^{-1}
-// note: apply to unit-lenght quaternion
-void QuaternionUnitInverse(const Quaternion *src, Quaternion *tgt) {
-	tgt->x = -src->x;
-	tgt->y = -src->y;
-	tgt->z = -src->z;
-	tgt->w =  src->w;
+Quaternion Quaternion::conjugate() const {
+	return Quaternion(m_v[3], -m_v[0], -m_v[1], -m_v[2]);
 }
 
-void QuaternionExp(const Quaternion *src, Quaternion *tgt) {
+Quaternion Quaternion::exp() const {
 
 	// If q = A*(x*i+y*j+z*k) where (x,y,z) is unit length, then
 	// exp(q) = cos(A)+sin(A)*(x*i+y*j+z*k).  If sin(A) is near zero,
 	// use exp(q) = cos(A)+A*(x*i+y*j+z*k) since A/sin(A) has limit 1.
 
-	float fAngle;
-	float fSin;
-	float fCoeff;
-
-	fAngle = sqrtf(src->x * src->x + src->y * src->y + src->z * src->z); // Angle in radians
-	fSin = sinf(fAngle);
-	tgt->w = cosf(fAngle);
-
-	if (fabsf(fSin) >= ms_fEpsilon) {
-		fCoeff = fSin / fAngle;
-		tgt->x = fCoeff * src->x;
-		tgt->y = fCoeff * src->y;
-		tgt->z = fCoeff * src->z;
-	} else {
-		tgt->x = src->x;
-		tgt->y = src->y;
-		tgt->z = src->z;
-	}
+	float fAngle = sqrtf(m_v[0] * m_v[0] + m_v[1] * m_v[1] + m_v[2] * m_v[2]);
+	float fSin = sinf(fAngle);
+	float fCoeff = fabsf(fSin) >= ms_fEpsilon ? fSin / fAngle : 1.0f;
+	return Quaternion(cosf(fAngle), fCoeff * m_v[0], fCoeff * m_v[1], fCoeff * m_v[2]);
 }
 
-void QuaternionLog(const Quaternion *src, Quaternion *tgt) {
+Quaternion Quaternion::log() const {
 
 	// If q = cos(A)+sin(A)*(x*i+y*j+z*k) where (x,y,z) is unit length, then
 	// log(q) = A*(x*i+y*j+z*k).  If sin(A) is near zero, use log(q) =
 	// sin(A)*(x*i+y*j+z*k) since sin(A)/A has limit 1.
 
-	float fAngle;
-	float fSin;
-	float fCoeff;
-
-	tgt->w = 0.0;
-	if ( fabsf(src->w) < 1.0f ) {
-		fAngle = acosf(src->w); // In radians
-		fSin = sinf(fAngle);
-		if (fabsf(fSin) >= ms_fEpsilon ) {
-			fCoeff = fAngle / fSin;
-			tgt->x = fCoeff * src->x;
-			tgt->y = fCoeff * src->y;
-			tgt->z = fCoeff * src->z;
-			return;
-		}
+	float fCoeff = 1.0f;
+	if (fabsf(m_v[3]) < 1.0f) {
+		float fAngle = acosf(m_v[3]);
+		float fSin = sinf(fAngle);
+		if (fabsf(fSin) >= ms_fEpsilon) fCoeff = fAngle / fSin;
 	}
-	tgt->x = src->x;
-	tgt->y = src->y;
-	tgt->z = src->z;
+	return Quaternion(0.0f, fCoeff * m_v[0], fCoeff * m_v[1], fCoeff * m_v[2]);
 }
 
-// rotation of a vector by a quaternion
-void QuaternionTransformVector(const Quaternion *src , float *vx, float *vy, float *vz ) {
+Vector3 Quaternion::rotate(const Vector3 & V) const {
 
 	// nVidia SDK implementation
 
-	float uv[3], uuv[3];
-	float qvec[3] = { src->x, src->y, src->z };
-	float fFactor;
-
-	// uv = qvec * v
-	crossVV(&uv[0], &uv[1], &uv[2],
-			qvec[0], qvec[1], qvec[2],
-			*vx, *vy, *vz);
-	// uuv = qvec * uv
-	crossVV(&uuv[0], &uuv[1], &uuv[2],
-			qvec[0], qvec[1], qvec[2],
-			uv[0], uv[1], uv[2]);
-
-	fFactor = 2.0f * src->w;
-	uv[0] *= fFactor; uv[1] *= fFactor; uv[2] *= fFactor;
-	uuv[0] *= 2.0f; uuv[1] *= 2.0f; uuv[2] *= 2.0f;
-
-	*vx += uv[0] + uuv[0];
-	*vy += uv[1] + uuv[1];
-	*vz += uv[2] + uuv[2];
+	Vector3 qvec(m_v[0], m_v[1], m_v[2]);
+	Vector3 uv = crossVectors(qvec, V);
+	Vector3 uuv = crossVectors(qvec, uv);
+	return V + uv * (2.0f * m_v[3]) + uuv * 2.0f;
 }
 
-float QuaternionGetRoll(const Quaternion *src, int reprojectAxis) {
-
-	//float fTx;
-	float fTy;
-	float fTz;
-	float fTwz;
-	float fTxy;
-	float fTyy;
-	float fTzz;
-
-	float res; // in radians
+void Quaternion::getColumns(Vector3 & c1, Vector3 & c2, Vector3 & c3) const {
+	float fTx  = m_v[0] + m_v[0];
+	float fTy  = m_v[1] + m_v[1];
+	float fTz  = m_v[2] + m_v[2];
+	float fTwx = fTx * m_v[3];
+	float fTwy = fTy * m_v[3];
+	float fTwz = fTz * m_v[3];
+	float fTxx = fTx * m_v[0];
+	float fTxy = fTy * m_v[0];
+	float fTxz = fTz * m_v[0];
+	float fTyy = fTy * m_v[1];
+	float fTyz = fTz * m_v[1];
+	float fTzz = fTz * m_v[2];
+
+	c1 = Vector3(1.0f - (fTyy + fTzz), fTxy + fTwz, fTxz - fTwy);
+	c2 = Vector3(fTxy - fTwz, 1.0f - (fTxx + fTzz), fTyz + fTwx);
+	c3 = Vector3(fTxz + fTwy, fTyz - fTwx, 1.0f - (fTxx + fTyy));
+}
 
+float Quaternion::getRoll(bool reprojectAxis) const {
+	const float *q = m_v;
 	if (reprojectAxis) {
 		// roll = atan2(localx.y, localx.x)
 		// pick parts of xAxis() implementation that we need
-
-		//fTx  = 2.0 * src->x;
-		fTy  = 2.0f * src->y;
-		fTz  = 2.0f * src->z;
-		fTwz = fTz * src->w;
-		fTxy = fTy * src->x;
-		fTyy = fTy * src->y;
-		fTzz = fTz * src->z;
-
+		float fTy  = 2.0f * q[1];
+		float fTz  = 2.0f * q[2];
+		float fTwz = fTz * q[3];
+		float fTxy = fTy * q[0];
+		float fTyy = fTy * q[1];
+		float fTzz = fTz * q[2];
 		// Vector3(1.0-(fTyy+fTzz), fTxy+fTwz, fTxz-fTwy);
-		res = atan2f(fTxy + fTwz, 1.0f - (fTyy + fTzz));
-	} else {
-		res = atan2f(2*(src->x * src->y + src->w * src->z),
-					 src->w * src->w + src->x * src->x - src->y * src->y - src->z * src->z);
+		return atan2f(fTxy + fTwz, 1.0f - (fTyy + fTzz));
 	}
-	return res;
+	return atan2f(2 * (q[0] * q[1] + q[3] * q[2]),
+				  q[3] * q[3] + q[0] * q[0] - q[1] * q[1] - q[2] * q[2]);
 }
 
-float QuaternionGetPitch(const Quaternion *src, int reprojectAxis) {
-
-	float fTx;
-	//float fTy;
-	float fTz;
-	float fTwx;
-	float fTxx;
-	float fTyz;
-	float fTzz;
-
-	float res; // in radians
-
+float Quaternion::getPitch(bool reprojectAxis) const {
+	const float *q = m_v;
 	if (reprojectAxis) {
-		// roll = atan2(localx.y, localx.x)
-		// pick parts of xAxis() implementation that we need
-
-		fTx  = 2.0 * src->x;
-		//fTy  = 2.0f * src->y;
-		fTz  = 2.0f * src->z;
-		fTwx = fTx * src->w;
-		fTxx = fTx * src->x;
-		fTyz = fTz * src->y;
-		fTzz = fTz * src->z;
-
+		// pitch = atan2(localy.z, localy.y)
+		// pick parts of yAxis() implementation that we need
+		float fTx  = 2.0f * q[0];
+		float fTz  = 2.0f * q[2];
+		float fTwx = fTx * q[3];
+		float fTxx = fTx * q[0];
+		float fTyz = fTz * q[1];
+		float fTzz = fTz * q[2];
 		// Vector3(fTxy-fTwz, 1.0-(fTxx+fTzz), fTyz+fTwx);
-		res = atan2f(fTyz + fTwx, 1.0f - (fTxx + fTzz));
-	} else {
-		res = atan2f(2*(src->y * src->z + src->w*src->x),
-					 src->w*src->w - src->x*src->x - src->y*src->y + src->z*src->z);
+		return atan2f(fTyz + fTwx, 1.0f - (fTxx + fTzz));
 	}
-	return res;
+	return atan2f(2 * (q[1] * q[2] + q[3] * q[0]),
+				  q[3] * q[3] - q[0] * q[0] - q[1] * q[1] + q[2] * q[2]);
 }
 
-float QuaternionGetYaw(const Quaternion *src, int reprojectAxis) {
-
-	float fTx;
-	float fTy;
-	float fTz;
-	float fTwy;
-	float fTxx;
-	float fTxz;
-	float fTyy;
-
-	float res; // in radians
-
+float Quaternion::getYaw(bool reprojectAxis) const {
+	const float *q = m_v;
 	if (reprojectAxis) {
-		// roll = atan2(localx.y, localx.x)
-		// pick parts of xAxis() implementation that we need
-
-		fTx  = 2.0f * src->x;
-		fTy  = 2.0f * src->y;
-		fTz  = 2.0f * src->z;
-		fTwy = fTy * src->w;
-		fTxx = fTx * src->x;
-		fTxz = fTz * src->x;
-		fTyy = fTy * src->y;
-
+		// yaw = atan2(localz.x, localz.z)
+		// pick parts of zAxis() implementation that we need
+		float fTx  = 2.0f * q[0];
+		float fTy  = 2.0f * q[1];
+		float fTz  = 2.0f * q[2];
+		float fTwy = fTy * q[3];
+		float fTxx = fTx * q[0];
+		float fTxz = fTz * q[0];
+		float fTyy = fTy * q[1];
 		// Vector3(fTxz+fTwy, fTyz-fTwx, 1.0-(fTxx+fTyy));
-		res = atan2f(fTxz + fTwy, 1.0f - (fTxx + fTyy));
-	} else {
-		// internal version
-		res = asinf(-2*(src->x*src->z - src->w*src->y));
+		return atan2f(fTxz + fTwy, 1.0f - (fTxx + fTyy));
 	}
-	return res;
+	// internal version
+	return asinf(-2 * (q[0] * q[2] - q[3] * q[1]));
 }
 
-/** Performs Spherical linear interpolation between two quaternions, and returns the result.
-	B = Slerp( fT, A, B). Take into account that:
-	Slerp ( 0.0f, A, B ) = A
-	Slerp ( 1.0f, A, B ) = B
-	@remarks
-	Slerp has the proprieties of performing the interpolation at constant
-	velocity, and being torque-minimal (unless shortestPath=false).
-	However, it's NOT commutative, which means
-	Slerp ( 0.75f, A, B ) != Slerp ( 0.25f, B, A );
-	therefore be careful if your code relies in the order of the operands.
-	This is specially important in IK animation.
-*/
-
-void QuaternionSlerp(const Quaternion *rkP, const Quaternion *rkQ,
-					 Quaternion *tgt, float fT, int shortestPath) {
-
-	float fSin, fInvSin;
-	float fAngle;
-	float fCoeff0, fCoeff1;
-	float fCos;
-	float x, y, z, w;
-
-	x = y = z = 0.0f;
-	w = 1.0f;
-
-	fCos = QuaternionDot(rkP, rkQ);
+// out = c0 * A + c1 * B, normalized if 'unit'. out may be A or B.
+
+static inline void blend(const float *A, const float *B, float c0, float c1,
+						 bool unit, float *out) {
+#ifdef TRFM_SSE
+	__m128 r = _mm_add_ps(_mm_mul_ps(_mm_load_ps(A), _mm_set1_ps(c0)),
+						  _mm_mul_ps(_mm_load_ps(B), _mm_set1_ps(c1)));
+	if (unit) {
+		// horizontal sum of r*r in every component
+		__m128 d = _mm_mul_ps(r, r);
+		d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+		d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+		r = _mm_div_ps(r, _mm_sqrt_ps(d));
+	}
+	_mm_store_ps(out, r);
+#else
+	float r[4];
+	for(int i = 0; i < 4; ++i) r[i] = c0 * A[i] + c1 * B[i];
+	float factor = unit ? 1.0f / sqrtf(r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]) : 1.0f;
+	for(int i = 0; i < 4; ++i) out[i] = r[i] * factor;
+#endif
+}
 
+// slerp and nlerp blend coefficients of A and B. Return whether the result
+// has to be normalized.
+
+static inline bool slerp_coeffs(float fCos, float fT, bool shortestPath,
+								float & c0, float & c1) {
+	float sign = 1.0f;
 	if (fCos < 0.0f && shortestPath) {
 		fCos = -fCos;
-		x = -rkQ->x;
-		y = -rkQ->y;
-		z = -rkQ->z;
-		w = -rkQ->w;
-	} else {
-		x = rkQ->x;
-		y = rkQ->y;
-		z = rkQ->z;
-		w = rkQ->w;
+		sign = -1.0f;
 	}
-
 	if (fabsf(fCos) < 1 - ms_fEpsilon) {
 		// Standard case (slerp)
-		fSin = sqrtf(1 - sqrtf(fCos));
-		fAngle = atan2f(fSin, fCos);
-		fInvSin = 1.0f / fSin;
-		fCoeff0 = sinf((1.0f - fT) * fAngle) * fInvSin;
-		fCoeff1 = sinf(fT * fAngle) * fInvSin;
-		tgt->x = fCoeff0 * rkP->x + fCoeff1 * x;
-		tgt->y = fCoeff0 * rkP->y + fCoeff1 * y;
-		tgt->z = fCoeff0 * rkP->z + fCoeff1 * z;
-		tgt->w = fCoeff0 * rkP->w + fCoeff1 * w;
-		return;
-	} else {
-		// There are two situations:
-		// 1. "rkP" and "rkQ" are very close (fCos ~= +1), so we can do a linear
-		//    interpolation safely.
-		// 2. "rkP" and "rkQ" are almost inverse of each other (fCos ~= -1), there
-		//    are an infinite number of possibilities interpolation. but we haven't
-		//    have method to fix this case, so just use linear interpolation here.
-		tgt->x = (1.0f - fT) * rkP->x + fT * x;
-		tgt->y = (1.0f - fT) * rkP->y + fT * x;
-		tgt->z = (1.0f - fT) * rkP->z + fT * z;
-		tgt->w = (1.0f - fT) * rkP->w + fT * w;
-		QuaternionNormalize(tgt);
-		return;
+		float fSin = sqrtf(1 - fCos * fCos);
+		float fAngle = atan2f(fSin, fCos);
+		float fInvSin = 1.0f / fSin;
+		c0 = sinf((1.0f - fT) * fAngle) * fInvSin;
+		c1 = sign * sinf(fT * fAngle) * fInvSin;
+		return false;
 	}
+	// There are two situations:
+	// 1. "A" and "B" are very close (fCos ~= +1), so we can do a linear
+	//    interpolation safely.
+	// 2. "A" and "B" are almost inverse of each other (fCos ~= -1), there
+	//    are an infinite number of possibilities interpolation. but we haven't
+	//    have method to fix this case, so just use linear interpolation here.
+	c0 = 1.0f - fT;
+	c1 = sign * fT;
+	return true;
 }
 
-/** @See Slerp. It adds extra "spins" (i.e. rotates several times) specified
-	by parameter 'iExtraSpins' while interpolating before arriving to the
-	final values
-*/
-void QuaternionSlerpExtraSpins(const Quaternion *rkP, const Quaternion *rkQ,
-							   Quaternion *tgt, float fT, int iExtraSpins) {
-
-	float fSin, fInvSin;
-	float fPhase;
-	float fCoeff0, fCoeff1;
-	float fCos;
-	float fAngle;
-
-	fCos = QuaternionDot(rkP, rkQ);
-	fAngle = acosf(fCos);
-
-	if (fabsf(fAngle) < ms_fEpsilon ) {
-		tgt->x = rkP->x;
-		tgt->y = rkP->y;
-		tgt->z = rkP->z;
-		tgt->w = rkP->w;
-		return;
-	}
+static inline void nlerp_coeffs(float fCos, float fT, bool shortestPath,
+								float & c0, float & c1) {
+	c0 = 1.0f - fT;
+	c1 = (fCos < 0.0f && shortestPath) ? -fT : fT;
+}
 
-	fSin = sinf(fAngle);
-	fPhase = PI_VALUE * iExtraSpins * fT;
-	fInvSin = 1.0f/fSin;
-	fCoeff0 = sinf((1.0f - fT) * fAngle - fPhase) * fInvSin;
-	fCoeff1 = sinf(fT * fAngle + fPhase) * fInvSin;
-	tgt->x = fCoeff0 * rkP->x + fCoeff1 * rkQ->x;
-	tgt->y = fCoeff0 * rkP->y + fCoeff1 * rkQ->y;
-	tgt->z = fCoeff0 * rkP->z + fCoeff1 * rkQ->z;
-	tgt->w = fCoeff0 * rkP->w + fCoeff1 * rkQ->w;
-	return;
+Quaternion Quaternion::slerp(const Quaternion & A, const Quaternion & B, float fT,
+							 bool shortestPath) {
+	Quaternion res;
+	float c0, c1;
+	bool unit = slerp_coeffs(A.dot(B), fT, shortestPath, c0, c1);
+	blend(A.m_v, B.m_v, c0, c1, unit, res.m_v);
+	return res;
 }
 
-/** Performs Normalised linear interpolation between two quaternions, and returns the result.
-	nlerp ( 0.0f, A, B ) = A
-	nlerp ( 1.0f, A, B ) = B
-	@remarks
-	Nlerp is faster than Slerp.
-	Nlerp has the proprieties of being commutative (@See Slerp;
-	commutativity is desired in certain places, like IK animation), and
-	being torque-minimal (unless shortestPath=false). However, it's performing
-	the interpolation at non-constant velocity; sometimes this is desired,
-	sometimes it is not. Having a non-constant velocity can produce a more
-	natural rotation feeling without the need of tweaking the weights; however
-	if your scene relies on the timing of the rotation or assumes it will point
-	at a specific angle at a specific weight value, Slerp is a better choice.
-*/
-void QuaternionNlerp(const Quaternion *rkP, const Quaternion *rkQ,
-					 Quaternion *tgt, float fT, int shortestPath) {
-
-	float fCos;
-	fCos= QuaternionDot(rkP, rkQ);
-	if (fCos < 0.0f && shortestPath) {
-		tgt->x = rkP->x + fT * ((-rkQ->x) - rkP->x);
-		tgt->y = rkP->y + fT * ((-rkQ->y) - rkP->y);
-		tgt->z = rkP->z + fT * ((-rkQ->z) - rkP->z);
-		tgt->w = rkP->w + fT * ((-rkQ->w) - rkP->w);
-	}	else {
-		tgt->x = rkP->x + fT * (rkQ->x - rkP->x);
-		tgt->y = rkP->y + fT * (rkQ->y - rkP->y);
-		tgt->z = rkP->z + fT * (rkQ->z - rkP->z);
-		tgt->w = rkP->w + fT * (rkQ->w - rkP->w);
+Quaternion Quaternion::slerpExtraSpins(const Quaternion & A, const Quaternion & B, float fT,
+									   int iExtraSpins) {
+	float fAngle = acosf(A.dot(B));
+	if (fabsf(fAngle) < ms_fEpsilon) return A;
+
+	float fSin = sinf(fAngle);
+	float fPhase = Constants::pi * iExtraSpins * fT;
+	float fInvSin = 1.0f / fSin;
+	Quaternion res;
+	blend(A.m_v, B.m_v, sinf((1.0f - fT) * fAngle - fPhase) * fInvSin,
+		  sinf(fT * fAngle + fPhase) * fInvSin, false, res.m_v);
+	return res;
+}
+
+Quaternion Quaternion::nlerp(const Quaternion & A, const Quaternion & B, float fT,
+							 bool shortestPath) {
+	Quaternion res;
+	float c0, c1;
+	nlerp_coeffs(A.dot(B), fT, shortestPath, c0, c1);
+	blend(A.m_v, B.m_v, c0, c1, true, res.m_v);
+	return res;
+}
+
+void Quaternion::slerp(const Quaternion *A, const Quaternion *B, const float *t,
+					   Quaternion *out, size_t n, bool shortestPath) {
+	for(size_t i = 0; i < n; ++i) {
+		float c0, c1;
+		bool unit = slerp_coeffs(A[i].dot(B[i]), t[i], shortestPath, c0, c1);
+		blend(A[i].m_v, B[i].m_v, c0, c1, unit, out[i].m_v);
+	}
+}
+
+void Quaternion::nlerp(const Quaternion *A, const Quaternion *B, const float *t,
+					   Quaternion *out, size_t n, bool shortestPath) {
+	for(size_t i = 0; i < n; ++i) {
+		float c0, c1;
+		nlerp_coeffs(A[i].dot(B[i]), t[i], shortestPath, c0, c1);
+		blend(A[i].m_v, B[i].m_v, c0, c1, true, out[i].m_v);
 	}
-	QuaternionNormalize(tgt);
-	return;
 }
 
-void PrintQuaternion(Quaternion *b) {
-	printf("Quaternion(w:%.2f, x:%.2f, y:%.2f, z:%.2f) ", b->w, b->x, b->y, b->z);
+void Quaternion::print() const {
+	printf("Quaternion(w:%.2f, x:%.2f, y:%.2f, z:%.2f) ", m_v[3], m_v[0], m_v[1], m_v[2]);
 }
@@ -17,148 +17,126 @@
  *
  */
 
-
+#include <cstddef>
+#include "vector3.h"
 #include "trfm3D.h"
 
-typedef struct _Quaternion {
-	float w, x, y, z;
-} Quaternion;
-
-void DestroyQuaternion(Quaternion **theQuat);
-
-Quaternion *CreateQuaternion(float x, float y, float z, float w);
-Quaternion *CreateQuaternionFromTrfm3D(trfm3D *T);
-Quaternion *CreateQuaternionCopy(Quaternion *theQuat);
-
-void QuaternionToTrfm3D(const Quaternion *theQuat, trfm3D *T);
-
-// tgt = src + tgt
-void AddQuaternion(const Quaternion *src, Quaternion *tgt);
-
-// tgt = src - tgt
-void SubstractQuaternion(const Quaternion *src, Quaternion *tgt);
-
-void  QuaternionScalarProduct(Quaternion *src, float scalar);
-
-// tgt = src * tgt
-void  QuaternionProduct(const Quaternion *src, Quaternion *tgt);
-
-float QuaternionDot(const Quaternion *theQuat, const Quaternion *otherQuat);
-float QuaternionNorm(const Quaternion *theQuat);
-
-/// Normalizes this quaternion, and returns the previous length
-float QuaternionNormalize(Quaternion *theQuat);
-
-// tgt = src^{-1}
-// note: apply to non-zero quaternion
-void QuaternionInverse(const Quaternion *src, Quaternion *tgt);
-
-// tgt = src^{-1}
-// note: apply to unit-lenght quaternion
-void QuaternionUnitInverse(const Quaternion *src, Quaternion *tgt);
-
-void QuaternionExp(const Quaternion *src, Quaternion *tgt);
-void QuaternionLog(const Quaternion *src, Quaternion *tgt);
-
-// rotation of a vector by a quaternion
-void QuaternionTransformVector(const Quaternion *src , float *xtr, float *ytr, float *ztr );
-
-/**
- * Calculate the local roll element of this quaternion.
- *
- * @param src the quaternion
- * @param reprojectAxis By default the method returns the 'intuitive' result
- that is, if you projected the local Y of the quaternion onto the X and
- Y axes, the angle between them is returned. If set to false though, the
- result is the actual yaw that will be used to implement the quaternion,
- which is the shortest possible path to get to the same orientation and
- may involve less axial rotation.
-
- @return: roll angle in degrees
-**/
-
-float QuaternionGetRoll(const Quaternion *src, int reprojectAxis);
-
-
-/**
- * Calculate the local pitch element of this quaternion
- *
- * @param src the Quaternion
- @param reprojectAxis By default the method returns the 'intuitive' result
- that is, if you projected the local Z of the quaternion onto the X and
- Y axes, the angle between them is returned. If set to true though, the
- result is the actual yaw that will be used to implement the quaternion,
- which is the shortest possible path to get to the same orientation and
- may involve less axial rotation.
- @return: pitch angle in degrees
-*/
-
-float QuaternionGetPitch(const Quaternion *src, int reprojectAxis);
-
-/**
- * Calculate the local yaw element of this quaternion
- *
- * @param src the Quqternion
- @param reprojectAxis By default the method returns the 'intuitive' result
- that is, if you projected the local Z of the quaternion onto the X and
- Z axes, the angle between them is returned. If set to true though, the
- result is the actual yaw that will be used to implement the quaternion,
- which is the shortest possible path to get to the same orientation and
- may involve less axial rotation.
- @return: yaw angle in degrees
-*/
-
-float QuaternionGetYaw(const Quaternion *src, int reprojectAxis);
-
-
-/**
-   Performs Spherical linear interpolation between two quaternions, and returns the result.
-   C = Slerp( fT, A, B).
-
-   Take into account that:
-   Slerp ( 0.0f, A, B ) = A
-   Slerp ( 1.0f, A, B ) = B
-
-   @param fT the step
-   @param A source Quaternion
-   @param B target Quaternion
-
-   @return the iterpolated Quaternion
-
-   @remarks
-   Slerp has the proprieties of performing the interpolation at constant
-   velocity, and being torque-minimal (unless shortestPath=false).
-   However, it's NOT commutative, which means
-   Slerp ( 0.75f, A, B ) != Slerp ( 0.25f, B, A );
-   therefore be careful if your code relies in the order of the operands.
-   This is specially important in IK animation.
-*/
-
-void QuaternionSlerp(const Quaternion *A, const Quaternion *B,
-					 Quaternion *C, float fT, int shortestPath);
-
-/** @See Slerp. It adds extra "spins" (i.e. rotates several times) specified
-	by parameter 'iExtraSpins' while interpolating before arriving to the
-	final values
-*/
-void QuaternionSlerpExtraSpins(const Quaternion *A, const Quaternion *B,
-							   Quaternion *C, float fT, int iExtraSpins);
-
-/** Performs Normalised linear interpolation between two quaternions, and returns the result.
-	nlerp ( 0.0f, A, B ) = A
-	nlerp ( 1.0f, A, B ) = B
-	@remarks
-	Nlerp is faster than Slerp.
-	Nlerp has the proprieties of being commutative (@See Slerp;
-	commutativity is desired in certain places, like IK animation), and
-	being torque-minimal (unless shortestPath=false). However, it's performing
-	the interpolation at non-constant velocity; sometimes this is desired,
-	sometimes it is not. Having a non-constant velocity can produce a more
-	natural rotation feeling without the need of tweaking the weights; however
-	if your scene relies on the timing of the rotation or assumes it will point
-	at a specific angle at a specific weight value, Slerp is a better choice.
-*/
-void QuaternionNlerp(const Quaternion *A, const Quaternion *B,
-					 Quaternion *C, float fT, int shortestPath);
-
-void PrintQuaternion(Quaternion *theQuat);
+/*! The quaternion is stored as an aligned (x, y, z, w) vector, so that the
+  4-component operations of the interpolations are a single SSE register. */
+
+class Quaternion {
+
+public:
+
+	static const Quaternion IDENTITY; // (w:1, x:0, y:0, z:0)
+
+	// Constructors
+	Quaternion(); // identity
+	Quaternion(float w, float x, float y, float z);
+	//! rotation of angle radians about axis (needs not be unit)
+	Quaternion(const Vector3 & axis, float angle);
+	//! rotation part of T (the uniform scale is divided out)
+	explicit Quaternion(const Trfm3D & T);
+
+	// Coordinate access
+	float w() const;
+	float x() const;
+	float y() const;
+	float z() const;
+
+	// this * rhs (first rhs, then this)
+	Quaternion operator*(const Quaternion & rhs) const;
+	void operator*=(const Quaternion & rhs);
+
+	float dot(const Quaternion & rhs) const;
+	float norm() const; // squared length
+
+	/// Normalizes this quaternion, and returns the previous length
+	float normalize();
+
+	// note: apply to non-zero quaternion
+	Quaternion inverse() const;
+	// note: apply to unit-lenght quaternion
+	Quaternion conjugate() const;
+
+	Quaternion exp() const;
+	Quaternion log() const;
+
+	// rotation of a vector by a (unit) quaternion
+	Vector3 rotate(const Vector3 & V) const;
+
+	// rotation columns of the matrix of this (unit) quaternion
+	void getColumns(Vector3 & c1, Vector3 & c2, Vector3 & c3) const;
+
+	/**
+	 * Local roll, pitch and yaw elements of this quaternion (in radians).
+	 *
+	 * @param reprojectAxis By default the methods return the 'intuitive'
+	 result that is, if you projected the local Y (roll) or Z (pitch, yaw)
+	 of the quaternion onto the corresponding axes, the angle between them
+	 is returned. If set to false though, the result is the actual angle
+	 that will be used to implement the quaternion, which is the shortest
+	 possible path to get to the same orientation and may involve less
+	 axial rotation.
+	**/
+	float getRoll(bool reprojectAxis = true) const;
+	float getPitch(bool reprojectAxis = true) const;
+	float getYaw(bool reprojectAxis = true) const;
+
+	/**
+	   Performs Spherical linear interpolation between two quaternions, and returns the result.
+	   C = Slerp(A, B, fT).
+
+	   Take into account that:
+	   Slerp (A, B, 0.0f) = A
+	   Slerp (A, B, 1.0f) = B
+
+	   @remarks
+	   Slerp has the proprieties of performing the interpolation at constant
+	   velocity, and being torque-minimal (unless shortestPath=false).
+	   However, it's NOT commutative, which means
+	   Slerp (A, B, 0.75f) != Slerp (B, A, 0.25f);
+	   therefore be careful if your code relies in the order of the operands.
+	   This is specially important in IK animation.
+	*/
+	static Quaternion slerp(const Quaternion & A, const Quaternion & B, float fT,
+							bool shortestPath = true);
+
+	/** @See slerp. It adds extra "spins" (i.e. rotates several times) specified
+		by parameter 'iExtraSpins' while interpolating before arriving to the
+		final values
+	*/
+	static Quaternion slerpExtraSpins(const Quaternion & A, const Quaternion & B, float fT,
+									  int iExtraSpins);
+
+	/** Performs Normalised linear interpolation between two quaternions, and returns the result.
+		nlerp (A, B, 0.0f) = A
+		nlerp (A, B, 1.0f) = B
+		@remarks
+		Nlerp is faster than Slerp.
+		Nlerp has the proprieties of being commutative (@See Slerp;
+		commutativity is desired in certain places, like IK animation), and
+		being torque-minimal (unless shortestPath=false). However, it's performing
+		the interpolation at non-constant velocity; sometimes this is desired,
+		sometimes it is not. Having a non-constant velocity can produce a more
+		natural rotation feeling without the need of tweaking the weights; however
+		if your scene relies on the timing of the rotation or assumes it will point
+		at a specific angle at a specific weight value, Slerp is a better choice.
+	*/
+	static Quaternion nlerp(const Quaternion & A, const Quaternion & B, float fT,
+							bool shortestPath = true);
+
+	/**
+	 * Array versions of slerp and nlerp, for animation: out[i] is the
+	 * interpolation between A[i] and B[i] at step t[i]. out may be A or B.
+	 */
+	static void slerp(const Quaternion *A, const Quaternion *B, const float *t,
+					  Quaternion *out, size_t n, bool shortestPath = true);
+	static void nlerp(const Quaternion *A, const Quaternion *B, const float *t,
+					  Quaternion *out, size_t n, bool shortestPath = true);
+
+	void print() const;
+
+private:
+	alignas(16) float m_v[4]; // x, y, z, w
+};
@@ -1,190 +1,90 @@
 #include <cassert>
 #include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <cmath>
 
 #include <GL/glut.h>
 
 #include "tools.h"
 #include "trfm3D.h"
+#include "quaternion.h"
+#include "threadPool.h"
 
+static const float identity[16] = { 1.0f, 0.0f, 0.0f, 0.0f,
+									0.0f, 1.0f, 0.0f, 0.0f,
+									0.0f, 0.0f, 1.0f, 0.0f,
+									0.0f, 0.0f, 0.0f, 1.0f };
 
-Trfm3D::Trfm3D() : m_c1(Vector3::UNIT_X), m_c2(Vector3::UNIT_Y), m_c3(Vector3::UNIT_Z),
-				   m_tr(Vector3::ZERO), m_d(Vector3::ZERO), m_scl(1.0f), m_w(1.0f) {}
+Trfm3D::Trfm3D() : m_scl(1.0f) {
+	memcpy(m_m, identity, sizeof(m_m));
+}
 
-Trfm3D::Trfm3D(const Trfm3D & T) : m_c1(T.m_c1), m_c2(T.m_c2), m_c3(T.m_c3),
-								   m_tr(T.m_tr), m_d(T.m_d), m_scl(T.m_scl), m_w(T.m_w) {}
+Trfm3D::Trfm3D(const Trfm3D & T) : m_scl(T.m_scl) {
+	memcpy(m_m, T.m_m, sizeof(m_m));
+}
 
 void Trfm3D::swap(Trfm3D & T) {
-	m_c1.swap(T.m_c1);
-	m_c2.swap(T.m_c2);
-	m_c3.swap(T.m_c3);
-	m_tr.swap(T.m_tr);
-	m_d.swap(T.m_d);
+	for(int i = 0; i < 16; ++i) std::swap(m_m[i], T.m_m[i]);
 	std::swap(m_scl, T.m_scl);
-	std::swap(m_w, T.m_w);
 }
 
+// set the affine trfm with rotation columns c1, c2, c3 (to be scaled by
+// scl) and translation tr
 
-// Compute this*add and leave the result in this
-
-void Trfm3D::add( const Trfm3D &T ) {
-
-	float    newR1X, newR1Y, newR1Z;
-	float    newR2X, newR2Y, newR2Z;
-	float    newR3X, newR3Y, newR3Z;
-
-	float    newDX, newDY, newDZ, newDW;
-
-	float    newTrX, newTrY, newTrZ;
-
-	float c10 = m_c1[0];
-	float c11 = m_c1[1];
-	float c12 = m_c1[2];
-	float c20 = m_c2[0];
-	float c21 = m_c2[1];
-	float c22 = m_c2[2];
-	float c30 = m_c3[0];
-	float c31 = m_c3[1];
-	float c32 = m_c3[2];
-	float tr0 = m_tr[0];
-	float tr1 = m_tr[1];
-	float tr2 = m_tr[2];
-
-	// New rotation Matrix
-
-	newR1X = newR1Y = newR1Z = 0.0;
-
-	newR1X += c10 * T.m_c1[0];
-	newR1X += c20 * T.m_c1[1];
-	newR1X += c30 * T.m_c1[2];
-	newR1X += tr0 * T.m_d[0] ;
-
-	newR1Y += c11 * T.m_c1[0];
-	newR1Y += c21 * T.m_c1[1];
-	newR1Y += c31 * T.m_c1[2];
-	newR1Y += tr1 * T.m_d[0] ;
-
-	newR1Z += c12 * T.m_c1[0];
-	newR1Z += c22 * T.m_c1[1];
-	newR1Z += c32 * T.m_c1[2];
-	newR1Z += tr2 * T.m_d[0] ;
-
-	newR2X = newR2Y = newR2Z = 0.0;
-
-	newR2X += c10 * T.m_c2[0];
-	newR2X += c20 * T.m_c2[1];
-	newR2X += c30 * T.m_c2[2];
-	newR2X += tr0 * T.m_d[1] ;
-
-	newR2Y += c11 * T.m_c2[0];
-	newR2Y += c21 * T.m_c2[1];
-	newR2Y += c31 * T.m_c2[2];
-	newR2Y += tr1 * T.m_d[1] ;
-
-	newR2Z += c12 * T.m_c2[0];
-	newR2Z += c22 * T.m_c2[1];
-	newR2Z += c32 * T.m_c2[2];
-	newR2Z += tr2 * T.m_d[1] ;
-
-	newR3X = newR3Y = newR3Z = 0.0;
-
-	newR3X += c10 * T.m_c3[0];
-	newR3X += c20 * T.m_c3[1];
-	newR3X += c30 * T.m_c3[2];
-	newR3X += tr0 * T.m_d[2] ;
-
-	newR3Y += c11 * T.m_c3[0];
-	newR3Y += c21 * T.m_c3[1];
-	newR3Y += c31 * T.m_c3[2];
-	newR3Y += tr1 * T.m_d[2] ;
-
-	newR3Z += c12 * T.m_c3[0];
-	newR3Z += c22 * T.m_c3[1];
-	newR3Z += c32 * T.m_c3[2];
-	newR3Z += tr2 * T.m_d[2] ;
-
-	newDX = newDY = newDZ = newDW = 0.0;
-
-	newDX += this->m_d[0] * T.m_c1[0];
-	newDX += this->m_d[1] * T.m_c1[1];
-	newDX += this->m_d[2] * T.m_c1[2];
-	newDX += this->m_w * T.m_d[0];
-
-	newDY += this->m_d[0] * T.m_c2[0];
-	newDY += this->m_d[1] * T.m_c2[1];
-	newDY += this->m_d[2] * T.m_c2[2];
-	newDY += this->m_w * T.m_d[1];
-
-	newDZ += this->m_d[0] * T.m_c3[0];
-	newDZ += this->m_d[1] * T.m_c3[1];
-	newDZ += this->m_d[2] * T.m_c3[2];
-	newDZ += this->m_w * T.m_d[2];
-
-	newDW += this->m_d[0] * T.m_tr[0];
-	newDW += this->m_d[1] * T.m_tr[1];
-	newDW += this->m_d[2] * T.m_tr[2];
-	newDW += this->m_w * T.m_w;
-
-	// New Translation
-
-	newTrX = 0;
-	newTrX += this->m_scl * c10 * T.m_tr[0];
-	newTrX += this->m_scl * c20 * T.m_tr[1];
-	newTrX += this->m_scl * c30 * T.m_tr[2];
-	newTrX += tr0 * T.m_w;
-
-	newTrY = 0;
-	newTrY += this->m_scl * c11 * T.m_tr[0];
-	newTrY += this->m_scl * c21 * T.m_tr[1];
-	newTrY += this->m_scl * c31 * T.m_tr[2];
-	newTrY += tr1 * T.m_w;
-
-	newTrZ = 0;
-	newTrZ += this->m_scl * c12 * T.m_tr[0];
-	newTrZ += this->m_scl * c22 * T.m_tr[1];
-	newTrZ += this->m_scl * c32 * T.m_tr[2];
-	newTrZ += tr2 * T.m_w;
-
-	// New scale
-
-	this->m_scl = T.m_scl * this->m_scl;
-
-	// Copy values
-
-	this->m_c1[0] = newR1X;
-	this->m_c1[1] = newR1Y;
-	this->m_c1[2] = newR1Z;
-
-	this->m_c2[0] = newR2X;
-	this->m_c2[1] = newR2Y;
-	this->m_c2[2] = newR2Z;
-
-	this->m_c3[0] = newR3X;
-	this->m_c3[1] = newR3Y;
-	this->m_c3[2] = newR3Z;
+void Trfm3D::setColumns(const Vector3 & c1, const Vector3 & c2, const Vector3 & c3,
+						const Vector3 & tr, float scl) {
+	for(int i = 0; i < 3; ++i) {
+		m_m[i] = c1[i] * scl;
+		m_m[4 + i] = c2[i] * scl;
+		m_m[8 + i] = c3[i] * scl;
+		m_m[12 + i] = tr[i];
+	}
+	m_m[3] = m_m[7] = m_m[11] = 0.0f;
+	m_m[15] = 1.0f;
+	m_scl = scl;
+}
 
-	this->m_tr[0] = newTrX;
-	this->m_tr[1] = newTrY;
-	this->m_tr[2] = newTrZ;
+Vector3 Trfm3D::column(int j) const {
+	return Vector3(m_m[4 * j], m_m[4 * j + 1], m_m[4 * j + 2]);
+}
 
-	this->m_d[0] = newDX;
-	this->m_d[1] = newDY;
-	this->m_d[2] = newDZ;
-	this->m_w = newDW;
+// Compute this*add and leave the result in this. Every column of the result
+// is a combination of the columns of this:
+//
+//   res_j = M_0 * T_0j + M_1 * T_1j + M_2 * T_2j + M_3 * T_3j
 
+void Trfm3D::add( const Trfm3D &T ) {
+#ifdef TRFM_SSE
+	__m128 c0 = _mm_load_ps(m_m);
+	__m128 c1 = _mm_load_ps(m_m + 4);
+	__m128 c2 = _mm_load_ps(m_m + 8);
+	__m128 c3 = _mm_load_ps(m_m + 12);
+	for(int j = 0; j < 4; ++j) {
+		const float *t = T.m_m + 4 * j;
+		__m128 r = _mm_mul_ps(c0, _mm_set1_ps(t[0]));
+		r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(t[1])));
+		r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(t[2])));
+		r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(t[3])));
+		_mm_store_ps(m_m + 4 * j, r);
+	}
+#else
+	float M[16];
+	memcpy(M, m_m, sizeof(M));
+	for(int j = 0; j < 4; ++j) {
+		const float *t = T.m_m + 4 * j;
+		for(int i = 0; i < 4; ++i)
+			m_m[4 * j + i] = M[i] * t[0] + M[4 + i] * t[1] + M[8 + i] * t[2] + M[12 + i] * t[3];
+	}
+#endif
+	m_scl *= T.m_scl;
 }
 
 void Trfm3D::add(const Trfm3D * T ) { add(*T); }
 
 void Trfm3D::clone( const Trfm3D &T ) {
-	m_c1 = T.m_c1;
-	m_c2 = T.m_c2;
-	m_c3 = T.m_c3;
-	m_tr = T.m_tr;
-	m_d  = T.m_d;
+	memcpy(m_m, T.m_m, sizeof(m_m));
 	m_scl = T.m_scl;
-	m_w  = T.m_w;
 }
 
 void Trfm3D::clone( const Trfm3D *T ) {	clone(*T); }
@@ -193,60 +93,125 @@ void Trfm3D::clone( const Trfm3D *T ) {	clone(*T); }
 ////////////////////////////////////////////////////////////////////////////////////
 // Transform points, vectors, planes ...
 
-// @@ TODO. Transform a point
+Vector3 Trfm3D::transformNormal(const Vector3 & N) const {
+	// this = M = S*R*T = S*R (no translations to normals)
+	// (M^{-1})^{T} == S^{-1}*R, which has the direction of M
+	Vector3 X = transformVector(N);
+	if ( m_scl != 1.0) {
+		X.normalize();
+	}
+	return X;
+}
 
-Vector3 Trfm3D::transformPoint(const Vector3 &P) const {
+// Array kernels. M is the 3x4 affine part of the matrix (column-major),
+// applied to the elements [begin, end).
+//
+// With SSE, packed (stride 3) arrays are read 4 elements (3 registers) at a
+// time and transposed to x, y and z registers, so that every product serves
+// 4 elements. Other strides transform one element per iteration, with the
+// columns kept in registers.
+
+static const size_t array_grain = 16384; // elements per chunk of the ThreadPool
+
+#ifdef TRFM_SSE
+#define SHUF(a, b, i, j, k, l) _mm_shuffle_ps(a, b, _MM_SHUFFLE(l, k, j, i))
+#endif
+
+static void transform_range(const float *M, const float *in, float *out,
+							size_t begin, size_t end, size_t stride) {
+	size_t i = begin;
+#ifdef TRFM_SSE
+	__m128 m[12];
+	for(int k = 0; k < 12; ++k) m[k] = _mm_set1_ps(M[k]);
+	for(; stride == 3 && i + 4 <= end; i += 4) {
+		// (x0 y0 z0 x1) (y1 z1 x2 y2) (z2 x3 y3 z3)
+		const float *p = in + 3 * i;
+		__m128 a = _mm_loadu_ps(p);
+		__m128 b = _mm_loadu_ps(p + 4);
+		__m128 c = _mm_loadu_ps(p + 8);
+		__m128 x = SHUF(a, SHUF(b, c, 2, 2, 1, 1), 0, 3, 0, 2);
+		__m128 y = SHUF(SHUF(a, b, 1, 1, 0, 0), SHUF(b, c, 3, 3, 2, 2), 0, 2, 0, 2);
+		__m128 z = SHUF(SHUF(a, b, 2, 2, 1, 1), SHUF(c, c, 0, 0, 3, 3), 0, 2, 0, 2);
+		__m128 r[3];
+		for(int k = 0; k < 3; ++k) {
+			__m128 t = _mm_add_ps(_mm_mul_ps(m[k], x), _mm_mul_ps(m[3 + k], y));
+			r[k] = _mm_add_ps(_mm_add_ps(t, _mm_mul_ps(m[6 + k], z)), m[9 + k]);
+		}
+		float *q = out + 3 * i;
+		_mm_storeu_ps(q, SHUF(SHUF(r[0], r[1], 0, 0, 0, 0), SHUF(r[2], r[0], 0, 0, 1, 1), 0, 2, 0, 2));
+		_mm_storeu_ps(q + 4, SHUF(SHUF(r[1], r[2], 1, 1, 1, 1), SHUF(r[0], r[1], 2, 2, 2, 2), 0, 2, 0, 2));
+		_mm_storeu_ps(q + 8, SHUF(SHUF(r[2], r[0], 2, 2, 3, 3), SHUF(r[1], r[2], 3, 3, 3, 3), 0, 2, 0, 2));
+	}
+	__m128 c0 = _mm_setr_ps(M[0], M[1], M[2], 0.0f);
+	__m128 c1 = _mm_setr_ps(M[3], M[4], M[5], 0.0f);
+	__m128 c2 = _mm_setr_ps(M[6], M[7], M[8], 0.0f);
+	__m128 c3 = _mm_setr_ps(M[9], M[10], M[11], 0.0f);
+	for(; i < end; ++i) {
+		const float *p = in + i * stride;
+		__m128 r = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p[0])), _mm_mul_ps(c1, _mm_set1_ps(p[1])));
+		r = _mm_add_ps(_mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(p[2]))), c3);
+		float *q = out + i * stride;
+		_mm_storel_pi((__m64 *) q, r);
+		_mm_store_ss(q + 2, _mm_movehl_ps(r, r));
+	}
+#else
+	for(; i < end; ++i) {
+		const float *p = in + i * stride;
+		float x = p[0], y = p[1], z = p[2];
+		float *q = out + i * stride;
+		q[0] = M[0] * x + M[3] * y + M[6] * z + M[9];
+		q[1] = M[1] * x + M[4] * y + M[7] * z + M[10];
+		q[2] = M[2] * x + M[5] * y + M[8] * z + M[11];
+	}
+#endif
+}
 
-	Vector3 res(this->m_c1.x() * P.x() * this->m_scl + this->m_c2.x() * P.y() * this->m_scl + this->m_c3.x() * P.z() * this->m_scl + this->m_tr.x() ,
-				this->m_c1.y() * P.x() * this->m_scl + this->m_c2.y() * P.y() * this->m_scl + this->m_c3.y() * P.z() * this->m_scl + this->m_tr.y() ,
-				this->m_c1.z() * P.x() * this->m_scl + this->m_c2.z() * P.y() * this->m_scl + this->m_c3.z() * P.z() * this->m_scl + this->m_tr.z() );
+// the rotation columns are multiplied by 'scale'; translation only for points
 
-	return res;
+void Trfm3D::transformArray(const float *in, float *out, size_t n, size_t stride,
+							bool parallel, bool points, float scale) const {
+	float M[12];
+	for(int j = 0; j < 3; ++j)
+		for(int i = 0; i < 3; ++i) M[3 * j + i] = m_m[4 * j + i] * scale;
+	for(int i = 0; i < 3; ++i) M[9 + i] = points ? m_m[12 + i] : 0.0f;
+	if (!parallel || n <= array_grain) {
+		transform_range(M, in, out, 0, n, stride);
+		return;
+	}
+	ThreadPool::instance()->parallelFor(n, array_grain, [&](size_t begin, size_t end) {
+		transform_range(M, in, out, begin, end, stride);
+	});
 }
 
-// @@ TODO. Transform a vector.* this.m_scl
-//
-// Remember: Vectors don't translate
-
-Vector3 Trfm3D::transformVector(const Vector3 &V) const{
-	Vector3 res(this->m_c1.x() * V.x() * this->m_scl + this->m_c2.x() * V.y() * this->m_scl + this->m_c3.x() * V.z() * this->m_scl,
-				this->m_c1.y() * V.x() * this->m_scl + this->m_c2.y() * V.y() * this->m_scl + this->m_c3.y() * V.z() * this->m_scl,
-				this->m_c1.z() * V.x() * this->m_scl + this->m_c2.z() * V.y() * this->m_scl + this->m_c3.z() * V.z() * this->m_scl);
+void Trfm3D::transformPoints(const float *in, float *out, size_t n, size_t stride,
+							 bool parallel) const {
+	transformArray(in, out, n, stride, parallel, true, 1.0f);
+}
 
-	return res;
+void Trfm3D::transformVectors(const float *in, float *out, size_t n, size_t stride,
+							  bool parallel) const {
+	transformArray(in, out, n, stride, parallel, false, 1.0f);
 }
 
-Vector3 Trfm3D::transformNormal(const Vector3 & N) const {
-	// this = M = S*R*T = S*R (no translations to normals)
-	// auxTrfm = (M^{-1})^{T} == S^{-1}*R
-	Trfm3D auxTrfm(*this);
-	auxTrfm.m_scl = 1.0f / m_scl; // S^{-1}
-	auxTrfm.m_tr = Vector3::ZERO;
-	// X = aurTrfm*N = S^{-1}*R*N
-	Vector3 X = auxTrfm.transformVector(N);
-	if ( m_scl != 1.0) {
-		X.normalize();
-	}
-	return X;
+void Trfm3D::transformNormals(const float *in, float *out, size_t n, size_t stride,
+							  bool parallel) const {
+	// M = S*R*T: normals are transformed by R = M / s
+	transformArray(in, out, n, stride, parallel, false, m_scl != 0.0f ? 1.0f / m_scl : 1.0f);
 }
 
 void Trfm3D::transformPlane(Plane * plane) const {
 	Vector3 & pnormal = plane->m_n;
 	float & pd = plane->m_d;
 	// this  == M = S*R*T = S*R (no translations to normals)
-	// auxTrfm = (M^{-1})^{T} == S^{-1}*R
-	Trfm3D auxTrfm(*this);
-	auxTrfm.m_scl = 1.0f / m_scl; // S^{-1}
-	auxTrfm.m_tr = Vector3::ZERO;
-	// X = aurTrfm = S^{-1}*R*N
-	Vector3 X(pnormal);
-	auxTrfm.transformVector(X);
+	// X = (M^{-1})^{T} * N == S^{-1}*R*N
+	Vector3 X = transformVector(pnormal) / (m_scl * m_scl);
 	// d1 =  d + T*X
-	float d1 = pd + m_tr.dot(X);
+	float d1 = pd + column(3).dot(X);
 	if (m_scl != 1.0) {
 		// normalize X
-		float factor = X.normalize();
-		d1 /= factor;
+		float len = X.length();
+		X /= len;
+		d1 /= len;
 	}
 	pnormal = X;
 	pd = d1;
@@ -254,23 +219,10 @@ void Trfm3D::transformPlane(Plane * plane) const {
 
 Vector3 Trfm3D::projectPoint(const Vector3 & P) const {
 
-	Vector3 tmpV;
-	float tmpW;
-	float scale;
-
-	scale = m_scl;
-
-	//Px' = Px*m_c1[0] + Py*m_c2[0] + Pz*m_c3[0] + m_tr[0]
-	tmpV[0] = P[0] * m_c1[0] * scale + P[1] * m_c2[0] * scale + P[2] * m_c3[0] * scale + m_tr[0];
-
-	//Py' = Px*m_c1[1]*scale + Py*m_c2[1]*scale + Pz*m_c3[1]*scale + m_tr[1]
-	tmpV[1] = P[0] * m_c1[1] * scale + P[1] * m_c2[1] * scale + P[2] * m_c3[1] * scale + m_tr[1];
-
-	//Pz' = Px*m_c1[2]*scale + Py*m_c2[2]*scale + Pz*m_c3[2]*scale + m_tr[2]
-	tmpV[2] = P[0] * m_c1[2] * scale + P[1] * m_c2[2] * scale + P[2] * m_c3[2] * scale + m_tr[2];
+	Vector3 tmpV = transformPoint(P);
 
 	//Pw' = Px * dx + Py * dy + Pz * dz + dw
-	tmpW = P[0] * m_d[0] + P[1] * m_d[1] + P[2] * m_d[2] + m_w;
+	float tmpW = P[0] * m_m[3] + P[1] * m_m[7] + P[2] * m_m[11] + m_m[15];
 
 	if(distance_is_zero(tmpW)) {
 		fprintf(stderr, "[W] Trfm3D::projectPoint: zero W\n");
@@ -284,65 +236,42 @@ Vector3 Trfm3D::projectPoint(const Vector3 & P) const {
 // Obtain OpenGL matrix (float[16]) which is equivalent to Trfm3D
 
 void Trfm3D::getGLMatrix(float *glmatrix) const {
-	glmatrix[0]  = m_c1[0] * m_scl;
-	glmatrix[1]  = m_c1[1] * m_scl;
-	glmatrix[2]  = m_c1[2] * m_scl;
-	glmatrix[3]  = m_d[0];
-	glmatrix[4]  = m_c2[0] * m_scl;
-	glmatrix[5]  = m_c2[1] * m_scl;
-	glmatrix[6]  = m_c2[2] * m_scl;
-	glmatrix[7]  = m_d[1];
-	glmatrix[8]  = m_c3[0] * m_scl;
-	glmatrix[9]  = m_c3[1] * m_scl;
-	glmatrix[10] = m_c3[2] * m_scl;
-	glmatrix[11] = m_d[2];
-	glmatrix[12] = m_tr[0];
-	glmatrix[13] = m_tr[1];
-	glmatrix[14] = m_tr[2];
-	glmatrix[15] = m_w;
+	memcpy(glmatrix, m_m, sizeof(m_m));
 }
 
 
+
 ////////////////////////////////////////////////////////////////////////////////////
 // Set functions
 
 void Trfm3D::setUnit() {
-	Trfm3D T;
-	swap(T);
+	memcpy(m_m, identity, sizeof(m_m));
+	m_scl = 1.0f;
 }
 
 void Trfm3D::setRotX(float angle) {
-	m_c1 = Vector3( 1.0f,  0.0f,         0.0f );
-	m_c2 = Vector3( 0.0f,  cosf(angle),  sinf(angle) );
-	m_c3 = Vector3( 0.0f, -sinf(angle ), cosf(angle) );
-	m_scl = 1.0f;
-	m_tr = Vector3::ZERO;
-	m_d = Vector3::ZERO;
-	m_w  = 1.0f;
+	setColumns(Vector3( 1.0f,  0.0f,         0.0f ),
+			   Vector3( 0.0f,  cosf(angle),  sinf(angle) ),
+			   Vector3( 0.0f, -sinf(angle ), cosf(angle) ),
+			   Vector3::ZERO, 1.0f);
 }
 
 void Trfm3D::setRotY(float angle ) {
-	m_c1 = Vector3( cosf(angle),  0.0f, -sinf(angle) );
-	m_c2 = Vector3( 0.0f,         1.0f,   0.0f );
-	m_c3 = Vector3( sinf(angle),  0.0f,  cosf(angle) );
-	m_scl = 1.0f;
-	m_tr = Vector3::ZERO;
-	m_d = Vector3::ZERO;
-	m_w  = 1.0f;
+	setColumns(Vector3( cosf(angle),  0.0f, -sinf(angle) ),
+			   Vector3( 0.0f,         1.0f,   0.0f ),
+			   Vector3( sinf(angle),  0.0f,  cosf(angle) ),
+			   Vector3::ZERO, 1.0f);
 }
 
 void Trfm3D::setRotZ(float angle ) {
-	m_c1 = Vector3(  cosf(angle), sinf(angle), 0.0f );
-	m_c2 = Vector3( -sinf(angle), cos(angle),  0.0f );
-	m_c3 = Vector3(  0.0f,         0.0f,       1.0f );
-	m_scl = 1.0f;
-	m_tr = Vector3::ZERO;
-	m_d = Vector3::ZERO;
-	m_w  = 1.0f;
+	setColumns(Vector3(  cosf(angle), sinf(angle), 0.0f ),
+			   Vector3( -sinf(angle), cos(angle),  0.0f ),
+			   Vector3(  0.0f,         0.0f,       1.0f ),
+			   Vector3::ZERO, 1.0f);
 }
 
 /*
-  @@ TODO: Rotate by angle theta around an arbitrary axis r
+  Rotate by angle theta around an arbitrary axis r
 
   Positive angles are anticlockwise looking down the axis
   towards the origin.
@@ -359,42 +288,31 @@ void Trfm3D::setRotVec(const Vector3 & VV, float theta ) {
 	float y = V.y();
 	float z = V.z();
 
-	this->m_c1 = Vector3( t*x*x + c,   t*x*y + z*s, t*x*z - y*s);
-	this->m_c2 = Vector3( t*x*y - z*s, t*y*y + c,   t*y*z + x*s);
-	this->m_c3 = Vector3( t*x*z + y*s, t*y*z - x*s, t*z*z + c  );
-	this->m_scl = 1.0f;
-	this->m_tr = Vector3::ZERO;
-	this->m_d = Vector3::ZERO;
-	this->m_w  = 1.0f;
+	setColumns(Vector3( t*x*x + c,   t*x*y + z*s, t*x*z - y*s),
+			   Vector3( t*x*y - z*s, t*y*y + c,   t*y*z + x*s),
+			   Vector3( t*x*z + y*s, t*y*z - x*s, t*z*z + c  ),
+			   Vector3::ZERO, 1.0f);
 }
 
+void Trfm3D::setTRS(const Vector3 & tr, const Quaternion & rot, float scale) {
+	Vector3 c1, c2, c3;
+	rot.getColumns(c1, c2, c3);
+	setColumns(c1, c2, c3, tr, scale);
+}
 
 void Trfm3D::setTrans(const Vector3 & tr) {
-	m_c1 = Vector3::UNIT_X;
-	m_c2 = Vector3::UNIT_Y;
-	m_c3 = Vector3::UNIT_Z;
-	m_tr = tr;
-	m_d = Vector3::ZERO;
-	m_scl = 1.0f;
-	m_w  = 1.0f;
+	setColumns(Vector3::UNIT_X, Vector3::UNIT_Y, Vector3::UNIT_Z, tr, 1.0f);
 }
 
 void Trfm3D::setScale(float scale ) {
-	m_c1 = Vector3::UNIT_X;
-	m_c2 = Vector3::UNIT_Y;
-	m_c3 = Vector3::UNIT_Z;
-	m_tr = Vector3::ZERO;
-	m_d = Vector3::ZERO;
-	m_scl = scale;
-	m_w  = 1.0f;
+	setColumns(Vector3::UNIT_X, Vector3::UNIT_Y, Vector3::UNIT_Z, Vector3::ZERO, scale);
 }
 
-// @@ TODO: Rotate angle radians about an axis defined by vector and located at point
-//
+// Rotate angle radians about an axis defined by vector and located at point
 
 void Trfm3D::setRotAxis(const Vector3 & V, const Vector3 & P, float angle ) {
 	Vector3 opuesto = Vector3::ZERO - P;
-	
+
 	this->setTrans(P);
 	this->addRotVec(V, angle);
 	this->addTrans(opuesto);
@@ -404,18 +322,14 @@ void Trfm3D::setRotAxis(const Vector3 & V, const Vector3 & P, float angle ) {
 void Trfm3D::setOrtho(float left, float right,
 					  float bottom, float top,
 					  float near, float far) {
-	m_scl = 1.0f;
 	float a =  2.0f / (right - left) ;
 	float b =  2.0f / (bottom - top) ;
 	float c = -2.0f / (far - near) ;
 	float tx = (right + left) / ( right - left) ;
 	float ty = (bottom + top) / ( bottom - top) ;
 	float tz = (far + near) / (far - near) ;
-	m_c1[0] = a;    m_c2[0] = 0.0f;  m_c3[0] = 0.0f; m_tr[0] = -tx;
-	m_c1[1] = 0.0f; m_c2[1] = b;     m_c3[1] = 0.0f; m_tr[1] = -ty;
-	m_c1[2] = 0.0f; m_c2[2] = 0.0f;  m_c3[2] = c;    m_tr[2] = -tz;
-	m_d[0]  = 0.0f; m_d[1]  = 0.0f;  m_d[2]  = 0.0f; m_w  = 1.0f;
-
+	setColumns(Vector3(a, 0.0f, 0.0f), Vector3(0.0f, b, 0.0f), Vector3(0.0f, 0.0f, c),
+			   Vector3(-tx, -ty, -tz), 1.0f);
 }
 
 void Trfm3D::setFrustum(float left, float right,
@@ -428,73 +342,37 @@ void Trfm3D::setFrustum(float left, float right,
 	b = (top + bottom) / (top - bottom);
 	c = -(far + near) / (far - near);
 	d = -(2.0f * far * near) / (far - near);
-	m_scl = 1.0f;
-	m_c1[0] = x;    m_c2[0] = 0.0f;  m_c3[0] = a;     m_tr[0] = 0.0f;
-	m_c1[1] = 0.0f; m_c2[1] = y;     m_c3[1] = b;     m_tr[1] = 0.0f;
-	m_c1[2] = 0.0f; m_c2[2] = 0.0f;  m_c3[2] = c;     m_tr[2] = d;
-	m_d[0]  = 0.0f; m_d[1]  = 0.0f;  m_d[2]  = -1.0f; m_w  = 0.0f;
+	setColumns(Vector3(x, 0.0f, 0.0f), Vector3(0.0f, y, 0.0f), Vector3(a, b, c),
+			   Vector3(0.0f, 0.0f, d), 1.0f);
+	m_m[11] = -1.0f; // d.z
+	m_m[15] = 0.0f;  // w
 }
 
 void Trfm3D::setLocal2World(const Vector3 & P,
 							const Vector3 & R,
 							const Vector3 & U,
 							const Vector3 & D) {
-	m_c1 = R;
-	m_c2 = U;
-	m_c3 = D;
-	m_tr = P;
-	m_scl = 1.0;
-	m_d = Vector3::ZERO;
-	m_w  = 1.0f;
+	setColumns(R, U, D, P, 1.0f);
 }
 
 void Trfm3D::setWorld2Local(const Vector3 & P,
 							const Vector3 & R,
 							const Vector3 & U,
 							const Vector3 & D) {
-	m_c1[0] = R[0];
-	m_c1[1] = U[0];
-	m_c1[2] = D[0];
-
-	m_c2[0] = R[1];
-	m_c2[1] = U[1];
-	m_c2[2] = D[1];
-
-	m_c3[0] = R[2];
-	m_c3[1] = U[2];
-	m_c3[2] = D[2];
-
-	m_tr[0] = -1.0f * R.dot(P);
-	m_tr[1] = -1.0f * U.dot(P);
-	m_tr[2] = -1.0f * D.dot(P);
-
-	m_scl = 1.0f;
-	m_d = Vector3::ZERO;
-	m_w  = 1.0f;
+	setColumns(Vector3(R[0], U[0], D[0]),
+			   Vector3(R[1], U[1], D[1]),
+			   Vector3(R[2], U[2], D[2]),
+			   Vector3(-1.0f * R.dot(P), -1.0f * U.dot(P), -1.0f * D.dot(P)), 1.0f);
 }
 
-void Trfm3D::setWorld2LocalFrame(const Trfm3D &frameTrfm) {
-
-	m_c1[0] = frameTrfm.m_c1[0];
-	m_c1[1] = frameTrfm.m_c2[0];
-	m_c1[2] = frameTrfm.m_c3[0];
-
-	m_c2[0] = frameTrfm.m_c1[1];
-	m_c2[1] = frameTrfm.m_c2[1];
-	m_c2[2] = frameTrfm.m_c3[1];
-
-	m_c3[0] = frameTrfm.m_c1[2];
-	m_c3[1] = frameTrfm.m_c2[2];
-	m_c3[2] = frameTrfm.m_c3[2];
-
-	m_tr[0] = -1.0 * m_c1.dot(frameTrfm.m_tr);
-	m_tr[1] = -1.0 * m_c2.dot(frameTrfm.m_tr);
-	m_tr[2] = -1.0 * m_c3.dot(frameTrfm.m_tr);
-
-	m_d = Vector3::ZERO;
-	m_scl = 1.0;
-	m_w = 1.0f;
+// (the scale of the frame is ignored)
 
+void Trfm3D::setWorld2LocalFrame(const Trfm3D &frameTrfm) {
+	float inv = 1.0f / frameTrfm.m_scl;
+	Vector3 R = inv * frameTrfm.column(0);
+	Vector3 U = inv * frameTrfm.column(1);
+	Vector3 D = inv * frameTrfm.column(2);
+	setWorld2Local(frameTrfm.column(3), R, U, D);
 }
 
 void Trfm3D::setWorld2LocalFrame(const Trfm3D *frameTrfm) {
@@ -505,11 +383,17 @@ void Trfm3D::normalize() {
 	/*   Column1=Normalized(CrossProduct(Column2,Column3)); */
 	/*   Column2=Normalized(CrossProduct(Column3,Column1)); */
 	/*   Normalize(Column3); */
-	m_c1 = crossVectors(m_c2, m_c3);
-	m_c1.normalize();
-	m_c2 = crossVectors(m_c3, m_c1);
-	m_c2.normalize();
-	m_c3.normalize();
+	Vector3 c2 = column(1), c3 = column(2);
+	Vector3 c1 = crossVectors(c2, c3);
+	c1.normalize();
+	c2 = crossVectors(c3, c1);
+	c2.normalize();
+	c3.normalize();
+	for(int i = 0; i < 3; ++i) {
+		m_m[i] = c1[i] * m_scl;
+		m_m[4 + i] = c2[i] * m_scl;
+		m_m[8 + i] = c3[i] * m_scl;
+	}
 }
 
 
@@ -517,60 +401,53 @@ void Trfm3D::normalize() {
 // Add functions
 
 void Trfm3D::addRotX(float angle ) {
-	static Trfm3D localT;
+	Trfm3D localT;
 	localT.setRotX(angle );
 	add(localT);
 }
 
 void Trfm3D::addRotY(float angle ) {
-	static Trfm3D localT;
+	Trfm3D localT;
 	localT.setRotY(angle);
 	add(localT);
 }
 
 void Trfm3D::addRotZ(float angle ) {
-	static Trfm3D localT;
+	Trfm3D localT;
 	localT.setRotZ(angle);
 	add(localT);
 }
 
 void Trfm3D::addRotVec(const Vector3 & V, float theta ) {
-	static Trfm3D localT;
+	Trfm3D localT;
 	localT.setRotVec(V, theta);
 	add(localT);
 }
 
-// @@TODO: add a "RotAxis" transformation to the current trfm
-
 void Trfm3D::addRotAxis(const Vector3 & V, const Vector3 & P, float angle) {
-	static Trfm3D localT;
+	Trfm3D localT;
 	localT.setRotAxis(V, P, angle);
 	this->add(localT);
 }
 
-void Trfm3D::addTrans(const Vector3 & T) {
-
-	m_tr[0] += T[0] * m_scl * m_c1[0];
-	m_tr[0] += T[1] * m_scl * m_c2[0];
-	m_tr[0] += T[2] * m_scl * m_c3[0];
+// M * Trans(T): only the last column changes
 
-	m_tr[1] += T[0] * m_scl * m_c1[1];
-	m_tr[1] += T[1] * m_scl * m_c2[1];
-	m_tr[1] += T[2] * m_scl * m_c3[1];
-
-	m_tr[2] += T[0] * m_scl * m_c1[2];
-	m_tr[2] += T[1] * m_scl * m_c2[2];
-	m_tr[2] += T[2] * m_scl * m_c3[2];
+void Trfm3D::addTrans(const Vector3 & T) {
+	for(int i = 0; i < 4; ++i)
+		m_m[12 + i] += m_m[i] * T[0] + m_m[4 + i] * T[1] + m_m[8 + i] * T[2];
 }
 
+// M * Scale(s): the first three columns are scaled
+
 void Trfm3D::addScale(float scale) {
+	for(int i = 0; i < 12; ++i) m_m[i] *= scale;
 	m_scl *= scale;
 }
 
 void Trfm3D::addFrustum( float left, float right,
 						 float top, float bottom,
 						 float near, float far) {
-	static Trfm3D localT;
+	Trfm3D localT;
 	localT.setFrustum(left, right, top, bottom, near, far);
 	add(localT);
 }
@@ -581,7 +458,7 @@ void Trfm3D::addWorld2Local(const Vector3 & P,
 							const Vector3 & U,
 							const Vector3 & D) {
 
-	static Trfm3D localT;
+	Trfm3D localT;
 	localT.setWorld2Local(P, R, U, D);
 	add(localT);
 }
@@ -591,7 +468,7 @@ void Trfm3D::addLocal2World(const Vector3 & P,
 							const Vector3 & U,
 							const Vector3 & D) {
 
-	static Trfm3D localT;
+	Trfm3D localT;
 	localT.setLocal2World(P, R, U, D);
 	add(localT);
 }
@@ -600,23 +477,18 @@ void Trfm3D::addLocal2World(const Vector3 & P,
 ////////////////////////////////////////////////////////////////////////////////////
 // Misc
 
-int Trfm3D::cmp(const Trfm3D &rhs) const {
-
-	if (!distance_is_zero(m_c1[0] - rhs.m_c1[0])) return -2;
-	if (!distance_is_zero(m_c1[1] - rhs.m_c1[1])) return -2;
-	if (!distance_is_zero(m_c1[2] - rhs.m_c1[2])) return -2;
+// rotation columns (without the scale), translation and scale
 
-	if (!distance_is_zero(m_c2[0] - rhs.m_c2[0])) return -2;
-	if (!distance_is_zero(m_c2[1] - rhs.m_c2[1])) return -2;
-	if (!distance_is_zero(m_c2[2] - rhs.m_c2[2])) return -2;
+int Trfm3D::cmp(const Trfm3D &rhs) const {
 
-	if (!distance_is_zero(m_c3[0] - rhs.m_c3[0])) return -2;
-	if (!distance_is_zero(m_c3[1] - rhs.m_c3[1])) return -2;
-	if (!distance_is_zero(m_c3[2] - rhs.m_c3[2])) return -2;
+	float inv = 1.0f / m_scl, rinv = 1.0f / rhs.m_scl;
+	for(int j = 0; j < 3; ++j)
+		for(int i = 0; i < 3; ++i)
+			if (!distance_is_zero(m_m[4 * j + i] * inv - rhs.m_m[4 * j + i] * rinv)) return -2;
 
-	if (!distance_is_zero(m_tr[0] - rhs.m_tr[0])) return -3;
-	if (!distance_is_zero(m_tr[1] - rhs.m_tr[1])) return -3;
-	if (!distance_is_zero(m_tr[2] - rhs.m_tr[2])) return -3;
+	if (!distance_is_zero(m_m[12] - rhs.m_m[12])) return -3;
+	if (!distance_is_zero(m_m[13] - rhs.m_m[13])) return -3;
+	if (!distance_is_zero(m_m[14] - rhs.m_m[14])) return -3;
 
 	if (!distance_is_zero(m_scl - rhs.m_scl)) return -4;
 
@@ -637,11 +509,10 @@ void Trfm3D::setInverse() {
 	//                 |(1/s)R^{T}  -(1/s)R^{T}*T |
 	//      inv(M)   = |     0              1     |
 	//
+	// and (1/s)R^{T} = (sR)^{T} / s^2
 
-	// Compute inv(R) = R^{T}
-
-	if (distance_is_zero(m_d[0]) || distance_is_zero(m_d[1]) ||
-		distance_is_zero(m_d[2]) || distance_is_zero(1.0f - m_w)) {
+	if (!distance_is_zero(m_m[3]) || !distance_is_zero(m_m[7]) ||
+		!distance_is_zero(m_m[11]) || !distance_is_zero(1.0f - m_m[15])) {
 		fprintf(stderr, "[E] Can't compute inverse on a projective Trfm3D!\n");
 		exit(1);
 	}
@@ -650,47 +521,59 @@ void Trfm3D::setInverse() {
 		fprintf(stderr, "[E] Can't compute inverse: source Trfm3D has zero scale!\n");
 		exit(1);
 	}
-	Trfm3D auxTrfm(*this); // copy of this
-	// Compute inv(S) = 1/s
-	auxTrfm.m_scl = 1.0f / m_scl;
-	// Compute inv(T) = -(1/s)R^{T}*T
-	auxTrfm.m_tr[0] = m_tr[0]*auxTrfm.m_c1[0] + m_tr[1]*auxTrfm.m_c2[0] + m_tr[2]*auxTrfm.m_c3[0];
-	auxTrfm.m_tr[0]*= -auxTrfm.m_scl;
-	auxTrfm.m_tr[1] = m_tr[0]*auxTrfm.m_c1[1] + m_tr[1]*auxTrfm.m_c2[1] + m_tr[2]*auxTrfm.m_c3[1];
-	auxTrfm.m_tr[1]*= -auxTrfm.m_scl;
-	auxTrfm.m_tr[2] = m_tr[0]*auxTrfm.m_c1[2] + m_tr[1]*auxTrfm.m_c2[2] + m_tr[2]*auxTrfm.m_c3[2];
-	auxTrfm.m_tr[2]*= -auxTrfm.m_scl;
-	// Store result
-	swap(auxTrfm);
+	float inv2 = 1.0f / (m_scl * m_scl);
+#ifdef TRFM_SSE
+	__m128 c0 = _mm_load_ps(m_m);
+	__m128 c1 = _mm_load_ps(m_m + 4);
+	__m128 c2 = _mm_load_ps(m_m + 8);
+	__m128 c3 = _mm_load_ps(m_m + 12);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3); // the rows of M
+	__m128 s = _mm_set1_ps(inv2);
+	c0 = _mm_mul_ps(c0, s);
+	c1 = _mm_mul_ps(c1, s);
+	c2 = _mm_mul_ps(c2, s);
+	// -(1/s)R^{T}*T, with the columns of (1/s)R^{T}
+	__m128 t = _mm_mul_ps(c0, _mm_set1_ps(m_m[12]));
+	t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_set1_ps(m_m[13])));
+	t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_set1_ps(m_m[14])));
+	t = _mm_sub_ps(_mm_setzero_ps(), t);
+	_mm_store_ps(m_m, c0);
+	_mm_store_ps(m_m + 4, c1);
+	_mm_store_ps(m_m + 8, c2);
+	_mm_store_ps(m_m + 12, t);
+	// (the fourth lane of the rows holds T: set the last row again)
+	m_m[3] = m_m[7] = m_m[11] = 0.0f;
+	m_m[15] = 1.0f;
+#else
+	float M[16];
+	memcpy(M, m_m, sizeof(M));
+	for(int j = 0; j < 3; ++j)
+		for(int i = 0; i < 3; ++i)
+			m_m[4 * j + i] = M[4 * i + j] * inv2;
+	for(int i = 0; i < 3; ++i)
+		m_m[12 + i] = -(m_m[i] * M[12] + m_m[4 + i] * M[13] + m_m[8 + i] * M[14]);
+#endif
+	m_scl = 1.0f / m_scl;
 }
 
 void Trfm3D::abs() {
-
-	m_c1[0] = fabs(m_c1[0]);
-	m_c1[1] = fabs(m_c1[1]);
-	m_c1[2] = fabs(m_c1[2]);
-	m_c2[0] = fabs(m_c2[0]);
-	m_c2[1] = fabs(m_c2[1]);
-	m_c2[2] = fabs(m_c2[2]);
-	m_c3[0] = fabs(m_c3[0]);
-	m_c3[1] = fabs(m_c3[1]);
-	m_c3[2] = fabs(m_c3[2]);
+	for(int j = 0; j < 4; ++j)
+		for(int i = 0; i < 3; ++i)
+			m_m[4 * j + i] = fabs(m_m[4 * j + i]);
 	m_scl = fabs(m_scl);
-	m_tr[0] = fabs(m_tr[0]);
-	m_tr[1] = fabs(m_tr[1]);
-	m_tr[2] = fabs(m_tr[2]);
 }
 
 // Aux
 void Trfm3D::print( ) const {
+	float inv = 1.0f / m_scl;
 	printf( "% 0.4f scale\n", m_scl );
 	printf( "% 0.4f %0.4f %0.4f  %0.4f\n",
-			m_c1[0], m_c2[0], m_c3[0], m_tr[0] );
+			m_m[0] * inv, m_m[4] * inv, m_m[8] * inv, m_m[12] );
 	printf( "%0.4f %0.4f %0.4f  %0.4f\n",
-			m_c1[1], m_c2[1], m_c3[1], m_tr[1] );
+			m_m[1] * inv, m_m[5] * inv, m_m[9] * inv, m_m[13] );
 	printf( "%0.4f %0.4f %0.4f  %0.4f\n",
-			m_c1[2], m_c2[2], m_c3[2], m_tr[2] );
+			m_m[2] * inv, m_m[6] * inv, m_m[10] * inv, m_m[14] );
 	printf( "% 0.4f % 0.4f % 0.4f  %0.4f\n",
-			m_d[0], m_d[1], m_d[2], m_w );
+			m_m[3], m_m[7], m_m[11], m_m[15] );
 	printf("-------- -------- --------  ---\n");
 }
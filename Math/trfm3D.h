@@ -2,9 +2,17 @@
 
 #pragma once
 
+#include <cstddef>
 #include "vector3.h"
 #include "plane.h"
 
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define TRFM_SSE
+#endif
+
+class Quaternion;
+
 /*! \file trfm3D.h
 
   Geometric transformations
@@ -30,13 +38,19 @@
 */
 
 
-//! The matrix will be stored split into its components
+//! The matrix is stored as the OpenGL one (column-major, aligned), with the
+//! uniform scale s of the rotation columns also kept apart
 
 /*     | c1.x*s  c2.x*s  c3.x*s tr.x | */
 /* M = | c1.y*s  c2.y*s  c3.y*s tr.y | */
 /*     | c1.z*s  c2.z*s  c3.z*s tr.z | */
 /*     |   d.x     d.y     d.z   w   | */
 
+/* m_m = { c1*s, d.x,  c2*s, d.y,  c3*s, d.z,  tr, w } */
+
+/* Composition, transformations and the inverse work on whole columns (with
+   SSE when available). */
+
 class Trfm3D {
 
 public:
@@ -72,6 +86,24 @@ public:
 	 */
 	Vector3 transformNormal(const Vector3 & N) const;
 
+	/**
+	 * Array versions of transformPoint, transformVector and transformNormal,
+	 * for mesh data. Element i is read at in[i * stride] and written at
+	 * out[i * stride] (stride in floats, at least 3, so that interleaved
+	 * vertex data can be transformed). in and out may be the same array.
+	 *
+	 * transformNormals divides by the scale instead of normalizing, so that
+	 * unit normals stay unit.
+	 *
+	 * With 'parallel', large arrays are split among the ThreadPool.
+	 */
+	void transformPoints(const float *in, float *out, size_t n, size_t stride = 3,
+						 bool parallel = false) const;
+	void transformVectors(const float *in, float *out, size_t n, size_t stride = 3,
+						  bool parallel = false) const;
+	void transformNormals(const float *in, float *out, size_t n, size_t stride = 3,
+						  bool parallel = false) const;
+
 	/**
 	 * Transform a (normalized) plane given by N*X = d
 	  Leave the result in pl
@@ -91,6 +123,13 @@ public:
 	*/
 	void getGLMatrix(float *glmatrix ) const;
 
+	/*! The OpenGL compatible matrix itself (no copy). Valid as long as the
+	  Trfm3D is not changed
+	*/
+	const float *getGLMatrix() const;
+
+	float getScale() const; //!< the uniform scale of the rotation columns
+
 	// Set functions
 	void setUnit();  // Set the trfm to the unit transformation
 	void setRotX(float angle ); // Sets the trfm to be a rotation of angle radians in the X axis
@@ -99,6 +138,8 @@ public:
 	void setTrans(const Vector3 & tr); // Sets the trfm to be a translation T
 	void setScale(float scale ); // Sets the trfm to be a uniform scale
 	void setRotVec(const Vector3 & v, float theta ); //!< Sets the trfm to be a rotation of theta radians on arbitrary axis v
+	//! Sets the trfm to be Trans(tr) * Rot(rot) * Scale(scale). rot must be unit
+	void setTRS(const Vector3 & tr, const Quaternion & rot, float scale);
 	//! Set the trfm to rotate angle radians about an axis defined by vector V and
 	//! located at point P
 	/*!
@@ -199,10 +240,51 @@ public:
 	void abs();
 	void print() const;
 
-private:
-	Vector3 m_c1, m_c2, m_c3;
-	Vector3 m_tr;
-	Vector3 m_d;
-	float m_scl; // el escalado se guarda de forma uniforme
-	float  m_w;
+protected:
+	void setColumns(const Vector3 & c1, const Vector3 & c2, const Vector3 & c3,
+					const Vector3 & tr, float scl);
+	Vector3 column(int j) const; // column j (0..3), without the last row
+	void transformArray(const float *in, float *out, size_t n, size_t stride,
+						bool parallel, bool points, float scale) const;
+
+	alignas(16) float m_m[16]; // column-major, as OpenGL
+	float m_scl; // el escalado se guarda de forma uniforme (also in m_m)
 };
+
+// Transforming points and vectors is inline: it is in the inner loops of
+// the scene (BBoxes, collisions, lights...)
+
+inline Vector3 Trfm3D::transformPoint(const Vector3 &P) const {
+#ifdef TRFM_SSE
+	alignas(16) float res[4];
+	__m128 r = _mm_mul_ps(_mm_load_ps(m_m), _mm_set1_ps(P[0]));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m_m + 4), _mm_set1_ps(P[1])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m_m + 8), _mm_set1_ps(P[2])));
+	_mm_store_ps(res, _mm_add_ps(r, _mm_load_ps(m_m + 12)));
+	return Vector3(res[0], res[1], res[2]);
+#else
+	return Vector3(m_m[0] * P[0] + m_m[4] * P[1] + m_m[8] * P[2] + m_m[12],
+				   m_m[1] * P[0] + m_m[5] * P[1] + m_m[9] * P[2] + m_m[13],
+				   m_m[2] * P[0] + m_m[6] * P[1] + m_m[10] * P[2] + m_m[14]);
+#endif
+}
+
+// Remember: Vectors don't translate
+
+inline Vector3 Trfm3D::transformVector(const Vector3 &V) const{
+#ifdef TRFM_SSE
+	alignas(16) float res[4];
+	__m128 r = _mm_mul_ps(_mm_load_ps(m_m), _mm_set1_ps(V[0]));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m_m + 4), _mm_set1_ps(V[1])));
+	_mm_store_ps(res, _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m_m + 8), _mm_set1_ps(V[2]))));
+	return Vector3(res[0], res[1], res[2]);
+#else
+	return Vector3(m_m[0] * V[0] + m_m[4] * V[1] + m_m[8] * V[2],
+				   m_m[1] * V[0] + m_m[5] * V[1] + m_m[9] * V[2],
+				   m_m[2] * V[0] + m_m[6] * V[1] + m_m[10] * V[2]);
+#endif
+}
+
+inline const float *Trfm3D::getGLMatrix() const { return m_m; }
+
+inline float Trfm3D::getScale() const { return m_scl; }
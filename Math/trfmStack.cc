@@ -38,8 +38,7 @@ const Trfm3D *TrfmStack::top() const {
 }
 
 const GLfloat *TrfmStack::getGLMatrix() {
-	m_top.getGLMatrix(&m_M[0]);
-	return &m_M[0];
+	return m_top.getGLMatrix();
 }
 
 void TrfmStack::print() const {
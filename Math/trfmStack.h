@@ -87,5 +87,4 @@ private:
 
 	std::stack<Trfm3D> m_V;
 	Trfm3D m_top;
-	float m_M[16];
 };
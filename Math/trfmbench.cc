@@ -0,0 +1,171 @@
+// Benchmark of the Trfm3D kernels: compose, inverse, transformPoint,
+// transformVector, transformNormal and getGLMatrix. Only uses the API that
+// Trfm3D has had since before it was stored as a column-major matrix, so
+// that the same file builds against those trees too:
+//
+//   make bench-compare BENCH=trfmbench OLD=<rev>
+//
+// Older trees refuse to invert affine transforms (setInverse exits), so for
+// them add OLD_ARGS=-noinverse, which leaves trfm_inverse out.
+//
+// usage: trfmbench [-s seed] [-n elements] [-r runs] [-csv] [-noinverse]
+//
+// Prints the best time per operation of several runs, the throughput and a
+// checksum of the results (equal checksums: same results). With -csv, one
+// record per line:
+//
+//   bench,<kernel>,<ns_per_op>,<mops_per_s>,<checksum>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include "vector3.h"
+#include "trfm3D.h"
+
+using std::vector;
+
+static int N = 1 << 16; // operations per run
+static int runs = 7;
+static bool csv = false;
+
+static const float range = 20.0f; // of the random coordinates
+static const int trfms_n = 4096;
+
+static float frand(float lo, float hi) {
+	return lo + (hi - lo) * (rand() / (float) RAND_MAX);
+}
+
+static Vector3 vrand(float lo, float hi) {
+	return Vector3(frand(lo, hi), frand(lo, hi), frand(lo, hi));
+}
+
+struct data_t {
+	vector<Trfm3D> T; // random similarities
+	vector<Vector3> P;
+	vector<Vector3> normals; // unit length
+};
+
+static void data_init(data_t & d) {
+	d.T.resize(trfms_n);
+	for(int j = 0; j < trfms_n; ++j) {
+		d.T[j].setRotVec(vrand(-1.0f, 1.0f), frand(-3.0f, 3.0f));
+		d.T[j].addTrans(vrand(-range, range));
+		d.T[j].addScale(frand(0.5f, 2.0f));
+	}
+	d.P.resize(N);
+	d.normals.resize(N);
+	for(int i = 0; i < N; ++i) {
+		d.P[i] = vrand(-range, range);
+		d.normals[i] = vrand(-1.0f, 1.0f);
+		d.normals[i].normalize();
+	}
+}
+
+static double kCompose(data_t & d) {
+	Trfm3D T;
+	float M[16];
+	double sum = 0.0;
+	for(int i = 0; i < N; ++i) {
+		T.clone(d.T[i % trfms_n]);
+		T.add(d.T[(i + 1) % trfms_n]);
+		T.getGLMatrix(M);
+		sum += M[12];
+	}
+	return sum;
+}
+
+static double kInverse(data_t & d) {
+	Trfm3D T;
+	float M[16];
+	double sum = 0.0;
+	for(int i = 0; i < N; ++i) {
+		T.clone(d.T[i % trfms_n]);
+		T.setInverse();
+		T.getGLMatrix(M);
+		sum += M[12];
+	}
+	return sum;
+}
+
+static double kTransformPoint(data_t & d) {
+	Vector3 acc;
+	for(int i = 0; i < N; ++i) acc += d.T[i % trfms_n].transformPoint(d.P[i]);
+	return acc[0] + acc[1] + acc[2];
+}
+
+static double kTransformVector(data_t & d) {
+	Vector3 acc;
+	for(int i = 0; i < N; ++i) acc += d.T[i % trfms_n].transformVector(d.P[i]);
+	return acc[0] + acc[1] + acc[2];
+}
+
+static double kTransformNormal(data_t & d) {
+	Vector3 acc;
+	for(int i = 0; i < N; ++i) acc += d.T[i % trfms_n].transformNormal(d.normals[i]);
+	return acc[0] + acc[1] + acc[2];
+}
+
+static double kGLMatrix(data_t & d) {
+	float M[16];
+	double sum = 0.0;
+	for(int i = 0; i < N; ++i) {
+		d.T[i % trfms_n].getGLMatrix(M);
+		sum += M[0] + M[13];
+	}
+	return sum;
+}
+
+struct kernel_t {
+	const char *name;
+	double (*run)(data_t & d);
+};
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-s seed] [-n elements] [-r runs] [-csv] [-noinverse]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	int seed = 1;
+	bool inverse = true;
+	for(int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc) N = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc) runs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-csv")) csv = true;
+		else if (!strcmp(argv[i], "-noinverse")) inverse = false;
+		else usage(argv[0]);
+	}
+	if (N < 1 || runs < 1) usage(argv[0]);
+	srand(seed);
+	data_t d;
+	data_init(d);
+
+	kernel_t kernels[] = {
+		{ "trfm_compose", kCompose },
+		{ "trfm_inverse", kInverse },
+		{ "trfm_point", kTransformPoint },
+		{ "trfm_vector", kTransformVector },
+		{ "trfm_normal", kTransformNormal },
+		{ "trfm_glmatrix", kGLMatrix },
+	};
+	if (!csv) printf("%-26s %10s %10s %18s\n", "kernel", "ns/op", "Mops/s", "checksum");
+	for(size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+		if (!inverse && kernels[k].run == kInverse) continue;
+		double best = 1e30, sum = 0.0;
+		for(int r = 0; r < runs; ++r) {
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			sum = kernels[k].run(d);
+			std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+			double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / N;
+			if (ns < best) best = ns;
+		}
+		if (csv)
+			printf("bench,%s,%.4f,%.3f,%.9g\n", kernels[k].name, best, 1e3 / best, sum);
+		else
+			printf("%-26s %10.3f %10.1f %18.6g\n", kernels[k].name, best, 1e3 / best, sum);
+	}
+	return 0;
+}
@@ -0,0 +1,75 @@
+#include <cstdio>
+#include "trs.h"
+
+TRS::TRS() : m_pos(Vector3::ZERO), m_scl(1.0f) {}
+
+TRS::TRS(const Vector3 & pos, const Quaternion & rot, float scl) :
+	m_rot(rot), m_pos(pos), m_scl(scl) {}
+
+TRS::TRS(const Trfm3D & T) : m_rot(T), m_scl(T.getScale()) {
+	const float *m = T.getGLMatrix();
+	m_pos = Vector3(m[12], m[13], m[14]);
+	m_rot.normalize();
+}
+
+const Vector3 & TRS::position() const { return m_pos; }
+const Quaternion & TRS::rotation() const { return m_rot; }
+float TRS::scale() const { return m_scl; }
+
+void TRS::setUnit() {
+	m_rot = Quaternion::IDENTITY;
+	m_pos = Vector3::ZERO;
+	m_scl = 1.0f;
+}
+
+void TRS::set(const Vector3 & pos, const Quaternion & rot, float scl) {
+	m_rot = rot;
+	m_pos = pos;
+	m_scl = scl;
+}
+
+// T1 * T2 = Trans(P1 + S1 * R1(P2)) * Rot(R1 * R2) * Scale(S1 * S2)
+
+void TRS::add(const TRS & T) {
+	m_pos += m_rot.rotate(T.m_pos) * m_scl;
+	m_rot *= T.m_rot;
+	m_rot.normalize();
+	m_scl *= T.m_scl;
+}
+
+void TRS::addTrans(const Vector3 & P) {
+	m_pos += m_rot.rotate(P) * m_scl;
+}
+
+void TRS::addRot(const Quaternion & rot) {
+	m_rot *= rot;
+	m_rot.normalize();
+}
+
+void TRS::addRotX(float angle) { addRot(Quaternion(Vector3::UNIT_X, angle)); }
+void TRS::addRotY(float angle) { addRot(Quaternion(Vector3::UNIT_Y, angle)); }
+void TRS::addRotZ(float angle) { addRot(Quaternion(Vector3::UNIT_Z, angle)); }
+
+void TRS::addScale(float scale) { m_scl *= scale; }
+
+Vector3 TRS::transformPoint(const Vector3 & P) const {
+	return m_pos + m_rot.rotate(P) * m_scl;
+}
+
+void TRS::getTrfm(Trfm3D * T) const {
+	T->setTRS(m_pos, m_rot, m_scl);
+}
+
+TRS TRS::interpolate(const TRS & A, const TRS & B, float fT, bool fast) {
+	return TRS(A.m_pos + (B.m_pos - A.m_pos) * fT,
+			   fast ? Quaternion::nlerp(A.m_rot, B.m_rot, fT) : Quaternion::slerp(A.m_rot, B.m_rot, fT),
+			   A.m_scl + (B.m_scl - A.m_scl) * fT);
+}
+
+void TRS::print() const {
+	printf("TRS pos ");
+	m_pos.print();
+	printf(" ");
+	m_rot.print();
+	printf("scale %.4f\n", m_scl);
+}
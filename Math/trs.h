@@ -0,0 +1,62 @@
+// -*-C++-*-
+
+#pragma once
+
+#include "vector3.h"
+#include "quaternion.h"
+#include "trfm3D.h"
+
+/*! Compact placement: translation, rotation and uniform scale (32 bytes).
+
+  Represents the transformation
+
+  M = Trans(pos) * Rot(rot) * Scale(scl)
+
+  Composing TRS placements keeps the rotation a unit quaternion (it is
+  renormalized), so that, unlike matrices, they do not drift under repeated
+  rotations. The matrix is only built when asked for (getTrfm). */
+
+class TRS {
+
+public:
+	// Init with unit transformation
+	TRS();
+	TRS(const Vector3 & pos, const Quaternion & rot, float scl);
+	//! decompose an affine trfm with uniform scale
+	explicit TRS(const Trfm3D & T);
+
+	const Vector3 & position() const;
+	const Quaternion & rotation() const;
+	float scale() const;
+
+	void setUnit();
+	void set(const Vector3 & pos, const Quaternion & rot, float scl);
+
+	/*! Composition: this = this * T (as Trfm3D::add) */
+	void add(const TRS & T);
+
+	void addTrans(const Vector3 & P); //!< add a translation
+	void addRot(const Quaternion & rot); //!< add a rotation
+	void addRotX(float angle ); //!< add a rotation of angle radians in the X axis
+	void addRotY(float angle ); //!< add a rotation of angle radians in the Y axis
+	void addRotZ(float angle ); //!< add a rotation of angle radians in the Z axis
+	void addScale(float scale ); //!< add a uniform scale
+
+	Vector3 transformPoint(const Vector3 & P) const;
+
+	//! Set T to the matrix of this placement
+	void getTrfm(Trfm3D * T) const;
+
+	/**
+	 * Interpolate between A and B: the position and scale linearly, the
+	 * rotation by slerp (or nlerp, faster, if 'fast').
+	 */
+	static TRS interpolate(const TRS & A, const TRS & B, float fT, bool fast = false);
+
+	void print() const;
+
+private:
+	Quaternion m_rot; // first, as it is 16 bytes aligned
+	Vector3 m_pos;
+	float m_scl;
+};
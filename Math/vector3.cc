@@ -13,209 +13,11 @@ const Vector3 Vector3::UNIT_X(1.0f, 0.0f, 0.0f);
 const Vector3 Vector3::UNIT_Y(0.0f, 1.0f, 0.0f);
 const Vector3 Vector3::UNIT_Z(0.0f, 0.0f, 1.0f);
 const Vector3 Vector3::ONE(1.0f, 1.0f, 1.0f);
-const Vector3 Vector3::MIN(std::numeric_limits<float>::min(), std::numeric_limits<float>::min(), std::numeric_limits<float>::min());
+const Vector3 Vector3::MIN(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
 const Vector3 Vector3::MAX(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
 
 const float Vector3::epsilon = 0.0001f;
 
-Vector3::Vector3() {
-	m_v[0] = 0.0f;
-	m_v[1] = 0.0f;
-	m_v[2] = 0.0f;
-}
-
-Vector3::Vector3(float x, float y, float z) {
-	m_v[0] = x;
-	m_v[1] = y;
-	m_v[2] = z;
-}
-
-Vector3::Vector3(const float *ptr) {
-	m_v[0] = *ptr++;
-	m_v[1] = *ptr++;
-	m_v[2] = *ptr;
-}
-
-Vector3::Vector3(const Vector3 & vec) {
-	m_v[0] = vec.m_v[0];
-	m_v[1] = vec.m_v[1];
-	m_v[2] = vec.m_v[2];
-}
-
-Vector3 & Vector3::operator=(const Vector3 & vec) {
-	if (&vec != this) {
-		m_v[0] = vec.m_v[0];
-		m_v[1] = vec.m_v[1];
-		m_v[2] = vec.m_v[2];
-	}
-	return *this;
-}
-
-void Vector3::swap(Vector3 & vec) {
-	std::swap(m_v, vec.m_v);
-}
-
-// Coordinate access
-float Vector3::operator[](int i) const { return m_v[i]; }
-float & Vector3::operator[](int i) { return m_v[i]; }
-
-// Coordinate access.
-float Vector3::x () const { return m_v[0]; }
-float & Vector3::x () { return m_v[0]; };
-float Vector3::y () const { return m_v[1]; };
-float & Vector3::y () { return m_v[1]; };
-float Vector3::z () const { return m_v[2]; };
-float & Vector3::z () { return m_v[2]; };
-
-// convert to pointer to 3 flost vector
-const float * Vector3::to_3fv() const { return &m_v[0]; }
-
-// Arithmetic operations.
-void Vector3::operator +=(const Vector3 & rhs) {
-	m_v[0] += rhs.m_v[0];
-	m_v[1] += rhs.m_v[1];
-	m_v[2] += rhs.m_v[2];
-}
-
-void Vector3::operator -=(const Vector3 & rhs) {
-	m_v[0] -= rhs.m_v[0];
-	m_v[1] -= rhs.m_v[1];
-	m_v[2] -= rhs.m_v[2];
-}
-
-void Vector3::operator /=(float scalar) {
-	m_v[0] /= scalar;
-	m_v[1] /= scalar;
-	m_v[2] /= scalar;
-}
-
-void Vector3::operator *=(float scalar) {
-	m_v[0] *= scalar;
-	m_v[1] *= scalar;
-	m_v[2] *= scalar;
-}
-
-Vector3 operator+(const Vector3& lhs, const Vector3& rhs) {
-	return Vector3(lhs.m_v[0] + rhs.m_v[0],
-				   lhs.m_v[1] + rhs.m_v[1],
-				   lhs.m_v[2] + rhs.m_v[2]);
-};
-
-Vector3 operator-(const Vector3& lhs, const Vector3& rhs) {
-	return Vector3(lhs.m_v[0] - rhs.m_v[0],
-				   lhs.m_v[1] - rhs.m_v[1],
-				   lhs.m_v[2] - rhs.m_v[2]);
-};
-
-// component-wise multiplication
-Vector3 operator*(const Vector3& lhs, const Vector3& rhs) {
-	return Vector3(lhs.m_v[0] * rhs.m_v[0],
-				   lhs.m_v[1] * rhs.m_v[1],
-				   lhs.m_v[2] * rhs.m_v[2]);
-}
-
-Vector3 operator*(const Vector3& vec, float scalar) {
-	return Vector3(vec.m_v[0] *scalar,
-				   vec.m_v[1] *scalar,
-				   vec.m_v[2] *scalar);
-}
-
-Vector3 operator*(float scalar, const Vector3& vec) {
-	return Vector3(vec.m_v[0] *scalar,
-				   vec.m_v[1] *scalar,
-				   vec.m_v[2] *scalar);
-}
-
-Vector3 operator/ (const Vector3& vec, float scalar) {
-	assert(scalar != 0.0f);
-	return Vector3(vec.m_v[0] / scalar,
-				   vec.m_v[1] / scalar,
-				   vec.m_v[2] / scalar);
-}
-
-float Vector3::dot(const Vector3& rhs) const {
-	return m_v[0] * rhs.m_v[0] + m_v[1] * rhs.m_v[1] + m_v[2] * rhs.m_v[2];
-}
-
-// Return the projection of rhs into this
-Vector3 Vector3::projection(const Vector3& rhs) const {
-	float vsq = this->dot(*this);
-	if (vsq < epsilon) return Vector3(); // default unit vector
-	return *this * (this->dot(rhs) / vsq);
-}
-
-
-// cross product follows right-handed rule
-void Vector3::cross(const Vector3& rhs) {
-	float x = m_v[0];
-	float y = m_v[1];
-	float z = m_v[2];
-	m_v[0] = y * rhs.m_v[2] - z * rhs.m_v[1];
-	m_v[1] = z * rhs.m_v[0] - x * rhs.m_v[2];
-	m_v[2] = x * rhs.m_v[1] - y * rhs.m_v[0];
-}
-
-Vector3 crossVectors(const Vector3& lhs, const Vector3& rhs) {
-	Vector3 res(lhs);
-	res.cross(rhs);
-	return res;
-}
-
-float Vector3::length() const {
-	return sqrtf(m_v[0] * m_v[0] + m_v[1] * m_v[1] + m_v[2] * m_v[2]);
-}
-
-float Vector3::lengthSquare() const {
-	return m_v[0] * m_v[0] + m_v[1] * m_v[1] + m_v[2] * m_v[2];
-}
-
-// Set vector to unit length.
-// Returns the old length
-// If zero vector, set to UNIT_Z vector.
-float Vector3::normalize() {
-	float mod = 0.0f;
-	float mod2 = m_v[0]*m_v[0] + m_v[1]*m_v[1] + m_v[2]*m_v[2];
-	if( mod2 > epsilon ) {
-		mod = 1.0f / sqrtf( mod2 );
-		m_v[0] *= mod;
-		m_v[1] *= mod;
-		m_v[2] *= mod;
-	}
-	else {
-		m_v[0] = 0.0f;
-		m_v[1] = 0.0f;
-		m_v[2] = 1.0f;
-	}
-	return mod;
-}
-
-// Normalize L1 (so that coords sum to 1)
-// Returns the old length
-float Vector3::normalizeL1() {
-
-	float m = m_v[0] + m_v[1] + m_v[2];
-
-	if (fabs(m) > epsilon) {
-		float d = (float) 1.0 / m;
-		m_v[0] *= d;
-		m_v[1] *= d;
-		m_v[2] *= d;
-	} else {
-		m = 0.0f;
-		m_v[0] = 0.0f;
-		m_v[1] = 0.0f;
-		m_v[2] = 0.0f;
-	}
-	return m;
-}
-
-// Whether vector is zero
-bool Vector3::isZero() const {
-	return(fabs(m_v[0]) < epsilon &&
-		   fabs(m_v[1]) < epsilon &&
-		   fabs(m_v[2]) < epsilon);
-}
-
 // Given V = (vx, vy, vz), calculate (alpha, beta), so that:
 //
 // vx = |V| * cos beta * sin alfa
@@ -2,6 +2,14 @@
 
 #pragma once
 
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+/*! Everything but the constants, sphereCoordinates and print is inline (see
+  the end of the file), so that the hot loops don't pay a call per
+  coordinate. */
+
 class Vector3 {
 
 public:
@@ -18,34 +26,34 @@ public:
 	static const Vector3 MAX;     // Maximum possible vector
 
 	// Constructors
-	Vector3();
-	Vector3(float x, float y, float z);
-	Vector3(const float *ptr);
-	Vector3(const Vector3 & vec);
-	Vector3 & operator=(const Vector3 & vec);
+	constexpr Vector3();
+	constexpr Vector3(float x, float y, float z);
+	constexpr Vector3(const float *ptr);
+	Vector3(const Vector3 & vec) = default;
+	Vector3 & operator=(const Vector3 & vec) = default;
 
 	// swap two vectors
 	void swap(Vector3 & vec);
 
 	// Coordinate access
-	float operator[](int idx) const;
+	constexpr float operator[](int idx) const;
 	float & operator[](int idx);
-	float x () const;
+	constexpr float x () const;
 	float & x ();
-	float y () const;
+	constexpr float y () const;
 	float& y ();
-	float z () const;
+	constexpr float z () const;
 	float& z ();
 
 	// convert to pointer to 3 flost vector
-	const float * to_3fv() const;
+	constexpr const float * to_3fv() const;
 
 	// Arithmetic operations.
-	friend Vector3 operator+(const Vector3& lhs, const Vector3& rhs);
-	friend Vector3 operator-(const Vector3& lhs, const Vector3& rhs);
-	friend Vector3 operator*(const Vector3& lhs, const Vector3& rhs);
-	friend Vector3 operator*(const Vector3& vec, float scalar);
-	friend Vector3 operator*(float scalar, const Vector3& vec);
+	friend constexpr Vector3 operator+(const Vector3& lhs, const Vector3& rhs);
+	friend constexpr Vector3 operator-(const Vector3& lhs, const Vector3& rhs);
+	friend constexpr Vector3 operator*(const Vector3& lhs, const Vector3& rhs);
+	friend constexpr Vector3 operator*(const Vector3& vec, float scalar);
+	friend constexpr Vector3 operator*(float scalar, const Vector3& vec);
 	friend Vector3 operator/(const Vector3& vec, float scalar);
 	friend Vector3 operator/(float scalar, const Vector3& vec);
 	void operator +=(const Vector3 & rhs);
@@ -54,7 +62,7 @@ public:
 	void operator /=(float scalar);
 
 	// Return scalar product between this and vector in rhs
-	float dot(const Vector3& rhs) const;
+	constexpr float dot(const Vector3& rhs) const;
 
 	// Return the projection of rhs into this
 	Vector3 projection(const Vector3& rhs) const;
@@ -66,7 +74,7 @@ public:
 	friend Vector3 crossVectors(const Vector3& lhs, const Vector3& rhs);
 
 	float length() const; // vector module
-	float lengthSquare() const; // square of length
+	constexpr float lengthSquare() const; // square of length
 
 	// Set vector to unit length.
 	// Returns the length of vector before normalization
@@ -88,3 +96,172 @@ public:
 private:
 	float m_v[3];
 };
+
+// Constructors
+
+constexpr Vector3::Vector3() : m_v{0.0f, 0.0f, 0.0f} {}
+constexpr Vector3::Vector3(float x, float y, float z) : m_v{x, y, z} {}
+constexpr Vector3::Vector3(const float *ptr) : m_v{ptr[0], ptr[1], ptr[2]} {}
+
+inline void Vector3::swap(Vector3 & vec) {
+	std::swap(m_v, vec.m_v);
+}
+
+// Coordinate access
+constexpr float Vector3::operator[](int i) const { return m_v[i]; }
+inline float & Vector3::operator[](int i) { return m_v[i]; }
+
+constexpr float Vector3::x () const { return m_v[0]; }
+inline float & Vector3::x () { return m_v[0]; }
+constexpr float Vector3::y () const { return m_v[1]; }
+inline float & Vector3::y () { return m_v[1]; }
+constexpr float Vector3::z () const { return m_v[2]; }
+inline float & Vector3::z () { return m_v[2]; }
+
+constexpr const float * Vector3::to_3fv() const { return &m_v[0]; }
+
+// Arithmetic operations.
+inline void Vector3::operator +=(const Vector3 & rhs) {
+	m_v[0] += rhs.m_v[0];
+	m_v[1] += rhs.m_v[1];
+	m_v[2] += rhs.m_v[2];
+}
+
+inline void Vector3::operator -=(const Vector3 & rhs) {
+	m_v[0] -= rhs.m_v[0];
+	m_v[1] -= rhs.m_v[1];
+	m_v[2] -= rhs.m_v[2];
+}
+
+inline void Vector3::operator /=(float scalar) {
+	m_v[0] /= scalar;
+	m_v[1] /= scalar;
+	m_v[2] /= scalar;
+}
+
+inline void Vector3::operator *=(float scalar) {
+	m_v[0] *= scalar;
+	m_v[1] *= scalar;
+	m_v[2] *= scalar;
+}
+
+constexpr Vector3 operator+(const Vector3& lhs, const Vector3& rhs) {
+	return Vector3(lhs.m_v[0] + rhs.m_v[0],
+				   lhs.m_v[1] + rhs.m_v[1],
+				   lhs.m_v[2] + rhs.m_v[2]);
+}
+
+constexpr Vector3 operator-(const Vector3& lhs, const Vector3& rhs) {
+	return Vector3(lhs.m_v[0] - rhs.m_v[0],
+				   lhs.m_v[1] - rhs.m_v[1],
+				   lhs.m_v[2] - rhs.m_v[2]);
+}
+
+// component-wise multiplication
+constexpr Vector3 operator*(const Vector3& lhs, const Vector3& rhs) {
+	return Vector3(lhs.m_v[0] * rhs.m_v[0],
+				   lhs.m_v[1] * rhs.m_v[1],
+				   lhs.m_v[2] * rhs.m_v[2]);
+}
+
+constexpr Vector3 operator*(const Vector3& vec, float scalar) {
+	return Vector3(vec.m_v[0] * scalar,
+				   vec.m_v[1] * scalar,
+				   vec.m_v[2] * scalar);
+}
+
+constexpr Vector3 operator*(float scalar, const Vector3& vec) {
+	return Vector3(vec.m_v[0] * scalar,
+				   vec.m_v[1] * scalar,
+				   vec.m_v[2] * scalar);
+}
+
+inline Vector3 operator/ (const Vector3& vec, float scalar) {
+	assert(scalar != 0.0f);
+	return Vector3(vec.m_v[0] / scalar,
+				   vec.m_v[1] / scalar,
+				   vec.m_v[2] / scalar);
+}
+
+constexpr float Vector3::dot(const Vector3& rhs) const {
+	return m_v[0] * rhs.m_v[0] + m_v[1] * rhs.m_v[1] + m_v[2] * rhs.m_v[2];
+}
+
+// Return the projection of rhs into this
+inline Vector3 Vector3::projection(const Vector3& rhs) const {
+	float vsq = this->dot(*this);
+	if (vsq < epsilon) return Vector3(); // default unit vector
+	return *this * (this->dot(rhs) / vsq);
+}
+
+// cross product follows right-handed rule
+inline void Vector3::cross(const Vector3& rhs) {
+	float x = m_v[0];
+	float y = m_v[1];
+	float z = m_v[2];
+	m_v[0] = y * rhs.m_v[2] - z * rhs.m_v[1];
+	m_v[1] = z * rhs.m_v[0] - x * rhs.m_v[2];
+	m_v[2] = x * rhs.m_v[1] - y * rhs.m_v[0];
+}
+
+inline Vector3 crossVectors(const Vector3& lhs, const Vector3& rhs) {
+	Vector3 res(lhs);
+	res.cross(rhs);
+	return res;
+}
+
+inline float Vector3::length() const {
+	return sqrtf(m_v[0] * m_v[0] + m_v[1] * m_v[1] + m_v[2] * m_v[2]);
+}
+
+constexpr float Vector3::lengthSquare() const {
+	return m_v[0] * m_v[0] + m_v[1] * m_v[1] + m_v[2] * m_v[2];
+}
+
+// Set vector to unit length.
+// Returns the old length
+// If zero vector, set to UNIT_Z vector.
+inline float Vector3::normalize() {
+	float mod = 0.0f;
+	float mod2 = m_v[0]*m_v[0] + m_v[1]*m_v[1] + m_v[2]*m_v[2];
+	if( mod2 > epsilon ) {
+		mod = sqrtf( mod2 );
+		float inv = 1.0f / mod;
+		m_v[0] *= inv;
+		m_v[1] *= inv;
+		m_v[2] *= inv;
+	}
+	else {
+		m_v[0] = 0.0f;
+		m_v[1] = 0.0f;
+		m_v[2] = 1.0f;
+	}
+	return mod;
+}
+
+// Normalize L1 (so that coords sum to 1)
+// Returns the old length
+inline float Vector3::normalizeL1() {
+
+	float m = m_v[0] + m_v[1] + m_v[2];
+
+	if (fabs(m) > epsilon) {
+		float d = (float) 1.0 / m;
+		m_v[0] *= d;
+		m_v[1] *= d;
+		m_v[2] *= d;
+	} else {
+		m = 0.0f;
+		m_v[0] = 0.0f;
+		m_v[1] = 0.0f;
+		m_v[2] = 0.0f;
+	}
+	return m;
+}
+
+// Whether vector is zero
+inline bool Vector3::isZero() const {
+	return(fabs(m_v[0]) < epsilon &&
+		   fabs(m_v[1]) < epsilon &&
+		   fabs(m_v[2]) < epsilon);
+}
@@ -0,0 +1,493 @@
+/*
+  aabbtree.c
+
+  Dynamic AABB tree. See aabbtree.h
+
+  The cost of a tree is the sum of the surface areas of its inner nodes
+  (the chance of a random query visiting them). A new leaf descends from
+  the root towards the child with the lowest bound of the cost, and becomes
+  the sibling of the cheapest node found on the way. The ancestors of an
+  inserted or removed leaf are then refitted from the bottom up, with a
+  rotation wherever it lowers the cost.
+
+  Rotations keep the area low rather than the heights of the children
+  equal: rotating for height alone (as AVL trees do) makes queries several
+  times slower here.
+*/
+
+#include <float.h>
+#include <stdlib.h>
+#include "aabbtree.h"
+
+#define AABB_STACK 256         /* the height of the tree is much lower */
+#define AABB_HUGE_MARGIN 4.0f  /* fat boxes larger than this many margins are refitted */
+#define AABB_DISP_FACTOR 4.0f  /* fat boxes anticipate this many displacements */
+
+static void
+boxUnion(float* bmin, float* bmax, const AABBNode* a, const AABBNode* b)
+{
+	int i;
+	for (i = 0; i < 3; i++) {
+		bmin[i] = a->bmin[i] < b->bmin[i] ? a->bmin[i] : b->bmin[i];
+		bmax[i] = a->bmax[i] > b->bmax[i] ? a->bmax[i] : b->bmax[i];
+	}
+}
+
+/* half the surface area of a box */
+static float
+boxArea(const float* bmin, const float* bmax)
+{
+	float dx = bmax[0] - bmin[0];
+	float dy = bmax[1] - bmin[1];
+	float dz = bmax[2] - bmin[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static float
+unionArea(const AABBNode* a, const AABBNode* b)
+{
+	float bmin[3], bmax[3];
+	boxUnion(bmin, bmax, a, b);
+	return boxArea(bmin, bmax);
+}
+
+static int
+isLeaf(const AABBNode* n)
+{
+	return n->child[0] == AABB_NULL;
+}
+
+void
+aabbTreeInit(AABBTree* tree)
+{
+	tree->nodes = 0;
+	tree->capacity = 0;
+	tree->count = 0;
+	tree->root = AABB_NULL;
+	tree->free = AABB_NULL;
+	tree->proxies = 0;
+}
+
+void
+aabbTreeFree(AABBTree* tree)
+{
+	free(tree->nodes);
+	aabbTreeInit(tree);
+}
+
+static int
+allocNode(AABBTree* tree)
+{
+	int n;
+	if (tree->free == AABB_NULL) {
+		int i, capacity = tree->capacity ? 2 * tree->capacity : 16;
+		tree->nodes = (AABBNode*) realloc(tree->nodes, capacity * sizeof(AABBNode));
+		for (i = tree->capacity; i < capacity; i++) {
+			tree->nodes[i].parent = i + 1 < capacity ? i + 1 : AABB_NULL;
+			tree->nodes[i].height = -1;
+		}
+		tree->free = tree->capacity;
+		tree->capacity = capacity;
+	}
+	n = tree->free;
+	tree->free = tree->nodes[n].parent;
+	tree->nodes[n].parent = AABB_NULL;
+	tree->nodes[n].child[0] = tree->nodes[n].child[1] = AABB_NULL;
+	tree->nodes[n].height = 0;
+	tree->nodes[n].data = 0;
+	tree->count++;
+	return n;
+}
+
+static void
+freeNode(AABBTree* tree, int n)
+{
+	tree->nodes[n].parent = tree->free;
+	tree->nodes[n].height = -1;
+	tree->free = n;
+	tree->count--;
+}
+
+/* replace child 'from' of the parent of 'from' (or the root) by 'to' */
+static void
+replaceChild(AABBTree* tree, int parent, int from, int to)
+{
+	AABBNode* nodes = tree->nodes;
+	nodes[to].parent = parent;
+	if (parent == AABB_NULL)
+		tree->root = to;
+	else if (nodes[parent].child[0] == from)
+		nodes[parent].child[0] = to;
+	else
+		nodes[parent].child[1] = to;
+}
+
+static void
+refit(AABBNode* nodes, int n)
+{
+	AABBNode* node = nodes + n;
+	const AABBNode* a = nodes + node->child[0];
+	const AABBNode* b = nodes + node->child[1];
+	boxUnion(node->bmin, node->bmax, a, b);
+	node->height = 1 + (a->height > b->height ? a->height : b->height);
+}
+
+/* Rotations: swap a child of 'a' with a grandchild below the other child,
+ * if it reduces the area of that child (the area of 'a' stays the same). Of
+ * the four possible swaps, the one which reduces the area the most is done.
+ */
+static void
+rotate(AABBTree* tree, int a)
+{
+	AABBNode* nodes = tree->nodes;
+	float best = 0.0f;
+	int side, k, bestside = -1, bestk = 0, up, down, c;
+
+	for (side = 0; side < 2; side++) {
+		/* child 'down' of a goes below 'c', the other child */
+		const AABBNode* d = nodes + nodes[a].child[side];
+		const AABBNode* other = nodes + nodes[a].child[!side];
+		if (isLeaf(other)) continue;
+		for (k = 0; k < 2; k++) {
+			/* grandchild k goes up, and 'down' joins grandchild !k */
+			float gain = unionArea(d, nodes + other->child[!k]) -
+				boxArea(other->bmin, other->bmax);
+			if (gain < best) {
+				best = gain;
+				bestside = side;
+				bestk = k;
+			}
+		}
+	}
+	if (bestside < 0) return;
+	down = nodes[a].child[bestside];
+	c = nodes[a].child[!bestside];
+	up = nodes[c].child[bestk];
+	nodes[a].child[bestside] = up;
+	nodes[up].parent = a;
+	nodes[c].child[bestk] = down;
+	nodes[down].parent = c;
+	refit(nodes, c);
+}
+
+/* refit and rotate the ancestors of a node, from the bottom up */
+static void
+fixUpwards(AABBTree* tree, int n)
+{
+	while (n != AABB_NULL) {
+		refit(tree->nodes, n);
+		rotate(tree, n);
+		refit(tree->nodes, n);
+		n = tree->nodes[n].parent;
+	}
+}
+
+static void
+insertLeaf(AABBTree* tree, int leaf)
+{
+	AABBNode* nodes;
+	const AABBNode* l;
+	float direct, inherited, bestcost, leafarea;
+	int n, best, parent;
+
+	if (tree->root == AABB_NULL) {
+		tree->root = leaf;
+		tree->nodes[leaf].parent = AABB_NULL;
+		return;
+	}
+
+	/* best sibling: the cost of a sibling is the area of the new parent plus
+	 * the growth of the ancestors. Descend towards the child with the lower
+	 * bound of the cost of its subtree, while it can beat the best so far. */
+	nodes = tree->nodes;
+	l = nodes + leaf;
+	n = tree->root;
+	best = n;
+	direct = unionArea(nodes + n, l);
+	bestcost = direct;
+	inherited = 0.0f;
+	leafarea = boxArea(l->bmin, l->bmax);
+	while (!isLeaf(nodes + n)) {
+		const AABBNode* node = nodes + n;
+		float cost = direct + inherited, lower[2], childdirect[2];
+		int i;
+		if (cost < bestcost) {
+			bestcost = cost;
+			best = n;
+		}
+		inherited += direct - boxArea(node->bmin, node->bmax);
+		for (i = 0; i < 2; i++) {
+			const AABBNode* child = nodes + node->child[i];
+			childdirect[i] = unionArea(child, l);
+			if (isLeaf(child)) {
+				cost = childdirect[i] + inherited;
+				if (cost < bestcost) {
+					bestcost = cost;
+					best = node->child[i];
+				}
+				lower[i] = FLT_MAX;
+			} else {
+				float area = boxArea(child->bmin, child->bmax);
+				lower[i] = inherited + childdirect[i] + (leafarea < area ? leafarea - area : 0.0f);
+			}
+		}
+		i = lower[1] < lower[0];
+		if (bestcost <= lower[i]) break;
+		n = node->child[i];
+		direct = childdirect[i];
+	}
+	n = best;
+
+	/* new parent of the sibling and the leaf */
+	parent = allocNode(tree);
+	nodes = tree->nodes; /* (the pool may have moved) */
+	replaceChild(tree, nodes[n].parent, n, parent);
+	nodes[parent].child[0] = n;
+	nodes[parent].child[1] = leaf;
+	nodes[n].parent = parent;
+	nodes[leaf].parent = parent;
+	fixUpwards(tree, parent);
+}
+
+static void
+removeLeaf(AABBTree* tree, int leaf)
+{
+	AABBNode* nodes = tree->nodes;
+	int parent, sibling, grandparent;
+
+	if (leaf == tree->root) {
+		tree->root = AABB_NULL;
+		return;
+	}
+	parent = nodes[leaf].parent;
+	grandparent = nodes[parent].parent;
+	sibling = nodes[parent].child[nodes[parent].child[0] == leaf];
+	replaceChild(tree, grandparent, parent, sibling);
+	freeNode(tree, parent);
+	fixUpwards(tree, grandparent);
+}
+
+static void
+fatBox(float* fmin, float* fmax, const float bmin[3], const float bmax[3],
+	   float margin, const float* disp)
+{
+	int i;
+	for (i = 0; i < 3; i++) {
+		fmin[i] = bmin[i] - margin;
+		fmax[i] = bmax[i] + margin;
+		if (!disp) continue;
+		if (disp[i] < 0.0f)
+			fmin[i] += AABB_DISP_FACTOR * disp[i];
+		else
+			fmax[i] += AABB_DISP_FACTOR * disp[i];
+	}
+}
+
+int
+aabbTreeInsert(AABBTree* tree, const float bmin[3], const float bmax[3],
+			   float margin, void* data)
+{
+	int leaf = allocNode(tree);
+	AABBNode* node = tree->nodes + leaf;
+	fatBox(node->bmin, node->bmax, bmin, bmax, margin, 0);
+	node->data = data;
+	insertLeaf(tree, leaf);
+	tree->proxies++;
+	return leaf;
+}
+
+void
+aabbTreeRemove(AABBTree* tree, int proxy)
+{
+	removeLeaf(tree, proxy);
+	freeNode(tree, proxy);
+	tree->proxies--;
+}
+
+int
+aabbTreeMove(AABBTree* tree, int proxy, const float bmin[3], const float bmax[3],
+			 float margin, const float disp[3])
+{
+	AABBNode* node = tree->nodes + proxy;
+	float fmin[3], fmax[3];
+	int i, inside = 1, huge = 1;
+
+	fatBox(fmin, fmax, bmin, bmax, margin, disp);
+	for (i = 0; i < 3; i++) {
+		if (bmin[i] < node->bmin[i] || bmax[i] > node->bmax[i]) inside = 0;
+		if (node->bmin[i] < fmin[i] - AABB_HUGE_MARGIN * margin ||
+			node->bmax[i] > fmax[i] + AABB_HUGE_MARGIN * margin) huge = 0;
+	}
+	/* huge: the current fat box fits in a huge box around the new one */
+	if (inside && huge) return 0;
+	removeLeaf(tree, proxy);
+	for (i = 0; i < 3; i++) {
+		node->bmin[i] = fmin[i];
+		node->bmax[i] = fmax[i];
+	}
+	insertLeaf(tree, proxy);
+	return 1;
+}
+
+void*
+aabbTreeData(const AABBTree* tree, int proxy)
+{
+	return tree->nodes[proxy].data;
+}
+
+void
+aabbTreeQuery(const AABBTree* tree,
+			  int (*test)(void* ctx, const float bmin[3], const float bmax[3]),
+			  int (*visit)(void* ctx, int proxy, void* data, int inside),
+			  void* ctx)
+{
+	const AABBNode* nodes = tree->nodes;
+	int stack[AABB_STACK]; /* node * 2 + whether it is inside the region */
+	int top = 0;
+
+	if (tree->root == AABB_NULL) return;
+	stack[top++] = 2 * tree->root;
+	while (top) {
+		int n = stack[--top];
+		int inside = n & 1;
+		const AABBNode* node = nodes + (n >> 1);
+		if (!inside) {
+			int res = test(ctx, node->bmin, node->bmax);
+			if (res == AABB_OUTSIDE) continue;
+			inside = res == AABB_INSIDE;
+		}
+		if (isLeaf(node)) {
+			if (!visit(ctx, n >> 1, node->data, inside)) return;
+		} else if (top + 2 <= AABB_STACK) {
+			stack[top++] = 2 * node->child[1] + inside;
+			stack[top++] = 2 * node->child[0] + inside;
+		}
+	}
+}
+
+typedef struct {
+	const float* bmin;
+	const float* bmax;
+} BoxRegion;
+
+static int
+testBox(void* ctx, const float bmin[3], const float bmax[3])
+{
+	const BoxRegion* r = (const BoxRegion*) ctx;
+	int i;
+	for (i = 0; i < 3; i++)
+		if (bmin[i] > r->bmax[i] || bmax[i] < r->bmin[i]) return AABB_OUTSIDE;
+	return AABB_PARTIAL;
+}
+
+void
+aabbTreeQueryBox(const AABBTree* tree, const float bmin[3], const float bmax[3],
+				 int (*visit)(void* ctx, int proxy, void* data, int inside),
+				 void* ctx)
+{
+	const AABBNode* nodes = tree->nodes;
+	BoxRegion region;
+	int stack[AABB_STACK];
+	int top = 0;
+
+	if (tree->root == AABB_NULL) return;
+	region.bmin = bmin;
+	region.bmax = bmax;
+	stack[top++] = tree->root;
+	while (top) {
+		const AABBNode* node = nodes + stack[--top];
+		if (testBox(&region, node->bmin, node->bmax) == AABB_OUTSIDE) continue;
+		if (isLeaf(node)) {
+			if (!visit(ctx, (int) (node - nodes), node->data, 0)) return;
+		} else if (top + 2 <= AABB_STACK) {
+			stack[top++] = node->child[1];
+			stack[top++] = node->child[0];
+		}
+	}
+}
+
+/* entry parameter of the ray in a box (tmax if it misses it) */
+static float
+rayBox(const AABBNode* node, const float origin[3], const float inv[3], float tmax)
+{
+	float tnear = 0.0f, tfar = tmax;
+	int i;
+	for (i = 0; i < 3; i++) {
+		float t0 = (node->bmin[i] - origin[i]) * inv[i];
+		float t1 = (node->bmax[i] - origin[i]) * inv[i];
+		if (t0 > t1) {
+			float t = t0;
+			t0 = t1;
+			t1 = t;
+		}
+		if (t0 > tnear) tnear = t0;
+		if (t1 < tfar) tfar = t1;
+		if (tnear > tfar) return tmax;
+	}
+	return tnear;
+}
+
+void
+aabbTreeQueryRay(const AABBTree* tree, const float origin[3], const float dir[3],
+				 float tmax, float (*visit)(void* ctx, int proxy, void* data, float tmax),
+				 void* ctx)
+{
+	const AABBNode* nodes = tree->nodes;
+	int stack[AABB_STACK];
+	float enter[AABB_STACK]; /* entry parameter of the nodes in the stack */
+	float inv[3];
+	int top = 0, i;
+
+	if (tree->root == AABB_NULL) return;
+	for (i = 0; i < 3; i++)
+		inv[i] = dir[i] != 0.0f ? 1.0f / dir[i] : FLT_MAX;
+	enter[top] = rayBox(nodes + tree->root, origin, inv, tmax);
+	stack[top++] = tree->root;
+	while (top) {
+		const AABBNode* node;
+		--top;
+		if (enter[top] >= tmax) continue;
+		node = nodes + stack[top];
+		if (isLeaf(node)) {
+			tmax = visit(ctx, stack[top], node->data, tmax);
+		} else if (top + 2 <= AABB_STACK) {
+			/* the closest child is visited first */
+			float t0 = rayBox(nodes + node->child[0], origin, inv, tmax);
+			float t1 = rayBox(nodes + node->child[1], origin, inv, tmax);
+			int first = t1 < t0;
+			int a = node->child[first], b = node->child[!first];
+			float ta = first ? t1 : t0, tb = first ? t0 : t1;
+			if (tb < tmax) {
+				enter[top] = tb;
+				stack[top++] = b;
+			}
+			if (ta < tmax) {
+				enter[top] = ta;
+				stack[top++] = a;
+			}
+		}
+	}
+}
+
+int
+aabbTreeHeight(const AABBTree* tree)
+{
+	return tree->root == AABB_NULL ? 0 : tree->nodes[tree->root].height;
+}
+
+float
+aabbTreeAreaRatio(const AABBTree* tree)
+{
+	const AABBNode* root;
+	float sum = 0.0f, area;
+	int i;
+
+	if (tree->root == AABB_NULL) return 0.0f;
+	root = tree->nodes + tree->root;
+	area = boxArea(root->bmin, root->bmax);
+	for (i = 0; i < tree->capacity; i++) {
+		const AABBNode* node = tree->nodes + i;
+		if (node->height > 0) sum += boxArea(node->bmin, node->bmax);
+	}
+	return area > 0.0f ? sum / area : 0.0f;
+}
@@ -0,0 +1,140 @@
+/*
+  aabbtree.h
+
+  Dynamic AABB tree, for objects which move every frame.
+
+  Every object (proxy) is a leaf of a binary tree of axis aligned boxes.
+  Leaves store a fattened box: the box of the object grown by a margin, and
+  stretched along the last displacement, so that an object which moves a
+  little stays inside its fat box, and the tree is left as it is. Only
+  objects which leave their fat box are removed and inserted again.
+
+  Objects are inserted next to the sibling which increases the surface area
+  of the tree the least (found descending from the root), and the ancestors
+  are rebalanced with tree rotations which reduce the area, so that the tree
+  stays good for queries (and shallow) whatever the order of the updates.
+
+  Nodes live in a pool, so proxies are indices which don't change while the
+  object is in the tree. Queries don't modify the tree: several threads can
+  query it at once, as long as no thread updates it.
+*/
+#ifndef AABBTREE_H
+#define AABBTREE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AABB_NULL (-1)
+
+typedef struct {
+	float bmin[3];
+	float bmax[3];
+	void* data;       /* object of a leaf */
+	int parent;       /* AABB_NULL for the root. Next free node if free */
+	int child[2];     /* AABB_NULL for leaves */
+	int height;       /* 0 for leaves, -1 for free nodes */
+} AABBNode;
+
+typedef struct {
+	AABBNode* nodes;
+	int capacity;
+	int count;      /* nodes in use */
+	int root;
+	int free;       /* first free node */
+	int proxies;    /* number of leaves */
+} AABBTree;
+
+/* result of a test of a box against a region (see aabbTreeQuery) */
+#define AABB_OUTSIDE 0
+#define AABB_PARTIAL 1
+#define AABB_INSIDE 2
+
+/* aabbTreeInit: an empty tree. aabbTreeFree: free its memory. */
+void
+aabbTreeInit(AABBTree* tree);
+
+void
+aabbTreeFree(AABBTree* tree);
+
+/* aabbTreeInsert: insert an object with box (bmin, bmax).
+ *
+ * margin - the fat box is the box grown by margin in every direction
+ * data   - the object (see aabbTreeData)
+ *
+ * returns the proxy of the object.
+ */
+int
+aabbTreeInsert(AABBTree* tree, const float bmin[3], const float bmax[3],
+			   float margin, void* data);
+
+/* aabbTreeRemove: remove a proxy from the tree. */
+void
+aabbTreeRemove(AABBTree* tree, int proxy);
+
+/* aabbTreeMove: the box of an object changed.
+ *
+ * bmin, bmax - the new box
+ * margin     - as in aabbTreeInsert
+ * disp       - displacement of the object since the last update. The fat
+ *              box is stretched along it, to anticipate the next motion.
+ *
+ * The object is inserted again only if the box is outside its fat box, or
+ * much smaller than it. Returns whether it was inserted again.
+ */
+int
+aabbTreeMove(AABBTree* tree, int proxy, const float bmin[3], const float bmax[3],
+			 float margin, const float disp[3]);
+
+/* aabbTreeData: object of a proxy */
+void*
+aabbTreeData(const AABBTree* tree, int proxy);
+
+/* aabbTreeQuery: visit the leaves within a region.
+ *
+ * test  - test of a box (of the tree) against the region: AABB_OUTSIDE,
+ *         AABB_PARTIAL or AABB_INSIDE. The leaves of a subtree inside the
+ *         region are visited without more tests.
+ * visit - called for every leaf whose fat box is not outside the region,
+ *         with 'inside' whether it is inside. Return 0 to stop the query.
+ */
+void
+aabbTreeQuery(const AABBTree* tree,
+			  int (*test)(void* ctx, const float bmin[3], const float bmax[3]),
+			  int (*visit)(void* ctx, int proxy, void* data, int inside),
+			  void* ctx);
+
+/* aabbTreeQueryBox: visit the leaves whose fat box overlaps box (bmin,
+ * bmax), as aabbTreeQuery.
+ */
+void
+aabbTreeQueryBox(const AABBTree* tree, const float bmin[3], const float bmax[3],
+				 int (*visit)(void* ctx, int proxy, void* data, int inside),
+				 void* ctx);
+
+/* aabbTreeQueryRay: visit the leaves whose fat box the ray origin + t * dir
+ * hits with 0 < t < tmax, closest boxes first.
+ *
+ * visit - returns the new tmax (the closest intersection so far). Subtrees
+ *         beyond tmax are skipped.
+ */
+void
+aabbTreeQueryRay(const AABBTree* tree, const float origin[3], const float dir[3],
+				 float tmax, float (*visit)(void* ctx, int proxy, void* data, float tmax),
+				 void* ctx);
+
+/* aabbTreeHeight: height of the tree (0 if empty or one leaf) */
+int
+aabbTreeHeight(const AABBTree* tree);
+
+/* aabbTreeAreaRatio: sum of the areas of the inner nodes over the area of
+ * the root (a measure of the quality of the tree: lower is better)
+ */
+float
+aabbTreeAreaRatio(const AABBTree* tree);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
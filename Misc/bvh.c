@@ -0,0 +1,799 @@
+/*
+  bvh.c
+
+  Bounding volume hierarchy of triangles. See bvh.h
+
+  Leaves have at most BVH_LEAF_MAX triangles. A node with fewer triangles
+  becomes a leaf when no split is cheaper than intersecting all its
+  triangles. Below BVH_MAX_DEPTH levels (only reached with degenerate
+  splits) nodes are split in the middle, so that the traversal stack never
+  overflows.
+*/
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include "bvh.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BVH_SSE
+#endif
+
+#define BVH_BINS 16
+#define BVH_LEAF_MAX 8
+#define BVH_MAX_DEPTH 64
+#define BVH_STACK 128
+#define BVH_TRAVERSAL_COST 1.0f /* relative to intersecting a triangle */
+
+typedef struct {
+	float bmin[3];
+	float bmax[3];
+} Box;
+
+typedef struct {
+	BVHNode* nodes;
+	int* order;
+	const Box* boxes;      /* box of every triangle */
+	const float* centroid; /* centroid of every triangle */
+	int used;              /* nodes in use */
+} BuildContext;
+
+static void
+boxInit(Box* b)
+{
+	int i;
+	for (i = 0; i < 3; i++) {
+		b->bmin[i] = FLT_MAX;
+		b->bmax[i] = -FLT_MAX;
+	}
+}
+
+static void
+boxInclude(Box* b, const Box* o)
+{
+	int i;
+	for (i = 0; i < 3; i++) {
+		if (o->bmin[i] < b->bmin[i]) b->bmin[i] = o->bmin[i];
+		if (o->bmax[i] > b->bmax[i]) b->bmax[i] = o->bmax[i];
+	}
+}
+
+/* half the surface area of a box */
+static float
+boxArea(const Box* b)
+{
+	float dx = b->bmax[0] - b->bmin[0];
+	float dy = b->bmax[1] - b->bmin[1];
+	float dz = b->bmax[2] - b->bmin[2];
+	if (dx < 0.0f) return 0.0f;
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static void
+buildNode(BuildContext* ctx, int n, int begin, int end, int depth)
+{
+	BVHNode* node = ctx->nodes + n;
+	Box box, cbox;
+	int count = end - begin;
+	int bestaxis = -1, bestbin = 0, mid, left, right;
+	float bestcost;
+	int i, j, axis;
+
+	/* bounds of the triangles and of their centroids */
+	boxInit(&box);
+	boxInit(&cbox);
+	for (i = begin; i < end; i++) {
+		const float* c = ctx->centroid + 3 * ctx->order[i];
+		boxInclude(&box, ctx->boxes + ctx->order[i]);
+		for (j = 0; j < 3; j++) {
+			if (c[j] < cbox.bmin[j]) cbox.bmin[j] = c[j];
+			if (c[j] > cbox.bmax[j]) cbox.bmax[j] = c[j];
+		}
+	}
+	for (j = 0; j < 3; j++) {
+		node->bmin[j] = box.bmin[j];
+		node->bmax[j] = box.bmax[j];
+	}
+	node->offset = begin;
+	node->count = count;
+	if (count <= 1) return;
+
+	/* best binned SAH split (costs are multiplied by the area of the node) */
+	bestcost = count <= BVH_LEAF_MAX ? count * boxArea(&box) : FLT_MAX;
+	if (depth < BVH_MAX_DEPTH) {
+		for (axis = 0; axis < 3; axis++) {
+			Box bins[BVH_BINS], acc;
+			int counts[BVH_BINS];
+			float rightarea[BVH_BINS];
+			int rightcount[BVH_BINS];
+			float extent = cbox.bmax[axis] - cbox.bmin[axis];
+			float scale;
+			int n_left;
+			if (extent <= 0.0f) continue;
+			scale = BVH_BINS / extent;
+			for (j = 0; j < BVH_BINS; j++) {
+				boxInit(bins + j);
+				counts[j] = 0;
+			}
+			for (i = begin; i < end; i++) {
+				int t = ctx->order[i];
+				int b = (int) ((ctx->centroid[3 * t + axis] - cbox.bmin[axis]) * scale);
+				if (b >= BVH_BINS) b = BVH_BINS - 1;
+				counts[b]++;
+				boxInclude(bins + b, ctx->boxes + t);
+			}
+			/* sweep from the right, then from the left */
+			boxInit(&acc);
+			n_left = 0;
+			for (j = BVH_BINS - 1; j > 0; j--) {
+				boxInclude(&acc, bins + j);
+				n_left += counts[j];
+				rightarea[j] = boxArea(&acc);
+				rightcount[j] = n_left;
+			}
+			boxInit(&acc);
+			n_left = 0;
+			for (j = 0; j < BVH_BINS - 1; j++) {
+				float cost;
+				boxInclude(&acc, bins + j);
+				n_left += counts[j];
+				if (!n_left || !rightcount[j + 1]) continue;
+				cost = BVH_TRAVERSAL_COST * boxArea(&box) +
+					n_left * boxArea(&acc) + rightcount[j + 1] * rightarea[j + 1];
+				if (cost < bestcost) {
+					bestcost = cost;
+					bestaxis = axis;
+					bestbin = j;
+				}
+			}
+		}
+	}
+
+	if (bestaxis >= 0) {
+		/* triangles of bins 0 .. bestbin to the left */
+		float scale = BVH_BINS / (cbox.bmax[bestaxis] - cbox.bmin[bestaxis]);
+		i = begin;
+		j = end - 1;
+		while (i <= j) {
+			int t = ctx->order[i];
+			int b = (int) ((ctx->centroid[3 * t + bestaxis] - cbox.bmin[bestaxis]) * scale);
+			if (b >= BVH_BINS) b = BVH_BINS - 1;
+			if (b <= bestbin) {
+				i++;
+			} else {
+				ctx->order[i] = ctx->order[j];
+				ctx->order[j--] = t;
+			}
+		}
+		mid = i;
+	} else if (count > BVH_LEAF_MAX) {
+		mid = begin + count / 2; /* no useful split */
+	} else {
+		return; /* leaf */
+	}
+
+	left = ctx->used++;
+	buildNode(ctx, left, begin, mid, depth + 1);
+	right = ctx->used++;
+	buildNode(ctx, right, mid, end, depth + 1);
+	node = ctx->nodes + n;
+	node->offset = right;
+	node->count = 0;
+}
+
+int
+bvhBuild(BVHNode* nodes, int* order, const int* indices, int numtriangles,
+		 const float* positions)
+{
+	BuildContext ctx;
+	Box* boxes;
+	float* centroid;
+	int t, k, j;
+
+	if (numtriangles <= 0) return 0;
+	boxes = (Box*) malloc(numtriangles * sizeof(Box));
+	centroid = (float*) malloc(3 * numtriangles * sizeof(float));
+	for (t = 0; t < numtriangles; t++) {
+		boxInit(boxes + t);
+		for (k = 0; k < 3; k++) {
+			const float* p = positions + 3 * indices[3 * t + k];
+			for (j = 0; j < 3; j++) {
+				if (p[j] < boxes[t].bmin[j]) boxes[t].bmin[j] = p[j];
+				if (p[j] > boxes[t].bmax[j]) boxes[t].bmax[j] = p[j];
+			}
+		}
+		for (j = 0; j < 3; j++)
+			centroid[3 * t + j] = 0.5f * (boxes[t].bmin[j] + boxes[t].bmax[j]);
+		order[t] = t;
+	}
+	ctx.nodes = nodes;
+	ctx.order = order;
+	ctx.boxes = boxes;
+	ctx.centroid = centroid;
+	ctx.used = 1;
+	buildNode(&ctx, 0, 0, numtriangles, 0);
+	free(centroid);
+	free(boxes);
+	return ctx.used;
+}
+
+int
+bvhValid(const BVHNode* nodes, int numnodes, const int* order, int numtriangles)
+{
+	int stack[BVH_STACK], depth[BVH_STACK];
+	int top = 0, visited = 0, covered = 0, t;
+
+	if (numnodes <= 0 || numtriangles <= 0) return numnodes == 0;
+	if (numnodes > 2 * numtriangles - 1) return 0;
+	for (t = 0; t < numtriangles; t++)
+		if (order[t] < 0 || order[t] >= numtriangles) return 0;
+	/* depth first, as built: every node once, the leaves covering order in
+	   sequence, and no deeper than the traversal stacks allow */
+	stack[top] = 0;
+	depth[top++] = 0;
+	while (top) {
+		const BVHNode* node;
+		int n, d;
+		top--;
+		n = stack[top];
+		d = depth[top];
+		node = nodes + n;
+		visited++;
+		if (node->count) {
+			if ((int) node->offset != covered || (int) node->count > numtriangles - covered)
+				return 0;
+			covered += node->count;
+			continue;
+		}
+		if (d >= BVH_MAX_DEPTH || n + 1 >= numnodes ||
+			(int) node->offset <= n + 1 || (int) node->offset >= numnodes)
+			return 0;
+		stack[top] = node->offset;
+		depth[top++] = d + 1;
+		stack[top] = n + 1;
+		depth[top++] = d + 1;
+	}
+	return visited == numnodes && covered == numtriangles;
+}
+
+int
+rayTriangle(const float* p0, const float* p1, const float* p2,
+			const float origin[3], const float dir[3], float tmax, float hit[3])
+{
+	float e1[3], e2[3], p[3], s[3], q[3];
+	float det, inv, u, v, t;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		e1[i] = p1[i] - p0[i];
+		e2[i] = p2[i] - p0[i];
+		s[i] = origin[i] - p0[i];
+	}
+	p[0] = dir[1] * e2[2] - dir[2] * e2[1];
+	p[1] = dir[2] * e2[0] - dir[0] * e2[2];
+	p[2] = dir[0] * e2[1] - dir[1] * e2[0];
+	det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if (det == 0.0f) return 0; /* parallel (or degenerate triangle) */
+	inv = 1.0f / det;
+	u = inv * (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]);
+	if (u < 0.0f || u > 1.0f) return 0;
+	q[0] = s[1] * e1[2] - s[2] * e1[1];
+	q[1] = s[2] * e1[0] - s[0] * e1[2];
+	q[2] = s[0] * e1[1] - s[1] * e1[0];
+	v = inv * (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]);
+	if (v < 0.0f || u + v > 1.0f) return 0;
+	t = inv * (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]);
+	if (t <= 0.0f || t >= tmax) return 0;
+	hit[0] = u;
+	hit[1] = v;
+	hit[2] = t;
+	return 1;
+}
+
+/* entry distance of the ray into the box of a node, grown by pad on every
+   side (FLT_MAX if missed) */
+static float
+rayBox(const BVHNode* node, const float origin[3], const float invdir[3], float tmax,
+	   float pad)
+{
+	float tmin = 0.0f;
+	int i;
+	for (i = 0; i < 3; i++) {
+		float t0 = (node->bmin[i] - pad - origin[i]) * invdir[i];
+		float t1 = (node->bmax[i] + pad - origin[i]) * invdir[i];
+		if (t0 > t1) {
+			float tmp = t0;
+			t0 = t1;
+			t1 = tmp;
+		}
+		if (t0 > tmin) tmin = t0;
+		if (t1 < tmax) tmax = t1;
+		if (tmin > tmax) return FLT_MAX;
+	}
+	return tmin;
+}
+
+int
+bvhIntersect(const BVHNode* nodes, const int* order, const int* indices,
+			 const float* positions, const float origin[3], const float dir[3],
+			 float tmax, float hit[3])
+{
+	int stack[BVH_STACK];
+	int top = 0, best = -1, n = 0;
+	float invdir[3];
+	int i;
+
+	if (!nodes) return -1;
+	for (i = 0; i < 3; i++)
+		invdir[i] = 1.0f / dir[i]; /* +-inf for 0 */
+	if (rayBox(nodes, origin, invdir, tmax, 0.0f) == FLT_MAX) return -1;
+	for (;;) {
+		const BVHNode* node = nodes + n;
+		if (node->count) {
+			unsigned int k;
+			for (k = node->offset; k < node->offset + node->count; k++) {
+				const int* tri = indices + 3 * order[k];
+				if (rayTriangle(positions + 3 * tri[0], positions + 3 * tri[1],
+								positions + 3 * tri[2], origin, dir, tmax, hit)) {
+					tmax = hit[2];
+					best = order[k];
+				}
+			}
+		} else {
+			/* visit the nearest child first */
+			int a = n + 1, b = node->offset;
+			float ta = rayBox(nodes + a, origin, invdir, tmax, 0.0f);
+			float tb = rayBox(nodes + b, origin, invdir, tmax, 0.0f);
+			if (tb < ta) {
+				int tmp = a;
+				float tt = ta;
+				a = b;
+				b = tmp;
+				ta = tb;
+				tb = tt;
+			}
+			if (ta != FLT_MAX) {
+				if (tb != FLT_MAX) stack[top++] = b;
+				n = a;
+				continue;
+			}
+		}
+		/* next node on the stack (still in front of the closest hit) */
+		do {
+			if (!top) return best; /* hit is only set by closer hits */
+			n = stack[--top];
+		} while (rayBox(nodes + n, origin, invdir, tmax, 0.0f) == FLT_MAX);
+	}
+}
+
+/* Packets of rays, as SoA: origin[k][i] and invdir[k][i] are coordinate k of
+   ray i. The rays missing from a packet have a negative tmax. */
+typedef struct {
+	float origin[3][4];
+	float invdir[3][4];
+	float tmax[4];
+} Packet;
+
+/* rays of the packet which enter the box of a node before their tmax (bit i
+   for ray i), and where. As rayBox, for the 4 rays at once. */
+static unsigned int
+packetBox(const BVHNode* node, const Packet* p, float tnear[4])
+{
+#ifdef BVH_SSE
+	__m128 tn = _mm_setzero_ps();
+	__m128 tf = _mm_loadu_ps(p->tmax);
+	int i;
+	for (i = 0; i < 3; i++) {
+		__m128 o = _mm_loadu_ps(p->origin[i]);
+		__m128 v = _mm_loadu_ps(p->invdir[i]);
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node->bmin[i]), o), v);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node->bmax[i]), o), v);
+		tn = _mm_max_ps(tn, _mm_min_ps(t0, t1));
+		tf = _mm_min_ps(tf, _mm_max_ps(t0, t1));
+	}
+	_mm_storeu_ps(tnear, tn);
+	return _mm_movemask_ps(_mm_cmple_ps(tn, tf));
+#else
+	unsigned int mask = 0;
+	int i, j;
+	for (j = 0; j < 4; j++) {
+		float tn = 0.0f, tf = p->tmax[j];
+		for (i = 0; i < 3; i++) {
+			float t0 = (node->bmin[i] - p->origin[i][j]) * p->invdir[i][j];
+			float t1 = (node->bmax[i] - p->origin[i][j]) * p->invdir[i][j];
+			if (t0 > t1) {
+				float tmp = t0;
+				t0 = t1;
+				t1 = tmp;
+			}
+			if (t0 > tn) tn = t0;
+			if (t1 < tf) tf = t1;
+		}
+		tnear[j] = tn;
+		if (tn <= tf) mask |= 1u << j;
+	}
+	return mask;
+#endif
+}
+
+/* closest entry of the rays in mask */
+static float
+packetNear(unsigned int mask, const float tnear[4])
+{
+	float t = FLT_MAX;
+	int i;
+	for (i = 0; i < 4; i++)
+		if ((mask & (1u << i)) && tnear[i] < t) t = tnear[i];
+	return t;
+}
+
+int
+bvhIntersect4(const BVHNode* nodes, const int* order, const int* indices,
+			  const float* positions, int numrays, const float origin[][3],
+			  const float dir[][3], const float tmax[], float hit[][3], int tri[])
+{
+	Packet p;
+	int stack[BVH_STACK];
+	int top = 0, hits = 0, n = 0;
+	unsigned int mask;
+	float tnear[4];
+	int i, j;
+
+	for (j = 0; j < 4; j++) {
+		for (i = 0; i < 3; i++) {
+			p.origin[i][j] = j < numrays ? origin[j][i] : 0.0f;
+			p.invdir[i][j] = j < numrays ? 1.0f / dir[j][i] : 1.0f; /* +-inf for 0 */
+		}
+		p.tmax[j] = j < numrays ? tmax[j] : -1.0f;
+		if (j < numrays) tri[j] = -1;
+	}
+	if (!nodes) return 0;
+	mask = packetBox(nodes, &p, tnear);
+	while (mask) {
+		const BVHNode* node = nodes + n;
+		if (node->count) {
+			/* the rays which reach the leaf */
+			for (j = 0; j < 4; j++) {
+				unsigned int k;
+				if (!(mask & (1u << j))) continue;
+				for (k = node->offset; k < node->offset + node->count; k++) {
+					const int* t = indices + 3 * order[k];
+					if (rayTriangle(positions + 3 * t[0], positions + 3 * t[1],
+									positions + 3 * t[2], origin[j], dir[j], p.tmax[j],
+									hit[j])) {
+						p.tmax[j] = hit[j][2];
+						tri[j] = order[k];
+					}
+				}
+			}
+		} else {
+			/* visit first the child the packet reaches first */
+			int a = n + 1, b = node->offset;
+			unsigned int ma = packetBox(nodes + a, &p, tnear);
+			float ta = packetNear(ma, tnear);
+			unsigned int mb = packetBox(nodes + b, &p, tnear);
+			float tb = packetNear(mb, tnear);
+			if (tb < ta) {
+				int tmp = a;
+				unsigned int mtmp = ma;
+				a = b;
+				b = tmp;
+				ma = mb;
+				mb = mtmp;
+			}
+			if (ma) {
+				if (mb) stack[top++] = b;
+				n = a;
+				mask = ma;
+				continue;
+			}
+		}
+		/* next node on the stack (still in front of some closest hit) */
+		mask = 0;
+		while (!mask && top) {
+			n = stack[--top];
+			mask = packetBox(nodes + n, &p, tnear);
+		}
+	}
+	for (j = 0; j < numrays; j++)
+		if (tri[j] != -1) hits++;
+	return hits;
+}
+
+static float
+dot3(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/* closest point q of triangle (p0, p1, p2) to p (Ericson, Real-Time
+   Collision Detection, 5.1.5) */
+static void
+closestPointTriangle(const float* p0, const float* p1, const float* p2,
+					 const float p[3], float q[3])
+{
+	float ab[3], ac[3], ap[3], bp[3], cp[3];
+	float d1, d2, d3, d4, d5, d6, va, vb, vc, v, w, denom;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		ab[i] = p1[i] - p0[i];
+		ac[i] = p2[i] - p0[i];
+		ap[i] = p[i] - p0[i];
+		bp[i] = p[i] - p1[i];
+		cp[i] = p[i] - p2[i];
+	}
+	d1 = dot3(ab, ap);
+	d2 = dot3(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) { /* vertex p0 */
+		for (i = 0; i < 3; i++) q[i] = p0[i];
+		return;
+	}
+	d3 = dot3(ab, bp);
+	d4 = dot3(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) { /* vertex p1 */
+		for (i = 0; i < 3; i++) q[i] = p1[i];
+		return;
+	}
+	vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) { /* edge p0 p1 */
+		v = d1 / (d1 - d3);
+		for (i = 0; i < 3; i++) q[i] = p0[i] + v * ab[i];
+		return;
+	}
+	d5 = dot3(ab, cp);
+	d6 = dot3(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) { /* vertex p2 */
+		for (i = 0; i < 3; i++) q[i] = p2[i];
+		return;
+	}
+	vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) { /* edge p0 p2 */
+		w = d2 / (d2 - d6);
+		for (i = 0; i < 3; i++) q[i] = p0[i] + w * ac[i];
+		return;
+	}
+	va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) { /* edge p1 p2 */
+		w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		for (i = 0; i < 3; i++) q[i] = p1[i] + w * (p2[i] - p1[i]);
+		return;
+	}
+	denom = 1.0f / (va + vb + vc); /* inside the face */
+	v = vb * denom;
+	w = vc * denom;
+	for (i = 0; i < 3; i++) q[i] = p0[i] + v * ab[i] + w * ac[i];
+}
+
+int
+sphereTriangle(const float* p0, const float* p1, const float* p2,
+			   const float center[3], float radius)
+{
+	float q[3], d[3];
+	int i;
+	closestPointTriangle(p0, p1, p2, center, q);
+	for (i = 0; i < 3; i++) d[i] = center[i] - q[i];
+	return dot3(d, d) < radius * radius;
+}
+
+/* smallest root of a t^2 + b t + c = 0, if it is in [0, tmax) */
+static int
+lowestRoot(float a, float b, float c, float tmax, float* root)
+{
+	float det = b * b - 4.0f * a * c;
+	float s, r1, r2;
+	if (det < 0.0f || a == 0.0f) return 0;
+	s = sqrtf(det);
+	r1 = (-b - s) / (2.0f * a);
+	r2 = (-b + s) / (2.0f * a);
+	if (r2 < r1) r1 = r2;
+	if (r1 < 0.0f || r1 >= tmax) return 0;
+	*root = r1;
+	return 1;
+}
+
+int
+sweepSphereTriangle(const float* p0, const float* p1, const float* p2,
+					const float center[3], const float dir[3], float radius,
+					float tmax, float hit[4])
+{
+	const float* v[3];
+	float q[3], n[3], e1[3], e2[3], cq[3], contact[3];
+	float d2, len, best = tmax, a;
+	int found = 0, i, k;
+
+	v[0] = p0;
+	v[1] = p1;
+	v[2] = p2;
+	closestPointTriangle(p0, p1, p2, center, q);
+	for (i = 0; i < 3; i++) cq[i] = center[i] - q[i];
+	d2 = dot3(cq, cq);
+	if (d2 < radius * radius) {
+		/* already touching: only a contact if moving towards the triangle */
+		len = sqrtf(d2);
+		if (len == 0.0f) return 0; /* center on the triangle: no direction */
+		for (i = 0; i < 3; i++) cq[i] /= len;
+		if (dot3(dir, cq) >= 0.0f || tmax <= 0.0f) return 0;
+		hit[0] = 0.0f;
+		for (i = 0; i < 3; i++) hit[i + 1] = cq[i];
+		return 1;
+	}
+
+	/* the face: the sphere touches the plane inside the triangle */
+	for (i = 0; i < 3; i++) {
+		e1[i] = p1[i] - p0[i];
+		e2[i] = p2[i] - p0[i];
+	}
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	len = sqrtf(dot3(n, n));
+	if (len > 0.0f) {
+		float dist, nd, t;
+		for (i = 0; i < 3; i++) n[i] /= len;
+		for (i = 0; i < 3; i++) cq[i] = center[i] - p0[i];
+		dist = dot3(n, cq);
+		if (dist < 0.0f) { /* two-sided: the normal towards the sphere */
+			for (i = 0; i < 3; i++) n[i] = -n[i];
+			dist = -dist;
+		}
+		nd = dot3(n, dir);
+		if (nd < 0.0f) {
+			/* (dist < radius without touching: a contact on an edge, or
+			   rounding of a sphere just touching the face) */
+			t = dist > radius ? (dist - radius) / -nd : 0.0f;
+			if (t < best) {
+				float P[3];
+				for (i = 0; i < 3; i++) P[i] = center[i] + t * dir[i] - radius * n[i];
+				closestPointTriangle(p0, p1, p2, P, q);
+				for (i = 0; i < 3; i++) cq[i] = P[i] - q[i];
+				if (dot3(cq, cq) <= 1e-10f * dot3(e1, e1)) {
+					/* the first contact (vertices and edges can't come earlier) */
+					hit[0] = t;
+					for (i = 0; i < 3; i++) hit[i + 1] = n[i];
+					return 1;
+				}
+			}
+		}
+	}
+
+	/* the vertices: ray vs sphere of the vertex */
+	a = dot3(dir, dir);
+	for (k = 0; k < 3; k++) {
+		float b, c, t;
+		for (i = 0; i < 3; i++) cq[i] = center[i] - v[k][i];
+		b = 2.0f * dot3(dir, cq);
+		c = dot3(cq, cq) - radius * radius;
+		if (lowestRoot(a, b, c, best, &t)) {
+			best = t;
+			found = 1;
+			for (i = 0; i < 3; i++) contact[i] = v[k][i];
+		}
+	}
+
+	/* the edges: ray vs cylinder of the edge */
+	for (k = 0; k < 3; k++) {
+		const float* pa = v[k];
+		const float* pb = v[(k + 1) % 3];
+		float edge[3], base[3], esq, ed, eb, t;
+		for (i = 0; i < 3; i++) {
+			edge[i] = pb[i] - pa[i];
+			base[i] = pa[i] - center[i];
+		}
+		esq = dot3(edge, edge);
+		ed = dot3(edge, dir);
+		eb = dot3(edge, base);
+		if (lowestRoot(esq * -a + ed * ed, esq * 2.0f * dot3(dir, base) - 2.0f * ed * eb,
+					   esq * (radius * radius - dot3(base, base)) + eb * eb, best, &t)) {
+			float f = (ed * t - eb) / esq;
+			if (f >= 0.0f && f <= 1.0f) {
+				best = t;
+				found = 1;
+				for (i = 0; i < 3; i++) contact[i] = pa[i] + f * edge[i];
+			}
+		}
+	}
+	if (!found) return 0;
+	hit[0] = best;
+	for (i = 0; i < 3; i++) hit[i + 1] = (center[i] + best * dir[i] - contact[i]) / radius;
+	return 1;
+}
+
+/* distance from point p to the box of a node, squared */
+static float
+pointBox2(const BVHNode* node, const float p[3])
+{
+	float d2 = 0.0f;
+	int i;
+	for (i = 0; i < 3; i++) {
+		float d = 0.0f;
+		if (p[i] < node->bmin[i]) d = node->bmin[i] - p[i];
+		else if (p[i] > node->bmax[i]) d = p[i] - node->bmax[i];
+		d2 += d * d;
+	}
+	return d2;
+}
+
+int
+bvhSphere(const BVHNode* nodes, const int* order, const int* indices,
+		  const float* positions, const float center[3], float radius)
+{
+	int stack[BVH_STACK];
+	int top = 0, n = 0;
+	float r2 = radius * radius;
+
+	if (!nodes) return -1;
+	stack[top++] = 0;
+	while (top) {
+		const BVHNode* node;
+		n = stack[--top];
+		node = nodes + n;
+		if (pointBox2(node, center) >= r2) continue;
+		if (node->count) {
+			unsigned int k;
+			for (k = node->offset; k < node->offset + node->count; k++) {
+				const int* tri = indices + 3 * order[k];
+				if (sphereTriangle(positions + 3 * tri[0], positions + 3 * tri[1],
+								   positions + 3 * tri[2], center, radius))
+					return order[k];
+			}
+		} else {
+			stack[top++] = node->offset;
+			stack[top++] = n + 1;
+		}
+	}
+	return -1;
+}
+
+int
+bvhSweepSphere(const BVHNode* nodes, const int* order, const int* indices,
+			   const float* positions, const float center[3], const float dir[3],
+			   float radius, float tmax, float hit[4])
+{
+	int stack[BVH_STACK];
+	int top = 0, best = -1, n = 0;
+	float invdir[3];
+	int i;
+
+	if (!nodes) return -1;
+	for (i = 0; i < 3; i++)
+		invdir[i] = 1.0f / dir[i]; /* +-inf for 0 */
+	/* the boxes grown by the radius, against the path of the center */
+	if (rayBox(nodes, center, invdir, tmax, radius) == FLT_MAX) return -1;
+	for (;;) {
+		const BVHNode* node = nodes + n;
+		if (node->count) {
+			unsigned int k;
+			for (k = node->offset; k < node->offset + node->count; k++) {
+				const int* tri = indices + 3 * order[k];
+				if (sweepSphereTriangle(positions + 3 * tri[0], positions + 3 * tri[1],
+										positions + 3 * tri[2], center, dir, radius, tmax, hit)) {
+					tmax = hit[0];
+					best = order[k];
+				}
+			}
+		} else {
+			int a = n + 1, b = node->offset;
+			float ta = rayBox(nodes + a, center, invdir, tmax, radius);
+			float tb = rayBox(nodes + b, center, invdir, tmax, radius);
+			if (tb < ta) {
+				int tmp = a;
+				float tt = ta;
+				a = b;
+				b = tmp;
+				ta = tb;
+				tb = tt;
+			}
+			if (ta != FLT_MAX) {
+				if (tb != FLT_MAX) stack[top++] = b;
+				n = a;
+				continue;
+			}
+		}
+		do {
+			if (!top) return best;
+			n = stack[--top];
+		} while (rayBox(nodes + n, center, invdir, tmax, radius) == FLT_MAX);
+	}
+}
@@ -0,0 +1,142 @@
+/*
+  bvh.h
+
+  Bounding volume hierarchy (BVH) of the triangles of a mesh, for ray
+  queries.
+
+  The BVH is built top-down, splitting every node with the binned surface
+  area heuristic (SAH): triangle centroids are binned along each axis, and
+  the node is split at the bin boundary with the lowest estimated cost
+  (area of each side times its number of triangles). Nodes are 32 bytes,
+  stored depth first, so the first child of an inner node is the node
+  right after it.
+
+  Besides rays, the BVH answers sphere queries (overlap, and first contact
+  of a moving sphere), for collisions.
+*/
+#ifndef BVH_H
+#define BVH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	float bmin[3];
+	float bmax[3];
+	unsigned int offset; /* inner node: second child. leaf: first triangle in order */
+	unsigned int count;  /* number of triangles of a leaf. 0 for inner nodes */
+} BVHNode;
+
+/* bvhBuild: build the BVH of a triangle mesh.
+ *
+ * nodes        - on return, the nodes of the BVH (node 0 is the root). Must
+ *                have space for 2 * numtriangles - 1 nodes.
+ * order        - on return, the triangles in leaf order (leaves point to
+ *                ranges of it). Must have space for numtriangles ints.
+ * indices      - 3 * numtriangles position indices
+ * numtriangles - number of triangles
+ * positions    - positions (x, y, z)
+ *
+ * returns the number of nodes (0 if there are no triangles).
+ */
+int
+bvhBuild(BVHNode* nodes, int* order, const int* indices, int numtriangles,
+		 const float* positions);
+
+/* bvhValid: whether nodes and order are a BVH of numtriangles triangles as
+ * bvhBuild makes them (for BVHs read from files). Returns 1 if valid.
+ */
+int
+bvhValid(const BVHNode* nodes, int numnodes, const int* order, int numtriangles);
+
+/* bvhIntersect: closest intersection of a ray with the triangles of a BVH.
+ *
+ * nodes, order - the BVH (see bvhBuild)
+ * indices      - 3 * numtriangles position indices
+ * positions    - positions (x, y, z)
+ * origin, dir  - the ray: origin + t * dir
+ * tmax         - only intersections with 0 < t < tmax count
+ * hit          - on return (if there is an intersection) u, v and t of the
+ *                closest one. The point is (1 - u - v) P0 + u P1 + v P2.
+ *
+ * returns the triangle intersected (-1 if none). Triangles are two-sided.
+ */
+int
+bvhIntersect(const BVHNode* nodes, const int* order, const int* indices,
+			 const float* positions, const float origin[3], const float dir[3],
+			 float tmax, float hit[3]);
+
+/* bvhIntersect4: as bvhIntersect, for a packet of up to 4 rays at once.
+ *
+ * The rays traverse the BVH together: a node is visited if some ray reaches
+ * its box before its closest intersection so far, and every box is tested
+ * against the 4 rays at once (SSE). Best for coherent rays (neighbour
+ * pixels, samples of the same light), which visit mostly the same nodes.
+ *
+ * numrays      - number of rays (1 to 4)
+ * origin, dir  - ray i is origin[i] + t * dir[i]
+ * tmax         - only intersections with 0 < t < tmax[i] count for ray i
+ * hit, tri     - on return, the result of bvhIntersect for ray i: tri[i] is
+ *                the triangle (-1 if none), and hit[i] its u, v and t
+ *
+ * returns the number of rays which intersect some triangle.
+ */
+int
+bvhIntersect4(const BVHNode* nodes, const int* order, const int* indices,
+			  const float* positions, int numrays, const float origin[][3],
+			  const float dir[][3], const float tmax[], float hit[][3], int tri[]);
+
+/* rayTriangle: intersection of a ray with triangle (p0, p1, p2), as in
+ * bvhIntersect. Returns whether there is an intersection with 0 < t < tmax.
+ */
+int
+rayTriangle(const float* p0, const float* p1, const float* p2,
+			const float origin[3], const float dir[3], float tmax, float hit[3]);
+
+/* bvhSphere: whether a sphere intersects the triangles of a BVH.
+ *
+ * returns a triangle the sphere intersects (-1 if none).
+ */
+int
+bvhSphere(const BVHNode* nodes, const int* order, const int* indices,
+		  const float* positions, const float center[3], float radius);
+
+/* bvhSweepSphere: first contact of a moving sphere with the triangles of a
+ * BVH.
+ *
+ * center, dir  - the sphere moves from center to center + tmax * dir
+ * radius       - radius of the sphere
+ * hit          - on return (if there is a contact) t of the first contact,
+ *                and the unit normal of the contact (from the triangle
+ *                towards the center of the sphere)
+ *
+ * returns the triangle of the first contact (-1 if none). See
+ * sweepSphereTriangle.
+ */
+int
+bvhSweepSphere(const BVHNode* nodes, const int* order, const int* indices,
+			   const float* positions, const float center[3], const float dir[3],
+			   float radius, float tmax, float hit[4]);
+
+/* sphereTriangle: whether a sphere intersects triangle (p0, p1, p2) */
+int
+sphereTriangle(const float* p0, const float* p1, const float* p2,
+			   const float center[3], float radius);
+
+/* sweepSphereTriangle: first contact of a moving sphere with triangle (p0,
+ * p1, p2), as in bvhSweepSphere, with 0 <= t < tmax. The face, the edges and
+ * the vertices are tested. A sphere which already intersects the triangle
+ * touches it at t = 0 if it moves towards it, and never if it moves away
+ * (so that it can get out).
+ */
+int
+sweepSphereTriangle(const float* p0, const float* p1, const float* p2,
+					const float center[3], const float dir[3], float radius,
+					float tmax, float hit[4]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
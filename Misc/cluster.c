@@ -0,0 +1,286 @@
+/*
+  cluster.c
+
+  Mesh clusters (meshlets). See cluster.h
+
+  Seeds are taken in Morton order of the triangle centroids, so that
+  consecutive clusters are spatially close. When a cluster runs out of
+  neighbor triangles (disconnected parts, or seams where positions are
+  duplicated) it continues with the next free triangles along the Morton
+  curve.
+*/
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cluster.h"
+
+/* Number of triangles taken from the Morton curve when a cluster has no
+ * neighbor triangles left.
+ */
+#define CLUSTER_FALLBACK 8
+
+typedef struct {
+	unsigned int code;
+	int tri;
+} MortonKey;
+
+/* spread the 10 lower bits of x so that there are two zeros between them */
+static unsigned int
+mortonSpread(unsigned int x)
+{
+	x &= 0x3ff;
+	x = (x | (x << 16)) & 0x030000ff;
+	x = (x | (x << 8)) & 0x0300f00f;
+	x = (x | (x << 4)) & 0x030c30c3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+static int
+mortonCompare(const void* a, const void* b)
+{
+	const MortonKey* ka = (const MortonKey*) a;
+	const MortonKey* kb = (const MortonKey*) b;
+	if (ka->code != kb->code) return ka->code < kb->code ? -1 : 1;
+	return ka->tri - kb->tri;
+}
+
+/* triangleNormal: (area weighted) normal of triangle t */
+static void
+triangleNormal(float n[3], const int* indices, int t, const float* positions)
+{
+	const float* p0 = positions + 3 * indices[3 * t];
+	const float* p1 = positions + 3 * indices[3 * t + 1];
+	const float* p2 = positions + 3 * indices[3 * t + 2];
+	float e1[3], e2[3];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		e1[i] = p1[i] - p0[i];
+		e2[i] = p2[i] - p0[i];
+	}
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+int
+clusterMesh(int* order, int* starts, const int* indices, int numtriangles,
+			const float* positions, int numvertices, int maxtriangles)
+{
+	int* vstart;     /* triangles of position v: vtris[vstart[v]] ... */
+	int* vtris;      /* ... vtris[vstart[v + 1] - 1] */
+	float* centroid;
+	float* normal;   /* unit normals (zero for degenerate triangles) */
+	MortonKey* keys;
+	char* assigned;
+	int* stamp;      /* cluster + 1 if the triangle is a candidate of it */
+	int* cand;
+	float lo[3], hi[3], scale[3];
+	int ncand, nclusters, emitted, cursor;
+	int i, j, k, t, v;
+
+	if (numtriangles <= 0) {
+		starts[0] = 0;
+		return 0;
+	}
+	if (maxtriangles < 1) maxtriangles = 1;
+
+	/* position to triangle adjacency */
+	vstart = (int*) calloc(numvertices + 1, sizeof(int));
+	vtris = (int*) malloc(3 * numtriangles * sizeof(int));
+	for (i = 0; i < 3 * numtriangles; i++)
+		vstart[indices[i] + 1]++;
+	for (v = 0; v < numvertices; v++)
+		vstart[v + 1] += vstart[v];
+	for (t = 0; t < numtriangles; t++) {
+		for (k = 0; k < 3; k++) {
+			v = indices[3 * t + k];
+			vtris[vstart[v]++] = t;
+		}
+	}
+	for (v = numvertices; v > 0; v--)
+		vstart[v] = vstart[v - 1];
+	vstart[0] = 0;
+
+	/* centroids, normals and Morton order of the centroids */
+	centroid = (float*) malloc(3 * numtriangles * sizeof(float));
+	normal = (float*) malloc(3 * numtriangles * sizeof(float));
+	for (i = 0; i < 3; i++) {
+		lo[i] = FLT_MAX;
+		hi[i] = -FLT_MAX;
+	}
+	for (t = 0; t < numtriangles; t++) {
+		float* c = centroid + 3 * t;
+		float* n = normal + 3 * t;
+		float len;
+		for (i = 0; i < 3; i++) {
+			c[i] = (positions[3 * indices[3 * t] + i] +
+					positions[3 * indices[3 * t + 1] + i] +
+					positions[3 * indices[3 * t + 2] + i]) / 3.0f;
+			if (c[i] < lo[i]) lo[i] = c[i];
+			if (c[i] > hi[i]) hi[i] = c[i];
+		}
+		triangleNormal(n, indices, t, positions);
+		len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (i = 0; i < 3; i++)
+			n[i] = len > 0.0f ? n[i] / len : 0.0f;
+	}
+	for (i = 0; i < 3; i++)
+		scale[i] = hi[i] > lo[i] ? 1023.0f / (hi[i] - lo[i]) : 0.0f;
+	keys = (MortonKey*) malloc(numtriangles * sizeof(MortonKey));
+	for (t = 0; t < numtriangles; t++) {
+		const float* c = centroid + 3 * t;
+		keys[t].code = mortonSpread((unsigned int) ((c[0] - lo[0]) * scale[0])) |
+			(mortonSpread((unsigned int) ((c[1] - lo[1]) * scale[1])) << 1) |
+			(mortonSpread((unsigned int) ((c[2] - lo[2]) * scale[2])) << 2);
+		keys[t].tri = t;
+	}
+	qsort(keys, numtriangles, sizeof(MortonKey), mortonCompare);
+
+	/* grow the clusters */
+	assigned = (char*) calloc(numtriangles, 1);
+	stamp = (int*) calloc(numtriangles, sizeof(int));
+	cand = (int*) malloc(numtriangles * sizeof(int));
+	nclusters = 0;
+	emitted = 0;
+	cursor = 0;
+	for (;;) {
+		float center[3] = { 0.0f, 0.0f, 0.0f };
+		float axis[3] = { 0.0f, 0.0f, 0.0f };
+		int count = 0;
+
+		while (cursor < numtriangles && assigned[keys[cursor].tri]) cursor++;
+		if (cursor == numtriangles) break;
+		starts[nclusters] = emitted;
+		cand[0] = keys[cursor].tri;
+		stamp[cand[0]] = nclusters + 1;
+		ncand = 1;
+		while (count < maxtriangles) {
+			int best = -1;
+			float bestcost = FLT_MAX;
+			float inv, alen;
+			if (ncand == 0) {
+				/* no neighbors left: continue along the Morton curve */
+				for (j = cursor; j < numtriangles && ncand < CLUSTER_FALLBACK; j++) {
+					t = keys[j].tri;
+					if (assigned[t] || stamp[t] == nclusters + 1) continue;
+					stamp[t] = nclusters + 1;
+					cand[ncand++] = t;
+				}
+				if (ncand == 0) break;
+			}
+			/* closest candidate to the center, facing the way of the
+			   cluster */
+			inv = count ? 1.0f / count : 0.0f;
+			alen = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+			for (j = 0; j < ncand; j++) {
+				const float* c = centroid + 3 * cand[j];
+				const float* n = normal + 3 * cand[j];
+				float dx = c[0] - center[0] * inv;
+				float dy = c[1] - center[1] * inv;
+				float dz = c[2] - center[2] * inv;
+				float facing = alen > 0.0f ?
+					(n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]) / alen : 1.0f;
+				float cost = sqrtf(dx * dx + dy * dy + dz * dz) * (2.0f - facing);
+				if (cost < bestcost) {
+					bestcost = cost;
+					best = j;
+				}
+			}
+			t = cand[best];
+			cand[best] = cand[--ncand];
+			assigned[t] = 1;
+			order[emitted++] = t;
+			count++;
+			for (i = 0; i < 3; i++) {
+				center[i] += centroid[3 * t + i];
+				axis[i] += normal[3 * t + i];
+			}
+			/* new candidates: free triangles sharing a position with t */
+			for (k = 0; k < 3; k++) {
+				v = indices[3 * t + k];
+				for (j = vstart[v]; j < vstart[v + 1]; j++) {
+					int u = vtris[j];
+					if (assigned[u] || stamp[u] == nclusters + 1) continue;
+					stamp[u] = nclusters + 1;
+					cand[ncand++] = u;
+				}
+			}
+		}
+		nclusters++;
+	}
+	starts[nclusters] = emitted;
+
+	free(cand);
+	free(stamp);
+	free(assigned);
+	free(keys);
+	free(normal);
+	free(centroid);
+	free(vtris);
+	free(vstart);
+	return nclusters;
+}
+
+void
+clusterBounds(float bounds[8], const int* indices, int numtriangles,
+			  const float* positions)
+{
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	float axis[3] = { 0.0f, 0.0f, 0.0f };
+	float radius2 = 0.0f, len, mindot = 1.0f;
+	int i, k, t;
+
+	memset(bounds, 0, 8 * sizeof(float));
+	bounds[6] = 1.0f;
+	bounds[7] = 1.0f;
+	if (numtriangles <= 0) return;
+
+	/* sphere around the box of the triangles */
+	for (i = 0; i < 3 * numtriangles; i++) {
+		const float* p = positions + 3 * indices[i];
+		for (k = 0; k < 3; k++) {
+			if (p[k] < lo[k]) lo[k] = p[k];
+			if (p[k] > hi[k]) hi[k] = p[k];
+		}
+	}
+	for (k = 0; k < 3; k++)
+		bounds[k] = 0.5f * (lo[k] + hi[k]);
+	for (i = 0; i < 3 * numtriangles; i++) {
+		const float* p = positions + 3 * indices[i];
+		float dx = p[0] - bounds[0], dy = p[1] - bounds[1], dz = p[2] - bounds[2];
+		float d2 = dx * dx + dy * dy + dz * dz;
+		if (d2 > radius2) radius2 = d2;
+	}
+	bounds[3] = sqrtf(radius2);
+
+	/* cone around the (area weighted) mean normal */
+	for (t = 0; t < numtriangles; t++) {
+		float n[3];
+		triangleNormal(n, indices, t, positions);
+		for (k = 0; k < 3; k++)
+			axis[k] += n[k];
+	}
+	len = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	if (len <= 0.0f) return;
+	for (k = 0; k < 3; k++)
+		axis[k] /= len;
+	for (t = 0; t < numtriangles; t++) {
+		float n[3], d;
+		triangleNormal(n, indices, t, positions);
+		len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len <= 0.0f) continue; /* degenerate: never visible */
+		d = (n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]) / len;
+		if (d < mindot) mindot = d;
+	}
+	for (k = 0; k < 3; k++)
+		bounds[4 + k] = axis[k];
+	/* all the triangles face away from P when the angle between
+	   center - P and the axis is below 90 degrees minus the cone angle */
+	if (mindot > 0.0f)
+		bounds[7] = sqrtf(1.0f - mindot * mindot);
+}
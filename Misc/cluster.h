@@ -0,0 +1,58 @@
+/*
+  cluster.h
+
+  Split a triangle mesh into clusters (meshlets) of nearby triangles, and
+  compute the bounds of a cluster: a bounding sphere and a cone containing
+  the normals of its triangles.
+
+  Clusters are grown greedily over the triangles sharing a position with
+  the cluster, preferring the ones closest to its center and facing its
+  way, so that clusters are compact and (mostly) flat, which makes them
+  easy to cull.
+*/
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* clusterMesh: group triangles into clusters.
+ *
+ * order        - on return, the triangles (0 .. numtriangles - 1) in
+ *                cluster order. Must have space for numtriangles ints.
+ * starts       - on return, starts[c] is the position in order of the first
+ *                triangle of cluster c, and starts[nclusters] is
+ *                numtriangles. Must have space for numtriangles + 1 ints.
+ * indices      - 3 * numtriangles position indices
+ * numtriangles - number of triangles
+ * positions    - positions (x, y, z)
+ * numvertices  - number of positions
+ * maxtriangles - maximum number of triangles of a cluster
+ *
+ * returns the number of clusters.
+ */
+int
+clusterMesh(int* order, int* starts, const int* indices, int numtriangles,
+			const float* positions, int numvertices, int maxtriangles);
+
+/* clusterBounds: bounds of a set of triangles.
+ *
+ * bounds       - on return, the bounding sphere (center x, y, z, radius)
+ *                and the normal cone (axis x, y, z, cutoff). The triangles
+ *                are all back-facing from any point P with
+ *                dot(center - P, axis) >= cutoff * |center - P| + radius.
+ *                cutoff is 1 when the cone is too wide to cull anything.
+ * indices      - 3 * numtriangles position indices
+ * numtriangles - number of triangles
+ * positions    - positions (x, y, z)
+ */
+void
+clusterBounds(float bounds[8], const int* indices, int numtriangles,
+			  const float* positions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,18 +20,12 @@
 #include <string.h>
 #include <assert.h>
 #include "glm.h"
+#include "weld.h"
 
 
 #define T(x) (model->triangles[(x)])
 
 
-/* _GLMnode: general purpose node */
-typedef struct _GLMnode {
-	GLuint index;
-	GLboolean averaged;
-	struct _GLMnode* next;
-} GLMnode;
-
 
 /* glmMax: returns the maximum of two floats */
 static GLfloat
@@ -97,65 +91,39 @@ glmNormalize(GLfloat* v)
 	v[2] /= l;
 }
 
-/* glmEqual: compares two vectors and returns GL_TRUE if they are
- * equal (within a certain threshold) or GL_FALSE if not. An epsilon
- * that works fairly well is 0.000001.
- *
- * u - array of 3 GLfloats (GLfloat u[3])
- * v - array of 3 GLfloats (GLfloat v[3])
- */
-static GLboolean
-glmEqual(GLfloat* u, GLfloat* v, GLfloat epsilon)
-{
-	if (glmAbs(u[0] - v[0]) < epsilon &&
-		glmAbs(u[1] - v[1]) < epsilon &&
-		glmAbs(u[2] - v[2]) < epsilon)
-		{
-			return GL_TRUE;
-		}
-	return GL_FALSE;
-}
-
 /* glmWeldVectors: eliminate (weld) vectors that are within an
  * epsilon of each other.
  *
  * vectors     - array of GLfloat[3]'s to be welded
  * numvectors - number of GLfloat[3]'s in vectors
- * epsilon     - maximum difference between vectors
+ * epsilon     - maximum difference between vectors (if <= 0, only
+ *               equal vectors are welded)
  *
+ * Uses the spatial hash welder (see weld.h), so it runs in linear time
+ * instead of comparing every vector against all previous copies.
  */
 GLfloat*
 glmWeldVectors(GLfloat* vectors, GLuint* numvectors, GLfloat epsilon)
 {
 	GLfloat* copies;
 	GLuint copied;
-	GLuint i, j;
+	GLuint i;
+	int* idxmap;
 
 	copies = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (*numvectors + 1));
-	memcpy(copies, vectors, (sizeof(GLfloat) * 3 * (*numvectors + 1)));
-
-	copied = 1;
-	for (i = 1; i <= *numvectors; i++) {
-		for (j = 1; j <= copied; j++) {
-			if (glmEqual(&vectors[3 * i], &copies[3 * j], epsilon)) {
-				goto duplicate;
-			}
-		}
+	idxmap = (int*)malloc(sizeof(int) * (*numvectors + 1));
 
-		/* must not be any duplicates -- add to the copies array */
-		copies[3 * copied + 0] = vectors[3 * i + 0];
-		copies[3 * copied + 1] = vectors[3 * i + 1];
-		copies[3 * copied + 2] = vectors[3 * i + 2];
-		j = copied;             /* pass this along for below */
-		copied++;
+	copied = weldVectors(&vectors[3], *numvectors, 3, epsilon,
+						 &copies[3], idxmap);
 
-	duplicate:
+	for (i = 1; i <= *numvectors; i++) {
 		/* set the first component of this vector to point at the correct
 		   index into the new copies array */
-		vectors[3 * i + 0] = (GLfloat)j;
+		vectors[3 * i + 0] = (GLfloat)(idxmap[i - 1] + 1);
 	}
+	free(idxmap);
 
-	*numvectors = copied-1;
+	*numvectors = copied;
 	return copies;
 }
 
@@ -1026,14 +994,15 @@ glmFacetNormals(GLMmodel* model)
 GLvoid
 glmVertexNormals(GLMmodel* model, GLfloat angle)
 {
-	GLMnode* node;
-	GLMnode* tail;
-	GLMnode** members;
+	GLuint* start;
+	GLuint* members;
+	GLboolean* averaged;
 	GLfloat* normals;
+	GLfloat* facet;
 	GLuint numnormals;
 	GLfloat average[3];
 	GLfloat dot, cos_angle;
-	GLuint i, avg;
+	GLuint i, j, k, v, avg;
 
 	assert(model);
 	assert(model->facetnorms);
@@ -1049,57 +1018,53 @@ glmVertexNormals(GLMmodel* model, GLfloat angle)
 	model->numnormals = model->numtriangles * 3; /* 3 normals per triangle */
 	model->normals = (GLfloat*)malloc(sizeof(GLfloat)* 3* (model->numnormals+1));
 
-	/* allocate a structure that will hold a linked list of triangle
-	   indices for each vertex */
-	members = (GLMnode**)malloc(sizeof(GLMnode*) * (model->numvertices + 1));
+	/* build, for each vertex, the list of triangles it is in. Lists are
+	   stored back to back in members: the triangles of vertex i are
+	   members[start[i]] ... members[start[i+1]-1], newest triangle first */
+	start = (GLuint*)malloc(sizeof(GLuint) * (model->numvertices + 2));
+	members = (GLuint*)malloc(sizeof(GLuint) * (3 * model->numtriangles + 1));
+	averaged = (GLboolean*)malloc(sizeof(GLboolean) * (3 * model->numtriangles + 1));
+	for (i = 0; i <= model->numvertices + 1; i++)
+		start[i] = 0;
+	for (i = 0; i < model->numtriangles; i++)
+		for (j = 0; j < 3; j++)
+			start[T(i).vindices[j] + 1]++;
 	for (i = 1; i <= model->numvertices; i++)
-		members[i] = NULL;
-
-	/* for every triangle, create a node for each vertex in it */
-	for (i = 0; i < model->numtriangles; i++) {
-		node = (GLMnode*)malloc(sizeof(GLMnode));
-		node->index = i;
-		node->next  = members[T(i).vindices[0]];
-		members[T(i).vindices[0]] = node;
-
-		node = (GLMnode*)malloc(sizeof(GLMnode));
-		node->index = i;
-		node->next  = members[T(i).vindices[1]];
-		members[T(i).vindices[1]] = node;
-
-		node = (GLMnode*)malloc(sizeof(GLMnode));
-		node->index = i;
-		node->next  = members[T(i).vindices[2]];
-		members[T(i).vindices[2]] = node;
-	}
+		start[i + 1] += start[i];
+	/* fill in reverse order, using start[i] as the insertion point */
+	for (i = model->numtriangles; i-- > 0; )
+		for (j = 0; j < 3; j++)
+			members[start[T(i).vindices[j]]++] = i;
+	/* insertion moved start[i] to the start of vertex i+1; shift back */
+	for (i = model->numvertices + 1; i > 1; i--)
+		start[i] = start[i - 1];
+	start[1] = 0;
 
 	/* calculate the average normal for each vertex */
 	numnormals = 1;
 	for (i = 1; i <= model->numvertices; i++) {
 		/* calculate an average normal for this vertex by averaging the
 		   facet normal of every triangle this vertex is in */
-		node = members[i];
-		if (!node)
+		if (start[i] == start[i + 1])
 			fprintf(stderr, "glmVertexNormals(): vertex w/o a triangle\n");
 		average[0] = 0.0; average[1] = 0.0; average[2] = 0.0;
 		avg = 0;
-		while (node) {
+		for (k = start[i]; k < start[i + 1]; k++) {
 			/* only average if the dot product of the angle between the two
 			   facet normals is greater than the cosine of the threshold
 			   angle -- or, said another way, the angle between the two
 			   facet normals is less than (or equal to) the threshold angle */
-			dot = glmDot(&model->facetnorms[3 * T(node->index).findex],
-						 &model->facetnorms[3 * T(members[i]->index).findex]);
+			facet = &model->facetnorms[3 * T(members[k]).findex];
+			dot = glmDot(facet, &model->facetnorms[3 * T(members[start[i]]).findex]);
 			if (dot > cos_angle) {
-				node->averaged = GL_TRUE;
-				average[0] += model->facetnorms[3 * T(node->index).findex + 0];
-				average[1] += model->facetnorms[3 * T(node->index).findex + 1];
-				average[2] += model->facetnorms[3 * T(node->index).findex + 2];
+				averaged[k] = GL_TRUE;
+				average[0] += facet[0];
+				average[1] += facet[1];
+				average[2] += facet[2];
 				avg = 1;            /* we averaged at least one normal! */
 			} else {
-				node->averaged = GL_FALSE;
+				averaged[k] = GL_FALSE;
 			}
-			node = node->next;
 		}
 
 		if (avg) {
@@ -1115,48 +1080,34 @@ glmVertexNormals(GLMmodel* model, GLfloat angle)
 		}
 
 		/* set the normal of this vertex in each triangle it is in */
-		node = members[i];
-		while (node) {
-			if (node->averaged) {
-				/* if this node was averaged, use the average normal */
-				if (T(node->index).vindices[0] == i)
-					T(node->index).nindices[0] = avg;
-				else if (T(node->index).vindices[1] == i)
-					T(node->index).nindices[1] = avg;
-				else if (T(node->index).vindices[2] == i)
-					T(node->index).nindices[2] = avg;
+		for (k = start[i]; k < start[i + 1]; k++) {
+			GLMtriangle* triangle = &T(members[k]);
+			if (averaged[k]) {
+				/* if this triangle was averaged, use the average normal */
+				v = avg;
 			} else {
-				/* if this node wasn't averaged, use the facet normal */
-				model->normals[3 * numnormals + 0] =
-					model->facetnorms[3 * T(node->index).findex + 0];
-				model->normals[3 * numnormals + 1] =
-					model->facetnorms[3 * T(node->index).findex + 1];
-				model->normals[3 * numnormals + 2] =
-					model->facetnorms[3 * T(node->index).findex + 2];
-				if (T(node->index).vindices[0] == i)
-					T(node->index).nindices[0] = numnormals;
-				else if (T(node->index).vindices[1] == i)
-					T(node->index).nindices[1] = numnormals;
-				else if (T(node->index).vindices[2] == i)
-					T(node->index).nindices[2] = numnormals;
-				numnormals++;
+				/* if this triangle wasn't averaged, use the facet normal */
+				facet = &model->facetnorms[3 * triangle->findex];
+				model->normals[3 * numnormals + 0] = facet[0];
+				model->normals[3 * numnormals + 1] = facet[1];
+				model->normals[3 * numnormals + 2] = facet[2];
+				v = numnormals++;
 			}
-			node = node->next;
+			if (triangle->vindices[0] == i)
+				triangle->nindices[0] = v;
+			else if (triangle->vindices[1] == i)
+				triangle->nindices[1] = v;
+			else if (triangle->vindices[2] == i)
+				triangle->nindices[2] = v;
 		}
 	}
 
 	model->numnormals = numnormals - 1;
 
 	/* free the member information */
-	for (i = 1; i <= model->numvertices; i++) {
-		node = members[i];
-		while (node) {
-			tail = node;
-			node = node->next;
-			free(tail);
-		}
-	}
+	free(averaged);
 	free(members);
+	free(start);
 
 	/* pack the normals array (we previously allocated the maximum
 	   number of normals that could possibly be created (numtriangles *
@@ -252,6 +252,7 @@ glmList(GLMmodel* model, GLuint mode);
  * model      - initialized GLMmodel structure
  * epsilon    - maximum difference between vertices
  *              ( 0.00001 is a good start for a unitized model)
+ *              If <= 0, only equal vertices are welded.
  *
  */
 GLvoid
@@ -18,6 +18,7 @@
 #include "cameraManager.h"
 #include "avatarManager.h"
 #include "textureManager.h"
+#include "animationManager.h"
 #include "json.h"
 
 using std::string;
@@ -371,6 +372,7 @@ static Texture::type_t check_texture_type(const string & type) {
 	if (type == "tex") return Texture::tex;
 	if (type == "rt_depth") return Texture::rt_depth;
 	if (type == "rt_color") return Texture::rt_color;
+	if (type == "rt_rgba") return Texture::rt_rgba;
 	if (type == "cubemap") return Texture::cubemap;
 	if (type == "bumpmap") return Texture::bumpmap;
 	if (type == "proj") return Texture::proj;
@@ -418,6 +420,7 @@ static void populate_textures(Json::Value & textures) {
 			break;
 		case Texture::rt_depth:
 		case Texture::rt_color:
+		case Texture::rt_rgba:
 			if(!json_int(texture["height"], height)) {
 				fprintf(stderr, "[E] reading JSON file: RT texture %s with no height.\n", name.c_str());
 				exit(1);
@@ -429,7 +432,7 @@ static void populate_textures(Json::Value & textures) {
 			if(ttype == Texture::rt_depth)
 				tm->createDepthMap(name, height, width);
 			else
-				tm->createColorMap(name, height, width);
+				tm->createColorMap(name, height, width, ttype == Texture::rt_rgba);
 			break;
 		case Texture::cubemap:
 			if (!json_string(texture["xpos"], xpos)) {
@@ -469,9 +472,15 @@ static void populate_textures(Json::Value & textures) {
 	//     "name" : "root",
 	//     "trfm" : [ { "trans" : [0, -10, -100] } ],
 	//     "collision" : false
+	//     "dynamic" : true, (leaves which move every frame, see Node::setDynamic)
+	//     "staticBatch" : 100,  (chunk size, or true for the default size)
 	//     "shader" : "pervertex",
 	//     "children" : [ ... ]
 
+// nodes with a static batch, and the size of their chunks (batches are
+// built when the whole tree is in place)
+static vector<std::pair<Node *, float> > static_batches;
+
 static Node *populate_nodes(Json::Value &jsnode, Node *parent = 0) {
 
 	// lights is of type json::type_t::array
@@ -503,6 +512,23 @@ static Node *populate_nodes(Json::Value &jsnode, Node *parent = 0) {
 		json_bool(jsnode["collision"], checkColl);
 		node->setCheckCollision(checkColl);
 	}
+	Json::Value & jsbatch = jsnode["staticBatch"];
+	if (!jsbatch.isNull()) {
+		bool batch = false;
+		float chunkSize = 100.0f;
+		if (jsbatch.isNumeric()) {
+			chunkSize = jsbatch.asFloat();
+			batch = chunkSize > 0.0f;
+			if (!batch) {
+				fprintf(stderr, "[E] reading JSON file: invalid staticBatch in node %s.\n", name.c_str());
+				exit(1);
+			}
+		} else if (!json_bool(jsbatch, batch)) {
+			fprintf(stderr, "[E] reading JSON file: invalid staticBatch in node %s.\n", name.c_str());
+			exit(1);
+		}
+		if (batch) static_batches.push_back(std::make_pair(node, chunkSize));
+	}
 
 	string gObjName;
 	bool has_gObj = false;
@@ -525,6 +551,9 @@ static Node *populate_nodes(Json::Value &jsnode, Node *parent = 0) {
 		for(int i = 0; i < m; i++)
 			populate_nodes(jschildren[i], node);
 	}
+	bool dynamic = false;
+	if (json_bool(jsnode["dynamic"], dynamic) && dynamic)
+		node->setDynamic(true);
 	if (parent) parent->addChild(node);
 	return node;
 }
@@ -588,6 +617,114 @@ static void populate_global(Json::Value & jsglobal) {
 	}
 }
 
+// "animations" : [
+//     {
+//         "name" : "spin",
+//         "loop" : true,
+//         "nlerp" : false, (nlerp instead of slerp for the rotations)
+//         "play" : true,
+//         "tracks" : [
+//             {
+//                 "node" : "cubo",
+//                 "trans" : { "times" : [0, 1], "values" : [ [0, 0, 0], [0, 5, 0] ] },
+//                 "rotVec" : { "times" : [0, 1], "values" : [ { "vec" : [0, 1, 0], "angle" : 0 }, ... ] },
+//                 "scale" : { "times" : [0, 1], "values" : [1, 2] }
+//             }
+//         ]
+//     }
+// ]
+
+// times and values of an animation channel. Return the number of keys
+static int anim_keys(Json::Value & jschan, const string & clip, const string & node,
+					 const char *chan) {
+	Json::Value & times = jschan["times"];
+	Json::Value & values = jschan["values"];
+	if (!times.isArray() || !values.isArray() || times.size() != values.size()) {
+		fprintf(stderr, "[E] reading JSON file: invalid %s of node %s in animation %s.\n", chan, node.c_str(), clip.c_str());
+		exit(1);
+	}
+	return times.size();
+}
+
+static void populate_animations(Json::Value & jsanims) {
+	if(jsanims.isNull()) return;
+	if(!jsanims.isArray()) {
+		fprintf(stderr, "[E] reading JSON file: animations must be an array.\n");
+		exit(1);
+	}
+	AnimationManager *mgr = AnimationManager::instance();
+	int n = jsanims.size();
+	for(int i = 0; i < n; i++) {
+		Json::Value & jsanim = jsanims[i];
+		string name;
+		if (!json_string(jsanim["name"], name)) {
+			fprintf(stderr, "[E] reading JSON file: animation with no name.\n");
+			exit(1);
+		}
+		AnimClip *clip = mgr->create(name);
+		bool b;
+		if (json_bool(jsanim["loop"], b)) clip->setLoop(b);
+		if (json_bool(jsanim["nlerp"], b)) clip->setNlerp(b);
+		Json::Value & jstracks = jsanim["tracks"];
+		if (!jstracks.isArray()) {
+			fprintf(stderr, "[E] reading JSON file: animation %s with no tracks.\n", name.c_str());
+			exit(1);
+		}
+		int m = jstracks.size();
+		for(int j = 0; j < m; j++) {
+			Json::Value & jstrack = jstracks[j];
+			string nodeName;
+			Node *node = 0;
+			if (json_string(jstrack["node"], nodeName))
+				node = NodeManager::instance()->find(nodeName);
+			if (!node) {
+				fprintf(stderr, "[E] reading JSON file: animation %s with invalid node %s.\n", name.c_str(), nodeName.c_str());
+				exit(1);
+			}
+			size_t track = clip->addTrack(node);
+			float t, sc;
+			Vector3 V;
+			if (!jstrack["trans"].isNull()) {
+				Json::Value & jschan = jstrack["trans"];
+				int keys = anim_keys(jschan, name, nodeName, "trans");
+				for(int k = 0; k < keys; k++) {
+					if (!json_float(jschan["times"][k], t) || !json_vec(jschan["values"][k], V)) {
+						fprintf(stderr, "[E] reading JSON file: invalid trans of node %s in animation %s.\n", nodeName.c_str(), name.c_str());
+						exit(1);
+					}
+					clip->addTransKey(track, t, V);
+				}
+			}
+			if (!jstrack["rotVec"].isNull()) {
+				Json::Value & jschan = jstrack["rotVec"];
+				int keys = anim_keys(jschan, name, nodeName, "rotVec");
+				for(int k = 0; k < keys; k++) {
+					Json::Value & jsrotVec = jschan["values"][k];
+					if (!json_float(jschan["times"][k], t) || !json_vec(jsrotVec["vec"], V) ||
+						!json_float(jsrotVec["angle"], sc)) {
+						fprintf(stderr, "[E] reading JSON file: invalid rotVec of node %s in animation %s.\n", nodeName.c_str(), name.c_str());
+						exit(1);
+					}
+					clip->addRotKey(track, t, Quaternion(V, sc));
+				}
+			}
+			if (!jstrack["scale"].isNull()) {
+				Json::Value & jschan = jstrack["scale"];
+				int keys = anim_keys(jschan, name, nodeName, "scale");
+				for(int k = 0; k < keys; k++) {
+					if (!json_float(jschan["times"][k], t) || !json_float(jschan["values"][k], sc) ||
+						sc <= Constants::distance_epsilon) {
+						fprintf(stderr, "[E] reading JSON file: invalid scale of node %s in animation %s.\n", nodeName.c_str(), name.c_str());
+						exit(1);
+					}
+					clip->addScaleKey(track, t, sc);
+				}
+			}
+		}
+		if (json_bool(jsanim["play"], b) && b) mgr->play(clip);
+	}
+}
+
 static Node * populate_scene(Json::Value &scenejs) {
 
 // avatars json::value_t::array
@@ -596,6 +733,7 @@ static Node * populate_scene(Json::Value &scenejs) {
 // lights json::value_t::array
 // shaders json::value_t::array
 // node json::value_t::object
+// animations json::value_t::array
 
 	Node *root;
 	populate_global(scenejs["global"]);
@@ -607,6 +745,10 @@ static Node * populate_scene(Json::Value &scenejs) {
 	populate_textures(scenejs["textures"]);
 	populate_sky(scenejs["sky"]);
 	root = populate_nodes(scenejs["node"]);
+	populate_animations(scenejs["animations"]);
+	for(size_t i = 0; i < static_batches.size(); ++i)
+		static_batches[i].first->buildStaticBatch(static_batches[i].second);
+	static_batches.clear();
 	return root;
 }
 
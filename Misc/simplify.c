@@ -0,0 +1,421 @@
+/*
+  simplify.c
+
+  Quadric error metric simplification. See simplify.h
+
+  The mesh is simplified in passes. Every pass computes the cost of all the
+  (position) edges, sorts them, and collapses the cheapest ones whose
+  neighborhoods were not touched yet during the pass. Positions are
+  the unit of simplification: all the vertices at a position collapse at
+  once, so seams never open.
+
+  Seam and border edges get extra planes (perpendicular to the triangles)
+  in their quadrics, so that collapses along them are cheap but collapses
+  that bend or shrink them are expensive.
+*/
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "weld.h"
+#include "simplify.h"
+
+/* Weight of the planes that keep mesh borders in place, relative to the
+ * (area weighted) planes of the triangles.
+ */
+#define SIMPLIFY_BORDER_WEIGHT 10.0
+#define SIMPLIFY_SEAM_WEIGHT   1.0
+
+/* Quadric: symmetric 4x4 matrix (10 coefficients) plus the total weight of
+ * its planes.
+ */
+typedef struct {
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+	double w;
+} Quadric;
+
+typedef struct {
+	float cost;  /* squared distance to the planes of both positions */
+	int from;    /* position collapsed ... */
+	int to;      /* ... onto this one */
+} Collapse;
+
+static void
+quadricAddPlane(Quadric* Q, double a, double b, double c, double d, double w)
+{
+	Q->a2 += w * a * a; Q->ab += w * a * b; Q->ac += w * a * c; Q->ad += w * a * d;
+	Q->b2 += w * b * b; Q->bc += w * b * c; Q->bd += w * b * d;
+	Q->c2 += w * c * c; Q->cd += w * c * d;
+	Q->d2 += w * d * d;
+	Q->w += w;
+}
+
+static void
+quadricAdd(Quadric* Q, const Quadric* R)
+{
+	Q->a2 += R->a2; Q->ab += R->ab; Q->ac += R->ac; Q->ad += R->ad;
+	Q->b2 += R->b2; Q->bc += R->bc; Q->bd += R->bd;
+	Q->c2 += R->c2; Q->cd += R->cd;
+	Q->d2 += R->d2;
+	Q->w += R->w;
+}
+
+/* quadricError: mean (by weight) squared distance from p to the planes of
+ * Q.
+ */
+static float
+quadricError(const Quadric* Q, const float* p)
+{
+	double x = p[0], y = p[1], z = p[2];
+	double e;
+
+	if (Q->w <= 0.0) return 0.0f;
+	e = Q->a2 * x * x + Q->b2 * y * y + Q->c2 * z * z + Q->d2
+		+ 2.0 * (Q->ab * x * y + Q->ac * x * z + Q->bc * y * z
+				 + Q->ad * x + Q->bd * y + Q->cd * z);
+	return e > 0.0 ? (float)(e / Q->w) : 0.0f;
+}
+
+static void
+triangleNormal(const float* p0, const float* p1, const float* p2, double* n)
+{
+	double u[3], v[3];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		u[i] = (double)p1[i] - p0[i];
+		v[i] = (double)p2[i] - p0[i];
+	}
+	n[0] = u[1] * v[2] - u[2] * v[1];
+	n[1] = u[2] * v[0] - u[0] * v[2];
+	n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+static int
+compareEdges(const void* a, const void* b)
+{
+	unsigned long long u = *(const unsigned long long*)a;
+	unsigned long long v = *(const unsigned long long*)b;
+	return u < v ? -1 : u > v;
+}
+
+static int
+compareCollapses(const void* a, const void* b)
+{
+	const Collapse* u = (const Collapse*)a;
+	const Collapse* v = (const Collapse*)b;
+	if (u->cost != v->cost) return u->cost < v->cost ? -1 : 1;
+	if (u->from != v->from) return u->from < v->from ? -1 : 1;
+	return u->to < v->to ? -1 : u->to > v->to;
+}
+
+static unsigned long long
+edgeKey(int a, int b)
+{
+	return ((unsigned long long)(unsigned)a << 32) | (unsigned)b;
+}
+
+static int
+hasEdge(const unsigned long long* edges, int numedges, int a, int b)
+{
+	unsigned long long key = edgeKey(a, b);
+	return bsearch(&key, edges, numedges, sizeof(unsigned long long), compareEdges) != NULL;
+}
+
+int
+simplifyMesh(int* destination, const int* indices, int numtriangles,
+			 const float* positions, int numvertices,
+			 int target, float maxerror, float* error, float* newpositions)
+{
+	int* pos;           /* position of each vertex */
+	float* P;           /* unique positions */
+	int* pstart;        /* vertices of position p: pverts[pstart[p]] ... */
+	int* pverts;
+	unsigned long long* vedges; /* vertex half-edges (to find seams) */
+	int* vstart;        /* triangles of vertex v: vtris[vstart[v]] ... */
+	int* vtris;
+	int* remap;         /* vertex each vertex collapses onto */
+	int* wanted;        /* vertex at 'to' each vertex at 'from' merges with
+						   (-1: it keeps its attributes) */
+	Quadric* Q;
+	char* border;
+	char* locked;
+	unsigned long long* edges;
+	Collapse* collapses;
+	int* T;             /* current triangles */
+	int count;
+	int np, numedges, numvedges, numcollapses, removed, goal, applied;
+	int i, j, k, t, v, a, b, c, e;
+	float lo[3], hi[3], extent, passlimit, maxcost, worst, e2;
+	double n[3], m[3], u[3], len, area, d, w;
+	const float* pa;
+	const float* pb;
+
+	if (error) *error = 0.0f;
+	if (newpositions && numvertices > 0)
+		memcpy(newpositions, positions, sizeof(float) * 3 * numvertices);
+	if (numtriangles <= 0) return 0;
+	memcpy(destination, indices, sizeof(int) * 3 * numtriangles);
+	if (numtriangles <= target || numvertices <= 0) return numtriangles;
+
+	/* group vertices by position. Vertices at the same position were split
+	   by their attributes, so they match exactly; the epsilon only has to
+	   absorb rounding */
+	lo[0] = lo[1] = lo[2] = FLT_MAX;
+	hi[0] = hi[1] = hi[2] = -FLT_MAX;
+	for (v = 0; v < numvertices; v++)
+		for (k = 0; k < 3; k++) {
+			if (positions[3 * v + k] < lo[k]) lo[k] = positions[3 * v + k];
+			if (positions[3 * v + k] > hi[k]) hi[k] = positions[3 * v + k];
+		}
+	extent = 0.0f;
+	for (k = 0; k < 3; k++)
+		if (hi[k] - lo[k] > extent) extent = hi[k] - lo[k];
+	pos = (int*)malloc(sizeof(int) * numvertices);
+	P = (float*)malloc(sizeof(float) * 3 * numvertices);
+	np = weldVectors(positions, numvertices, 3,
+					 extent > 0.0f ? extent * 1e-6f : 1e-6f, P, pos);
+
+	pstart = (int*)malloc(sizeof(int) * (np + 1));
+	pverts = (int*)malloc(sizeof(int) * numvertices);
+	vstart = (int*)malloc(sizeof(int) * (numvertices + 1));
+	vtris = (int*)malloc(sizeof(int) * 3 * numtriangles);
+	remap = (int*)malloc(sizeof(int) * numvertices);
+	wanted = (int*)malloc(sizeof(int) * numvertices);
+	Q = (Quadric*)calloc(np, sizeof(Quadric));
+	border = (char*)malloc(np);
+	locked = (char*)malloc(np);
+	edges = (unsigned long long*)malloc(sizeof(unsigned long long) * 3 * numtriangles);
+	collapses = (Collapse*)malloc(sizeof(Collapse) * 3 * numtriangles);
+	T = destination;
+	count = numtriangles;
+	for (v = 0; v < numvertices; v++) remap[v] = v;
+
+	/* position edges (sorted half-edges a -> b) */
+	numedges = 0;
+	for (t = 0; t < count; t++)
+		for (k = 0; k < 3; k++) {
+			a = pos[T[3 * t + k]];
+			b = pos[T[3 * t + (k + 1) % 3]];
+			if (a != b) edges[numedges++] = edgeKey(a, b);
+		}
+	qsort(edges, numedges, sizeof(unsigned long long), compareEdges);
+	vedges = (unsigned long long*)malloc(sizeof(unsigned long long) * 3 * numtriangles);
+	numvedges = 0;
+	for (t = 0; t < count; t++)
+		for (k = 0; k < 3; k++)
+			vedges[numvedges++] = edgeKey(T[3 * t + k], T[3 * t + (k + 1) % 3]);
+	qsort(vedges, numvedges, sizeof(unsigned long long), compareEdges);
+
+	/* quadrics: planes of the triangles, weighted by area, and planes
+	   perpendicular to the border and seam edges. A seam edge has a
+	   neighbor triangle, but with other vertices (attributes) */
+	for (t = 0; t < count; t++) {
+		triangleNormal(&P[3 * pos[T[3 * t]]], &P[3 * pos[T[3 * t + 1]]],
+					   &P[3 * pos[T[3 * t + 2]]], n);
+		len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len == 0.0) continue;
+		area = 0.5 * len;
+		n[0] /= len; n[1] /= len; n[2] /= len;
+		for (k = 0; k < 3; k++) {
+			a = pos[T[3 * t + k]];
+			b = pos[T[3 * t + (k + 1) % 3]];
+			pa = &P[3 * a];
+			pb = &P[3 * b];
+			d = -(n[0] * pa[0] + n[1] * pa[1] + n[2] * pa[2]);
+			quadricAddPlane(&Q[a], n[0], n[1], n[2], d, area);
+			if (a == b) continue;
+			if (!hasEdge(edges, numedges, b, a))
+				w = SIMPLIFY_BORDER_WEIGHT;
+			else if (!hasEdge(vedges, numvedges, T[3 * t + (k + 1) % 3], T[3 * t + k]))
+				w = SIMPLIFY_SEAM_WEIGHT;
+			else
+				continue;
+			for (j = 0; j < 3; j++) u[j] = (double)pb[j] - pa[j];
+			len = u[0] * u[0] + u[1] * u[1] + u[2] * u[2];
+			m[0] = u[1] * n[2] - u[2] * n[1];
+			m[1] = u[2] * n[0] - u[0] * n[2];
+			m[2] = u[0] * n[1] - u[1] * n[0];
+			d = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+			if (d == 0.0) continue;
+			m[0] /= d; m[1] /= d; m[2] /= d;
+			d = -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]);
+			quadricAddPlane(&Q[a], m[0], m[1], m[2], d, len * w);
+			quadricAddPlane(&Q[b], m[0], m[1], m[2], d, len * w);
+		}
+	}
+	free(vedges);
+
+	maxcost = maxerror < sqrtf(FLT_MAX) ? maxerror * maxerror : FLT_MAX;
+	worst = 0.0f;
+	while (count > target) {
+
+		/* position -> vertex and vertex -> triangle adjacency */
+		memset(pstart, 0, sizeof(int) * (np + 1));
+		for (v = 0; v < numvertices; v++) pstart[pos[v] + 1]++;
+		for (i = 0; i < np; i++) pstart[i + 1] += pstart[i];
+		for (v = 0; v < numvertices; v++) pverts[pstart[pos[v]]++] = v;
+		for (i = np; i > 0; i--) pstart[i] = pstart[i - 1];
+		pstart[0] = 0;
+
+		memset(vstart, 0, sizeof(int) * (numvertices + 1));
+		for (i = 0; i < 3 * count; i++) vstart[T[i] + 1]++;
+		for (v = 0; v < numvertices; v++) vstart[v + 1] += vstart[v];
+		for (i = 0; i < 3 * count; i++) vtris[vstart[T[i]]++] = i / 3;
+		for (v = numvertices; v > 0; v--) vstart[v] = vstart[v - 1];
+		vstart[0] = 0;
+
+		/* position edges and border positions */
+		numedges = 0;
+		for (t = 0; t < count; t++)
+			for (k = 0; k < 3; k++) {
+				a = pos[T[3 * t + k]];
+				b = pos[T[3 * t + (k + 1) % 3]];
+				if (a != b) edges[numedges++] = edgeKey(a, b);
+			}
+		qsort(edges, numedges, sizeof(unsigned long long), compareEdges);
+		for (i = j = 0; i < numedges; i++)
+			if (j == 0 || edges[i] != edges[j - 1]) edges[j++] = edges[i];
+		numedges = j;
+		memset(border, 0, np);
+		for (i = 0; i < numedges; i++) {
+			a = (int)(edges[i] >> 32);
+			b = (int)(edges[i] & 0xffffffffu);
+			if (!hasEdge(edges, numedges, b, a)) border[a] = border[b] = 1;
+		}
+
+		/* candidate collapses: the cheapest valid direction of every edge.
+		   Border positions only move along border edges */
+		numcollapses = 0;
+		for (i = 0; i < numedges; i++) {
+			int isborder;
+			float cab, cba;
+			Quadric S;
+			a = (int)(edges[i] >> 32);
+			b = (int)(edges[i] & 0xffffffffu);
+			isborder = !hasEdge(edges, numedges, b, a);
+			if (!isborder && a > b) continue; /* visited as b -> a */
+			S = Q[a];
+			quadricAdd(&S, &Q[b]);
+			cab = cba = FLT_MAX;
+			if (!border[a] || (isborder && border[b]))
+				cab = quadricError(&S, &P[3 * b]);
+			if (!border[b] || (isborder && border[a]))
+				cba = quadricError(&S, &P[3 * a]);
+			if (cab == FLT_MAX && cba == FLT_MAX) continue;
+			collapses[numcollapses].cost = cab <= cba ? cab : cba;
+			collapses[numcollapses].from = cab <= cba ? a : b;
+			collapses[numcollapses].to = cab <= cba ? b : a;
+			numcollapses++;
+		}
+		if (numcollapses == 0) break;
+		qsort(collapses, numcollapses, sizeof(Collapse), compareCollapses);
+
+		/* every collapse removes about two triangles. Don't go (much)
+		   beyond the cost of the collapses this pass needs, so that cheap
+		   collapses uncovered by the next pass go first */
+		goal = (count - target) / 2;
+		if (goal >= numcollapses) goal = numcollapses - 1;
+		passlimit = collapses[goal].cost * 1.5f;
+
+		memset(locked, 0, np);
+		removed = 0;
+		applied = 0;
+		for (e = 0; e < numcollapses && count - removed > target; e++) {
+			int ok = 1, collapsed = 0;
+			Collapse* col = &collapses[e];
+			if (col->cost > maxcost) break;
+			if (col->cost > passlimit && applied) break;
+			a = col->from;
+			b = col->to;
+			if (locked[a] || locked[b]) continue;
+
+			/* every vertex at a merges with the vertex at b on its side
+			   of the seams, if there is exactly one. Otherwise (it is on
+			   a seam through b, or b is not on its side) it keeps its
+			   attributes and just moves to b. No triangle may flip */
+			for (i = pstart[a]; i < pstart[a + 1] && ok; i++) {
+				int merge = 1;
+				v = pverts[i];
+				wanted[v] = -1;
+				for (j = vstart[v]; j < vstart[v + 1] && ok; j++) {
+					const int* tri = &T[3 * vtris[j]];
+					int hasb = 0;
+					for (k = 0; k < 3; k++) {
+						c = tri[k];
+						if (pos[c] != b) continue;
+						hasb = 1;
+						if (wanted[v] == -1) wanted[v] = c;
+						else if (wanted[v] != c) merge = 0;
+					}
+					if (!hasb) {
+						const float* p[3];
+						double n1[3];
+						for (k = 0; k < 3; k++)
+							p[k] = &P[3 * pos[tri[k]]];
+						triangleNormal(p[0], p[1], p[2], n);
+						for (k = 0; k < 3; k++)
+							if (tri[k] == v) p[k] = &P[3 * b];
+						triangleNormal(p[0], p[1], p[2], n1);
+						if (n[0] * n1[0] + n[1] * n1[1] + n[2] * n1[2] <= 0.0)
+							ok = 0;
+					} else
+						collapsed++;
+				}
+				if (!merge) wanted[v] = -1;
+			}
+			if (!ok) continue;
+
+			for (i = pstart[a]; i < pstart[a + 1]; i++) {
+				v = pverts[i];
+				if (wanted[v] != -1) remap[v] = wanted[v];
+				else pos[v] = b;
+				for (j = vstart[v]; j < vstart[v + 1]; j++)
+					for (k = 0; k < 3; k++)
+						locked[pos[T[3 * vtris[j] + k]]] = 1;
+			}
+			locked[a] = locked[b] = 1;
+			/* the error of the collapse is the distance to the planes of
+			   a alone (those of b are close to b anyway) */
+			e2 = quadricError(&Q[a], &P[3 * b]);
+			if (e2 > worst) worst = e2;
+			quadricAdd(&Q[b], &Q[a]);
+			removed += collapsed;
+			applied++;
+		}
+		if (applied == 0) break;
+
+		/* remap the triangles and remove the degenerate ones */
+		for (t = i = 0; t < count; t++) {
+			a = remap[T[3 * t]];
+			b = remap[T[3 * t + 1]];
+			c = remap[T[3 * t + 2]];
+			if (pos[a] == pos[b] || pos[b] == pos[c] || pos[c] == pos[a]) continue;
+			T[3 * i] = a;
+			T[3 * i + 1] = b;
+			T[3 * i + 2] = c;
+			i++;
+		}
+		count = i;
+	}
+
+	if (newpositions)
+		for (v = 0; v < numvertices; v++)
+			memcpy(&newpositions[3 * v], &P[3 * pos[v]], sizeof(float) * 3);
+	if (error) *error = sqrtf(worst);
+	free(collapses);
+	free(edges);
+	free(locked);
+	free(border);
+	free(Q);
+	free(wanted);
+	free(remap);
+	free(vtris);
+	free(vstart);
+	free(pverts);
+	free(pstart);
+	free(P);
+	free(pos);
+	return count;
+}
@@ -0,0 +1,52 @@
+/*
+  simplify.h
+
+  Simplify an indexed triangle mesh with quadric error metrics (Garland &
+  Heckbert).
+
+  No vertex is created: every collapse moves the vertices at one position
+  to the position of a neighbor (half-edge collapse). Vertices keep their
+  attributes (normals, texture coordinates, tangents), unless they merge
+  with the neighbor vertex on their side of the seams.
+
+  Attribute seams are respected. Vertices sharing their position (but not
+  their attributes) always move together, so seams never open, and seams
+  resist collapses that would bend them. Mesh borders only collapse along
+  the border.
+*/
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* simplifyMesh: reduce the number of triangles of a mesh.
+ *
+ * destination  - on return, the indices of the simplified mesh. Must have
+ *                space for 3 * numtriangles indices.
+ * indices      - 3 * numtriangles vertex indices
+ * numtriangles - number of triangles
+ * positions    - vertex positions (x, y, z)
+ * numvertices  - number of vertices
+ * target       - desired number of triangles
+ * maxerror     - maximum distance between the simplified and the original
+ *                surface
+ * error        - if not NULL, on return, the (estimated) distance between
+ *                the simplified and the original surface
+ * newpositions - if not NULL, on return, the (new) positions of the
+ *                vertices. Must have space for 3 * numvertices floats.
+ *
+ * returns the number of triangles of the simplified mesh, which can be
+ * bigger than target when the mesh can't be simplified any further.
+ */
+int
+simplifyMesh(int* destination, const int* indices, int numtriangles,
+			 const float* positions, int numvertices,
+			 int target, float maxerror, float* error, float* newpositions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include "threadPool.h"
+
+// whether the current thread is running chunks of a job
+static thread_local bool t_inPool = false;
+
+ThreadPool * ThreadPool::instance() {
+	static ThreadPool inst;
+	return &inst;
+}
+
+ThreadPool::ThreadPool() : m_fn(0), m_n(0), m_grain(1), m_next(0),
+						   m_active(0), m_generation(0), m_quit(false) {
+	size_t n = std::thread::hardware_concurrency();
+	for(size_t i = 1; i < n; ++i)
+		m_threads.push_back(std::thread(&ThreadPool::worker, this));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for(size_t i = 0; i < m_threads.size(); ++i)
+		m_threads[i].join();
+}
+
+size_t ThreadPool::size() const { return m_threads.size() + 1; }
+
+void ThreadPool::runChunks() {
+	bool inPool = t_inPool;
+	t_inPool = true;
+	for(;;) {
+		size_t begin = m_next.fetch_add(m_grain);
+		if (begin >= m_n) break;
+		(*m_fn)(begin, std::min(begin + m_grain, m_n));
+	}
+	t_inPool = inPool;
+}
+
+void ThreadPool::worker() {
+	unsigned int seen = 0;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for(;;) {
+		while (!m_quit && m_generation == seen) m_wake.wait(lock);
+		if (m_quit) return;
+		seen = m_generation;
+		lock.unlock();
+		runChunks();
+		lock.lock();
+		if (--m_active == 0) m_done.notify_one();
+	}
+}
+
+void ThreadPool::parallelFor(size_t n, size_t grain, const range_fn & fn) {
+	if (!n) return;
+	if (!grain) grain = 1;
+	if (m_threads.empty() || n <= grain || t_inPool || !m_jobMutex.try_lock()) {
+		fn(0, n); // run serially
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_fn = &fn;
+		m_n = n;
+		m_grain = grain;
+		m_next = 0;
+		m_active = m_threads.size();
+		++m_generation;
+	}
+	m_wake.notify_all();
+	runChunks();
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (m_active) m_done.wait(lock);
+		m_fn = 0;
+	}
+	m_jobMutex.unlock();
+}
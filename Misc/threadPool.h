@@ -0,0 +1,65 @@
+// -*-C++-*-
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/**
+ * @brief A pool of worker threads to run data-parallel loops.
+ *
+ * The pool is created on first use, with as many threads as hardware cores.
+ * The calling thread also takes part in the work.
+ *
+ * Usage:
+ *
+ *    ThreadPool::instance()->parallelFor(n, 1024, [&](size_t begin, size_t end) {
+ *        for(size_t i = begin; i != end; ++i) out[i] = f(in[i]);
+ *    });
+ *
+ * Note: nested parallelFor calls (and calls made while another thread is
+ * using the pool) run serially in the calling thread.
+ */
+
+class ThreadPool {
+
+public:
+	static ThreadPool * instance();
+
+	typedef std::function<void (size_t, size_t)> range_fn;
+
+	/**
+	 * Split [0, n) into chunks of (at least) 'grain' elements and call fn(begin,
+	 * end) for each of them. Return when all chunks are done.
+	 */
+	void parallelFor(size_t n, size_t grain, const range_fn & fn);
+
+	size_t size() const; // number of threads (including the caller)
+
+private:
+	ThreadPool();
+	~ThreadPool();
+	ThreadPool(const ThreadPool &);
+	ThreadPool & operator=(const ThreadPool &);
+
+	void worker();
+	void runChunks();
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_jobMutex; // one job at a time
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	const range_fn *m_fn;
+	size_t m_n;
+	size_t m_grain;
+	std::atomic<size_t> m_next; // next chunk to run
+	size_t m_active;            // workers still running the current job
+	unsigned int m_generation;  // incremented on each job
+	bool m_quit;
+};
@@ -2,7 +2,11 @@
 #include "constants.h"
 #include <cmath>
 #include <cstdio>
+#include <strings.h>
+#include <algorithm>
 #include <sstream> // for ostringstream
+#include <dirent.h>
+#include <sys/stat.h>
 
 using std::string;
 
@@ -38,3 +42,40 @@ std::string float_to_string(float v) {
 	out << v;
 	return out.str();
 }
+
+double elapsed_ms(std::chrono::steady_clock::time_point since) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+bool is_dir(const string & path) {
+	struct stat st;
+	return !stat(path.c_str(), &st) && S_ISDIR(st.st_mode);
+}
+
+bool is_obj(const string & fname) {
+	size_t n = fname.size();
+	return n > 4 && !strcasecmp(fname.c_str() + n - 4, ".obj");
+}
+
+void find_objs(const string & dir, std::vector<std::pair<string, string> > & objs) {
+	DIR *dh = opendir(dir.c_str());
+	if (!dh) {
+		fprintf(stderr, "[W] can't open directory %s\n", dir.c_str());
+		return;
+	}
+	std::vector<string> names;
+	while (struct dirent *entry = readdir(dh)) {
+		if (entry->d_name[0] == '.') continue; // ., .. and hidden files
+		names.push_back(entry->d_name);
+	}
+	closedir(dh);
+	std::sort(names.begin(), names.end());
+	string prefix = dir[dir.size() - 1] == '/' ? dir : dir + "/";
+	for(size_t i = 0; i < names.size(); ++i) {
+		string path = prefix + names[i];
+		if (is_dir(path))
+			find_objs(path, objs);
+		else if (is_obj(names[i]))
+			objs.push_back(std::make_pair(prefix, names[i]));
+	}
+}
@@ -4,6 +4,8 @@
 
 #include <string>
 #include <vector>
+#include <utility>
+#include <chrono>
 
 #define ASSERT_OPENGL { GLenum errorCode = glGetError();				\
 		if (errorCode != GL_NO_ERROR) {									\
@@ -21,3 +23,16 @@ void writeV(const std::vector<float> & v);
 
 // float 2 string
 std::string float_to_string(float v);
+
+// milliseconds elapsed since a time point of the steady clock
+double elapsed_ms(std::chrono::steady_clock::time_point since);
+
+// whether path is a directory
+bool is_dir(const std::string & path);
+
+// whether fname is a wavefront file (ends in .obj, in any case)
+bool is_obj(const std::string & fname);
+
+// collect (directory, file name) pairs of all .obj files below dir, sorted
+// by name. The directories end in '/'.
+void find_objs(const std::string & dir, std::vector<std::pair<std::string, std::string> > & objs);
@@ -0,0 +1,179 @@
+/*
+  vcache.c
+
+  Vertex cache optimization. See vcache.h
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vcache.h"
+
+/* Size of the simulated LRU cache, and the constants of the score
+ * function, as proposed by Forsyth.
+ */
+#define VCACHE_SIZE           32
+#define VCACHE_DECAY_POWER    1.5f
+#define VCACHE_LAST_TRI_SCORE 0.75f
+#define VCACHE_VALENCE_SCALE  2.0f
+#define VCACHE_VALENCE_POWER  0.5f
+
+/* vcacheScore: score of a vertex at position cachepos of the cache (-1 if
+ * not cached) used by live triangles not yet emitted.
+ */
+static float
+vcacheScore(int cachepos, int live)
+{
+	float score = 0.0f;
+
+	if (live == 0) return -1.0f; /* no triangle left */
+	if (cachepos >= 0) {
+		if (cachepos < 3) {
+			/* vertices of the last triangle get a fixed score, so that
+			   strips are not preferred over fans or vice versa */
+			score = VCACHE_LAST_TRI_SCORE;
+		} else {
+			score = 1.0f - (float)(cachepos - 3) / (float)(VCACHE_SIZE - 3);
+			score = powf(score, VCACHE_DECAY_POWER);
+		}
+	}
+	/* boost vertices with few triangles left, to get rid of them soon */
+	score += VCACHE_VALENCE_SCALE * powf((float)live, -VCACHE_VALENCE_POWER);
+	return score;
+}
+
+void
+optimizeVertexCache(int* indices, int numtriangles, int numvertices)
+{
+	int* start;     /* triangles of vertex v: adj[start[v]] ... */
+	int* live;      /* ... adj[start[v] + live[v] - 1] (not emitted yet) */
+	int* adj;
+	int* cachepos;
+	float* vscore;
+	char* emitted;
+	int* out;
+	int cache[VCACHE_SIZE + 3], newcache[VCACHE_SIZE + 3];
+	int cachelen, newlen;
+	int i, j, k, a, t, v, best, next;
+	const int* tri;
+	float score, bestscore;
+
+	if (numtriangles <= 0) return;
+
+	start = (int*)malloc(sizeof(int) * (numvertices + 1));
+	live = (int*)calloc(numvertices, sizeof(int));
+	adj = (int*)malloc(sizeof(int) * 3 * numtriangles);
+	cachepos = (int*)malloc(sizeof(int) * numvertices);
+	vscore = (float*)malloc(sizeof(float) * numvertices);
+	emitted = (char*)calloc(numtriangles, sizeof(char));
+	out = (int*)malloc(sizeof(int) * 3 * numtriangles);
+
+	/* vertex -> triangle adjacency */
+	for (i = 0; i < 3 * numtriangles; i++)
+		live[indices[i]]++;
+	start[0] = 0;
+	for (v = 0; v < numvertices; v++)
+		start[v + 1] = start[v] + live[v];
+	for (v = 0; v < numvertices; v++)
+		live[v] = 0;
+	for (i = 0; i < 3 * numtriangles; i++) {
+		v = indices[i];
+		adj[start[v] + live[v]++] = i / 3;
+	}
+	for (v = 0; v < numvertices; v++) {
+		cachepos[v] = -1;
+		vscore[v] = vcacheScore(-1, live[v]);
+	}
+
+	cachelen = 0;
+	best = -1;
+	next = 0;
+	for (i = 0; i < numtriangles; i++) {
+		if (best == -1) {
+			/* no candidate around the cache: take the next triangle in
+			   input order */
+			while (emitted[next]) next++;
+			best = next;
+		}
+		t = best;
+		tri = &indices[3 * t];
+		emitted[t] = 1;
+		memcpy(&out[3 * i], tri, sizeof(int) * 3);
+
+		/* remove the triangle from the lists of its vertices */
+		for (k = 0; k < 3; k++) {
+			v = tri[k];
+			for (a = start[v]; adj[a] != t; a++);
+			adj[a] = adj[start[v] + live[v] - 1];
+			live[v]--;
+		}
+
+		/* new cache: the vertices of the triangle go first */
+		newlen = 0;
+		for (k = 0; k < 3; k++) {
+			v = tri[k];
+			for (j = 0; j < newlen && newcache[j] != v; j++);
+			if (j == newlen) newcache[newlen++] = v;
+		}
+		for (j = 0; j < cachelen; j++) {
+			v = cache[j];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newcache[newlen++] = v;
+		}
+
+		/* update vertex scores. Vertices pushed out of the cache get
+		   updated too */
+		for (j = 0; j < newlen; j++) {
+			v = newcache[j];
+			cachepos[v] = j < VCACHE_SIZE ? j : -1;
+			vscore[v] = vcacheScore(cachepos[v], live[v]);
+		}
+
+		/* next triangle: the best one using any vertex in the cache */
+		best = -1;
+		bestscore = -1.0f;
+		for (j = 0; j < newlen; j++) {
+			v = newcache[j];
+			for (a = start[v]; a < start[v] + live[v]; a++) {
+				tri = &indices[3 * adj[a]];
+				score = vscore[tri[0]] + vscore[tri[1]] + vscore[tri[2]];
+				if (score > bestscore) {
+					bestscore = score;
+					best = adj[a];
+				}
+			}
+		}
+
+		cachelen = newlen < VCACHE_SIZE ? newlen : VCACHE_SIZE;
+		memcpy(cache, newcache, sizeof(int) * cachelen);
+	}
+
+	memcpy(indices, out, sizeof(int) * 3 * numtriangles);
+	free(out);
+	free(emitted);
+	free(vscore);
+	free(cachepos);
+	free(adj);
+	free(live);
+	free(start);
+}
+
+float
+vertexCacheMissRatio(const int* indices, int numtriangles, int numvertices,
+					 int cachesize)
+{
+	int* stamp;    /* insertion time of each vertex (-1 if never cached) */
+	int time, i, v;
+
+	if (numtriangles <= 0) return 0.0f;
+	stamp = (int*)malloc(sizeof(int) * numvertices);
+	for (v = 0; v < numvertices; v++) stamp[v] = -1;
+	time = 0;
+	for (i = 0; i < 3 * numtriangles; i++) {
+		v = indices[i];
+		if (stamp[v] == -1 || time - stamp[v] >= cachesize)
+			stamp[v] = time++; /* miss */
+	}
+	free(stamp);
+	return (float)time / (float)numtriangles;
+}
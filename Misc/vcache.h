@@ -0,0 +1,43 @@
+/*
+  vcache.h
+
+  Reorder the triangles of an indexed mesh so that the GPU post-transform
+  vertex cache is used as much as possible.
+
+  Uses Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": vertices are
+  scored according to their position in a simulated LRU cache and to the
+  number of triangles still using them, and the triangle with the best score
+  is emitted next. Runs in (roughly) linear time and does not depend on the
+  actual cache size of the GPU.
+*/
+#ifndef VCACHE_H
+#define VCACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* optimizeVertexCache: reorder triangles for vertex cache locality.
+ *
+ * indices      - 3 * numtriangles vertex indices. Reordered in place.
+ * numtriangles - number of triangles
+ * numvertices  - number of vertices (all indices must be < numvertices)
+ *
+ * Vertices (and the winding of each triangle) are left untouched.
+ */
+void
+optimizeVertexCache(int* indices, int numtriangles, int numvertices);
+
+/* vertexCacheMissRatio: average number of cache misses per triangle (ACMR)
+ * of a FIFO vertex cache of cachesize entries. Ranges from 0.5 (best case
+ * for regular meshes) to 3.0 (no reuse at all).
+ */
+float
+vertexCacheMissRatio(const int* indices, int numtriangles, int numvertices,
+					 int cachesize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,207 @@
+/*
+  weld.c
+
+  Spatial-hash vector welding. See weld.h
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "weld.h"
+
+/* Cells are WELD_CELL times bigger than epsilon. Vectors lying farther than
+ * epsilon from the cell borders only need to look at their own cell.
+ */
+#define WELD_CELL 8.0
+
+/* _WeldCell: one (occupied) grid cell of the hash table */
+typedef struct _WeldCell {
+	unsigned long long key; /* hash of the integer cell coordinates */
+	int head;               /* first representative in cell (-1 if empty slot) */
+	int tail;               /* last representative in cell */
+} WeldCell;
+
+/* _WeldTable: open addressing hash table of grid cells */
+typedef struct _WeldTable {
+	WeldCell* cells;
+	unsigned int size;      /* power of 2 */
+	unsigned int used;
+} WeldTable;
+
+/* weldHash: hash integer cell coordinates
+ *
+ * Different cells may (very unlikely) share the same hash. Then they share
+ * the representative chain too, which is harmless, since representatives are
+ * always compared against the actual vector.
+ */
+static unsigned long long
+weldHash(const long long* key)
+{
+	unsigned long long h;
+
+	h  = (unsigned long long)key[0] * 0x9E3779B97F4A7C15ULL;
+	h ^= (unsigned long long)key[1] * 0xC2B2AE3D27D4EB4FULL;
+	h ^= (unsigned long long)key[2] * 0x165667B19E3779F9ULL;
+	h ^= h >> 29;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+/* weldFind: find the slot of a cell. Returns the slot holding key or, if the
+ * cell is not in the table, the empty slot where it should be inserted.
+ */
+static unsigned int
+weldFind(const WeldTable* table, unsigned long long key)
+{
+	unsigned int mask = table->size - 1;
+	unsigned int slot = (unsigned int)key & mask;
+
+	while (table->cells[slot].head != -1 && table->cells[slot].key != key)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+/* weldInit: allocate an empty table of given size (power of 2) */
+static void
+weldInit(WeldTable* table, unsigned int size)
+{
+	unsigned int slot;
+
+	table->cells = (WeldCell*)malloc(sizeof(WeldCell) * size);
+	table->size = size;
+	table->used = 0;
+	for (slot = 0; slot < size; slot++) table->cells[slot].head = -1;
+}
+
+/* weldGrow: double the size of the table */
+static void
+weldGrow(WeldTable* table)
+{
+	WeldCell* old = table->cells;
+	unsigned int oldsize = table->size;
+	unsigned int used = table->used;
+	unsigned int i;
+
+	weldInit(table, oldsize * 2);
+	for (i = 0; i < oldsize; i++) {
+		if (old[i].head == -1) continue;
+		table->cells[weldFind(table, old[i].key)] = old[i];
+	}
+	table->used = used;
+	free(old);
+}
+
+/* weldEqual: whether two vectors are within epsilon on every coordinate
+ * (equal, if epsilon <= 0) */
+static int
+weldEqual(const float* u, const float* v, int dim, float epsilon)
+{
+	int i;
+
+	if (epsilon <= 0.0f) {
+		for (i = 0; i < dim; i++)
+			if (u[i] != v[i]) return 0;
+		return 1;
+	}
+	for (i = 0; i < dim; i++)
+		if (!(fabsf(u[i] - v[i]) < epsilon)) return 0;
+	return 1;
+}
+
+/* weldBits: cell key of a coordinate when only equal vectors are merged:
+ * its bits (with -0 as 0, so that equal coordinates share them) */
+static long long
+weldBits(float x)
+{
+	unsigned int bits;
+
+	x += 0.0f; /* -0 -> 0 */
+	memcpy(&bits, &x, sizeof(bits));
+	return (long long)bits;
+}
+
+int
+weldVectors(const float* vectors, int numvectors, int dim, float epsilon,
+			float* unique, int* idxmap)
+{
+	WeldTable table;
+	int* next;     /* next representative in the same cell */
+	unsigned int slot;
+	long long key[3], nkey[3];
+	int lo[3], hi[3];
+	double inv_cell, f;
+	int numunique;
+	int i, c, best, r;
+	int dx, dy, dz;
+
+	assert(dim >= 1 && dim <= 3);
+	if (numvectors <= 0) return 0;
+
+	weldInit(&table, 1024);
+	next = (int*)malloc(sizeof(int) * numvectors);
+
+	inv_cell = epsilon > 0.0f ? 1.0 / (WELD_CELL * (double)epsilon) : 0.0;
+	for (c = 0; c < 3; c++) {
+		key[c] = 0; lo[c] = 0; hi[c] = 0;
+	}
+	numunique = 0;
+
+	for (i = 0; i < numvectors; i++) {
+		const float* v = &vectors[dim * i];
+		/* cell of the vector, and the neighbor cells (only those whose
+		   border is closer than epsilon) */
+		for (c = 0; c < dim; c++) {
+			if (epsilon <= 0.0f) {
+				key[c] = weldBits(v[c]);
+				continue;
+			}
+			f = (double)v[c] * inv_cell;
+			key[c] = (long long)floor(f);
+			f -= (double)key[c];
+			lo[c] = f * WELD_CELL < 1.0 ? -1 : 0;
+			hi[c] = (1.0 - f) * WELD_CELL < 1.0 ? 1 : 0;
+		}
+
+		/* look for the first representative (lowest index) within epsilon */
+		best = -1;
+		for (dx = lo[0]; dx <= hi[0]; dx++)
+			for (dy = lo[1]; dy <= hi[1]; dy++)
+				for (dz = lo[2]; dz <= hi[2]; dz++) {
+					nkey[0] = key[0] + dx;
+					nkey[1] = key[1] + dy;
+					nkey[2] = key[2] + dz;
+					slot = weldFind(&table, weldHash(nkey));
+					for (r = table.cells[slot].head; r != -1; r = next[r]) {
+						if (best != -1 && r > best) break; /* chains are sorted */
+						if (weldEqual(v, &unique[dim * r], dim, epsilon)) {
+							best = r;
+							break;
+						}
+					}
+				}
+
+		if (best == -1) {
+			/* new representative: append it to the chain of its own cell */
+			best = numunique++;
+			next[best] = -1;
+			if (2 * (table.used + 1) > table.size) weldGrow(&table);
+			slot = weldFind(&table, weldHash(key));
+			if (table.cells[slot].head == -1) {
+				table.cells[slot].key = weldHash(key);
+				table.cells[slot].head = best;
+				table.used++;
+			} else {
+				next[table.cells[slot].tail] = best;
+			}
+			table.cells[slot].tail = best;
+			memcpy(&unique[dim * best], v, sizeof(float) * dim);
+		}
+		idxmap[i] = best;
+	}
+
+	free(next);
+	free(table.cells);
+	return numunique;
+}
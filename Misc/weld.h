@@ -0,0 +1,49 @@
+/*
+  weld.h
+
+  Weld (merge) vectors that lie within an epsilon of each other.
+
+  Vectors are binned into a uniform grid whose cells are WELD_CELL (8)
+  times epsilon on every side, and the grid cells are stored in an
+  open-addressing hash table. Every vector is only compared against the
+  representatives found in its own cell and, if it lies within epsilon of a
+  cell border, in the neighbor cells across it, so welding runs in
+  (expected) linear time.
+
+  With epsilon <= 0, only equal vectors are merged, and the cells are keyed
+  by the bits of the coordinates.
+
+  Welding is deterministic: vectors are visited in input order and each one
+  is merged into the first representative (in input order) which is within
+  epsilon on every coordinate. The result does not depend on any sort order.
+*/
+#ifndef WELD_H
+#define WELD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* weldVectors: eliminate (weld) vectors that are within an epsilon of
+ * each other.
+ *
+ * vectors    - array of numvectors vectors, each one of dim floats
+ * numvectors - number of vectors
+ * dim        - number of coordinates of each vector (1, 2 or 3)
+ * epsilon    - coordinates closer than epsilon are merged. If <= 0, only
+ *              equal vectors are merged
+ * unique     - on return, the welded vectors (dim floats each). Must have
+ *              space for numvectors vectors.
+ * idxmap     - on return, idxmap[i] is the index in unique of vector i.
+ *
+ * returns the number of welded (unique) vectors
+ */
+int
+weldVectors(const float* vectors, int numvectors, int dim, float epsilon,
+			float* unique, int* idxmap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
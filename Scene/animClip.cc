@@ -0,0 +1,150 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include "animClip.h"
+
+using std::string;
+using std::vector;
+
+AnimClip::AnimClip(const string & name) :
+	m_name(name),
+	m_duration(0.0f),
+	m_loop(false),
+	m_nlerp(false),
+	m_time(0.0f) {}
+
+const string & AnimClip::getName() const { return m_name; }
+
+void AnimClip::setLoop(bool loop) { m_loop = loop; }
+bool AnimClip::getLoop() const { return m_loop; }
+void AnimClip::setNlerp(bool nlerp) { m_nlerp = nlerp; }
+bool AnimClip::getNlerp() const { return m_nlerp; }
+float AnimClip::getDuration() const { return m_duration; }
+float AnimClip::getTime() const { return m_time; }
+
+size_t AnimClip::addTrack(Node *node) {
+	for(size_t i = 0; i < m_tracks.size(); ++i) {
+		if (m_tracks[i].node == node) {
+			fprintf(stderr, "[E] AnimClip %s: node %s has two tracks\n",
+					m_name.c_str(), node->getName().c_str());
+			exit(1);
+		}
+	}
+	m_tracks.push_back(track_t());
+	track_t & tr = m_tracks.back();
+	tr.node = node;
+	for(int c = 0; c < channels_n; ++c) tr.channels[c].cursor = 0;
+	return m_tracks.size() - 1;
+}
+
+size_t AnimClip::numTracks() const { return m_tracks.size(); }
+
+Node *AnimClip::getNode(size_t track) const { return m_tracks[track].node; }
+
+void AnimClip::addKey(size_t track, int chan, float t, const float *v, int n) {
+	channel_t & c = m_tracks[track].channels[chan];
+	if (!c.times.empty() && t < c.times.back()) {
+		fprintf(stderr, "[E] AnimClip %s: keys of node %s not in time order\n",
+				m_name.c_str(), m_tracks[track].node->getName().c_str());
+		exit(1);
+	}
+	c.times.push_back(t);
+	for(int i = 0; i < n; ++i) c.values[i].push_back(v[i]);
+	m_duration = std::max(m_duration, t);
+}
+
+void AnimClip::addTransKey(size_t track, float t, const Vector3 & P) {
+	float v[3] = { P[0], P[1], P[2] };
+	addKey(track, trans, t, v, 3);
+}
+
+void AnimClip::addRotKey(size_t track, float t, const Quaternion & Q) {
+	float v[4] = { Q.x(), Q.y(), Q.z(), Q.w() };
+	addKey(track, rot, t, v, 4);
+}
+
+void AnimClip::addScaleKey(size_t track, float t, float scale) {
+	addKey(track, AnimClip::scale, t, &scale, 1);
+}
+
+// interpolation weight of key k + 1 at time t (0 if t is before the first
+// key or k is the last one)
+
+static float key_weight(const vector<float> & times, size_t k, float t) {
+	if (k + 1 >= times.size() || t <= times[k]) return 0.0f;
+	float span = times[k + 1] - times[k];
+	return span > 0.0f ? std::min((t - times[k]) / span, 1.0f) : 1.0f;
+}
+
+// keys[c] is the key of channel c at or before t (or the first one)
+
+void AnimClip::eval(const track_t & tr, const size_t *keys, float t, TRS & trs) const {
+	Vector3 P = trs.position();
+	Quaternion Q = trs.rotation();
+	float S = trs.scale();
+	const channel_t & ct = tr.channels[trans];
+	if (!ct.times.empty()) {
+		size_t k = keys[trans];
+		float u = key_weight(ct.times, k, t);
+		size_t k1 = u > 0.0f ? k + 1 : k;
+		for(int i = 0; i < 3; ++i)
+			P[i] = ct.values[i][k] + u * (ct.values[i][k1] - ct.values[i][k]);
+	}
+	const channel_t & cr = tr.channels[rot];
+	if (!cr.times.empty()) {
+		size_t k = keys[rot];
+		float u = key_weight(cr.times, k, t);
+		const vector<float> *v = cr.values;
+		Q = Quaternion(v[3][k], v[0][k], v[1][k], v[2][k]);
+		if (u > 0.0f) {
+			Quaternion Q1(v[3][k + 1], v[0][k + 1], v[1][k + 1], v[2][k + 1]);
+			Q = m_nlerp ? Quaternion::nlerp(Q, Q1, u) : Quaternion::slerp(Q, Q1, u);
+		}
+	}
+	const channel_t & cs = tr.channels[scale];
+	if (!cs.times.empty()) {
+		size_t k = keys[scale];
+		float u = key_weight(cs.times, k, t);
+		size_t k1 = u > 0.0f ? k + 1 : k;
+		S = cs.values[0][k] + u * (cs.values[0][k1] - cs.values[0][k]);
+	}
+	trs.set(P, Q, S);
+}
+
+void AnimClip::sample(size_t track, float t, TRS & trs) const {
+	const track_t & tr = m_tracks[track];
+	size_t keys[channels_n];
+	for(int c = 0; c < channels_n; ++c) {
+		const vector<float> & times = tr.channels[c].times;
+		size_t k = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+		keys[c] = k ? k - 1 : 0;
+	}
+	eval(tr, keys, t, trs);
+}
+
+// As sample, but stepping the cursors forward from the last sampled time
+// (or from the first key if t went back, as when looping)
+
+void AnimClip::sampleCursor(size_t track, float t, TRS & trs) {
+	track_t & tr = m_tracks[track];
+	size_t keys[channels_n];
+	for(int c = 0; c < channels_n; ++c) {
+		channel_t & ch = tr.channels[c];
+		size_t n = ch.times.size();
+		if (n && t < ch.times[ch.cursor]) ch.cursor = 0;
+		while (ch.cursor + 1 < n && ch.times[ch.cursor + 1] <= t) ++ch.cursor;
+		keys[c] = ch.cursor;
+	}
+	eval(tr, keys, t, trs);
+}
+
+void AnimClip::print() const {
+	printf("AnimClip %s: %zu tracks, duration %.2f%s%s\n", m_name.c_str(), m_tracks.size(),
+		   m_duration, m_loop ? ", loop" : "", m_nlerp ? ", nlerp" : "");
+	for(size_t i = 0; i < m_tracks.size(); ++i) {
+		const track_t & tr = m_tracks[i];
+		printf("  %s: %zu trans, %zu rot, %zu scale keys\n", tr.node->getName().c_str(),
+			   tr.channels[trans].times.size(), tr.channels[rot].times.size(),
+			   tr.channels[scale].times.size());
+	}
+}
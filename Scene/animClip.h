@@ -0,0 +1,92 @@
+// -*-C++-*-
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "vector3.h"
+#include "quaternion.h"
+#include "trs.h"
+#include "node.h"
+
+/**
+ * @brief Keyframe animation of the placements of some nodes
+ *
+ * A clip has one track per animated node, and every track has up to three
+ * channels (translation, rotation and scale) with their own keys. Channels
+ * without keys leave that part of the placement of the node untouched.
+ * Keys are interpolated linearly (rotations by slerp, or nlerp if asked
+ * for) and held before the first and after the last key.
+ *
+ * The keys of a channel are stored as arrays per component (SoA), and
+ * sampled through a cursor to the last key used, so that sampling at
+ * increasing times (as when playing) only steps forward instead of
+ * searching.
+ *
+ * Clips are created and played by the AnimationManager.
+ */
+
+class AnimClip {
+
+public:
+
+	const std::string & getName() const;
+
+	void setLoop(bool loop); //!< whether the clip starts again after the last key
+	bool getLoop() const;
+	void setNlerp(bool nlerp); //!< interpolate rotations by nlerp (faster) instead of slerp
+	bool getNlerp() const;
+	float getDuration() const; //!< time of the last key
+	float getTime() const; //!< time of the last pose played
+
+	/**
+	 * Add a track for node. Return the index of the track.
+	 */
+	size_t addTrack(Node *node);
+	size_t numTracks() const;
+	Node *getNode(size_t track) const;
+
+	// Add keys (in increasing time order) to the channels of a track
+	void addTransKey(size_t track, float t, const Vector3 & P);
+	void addRotKey(size_t track, float t, const Quaternion & Q);
+	void addScaleKey(size_t track, float t, float scale);
+
+	/**
+	 * Set the channels of trs to their value in 'track' at time t. Does not
+	 * use (nor change) the cursor.
+	 */
+	void sample(size_t track, float t, TRS & trs) const;
+
+	void print() const;
+
+	friend class AnimationManager;
+
+private:
+	AnimClip(const std::string & name);
+	AnimClip(const AnimClip &);
+	AnimClip & operator=(const AnimClip &);
+
+	enum { trans = 0, rot, scale, channels_n };
+
+	struct channel_t {
+		std::vector<float> times;
+		std::vector<float> values[4]; // component c of key k in values[c][k]
+		size_t cursor; // last key at or before the last sampled time
+	};
+
+	struct track_t {
+		Node *node;
+		channel_t channels[channels_n];
+	};
+
+	void addKey(size_t track, int chan, float t, const float *v, int n);
+	void sampleCursor(size_t track, float t, TRS & trs);
+	void eval(const track_t & tr, const size_t *keys, float t, TRS & trs) const;
+
+	std::string m_name;
+	std::vector<track_t> m_tracks;
+	float m_duration;
+	bool m_loop;
+	bool m_nlerp;
+	float m_time; // while playing (see AnimationManager)
+};
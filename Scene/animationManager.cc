@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <cmath>
+#include "animationManager.h"
+#include "threadPool.h"
+
+using std::string;
+using std::map;
+using std::list;
+using std::vector;
+
+static const size_t track_grain = 256; // tracks per ThreadPool chunk
+
+AnimationManager * AnimationManager::instance() {
+	static AnimationManager mgr;
+	return &mgr;
+}
+
+AnimationManager::AnimationManager() {}
+
+AnimationManager::~AnimationManager() {
+	for(map<string, AnimClip *>::iterator it = m_hash.begin(), end = m_hash.end();
+		it != end; ++it)
+		delete it->second;
+}
+
+AnimClip *AnimationManager::create(const string & key) {
+	map<string, AnimClip *>::iterator it = m_hash.find(key);
+	if (it != m_hash.end()) {
+		fprintf(stderr, "[W] duplicate animation clip %s\n", key.c_str());
+		return it->second;
+	}
+	AnimClip *newclip = new AnimClip(key);
+	it = m_hash.insert(make_pair(key, newclip)).first;
+	return it->second;
+}
+
+AnimClip *AnimationManager::find(const string & key) const {
+	map<string, AnimClip *>::const_iterator it = m_hash.find(key);
+	if (it == m_hash.end()) return 0;
+	return it->second;
+}
+
+bool AnimationManager::play(AnimClip *clip) {
+	if (isPlaying(clip)) {
+		clip->m_time = 0.0f;
+		return true;
+	}
+	for(size_t i = 0; i < clip->m_tracks.size(); ++i) {
+		const Node *node = clip->m_tracks[i].node;
+		map<const Node *, AnimClip *>::const_iterator it = m_animated.find(node);
+		if (it != m_animated.end()) {
+			fprintf(stderr, "[W] AnimationManager: node %s is animated by clip %s, clip %s not played\n",
+					node->getName().c_str(), it->second->getName().c_str(), clip->getName().c_str());
+			return false;
+		}
+	}
+	for(size_t i = 0; i < clip->m_tracks.size(); ++i) {
+		Node *node = clip->m_tracks[i].node;
+		if (!node->m_trs) node->m_trs = new TRS(*node->m_placement);
+		m_animated[node] = clip;
+	}
+	clip->m_time = 0.0f;
+	m_playing.push_back(clip);
+	updateJobs();
+	return true;
+}
+
+void AnimationManager::stop(AnimClip *clip) {
+	if (!isPlaying(clip)) return;
+	for(size_t i = 0; i < clip->m_tracks.size(); ++i)
+		m_animated.erase(clip->m_tracks[i].node);
+	m_playing.remove(clip);
+	updateJobs();
+}
+
+bool AnimationManager::isPlaying(const AnimClip *clip) const {
+	for(list<AnimClip *>::const_iterator it = m_playing.begin(), end = m_playing.end();
+		it != end; ++it)
+		if (*it == clip) return true;
+	return false;
+}
+
+void AnimationManager::updateJobs() {
+	m_jobs.clear();
+	for(list<AnimClip *>::iterator it = m_playing.begin(), end = m_playing.end();
+		it != end; ++it) {
+		AnimClip *clip = *it;
+		for(size_t i = 0; i < clip->m_tracks.size(); ++i) {
+			job_t job = { clip, i };
+			m_jobs.push_back(job);
+		}
+	}
+}
+
+void AnimationManager::update(float dt, bool parallel) {
+	if (m_playing.empty()) return;
+	vector<AnimClip *> finished;
+	for(list<AnimClip *>::iterator it = m_playing.begin(), end = m_playing.end();
+		it != end; ++it) {
+		AnimClip *clip = *it;
+		clip->m_time += dt;
+		if (clip->m_time <= clip->m_duration) continue;
+		if (clip->m_loop && clip->m_duration > 0.0f)
+			clip->m_time = fmodf(clip->m_time, clip->m_duration);
+		else {
+			clip->m_time = clip->m_duration;
+			finished.push_back(clip);
+		}
+	}
+	// every track writes the TRS of its own node
+	ThreadPool::range_fn sample = [this](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) {
+			AnimClip *clip = m_jobs[i].clip;
+			size_t track = m_jobs[i].track;
+			clip->sampleCursor(track, clip->m_time, *clip->m_tracks[track].node->m_trs);
+		}
+	};
+	if (parallel)
+		ThreadPool::instance()->parallelFor(m_jobs.size(), track_grain, sample);
+	else
+		sample(0, m_jobs.size());
+	m_roots.clear();
+	for(size_t i = 0; i < m_jobs.size(); ++i) {
+		Node *root = m_jobs[i].clip->m_tracks[m_jobs[i].track].node->markDirty();
+		if (root) m_roots.push_back(root);
+	}
+	for(size_t i = 0; i < m_roots.size(); ++i)
+		m_roots[i]->updateDirty();
+	for(size_t i = 0; i < finished.size(); ++i)
+		stop(finished[i]);
+}
+
+void AnimationManager::print() const {
+	for(map<string, AnimClip *>::const_iterator it = m_hash.begin(), end = m_hash.end();
+		it != end; ++it) {
+		it->second->print();
+		if (isPlaying(it->second)) printf("  playing at %.2f\n", it->second->m_time);
+	}
+}
+
+AnimationManager::iterator AnimationManager::begin() { return AnimationManager::iterator(m_hash.begin()); }
+AnimationManager::iterator AnimationManager::end() { return AnimationManager::iterator(m_hash.end()); }
@@ -0,0 +1,88 @@
+// -*-C++-*-
+
+#pragma once
+
+#include <string>
+#include <map>
+#include <list>
+#include <vector>
+#include "mgriter.h"
+#include "animClip.h"
+
+/**
+ * @brief Registry and player of the animation clips
+ *
+ * Every frame, update() advances the playing clips and writes their poses
+ * into the TRS placements of their nodes (see Node::setTRS; nodes are
+ * switched to TRS placements when a clip starts playing). The tracks of
+ * all the playing clips are sampled in the ThreadPool. The nodes are only
+ * marked as dirty, and the world transformations and BBoxes are updated
+ * afterwards in one pass over the changed subtrees (instead of one
+ * Node::updateGS per node).
+ *
+ * A node can only be animated by one playing clip at a time.
+ */
+
+class AnimationManager {
+
+public:
+	static AnimationManager * instance();
+
+	/**
+	 * Register a new clip
+	 *
+	 * If name is new, create new clip and register it.
+	 * If clip already exists, return it
+	 *
+	 */
+	AnimClip *create(const std::string & name);
+
+	/**
+	 * Get a registered clip
+	 *
+	 * Return the clip or 0 if not found
+	 */
+	AnimClip *find(const std::string & name) const;
+
+	/**
+	 * Play a clip from its start. Return false (and don't play it) if some
+	 * of its nodes is animated by another playing clip.
+	 */
+	bool play(AnimClip *clip);
+	void stop(AnimClip *clip);
+	bool isPlaying(const AnimClip *clip) const;
+
+	/**
+	 * Advance the playing clips dt seconds, and update the nodes. Clips which
+	 * don't loop stop after their last key.
+	 *
+	 * @param parallel whether to sample the tracks in the ThreadPool
+	 */
+	void update(float dt, bool parallel = true);
+
+	void print() const;
+
+	// iterate over all clips
+	typedef mgrIter<AnimClip *> iterator;
+	iterator begin();
+	iterator end();
+
+private:
+	AnimationManager();
+	~AnimationManager();
+	AnimationManager(const AnimationManager &);
+	AnimationManager & operator=(const AnimationManager &);
+
+	void updateJobs();
+
+	struct job_t {
+		AnimClip *clip;
+		size_t track;
+	};
+
+	std::map<std::string, AnimClip *> m_hash;
+	std::list<AnimClip *> m_playing;
+	std::map<const Node *, AnimClip *> m_animated; // node -> playing clip
+	std::vector<job_t> m_jobs; // the tracks of the playing clips
+	std::vector<Node *> m_roots; // (scratch) roots of the dirty trees
+};
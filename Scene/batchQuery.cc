@@ -0,0 +1,427 @@
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <stdint.h>
+#include "batchQuery.h"
+#include "scene.h"
+#include "collisionGrid.h"
+#include "dynamicTree.h"
+#include "threadPool.h"
+#include "intersect.h"
+
+using std::vector;
+using std::pair;
+
+// packets answered by every task of the ThreadPool
+static const size_t packets_grain = 8;
+
+// a packet whose box is larger than this times the boxes of its queries
+// walks the grid query by query
+static const float coherent_ratio = 8.0f;
+
+BatchQuery * BatchQuery::instance() {
+	static BatchQuery mgr;
+	return &mgr;
+}
+
+BatchQuery::BatchQuery() {}
+
+BatchQuery::~BatchQuery() {}
+
+/*
+ * Packets. The boxes (or rays) of the queries are stored by axis, one query
+ * per lane. Unused lanes hold empty boxes (rays with tmax < 0), which
+ * overlap nothing.
+ */
+
+struct BatchQuery::volume_t {
+	enum kind_t { spheres, sweeps, boxes } kind;
+	int n;                // queries in the packet
+	size_t idx[packet];   // index of every lane in the arrays
+	float bmin[3][packet];
+	float bmax[3][packet];
+	// the arrays of the batch
+	const BSphere *sph;
+	const Vector3 *d;
+	const BBox *box;
+	Node::sweep_t *hits;
+	const Node **res;
+};
+
+struct BatchQuery::rays_t {
+	int n;
+	size_t idx[packet];
+	float origin[3][packet];
+	float inv[3][packet]; // 1 / direction
+	float tmax[packet];   // closest intersection so far
+	const Line *rays;
+	Node::hit_t *hits;
+	const Node **res;
+};
+
+static bool empty(const BBox *box) {
+	return box->m_min[0] > box->m_max[0];
+}
+
+// lanes of the packet whose box overlaps 'box'
+
+static unsigned int overlap4(const float (*bmin)[4], const float (*bmax)[4], const BBox *box) {
+#ifdef TRFM_SSE
+	__m128 in = _mm_cmple_ps(_mm_set1_ps(box->m_min[0]), _mm_loadu_ps(bmax[0]));
+	in = _mm_and_ps(in, _mm_cmpge_ps(_mm_set1_ps(box->m_max[0]), _mm_loadu_ps(bmin[0])));
+	for(int i = 1; i < 3; ++i) {
+		in = _mm_and_ps(in, _mm_cmple_ps(_mm_set1_ps(box->m_min[i]), _mm_loadu_ps(bmax[i])));
+		in = _mm_and_ps(in, _mm_cmpge_ps(_mm_set1_ps(box->m_max[i]), _mm_loadu_ps(bmin[i])));
+	}
+	return _mm_movemask_ps(in);
+#else
+	unsigned int mask = 0;
+	for(int l = 0; l < 4; ++l) {
+		bool in = true;
+		for(int i = 0; i < 3; ++i)
+			in = in && box->m_min[i] <= bmax[i][l] && box->m_max[i] >= bmin[i][l];
+		if (in) mask |= 1u << l;
+	}
+	return mask;
+#endif
+}
+
+// spread the 10 low bits of x every 3 bits
+
+static uint32_t spread(uint32_t x) {
+	x &= 0x3ff;
+	x = (x | (x << 16)) & 0x030000ff;
+	x = (x | (x << 8)) & 0x0300f00f;
+	x = (x | (x << 4)) & 0x030c30c3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+// indices of the queries, sorted along the Morton curve of their keys (the
+// order of the batch is kept between equal keys)
+
+void BatchQuery::order(const vector<Vector3> & keys, vector<size_t> & idx) {
+	size_t n = keys.size();
+	idx.resize(n);
+	if (!n) return;
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, scale[3];
+	float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for(size_t i = 0; i < n; ++i)
+		for(int j = 0; j < 3; ++j) {
+			lo[j] = std::min(lo[j], keys[i][j]);
+			hi[j] = std::max(hi[j], keys[i][j]);
+		}
+	for(int j = 0; j < 3; ++j)
+		scale[j] = hi[j] > lo[j] ? 1023.0f / (hi[j] - lo[j]) : 0.0f;
+	// code in the high bits, index in the low ones
+	vector<uint64_t> codes(n);
+	for(size_t i = 0; i < n; ++i) {
+		uint64_t code = 0;
+		for(int j = 0; j < 3; ++j)
+			code |= spread((uint32_t) ((keys[i][j] - lo[j]) * scale[j])) << j;
+		codes[i] = code << 32 | i;
+	}
+	std::sort(codes.begin(), codes.end());
+	for(size_t i = 0; i < n; ++i) idx[i] = (size_t) (codes[i] & 0xffffffff);
+}
+
+// the leaves whose BBox overlaps the box of some query in 'lanes'. Nodes
+// which skip collisions are pruned, but for proximity queries.
+
+void BatchQuery::gatherTree(const Node *node, const volume_t & p, unsigned int lanes,
+							vector<const Node *> & leaves) {
+	if (!node->m_checkCollision && p.kind != volume_t::boxes) return;
+	if (!(overlap4(p.bmin, p.bmax, node->m_containerWC) & lanes)) return;
+	if (node->m_gObject) leaves.push_back(node);
+	for(std::list<Node *>::const_iterator it = node->m_children.begin(), end = node->m_children.end();
+		it != end; ++it) {
+		if ((*it)->m_dynamic) continue; // see DynamicTree
+		gatherTree(*it, p, lanes, leaves);
+	}
+}
+
+// candidate leaves for the queries in 'lanes': the leaves in the cells of
+// the grid around them (if any), or the leaves of the tree they overlap
+
+void BatchQuery::gather(const volume_t & p, unsigned int lanes, vector<const Node *> & leaves) {
+	CollisionGrid *grid = CollisionGrid::instance();
+	if (!grid->active()) {
+		gatherTree(Scene::instance()->rootNode(), p, lanes, leaves);
+		return;
+	}
+	BBox box;
+	for(int l = 0; l < p.n; ++l) {
+		if (!(lanes & (1u << l))) continue;
+		box.add(Vector3(p.bmin[0][l], p.bmin[1][l], p.bmin[2][l]));
+		box.add(Vector3(p.bmax[0][l], p.bmax[1][l], p.bmax[2][l]));
+	}
+	grid->overlapping(box, leaves);
+}
+
+static float volume(const float *bmin, const float *bmax) {
+	float v = 1.0f;
+	for(int i = 0; i < 3; ++i) v *= std::max(bmax[i] - bmin[i], 1e-6f);
+	return v;
+}
+
+void BatchQuery::answer(volume_t & p, vector<const Node *> & leaves) {
+	unsigned int full = (1u << p.n) - 1;
+	// Coherent queries walk the grid once, for the box of the whole packet.
+	// Queries far apart would visit all the cells between them: they walk
+	// the grid one by one, as single queries.
+	CollisionGrid *grid = CollisionGrid::instance();
+	bool coherent = !grid->active();
+	if (!coherent) {
+		float lmin[3], lmax[3], umin[3], umax[3], sum = 0.0f;
+		for(int i = 0; i < 3; ++i) {
+			umin[i] = FLT_MAX;
+			umax[i] = -FLT_MAX;
+		}
+		for(int l = 0; l < p.n; ++l) {
+			for(int i = 0; i < 3; ++i) {
+				lmin[i] = p.bmin[i][l];
+				lmax[i] = p.bmax[i][l];
+				umin[i] = std::min(umin[i], lmin[i]);
+				umax[i] = std::max(umax[i], lmax[i]);
+			}
+			sum += volume(lmin, lmax);
+		}
+		coherent = volume(umin, umax) <= coherent_ratio * sum;
+	}
+	unsigned int open = full; // lanes still looking for a node
+	for(int l = 0; !coherent && l < p.n && p.kind != volume_t::boxes; ++l) {
+		size_t i = p.idx[l];
+		if (p.kind == volume_t::spheres) p.res[i] = grid->checkCollision(&p.sph[i]);
+		else p.res[i] = grid->sweepSphere(&p.sph[i], p.d[i], p.hits[i]);
+		open = 0;
+	}
+	for(int g = 0; open && g < (coherent ? 1 : p.n); ++g) {
+		unsigned int group = coherent ? full : 1u << g;
+		leaves.clear();
+		gather(p, group, leaves);
+		for(size_t k = 0; k < leaves.size(); ++k) {
+			const Node *leaf = leaves[k];
+			unsigned int mask = overlap4(p.bmin, p.bmax, leaf->m_containerWC) & group & open;
+			if (!mask) continue;
+			for(int l = 0; l < p.n; ++l) {
+				if (!(mask & (1u << l))) continue;
+				size_t i = p.idx[l];
+				switch(p.kind) {
+				case volume_t::spheres:
+					if (BSphereBBoxIntersect(&p.sph[i], leaf->m_containerWC) != IINTERSECT) break;
+					if (!leaf->collisionsEnabled() || !leaf->collideLeaf(&p.sph[i])) break;
+					p.res[i] = leaf;
+					open &= ~(1u << l);
+					break;
+				case volume_t::sweeps:
+					if (leaf->collisionsEnabled() && leaf->sweepLeaf(&p.sph[i], p.d[i], p.hits[i])) p.res[i] = leaf;
+					break;
+				case volume_t::boxes:
+					p.res[i] = leaf;
+					open &= ~(1u << l);
+					break;
+				}
+			}
+		}
+	}
+	// the dynamic leaves, query by query
+	DynamicTree *dyn = DynamicTree::instance();
+	if (!dyn->size()) return;
+	for(int l = 0; l < p.n; ++l) {
+		size_t i = p.idx[l];
+		switch(p.kind) {
+		case volume_t::spheres:
+			if (!p.res[i]) p.res[i] = dyn->checkCollision(&p.sph[i]);
+			break;
+		case volume_t::sweeps: {
+			Node::sweep_t dhit;
+			const Node *dres = dyn->sweepSphere(&p.sph[i], p.d[i], dhit);
+			if (dres && dhit.t < p.hits[i].t) {
+				p.hits[i] = dhit;
+				p.res[i] = dres;
+			}
+			break;
+		}
+		case volume_t::boxes:
+			if (!p.res[i]) p.res[i] = dyn->overlapBox(&p.box[i]);
+			break;
+		}
+	}
+}
+
+// Split the queries of 'proto' (with their boxes in proto's first lane
+// slots) in packets of neighbours, and answer them in parallel
+
+void BatchQuery::answerVolumes(volume_t & proto, const vector<Vector3> & keys) {
+	size_t n = keys.size();
+	vector<size_t> idx;
+	order(keys, idx);
+	size_t packets = (n + packet - 1) / packet;
+	ThreadPool::instance()->parallelFor(packets, packets_grain, [&](size_t begin, size_t end) {
+		vector<const Node *> leaves;
+		for(size_t k = begin; k != end; ++k) {
+			volume_t p = proto;
+			p.n = (int) std::min((size_t) packet, n - k * packet);
+			for(int l = 0; l < packet; ++l) {
+				for(int j = 0; j < 3; ++j) {
+					p.bmin[j][l] = FLT_MAX;
+					p.bmax[j][l] = -FLT_MAX;
+				}
+				if (l >= p.n) continue;
+				size_t i = p.idx[l] = idx[k * packet + l];
+				p.res[i] = 0;
+				BBox box;
+				switch(p.kind) {
+				case volume_t::spheres:
+				case volume_t::sweeps: {
+					const BSphere & s = p.sph[i];
+					Vector3 R(s.m_radius, s.m_radius, s.m_radius);
+					box.add(s.m_centre - R);
+					box.add(s.m_centre + R);
+					if (p.kind == volume_t::sweeps) {
+						box.add(s.m_centre + p.d[i] - R);
+						box.add(s.m_centre + p.d[i] + R);
+						p.hits[i].t = 1.0f;
+					}
+					break;
+				}
+				case volume_t::boxes:
+					box.clone(&p.box[i]);
+					break;
+				}
+				for(int j = 0; j < 3; ++j) {
+					p.bmin[j][l] = box.m_min[j];
+					p.bmax[j][l] = box.m_max[j];
+				}
+			}
+			answer(p, leaves);
+		}
+	});
+}
+
+void BatchQuery::checkCollision(const BSphere *spheres, size_t n, const Node **res) {
+	vector<Vector3> keys(n);
+	for(size_t i = 0; i < n; ++i) keys[i] = spheres[i].m_centre;
+	volume_t p;
+	p.kind = volume_t::spheres;
+	p.sph = spheres;
+	p.res = res;
+	answerVolumes(p, keys);
+}
+
+void BatchQuery::sweepSphere(const BSphere *spheres, const Vector3 *d, size_t n,
+							 Node::sweep_t *hits, const Node **res) {
+	vector<Vector3> keys(n);
+	for(size_t i = 0; i < n; ++i) keys[i] = spheres[i].m_centre + 0.5f * d[i];
+	volume_t p;
+	p.kind = volume_t::sweeps;
+	p.sph = spheres;
+	p.d = d;
+	p.hits = hits;
+	p.res = res;
+	answerVolumes(p, keys);
+}
+
+void BatchQuery::overlapBox(const BBox *boxes, size_t n, const Node **res) {
+	vector<Vector3> keys(n);
+	for(size_t i = 0; i < n; ++i) keys[i] = 0.5f * (boxes[i].m_min + boxes[i].m_max);
+	volume_t p;
+	p.kind = volume_t::boxes;
+	p.box = boxes;
+	p.res = res;
+	answerVolumes(p, keys);
+}
+
+// Front to back traversal of the static tree, shared by the rays of the
+// packet: a node is visited if some ray reaches it before its closest
+// intersection so far, and the children are visited in the order the
+// first of those rays reaches them.
+
+void BatchQuery::answerRays(rays_t & p, vector<pair<float, const Node *> > & stack) {
+	stack.clear();
+	stack.push_back(std::make_pair(0.0f, (const Node *) Scene::instance()->rootNode()));
+	float tnear[packet];
+	while(!stack.empty()) {
+		const Node *node = stack.back().second;
+		stack.pop_back();
+		if (empty(node->m_containerWC)) continue;
+		unsigned int mask = IntersectBBoxRay4(node->m_containerWC, p.origin, p.inv, p.tmax, tnear);
+		if (!mask) continue;
+		if (node->m_gObject) {
+			for(int l = 0; l < p.n; ++l) {
+				if (!(mask & (1u << l))) continue;
+				size_t i = p.idx[l];
+				// (a node with geometry and children: the whole subtree)
+				if (node->intersectRayWC(p.rays[i], p.hits[i])) p.res[i] = node;
+				p.tmax[l] = p.hits[i].t;
+			}
+			continue;
+		}
+		size_t base = stack.size();
+		for(std::list<Node *>::const_iterator it = node->m_children.begin(), end = node->m_children.end();
+			it != end; ++it) {
+			const Node *child = *it;
+			if (child->m_dynamic || empty(child->m_containerWC)) continue; // see DynamicTree
+			unsigned int cmask = IntersectBBoxRay4(child->m_containerWC, p.origin, p.inv, p.tmax, tnear);
+			if (!cmask) continue;
+			float t = FLT_MAX;
+			for(int l = 0; l < p.n; ++l)
+				if (cmask & (1u << l)) t = std::min(t, tnear[l]);
+			stack.push_back(std::make_pair(t, child));
+		}
+		// the closest child on top
+		std::sort(stack.begin() + base, stack.end(), std::greater<pair<float, const Node *> >());
+	}
+	DynamicTree *dyn = DynamicTree::instance();
+	if (!dyn->size()) return;
+	for(int l = 0; l < p.n; ++l) {
+		size_t i = p.idx[l];
+		Node::hit_t dhit;
+		const Node *dres = dyn->intersectRay(p.rays[i], dhit, p.hits[i].t);
+		if (dres) {
+			p.hits[i] = dhit;
+			p.res[i] = dres;
+		}
+	}
+}
+
+void BatchQuery::intersectRay(const Line *rays, size_t n, Node::hit_t *hits, const Node **res,
+							  float tmax) {
+	// rays from the same point stay in the order of the batch (as the pixels
+	// of a screen)
+	vector<Vector3> keys(n);
+	for(size_t i = 0; i < n; ++i) keys[i] = rays[i].m_O;
+	vector<size_t> idx;
+	order(keys, idx);
+	size_t packets = (n + packet - 1) / packet;
+	ThreadPool::instance()->parallelFor(packets, packets_grain, [&](size_t begin, size_t end) {
+		vector<pair<float, const Node *> > stack;
+		for(size_t k = begin; k != end; ++k) {
+			rays_t p;
+			p.n = (int) std::min((size_t) packet, n - k * packet);
+			p.rays = rays;
+			p.hits = hits;
+			p.res = res;
+			for(int l = 0; l < packet; ++l) {
+				if (l >= p.n) {
+					for(int j = 0; j < 3; ++j) {
+						p.origin[j][l] = 0.0f;
+						p.inv[j][l] = 1.0f;
+					}
+					p.tmax[l] = -1.0f;
+					continue;
+				}
+				size_t i = p.idx[l] = idx[k * packet + l];
+				const Line & ray = rays[i];
+				for(int j = 0; j < 3; ++j) {
+					p.origin[j][l] = ray.m_O[j];
+					p.inv[j][l] = ray.m_d[j] != 0.0f ? 1.0f / ray.m_d[j] : FLT_MAX;
+				}
+				p.tmax[l] = tmax;
+				hits[i].t = tmax;
+				res[i] = 0;
+			}
+			answerRays(p, stack);
+		}
+	});
+}
@@ -0,0 +1,83 @@
+// -*-C++-*-
+
+#pragma once
+
+/**
+ * @brief Many collision and proximity queries at once (crowds of agents)
+ *
+ * Every function answers an array of queries on the whole scene (the static
+ * part of the tree, through the CollisionGrid if there is one, and the
+ * dynamic leaves, see DynamicTree), as the single queries of Scene.
+ *
+ * Queries are sorted along a Morton curve, so that neighbour queries end up
+ * together, and grouped in packets of 'packet' queries. The queries of a
+ * packet share one traversal of the tree (or one walk over the cells of the
+ * grid), and every BBox is tested against all of them at once (with SSE,
+ * one query per lane). Packets are answered in parallel by the ThreadPool.
+ */
+
+#include <cstddef>
+#include <cfloat>
+#include <vector>
+#include "bbox.h"
+#include "bsphere.h"
+#include "line.h"
+#include "node.h"
+
+class BatchQuery {
+
+public:
+	static BatchQuery * instance();
+
+	static const int packet = 4; // queries traversed together
+
+	/**
+	 * As Scene::checkCollision, for n spheres (in world coord.).
+	 *
+	 * @param res  res[i] is a node which collides with spheres[i] (0 if none)
+	 */
+	void checkCollision(const BSphere *spheres, size_t n, const Node **res);
+
+	/**
+	 * As Scene::sweepSphere, for n spheres moving by d[i].
+	 *
+	 * @param hits the first contact of every sphere
+	 * @param res  res[i] is the node touched first by spheres[i] (0 if none)
+	 */
+	void sweepSphere(const BSphere *spheres, const Vector3 *d, size_t n,
+					 Node::sweep_t *hits, const Node **res);
+
+	/**
+	 * As Scene::intersectRay, for n rays.
+	 *
+	 * @param hits the closest intersection of every ray
+	 * @param res  res[i] is the node intersected by rays[i] (0 if none)
+	 */
+	void intersectRay(const Line *rays, size_t n, Node::hit_t *hits, const Node **res,
+					  float tmax = FLT_MAX);
+
+	/**
+	 * Proximity: for n boxes (in world coord.), a leaf whose BBox overlaps
+	 * each of them.
+	 *
+	 * @param res  res[i] is a leaf near boxes[i] (0 if none)
+	 */
+	void overlapBox(const BBox *boxes, size_t n, const Node **res);
+
+private:
+	BatchQuery();
+	~BatchQuery();
+	BatchQuery(const BatchQuery &);
+	BatchQuery & operator=(const BatchQuery &);
+
+	struct volume_t; // a packet of queries with a box each (see batchQuery.cc)
+	struct rays_t;   // a packet of rays
+
+	static void order(const std::vector<Vector3> & keys, std::vector<size_t> & idx);
+	static void gather(const volume_t & p, unsigned int lanes, std::vector<const Node *> & leaves);
+	static void gatherTree(const Node *node, const volume_t & p, unsigned int lanes,
+						   std::vector<const Node *> & leaves);
+	static void answer(volume_t & p, std::vector<const Node *> & leaves);
+	static void answerRays(rays_t & p, std::vector<std::pair<float, const Node *> > & stack);
+	static void answerVolumes(volume_t & proto, const std::vector<Vector3> & keys);
+};
@@ -0,0 +1,270 @@
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include "collisionGrid.h"
+#include "node.h"
+#include "intersect.h"
+
+using std::vector;
+using std::unordered_map;
+
+CollisionGrid * CollisionGrid::instance() {
+	static CollisionGrid mgr;
+	return &mgr;
+}
+
+CollisionGrid::CollisionGrid() : m_root(0), m_cellSize(1.0f) {}
+
+CollisionGrid::~CollisionGrid() {}
+
+// cells are keyed on 21 bits of each coordinate (far cells which share a key
+// only cost some extra tests)
+
+static uint64_t cell_key(int x, int y, int z) {
+	return ((uint64_t) (x & 0x1fffff) << 42) | ((uint64_t) (y & 0x1fffff) << 21) |
+		(uint64_t) (z & 0x1fffff);
+}
+
+static int cell_coord(float v, float cellSize) {
+	float c = floorf(v / cellSize);
+	return (int) std::max(std::min(c, 1e9f), -1e9f);
+}
+
+// cells overlapped by box (lo > hi if the box is empty)
+
+void CollisionGrid::cells(const BBox & box, int *lo, int *hi) const {
+	for(int i = 0; i < 3; ++i) {
+		if (box.m_min[i] > box.m_max[i]) {
+			lo[0] = lo[1] = lo[2] = 0;
+			hi[0] = hi[1] = hi[2] = -1;
+			return;
+		}
+		lo[i] = cell_coord(box.m_min[i], m_cellSize);
+		hi[i] = cell_coord(box.m_max[i], m_cellSize);
+	}
+}
+
+void CollisionGrid::link(entry_t *e) {
+	cells(e->box, e->lo, e->hi);
+	double n = 1.0;
+	for(int i = 0; i < 3; ++i) n *= std::max(e->hi[i] - e->lo[i] + 1, 0);
+	e->big = n > max_cells;
+	if (e->big) {
+		m_big.push_back(e);
+		return;
+	}
+	for(int x = e->lo[0]; x <= e->hi[0]; ++x)
+		for(int y = e->lo[1]; y <= e->hi[1]; ++y)
+			for(int z = e->lo[2]; z <= e->hi[2]; ++z)
+				m_cells[cell_key(x, y, z)].push_back(e);
+}
+
+void CollisionGrid::unlink(entry_t *e) {
+	if (e->big) {
+		vector<entry_t *>::iterator it = std::find(m_big.begin(), m_big.end(), e);
+		if (it != m_big.end()) {
+			*it = m_big.back();
+			m_big.pop_back();
+		}
+		return;
+	}
+	for(int x = e->lo[0]; x <= e->hi[0]; ++x)
+		for(int y = e->lo[1]; y <= e->hi[1]; ++y)
+			for(int z = e->lo[2]; z <= e->hi[2]; ++z) {
+				unordered_map<uint64_t, vector<entry_t *> >::iterator it = m_cells.find(cell_key(x, y, z));
+				if (it == m_cells.end()) continue;
+				vector<entry_t *> & v = it->second;
+				vector<entry_t *>::iterator eit = std::find(v.begin(), v.end(), e);
+				if (eit != v.end()) {
+					*eit = v.back();
+					v.pop_back();
+				}
+				if (v.empty()) m_cells.erase(it);
+			}
+}
+
+void CollisionGrid::collectLeaves(const Node *node, vector<const Node *> & leaves) {
+	if (node->m_gObject) {
+		if (!node->m_dynamic) leaves.push_back(node); // (see DynamicTree)
+		return;
+	}
+	for(std::list<Node *>::const_iterator it = node->m_children.begin(), end = node->m_children.end();
+		it != end; ++it)
+		collectLeaves(*it, leaves);
+}
+
+void CollisionGrid::build(Node *root, float cellSize) {
+	clear();
+	if (!root) return;
+	vector<const Node *> leaves;
+	collectLeaves(root, leaves);
+	if (cellSize <= 0.0f) {
+		double sum = 0.0;
+		size_t n = 0;
+		for(size_t i = 0; i < leaves.size(); ++i) {
+			const BBox *box = leaves[i]->m_containerWC;
+			if (box->m_min[0] > box->m_max[0]) continue;
+			Vector3 d = box->m_max - box->m_min;
+			sum += std::max(d[0], std::max(d[1], d[2]));
+			++n;
+		}
+		cellSize = n && sum > 0.0 ? sum / n : 1.0f;
+	}
+	m_root = root;
+	m_cellSize = cellSize;
+	m_leaves.reserve(leaves.size());
+	for(size_t i = 0; i < leaves.size(); ++i)
+		insert(leaves[i]);
+}
+
+void CollisionGrid::clear() {
+	m_root = 0;
+	m_leaves.clear();
+	m_cells.clear();
+	m_big.clear();
+}
+
+bool CollisionGrid::active() const { return m_root != 0; }
+
+bool CollisionGrid::indexes(const Node *node) const {
+	if (!m_root) return false;
+	for(; node; node = node->m_parent)
+		if (node == m_root) return true;
+	return false;
+}
+
+void CollisionGrid::insert(const Node *node) {
+	if (!m_root) return;
+	if (!node->m_gObject) {
+		for(std::list<Node *>::const_iterator it = node->m_children.begin(), end = node->m_children.end();
+			it != end; ++it)
+			insert(*it);
+		return;
+	}
+	if (node->m_dynamic) return; // in DynamicTree
+	std::pair<unordered_map<const Node *, entry_t>::iterator, bool> res =
+		m_leaves.insert(std::make_pair(node, entry_t()));
+	if (!res.second) return; // already registered
+	entry_t *e = &res.first->second; // (elements of m_leaves don't move)
+	e->node = node;
+	e->box.clone(node->m_containerWC);
+	link(e);
+}
+
+void CollisionGrid::remove(const Node *node) {
+	if (!m_root) return;
+	for(std::list<Node *>::const_iterator it = node->m_children.begin(), end = node->m_children.end();
+		it != end; ++it)
+		remove(*it);
+	unordered_map<const Node *, entry_t>::iterator it = m_leaves.find(node);
+	if (it == m_leaves.end()) return;
+	unlink(&it->second);
+	m_leaves.erase(it);
+}
+
+void CollisionGrid::update(const Node *leaf) {
+	unordered_map<const Node *, entry_t>::iterator it = m_leaves.find(leaf);
+	if (it == m_leaves.end()) return;
+	entry_t *e = &it->second;
+	e->box.clone(leaf->m_containerWC);
+	int lo[3], hi[3];
+	cells(e->box, lo, hi);
+	if (std::equal(lo, lo + 3, e->lo) && std::equal(hi, hi + 3, e->hi)) return; // same cells
+	unlink(e);
+	link(e);
+}
+
+// the leaf of e, if it collides with bsph
+
+const Node *CollisionGrid::test(const entry_t *e, const BSphere *bsph) const {
+	if (BSphereBBoxIntersect(bsph, &e->box) != IINTERSECT) return 0;
+	if (!e->node->collisionsEnabled() || !e->node->collideLeaf(bsph)) return 0;
+	return e->node;
+}
+
+const Node *CollisionGrid::checkCollision(const BSphere *bsph) const {
+	if (!m_root) return 0;
+	Vector3 R(bsph->m_radius, bsph->m_radius, bsph->m_radius);
+	BBox box(bsph->m_centre - R, bsph->m_centre + R);
+	int lo[3], hi[3];
+	cells(box, lo, hi);
+	for(int x = lo[0]; x <= hi[0]; ++x)
+		for(int y = lo[1]; y <= hi[1]; ++y)
+			for(int z = lo[2]; z <= hi[2]; ++z) {
+				unordered_map<uint64_t, vector<entry_t *> >::const_iterator it = m_cells.find(cell_key(x, y, z));
+				if (it == m_cells.end()) continue;
+				const vector<entry_t *> & v = it->second;
+				for(size_t i = 0; i < v.size(); ++i) {
+					const entry_t *e = v[i];
+					// test every leaf only in the first cell it shares with the sphere
+					if (std::max(lo[0], e->lo[0]) != x || std::max(lo[1], e->lo[1]) != y ||
+						std::max(lo[2], e->lo[2]) != z) continue;
+					const Node *res = test(e, bsph);
+					if (res) return res;
+				}
+			}
+	for(size_t i = 0; i < m_big.size(); ++i) {
+		const Node *res = test(m_big[i], bsph);
+		if (res) return res;
+	}
+	return 0;
+}
+
+const Node *CollisionGrid::sweepSphere(const BSphere *bsph, const Vector3 & d,
+									   Node::sweep_t & hit) const {
+	hit.t = 1.0f;
+	if (!m_root) return 0;
+	Vector3 R(bsph->m_radius, bsph->m_radius, bsph->m_radius);
+	BBox box(bsph->m_centre - R, bsph->m_centre + R);
+	box.add(bsph->m_centre + d - R);
+	box.add(bsph->m_centre + d + R);
+	const Node *res = 0;
+	int lo[3], hi[3];
+	cells(box, lo, hi);
+	for(int x = lo[0]; x <= hi[0]; ++x)
+		for(int y = lo[1]; y <= hi[1]; ++y)
+			for(int z = lo[2]; z <= hi[2]; ++z) {
+				unordered_map<uint64_t, vector<entry_t *> >::const_iterator it = m_cells.find(cell_key(x, y, z));
+				if (it == m_cells.end()) continue;
+				const vector<entry_t *> & v = it->second;
+				for(size_t i = 0; i < v.size(); ++i) {
+					const entry_t *e = v[i];
+					if (std::max(lo[0], e->lo[0]) != x || std::max(lo[1], e->lo[1]) != y ||
+						std::max(lo[2], e->lo[2]) != z) continue;
+					if (BBoxBBoxIntersect(&box, &e->box) == IREJECT || !e->node->collisionsEnabled()) continue;
+					if (e->node->sweepLeaf(bsph, d, hit)) res = e->node;
+				}
+			}
+	for(size_t i = 0; i < m_big.size(); ++i) {
+		const entry_t *e = m_big[i];
+		if (BBoxBBoxIntersect(&box, &e->box) == IREJECT || !e->node->collisionsEnabled()) continue;
+		if (e->node->sweepLeaf(bsph, d, hit)) res = e->node;
+	}
+	return res;
+}
+
+void CollisionGrid::overlapping(const BBox & box, vector<const Node *> & leaves) const {
+	if (!m_root) return;
+	int lo[3], hi[3];
+	cells(box, lo, hi);
+	for(int x = lo[0]; x <= hi[0]; ++x)
+		for(int y = lo[1]; y <= hi[1]; ++y)
+			for(int z = lo[2]; z <= hi[2]; ++z) {
+				unordered_map<uint64_t, vector<entry_t *> >::const_iterator it = m_cells.find(cell_key(x, y, z));
+				if (it == m_cells.end()) continue;
+				const vector<entry_t *> & v = it->second;
+				for(size_t i = 0; i < v.size(); ++i) {
+					const entry_t *e = v[i];
+					if (std::max(lo[0], e->lo[0]) != x || std::max(lo[1], e->lo[1]) != y ||
+						std::max(lo[2], e->lo[2]) != z) continue;
+					leaves.push_back(e->node);
+				}
+			}
+	for(size_t i = 0; i < m_big.size(); ++i)
+		leaves.push_back(m_big[i]->node);
+}
+
+void CollisionGrid::print() const {
+	printf("CollisionGrid: %zu leaves, %zu cells of size %.2f, %zu leaves in all cells\n",
+		   m_leaves.size(), m_cells.size(), m_cellSize, m_big.size());
+}
@@ -0,0 +1,102 @@
+// -*-C++-*-
+
+#pragma once
+
+/**
+ * @brief Broadphase for collisions with the scene
+ *
+ * A hashed uniform grid of the leaves (nodes with geometry) of a tree,
+ * keyed on their BBox in world coordinates. Every leaf is registered in the
+ * cells its BBox overlaps, so that a collision query only tests the leaves
+ * in the cells around the sphere, instead of descending the tree. The leaves
+ * found are then tested against their triangles (see Node::checkCollision). Leaves
+ * which overlap too many cells (floors, terrain) are kept in a list which
+ * every query tests.
+ *
+ * The grid follows the tree: nodes update their cells when they move (see
+ * Node::updateBB), and subtrees are registered when attached below the
+ * indexed root, and removed when detached. Dynamic leaves (see
+ * Node::setDynamic) are left to DynamicTree.
+ */
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "bbox.h"
+#include "bsphere.h"
+#include "node.h"
+
+class CollisionGrid {
+
+public:
+	static CollisionGrid * instance();
+
+	/**
+	 * Index the leaves of the tree starting at 'root' (replaces the
+	 * previous grid)
+	 *
+	 * @param cellSize  side of the cells. If 0, the mean of the largest side
+	 *                  of the leaves' BBoxes
+	 */
+	void build(Node *root, float cellSize = 0.0f);
+	void clear();
+	bool active() const; // whether there is a grid
+
+	/**
+	 * Check wether a BSphere (in world coord.) collides with the indexed
+	 * tree, as Node::checkCollision. Safe to call from several threads.
+	 *
+	 * @return the leaf which collided with the BSphere. 0 if not collision.
+	 */
+	const Node *checkCollision(const BSphere *bsph) const;
+
+	/**
+	 * First contact of a BSphere moving to its position + d, as
+	 * Node::sweepSphere. Safe to call from several threads.
+	 */
+	const Node *sweepSphere(const BSphere *bsph, const Vector3 & d, Node::sweep_t & hit) const;
+
+	/**
+	 * Add to 'leaves' the leaves registered in the cells which 'box' (in
+	 * world coord.) overlaps, and the leaves in all cells (each leaf once,
+	 * not tested against the box). Safe to call from several threads.
+	 */
+	void overlapping(const BBox & box, std::vector<const Node *> & leaves) const;
+
+	// whether 'node' is in the indexed tree
+	bool indexes(const Node *node) const;
+
+	void insert(const Node *node); // register the leaves of a subtree
+	void remove(const Node *node); // remove the leaves of a subtree
+	void update(const Node *leaf); // the BBox of a registered leaf changed
+
+	void print() const;
+
+private:
+	CollisionGrid();
+	~CollisionGrid();
+	CollisionGrid(const CollisionGrid &);
+	CollisionGrid & operator=(const CollisionGrid &);
+
+	struct entry_t {
+		const Node *node;
+		BBox box;      // world coordinates
+		int lo[3];     // cells overlapped by the box
+		int hi[3];
+		bool big;      // in m_big instead of the cells
+	};
+
+	static const size_t max_cells = 64; // cells of a leaf not in m_big
+
+	static void collectLeaves(const Node *node, std::vector<const Node *> & leaves);
+	void cells(const BBox & box, int *lo, int *hi) const;
+	void link(entry_t *e);
+	void unlink(entry_t *e);
+	const Node *test(const entry_t *e, const BSphere *bsph) const;
+
+	const Node *m_root; // 0 if no grid
+	float m_cellSize;
+	std::unordered_map<const Node *, entry_t> m_leaves;
+	std::unordered_map<uint64_t, std::vector<entry_t *> > m_cells;
+	std::vector<entry_t *> m_big;
+};
@@ -0,0 +1,241 @@
+#include <cstdio>
+#include <algorithm>
+#include "dynamicTree.h"
+#include "renderState.h"
+#include "intersect.h"
+
+using std::vector;
+using std::unordered_map;
+
+const float DynamicTree::fat_ratio = 0.1f;
+
+DynamicTree * DynamicTree::instance() {
+	static DynamicTree mgr;
+	return &mgr;
+}
+
+DynamicTree::DynamicTree() {
+	aabbTreeInit(&m_tree);
+}
+
+DynamicTree::~DynamicTree() {
+	aabbTreeFree(&m_tree);
+}
+
+static void floats(const Vector3 & v, float *f) {
+	f[0] = v[0];
+	f[1] = v[1];
+	f[2] = v[2];
+}
+
+static BBox box_of(const float *bmin, const float *bmax) {
+	return BBox(Vector3(bmin[0], bmin[1], bmin[2]), Vector3(bmax[0], bmax[1], bmax[2]));
+}
+
+static bool empty(const BBox *box) {
+	return box->m_min[0] > box->m_max[0];
+}
+
+void DynamicTree::insert(Node *node) {
+	if (!node->m_gObject) {
+		for(std::list<Node *>::const_iterator it = node->m_children.begin(), end = node->m_children.end();
+			it != end; ++it)
+			insert(*it);
+		return;
+	}
+	const BBox *box = node->m_containerWC;
+	if (!node->m_dynamic || empty(box)) return;
+	std::pair<unordered_map<const Node *, entry_t>::iterator, bool> res =
+		m_leaves.insert(std::make_pair(node, entry_t()));
+	if (!res.second) return; // already registered
+	entry_t & e = res.first->second;
+	Vector3 size = box->m_max - box->m_min;
+	float bmin[3], bmax[3];
+	floats(box->m_min, bmin);
+	floats(box->m_max, bmax);
+	e.centre = 0.5f * (box->m_min + box->m_max);
+	e.proxy = aabbTreeInsert(&m_tree, bmin, bmax,
+							 fat_ratio * std::max(size[0], std::max(size[1], size[2])), node);
+}
+
+void DynamicTree::remove(const Node *node) {
+	for(std::list<Node *>::const_iterator it = node->m_children.begin(), end = node->m_children.end();
+		it != end; ++it)
+		remove(*it);
+	unordered_map<const Node *, entry_t>::iterator it = m_leaves.find(node);
+	if (it == m_leaves.end()) return;
+	aabbTreeRemove(&m_tree, it->second.proxy);
+	m_leaves.erase(it);
+	vector<Node *>::iterator vit = std::find(m_visible.begin(), m_visible.end(), node);
+	if (vit != m_visible.end()) m_visible.erase(vit);
+}
+
+void DynamicTree::update(const Node *leaf) {
+	unordered_map<const Node *, entry_t>::iterator it = m_leaves.find(leaf);
+	if (it == m_leaves.end()) return;
+	entry_t & e = it->second;
+	const BBox *box = leaf->m_containerWC;
+	Vector3 size = box->m_max - box->m_min;
+	Vector3 centre = 0.5f * (box->m_min + box->m_max);
+	float bmin[3], bmax[3], disp[3];
+	floats(box->m_min, bmin);
+	floats(box->m_max, bmax);
+	floats(centre - e.centre, disp);
+	aabbTreeMove(&m_tree, e.proxy, bmin, bmax,
+				 fat_ratio * std::max(size[0], std::max(size[1], size[2])), disp);
+	e.centre = centre;
+}
+
+size_t DynamicTree::size() const { return m_leaves.size(); }
+
+struct DynamicTree::query_t {
+	Camera *cam;
+	vector<Node *> *visible;
+	const BSphere *bsph;
+	const BBox *box;
+	Vector3 d;
+	Node::sweep_t *sweep;
+	const Line *ray;
+	Node::hit_t *hit;
+	const Node *res;
+};
+
+int DynamicTree::testFrustum(void *ctx, const float *bmin, const float *bmax) {
+	query_t *q = (query_t *) ctx;
+	BBox box = box_of(bmin, bmax);
+	int res = q->cam->checkFrustum(&box, 0);
+	return res > 0 ? AABB_OUTSIDE : (res < 0 ? AABB_INSIDE : AABB_PARTIAL);
+}
+
+int DynamicTree::visitCull(void *ctx, int proxy, void *data, int inside) {
+	query_t *q = (query_t *) ctx;
+	Node *leaf = (Node *) data;
+	// the fat box is not inside: test the bounding volumes of the leaf
+	if (!inside && leaf->checkFrustum(q->cam) > 0) return 1;
+	leaf->m_isCulled = false;
+	q->visible->push_back(leaf);
+	return 1;
+}
+
+void DynamicTree::frustumCull(Camera *cam) {
+	for(size_t i = 0; i < m_visible.size(); ++i)
+		m_visible[i]->m_isCulled = true;
+	m_visible.clear();
+	query_t q;
+	q.cam = cam;
+	q.visible = &m_visible;
+	aabbTreeQuery(&m_tree, testFrustum, visitCull, &q);
+}
+
+void DynamicTree::draw() {
+	RenderState *rs = RenderState::instance();
+	bool pick = rs->getPickPass();
+	ShaderProgram *prev_shader = rs->getShader();
+	for(size_t i = 0; i < m_visible.size(); ++i) {
+		Node *leaf = m_visible[i];
+		if (!pick) {
+			ShaderProgram *shader = 0;
+			for(const Node *node = leaf->m_parent; node && !shader; node = node->m_parent)
+				shader = node->m_shader;
+			if (shader && shader != rs->getShader()) rs->setShader(shader);
+		}
+		leaf->draw();
+	}
+	if (!pick && prev_shader && prev_shader != rs->getShader()) rs->setShader(prev_shader);
+}
+
+int DynamicTree::visitCollision(void *ctx, int proxy, void *data, int inside) {
+	query_t *q = (query_t *) ctx;
+	const Node *leaf = (const Node *) data;
+	if (BSphereBBoxIntersect(q->bsph, leaf->m_containerWC) != IINTERSECT) return 1;
+	if (!leaf->collisionsEnabled() || !leaf->collideLeaf(q->bsph)) return 1;
+	q->res = leaf;
+	return 0;
+}
+
+const Node *DynamicTree::checkCollision(const BSphere *bsph) const {
+	Vector3 R(bsph->m_radius, bsph->m_radius, bsph->m_radius);
+	float bmin[3], bmax[3];
+	floats(bsph->m_centre - R, bmin);
+	floats(bsph->m_centre + R, bmax);
+	query_t q;
+	q.bsph = bsph;
+	q.res = 0;
+	aabbTreeQueryBox(&m_tree, bmin, bmax, visitCollision, &q);
+	return q.res;
+}
+
+int DynamicTree::visitSweep(void *ctx, int proxy, void *data, int inside) {
+	query_t *q = (query_t *) ctx;
+	const Node *leaf = (const Node *) data;
+	if (BBoxBBoxIntersect(q->box, leaf->m_containerWC) == IREJECT || !leaf->collisionsEnabled()) return 1;
+	if (leaf->sweepLeaf(q->bsph, q->d, *q->sweep)) q->res = leaf;
+	return 1;
+}
+
+const Node *DynamicTree::sweepSphere(const BSphere *bsph, const Vector3 & d,
+									 Node::sweep_t & hit) const {
+	Vector3 R(bsph->m_radius, bsph->m_radius, bsph->m_radius);
+	BBox box(bsph->m_centre - R, bsph->m_centre + R);
+	box.add(bsph->m_centre + d - R);
+	box.add(bsph->m_centre + d + R);
+	float bmin[3], bmax[3];
+	floats(box.m_min, bmin);
+	floats(box.m_max, bmax);
+	hit.t = 1.0f;
+	query_t q;
+	q.bsph = bsph;
+	q.box = &box;
+	q.d = d;
+	q.sweep = &hit;
+	q.res = 0;
+	aabbTreeQueryBox(&m_tree, bmin, bmax, visitSweep, &q);
+	return q.res;
+}
+
+int DynamicTree::visitOverlap(void *ctx, int proxy, void *data, int inside) {
+	query_t *q = (query_t *) ctx;
+	const Node *leaf = (const Node *) data;
+	if (BBoxBBoxIntersect(q->box, leaf->m_containerWC) == IREJECT) return 1;
+	q->res = leaf;
+	return 0;
+}
+
+const Node *DynamicTree::overlapBox(const BBox *box) const {
+	float bmin[3], bmax[3];
+	floats(box->m_min, bmin);
+	floats(box->m_max, bmax);
+	query_t q;
+	q.box = box;
+	q.res = 0;
+	aabbTreeQueryBox(&m_tree, bmin, bmax, visitOverlap, &q);
+	return q.res;
+}
+
+float DynamicTree::visitRay(void *ctx, int proxy, void *data, float tmax) {
+	query_t *q = (query_t *) ctx;
+	const Node *leaf = (const Node *) data;
+	float tnear;
+	if (IntersectBBoxRay(leaf->m_containerWC, q->ray, q->hit->t, tnear) == IREJECT) return q->hit->t;
+	if (leaf->intersectRayWC(*q->ray, *q->hit)) q->res = leaf;
+	return q->hit->t;
+}
+
+const Node *DynamicTree::intersectRay(const Line & ray, Node::hit_t & hit, float tmax) const {
+	float origin[3], dir[3];
+	floats(ray.m_O, origin);
+	floats(ray.m_d, dir);
+	hit.t = tmax;
+	query_t q;
+	q.ray = &ray;
+	q.hit = &hit;
+	q.res = 0;
+	aabbTreeQueryRay(&m_tree, origin, dir, tmax, visitRay, &q);
+	return q.res;
+}
+
+void DynamicTree::print() const {
+	printf("DynamicTree: %zu leaves, %d nodes, height %d, area ratio %.1f, %zu visible\n",
+		   m_leaves.size(), m_tree.count, aabbTreeHeight(&m_tree), aabbTreeAreaRatio(&m_tree),
+		   m_visible.size());
+}
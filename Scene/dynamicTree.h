@@ -0,0 +1,92 @@
+// -*-C++-*-
+
+#pragma once
+
+/**
+ * @brief Leaves which move every frame
+ *
+ * Moving a node updates the BBoxes of all its ancestors (see
+ * Node::propagateBBRoot), which visits all their children, and makes the
+ * BBoxes of the static part of the tree grow with the motion. Leaves
+ * marked as dynamic (see Node::setDynamic) are left out of the BBoxes of
+ * their ancestors, and are indexed instead in a dynamic AABB tree (see
+ * aabbtree.h), with fattened boxes, so that most motions don't change the
+ * tree at all.
+ *
+ * The static queries of the scene (Node::frustumCull, Node::checkCollision,
+ * Node::intersectRay, CollisionGrid...) skip dynamic leaves, which are
+ * culled, drawn and queried here instead. Scene combines both.
+ *
+ * The leaves follow the tree: they update their proxies when they move (see
+ * Node::updateBB), and are removed when detached, and inserted again when
+ * attached.
+ */
+
+#include <vector>
+#include <unordered_map>
+#include <cfloat>
+#include "aabbtree.h"
+#include "node.h"
+
+class DynamicTree {
+
+public:
+	static DynamicTree * instance();
+
+	void insert(Node *node); // register the dynamic leaves of a subtree
+	void remove(const Node *node); // remove the dynamic leaves of a subtree
+	void update(const Node *leaf); // the BBox of a registered leaf changed
+	size_t size() const; // number of leaves
+
+	/**
+	 * Frustum culling of the dynamic leaves (sets their m_isCulled). Only
+	 * the leaves inside the frustum are drawn by draw().
+	 */
+	void frustumCull(Camera *cam);
+
+	/**
+	 * Draw the dynamic leaves which passed the last frustumCull(), each with
+	 * the shader of its closest ancestor (as in Node::draw).
+	 */
+	void draw();
+
+	//! As Node::checkCollision. Safe to call from several threads.
+	const Node *checkCollision(const BSphere *bsph) const;
+
+	//! As Node::sweepSphere. Safe to call from several threads.
+	const Node *sweepSphere(const BSphere *bsph, const Vector3 & d, Node::sweep_t & hit) const;
+
+	//! A leaf whose BBox overlaps 'box'. Safe to call from several threads.
+	const Node *overlapBox(const BBox *box) const;
+
+	//! As Node::intersectRay. Safe to call from several threads.
+	const Node *intersectRay(const Line & ray, Node::hit_t & hit, float tmax = FLT_MAX) const;
+
+	void print() const;
+
+private:
+	DynamicTree();
+	~DynamicTree();
+	DynamicTree(const DynamicTree &);
+	DynamicTree & operator=(const DynamicTree &);
+
+	struct entry_t {
+		int proxy;
+		Vector3 centre; // of the BBox at the last update
+	};
+
+	static const float fat_ratio; // margin of the fat boxes (of the largest side)
+
+	struct query_t; // state of a query (see dynamicTree.cc)
+
+	static int testFrustum(void *ctx, const float *bmin, const float *bmax);
+	static int visitCull(void *ctx, int proxy, void *data, int inside);
+	static int visitCollision(void *ctx, int proxy, void *data, int inside);
+	static int visitSweep(void *ctx, int proxy, void *data, int inside);
+	static int visitOverlap(void *ctx, int proxy, void *data, int inside);
+	static float visitRay(void *ctx, int proxy, void *data, float tmax);
+
+	AABBTree m_tree;
+	std::unordered_map<const Node *, entry_t> m_leaves;
+	std::vector<Node *> m_visible; // leaves inside the frustum of the last frustumCull()
+};
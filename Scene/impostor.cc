@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "impostor.h"
+#include "renderState.h"
+#include "lightManager.h"
+#include "textureManager.h"
+#include "materialManager.h"
+
+using std::string;
+
+// Every instance is 8 floats: center (world coords.) and radius of the quad,
+// and the atlas tile (origin and size, in texture coords.) to draw.
+
+#define VBO_BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+Impostor::Impostor(const string & name, GObject *gobj) :
+	m_name(name),
+	m_gObject(gobj),
+	m_radius(0.0f),
+	m_atlas(0),
+	m_material(0),
+	m_vao_id(0),
+	m_quad_id(0),
+	m_vbo_id(0) {
+	const BBox *box = gobj->getContainer();
+	m_center = 0.5f * (box->m_min + box->m_max);
+	m_radius = 0.5f * (box->m_max - box->m_min).length();
+}
+
+Impostor::~Impostor() {
+	glDeleteBuffers(1, &m_quad_id);
+	glDeleteBuffers(1, &m_vbo_id);
+	glDeleteVertexArrays(1, &m_vao_id);
+}
+
+GObject *Impostor::getGobject() const { return m_gObject; }
+const string & Impostor::getName() const { return m_name; }
+
+// Render the object from every view into its tile of the atlas, with an
+// orthographic camera around the bounding sphere. Lights are placed for
+// every view (as if the object was at the origin), and placed back for the
+// current view at the end.
+
+void Impostor::bake() {
+
+	static const float pi = 3.14159265358979f;
+	RenderState *rs = RenderState::instance();
+	LightManager *lmgr = LightManager::instance();
+	GLfloat clearColor[4];
+
+	m_atlas = TextureManager::instance()->createColorMap(m_name + "#impostor",
+														 views_el * tile_size,
+														 views_az * tile_size, true);
+	m_material = MaterialManager::instance()->create("impostor", m_name);
+	m_material->setTexture(m_atlas);
+	if (m_radius <= 0.0f) return; // empty object
+
+	m_atlas->bind();
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+	Trfm3D proj;
+	// bottom and top swapped, as in the orthographic camera of the browser
+	proj.setOrtho(-m_radius, m_radius, m_radius, -m_radius, m_radius, 3.0f * m_radius);
+	rs->push(RenderState::projection);
+	rs->push(RenderState::modelview);
+	rs->push(RenderState::model);
+	rs->loadTrfm(RenderState::projection, &proj);
+	rs->loadIdentity(RenderState::model);
+	for(int a = 0; a < views_az; ++a) {
+		float az = 2.0f * pi * a / views_az;
+		for(int e = 0; e < views_el; ++e) {
+			float el = 0.5f * pi * e / (views_el - 1);
+			// D looks backwards (from the object to the eye)
+			Vector3 D(sinf(az) * cosf(el), sinf(el), cosf(az) * cosf(el));
+			Vector3 R(cosf(az), 0.0f, -sinf(az));
+			Vector3 U = crossVectors(D, R);
+			Trfm3D view;
+			view.setWorld2Local(m_center + 2.0f * m_radius * D, R, U, D);
+			rs->loadTrfm(RenderState::modelview, &view);
+			for(LightManager::iterator it = lmgr->begin(), end = lmgr->end();
+				it != end; ++it) {
+				Light *theLight = *it;
+				if (theLight->isOn()) theLight->placeScene();
+			}
+			glViewport(a * tile_size, e * tile_size, tile_size, tile_size);
+			m_gObject->draw(0);
+		}
+	}
+	rs->pop(RenderState::model);
+	rs->pop(RenderState::modelview);
+	rs->pop(RenderState::projection);
+	for(LightManager::iterator it = lmgr->begin(), end = lmgr->end();
+		it != end; ++it) {
+		Light *theLight = *it;
+		if (theLight->isOn()) theLight->placeScene();
+	}
+	m_atlas->unbind();
+	m_atlas->buildMipmap();
+}
+
+// The tile of the view closest to the direction from the instance to the
+// camera (in local coordinates). Local axes are orthogonal and have the
+// same length, so dotting with them gives the (scaled) local direction.
+
+void Impostor::addInstance(const Trfm3D *T, const Vector3 & E) {
+
+	static const float pi = 3.14159265358979f;
+
+	if (!m_atlas) bake();
+	Vector3 C = T->transformPoint(m_center);
+	Vector3 X = T->transformVector(Vector3::UNIT_X);
+	Vector3 Y = T->transformVector(Vector3::UNIT_Y);
+	Vector3 Z = T->transformVector(Vector3::UNIT_Z);
+	Vector3 D = E - C;
+	Vector3 L(X.dot(D), Y.dot(D), Z.dot(D));
+	L.normalize();
+	float az = atan2f(L[0], L[2]);
+	float el = asinf(std::max(L[1], 0.0f));
+	int a = (int) floorf(az * views_az / (2.0f * pi) + 0.5f);
+	a = ((a % views_az) + views_az) % views_az;
+	int e = (int) floorf(el * (views_el - 1) / (0.5f * pi) + 0.5f);
+	e = std::min(e, views_el - 1);
+
+	m_instances.push_back(C[0]);
+	m_instances.push_back(C[1]);
+	m_instances.push_back(C[2]);
+	m_instances.push_back(m_radius * X.length());
+	m_instances.push_back((float) a / views_az);
+	m_instances.push_back((float) e / views_el);
+	m_instances.push_back(1.0f / views_az);
+	m_instances.push_back(1.0f / views_el);
+}
+
+void Impostor::draw() {
+
+	static const GLfloat corners[8] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+	RenderState *rs = RenderState::instance();
+	ShaderProgram *shader = rs->getShader();
+
+	if (m_instances.empty()) return;
+	if (!shader) {
+		fprintf(stderr, "[E] Impostor::draw: no active shader\n");
+		exit(1);
+	}
+	if (!m_vao_id) {
+		glGenVertexArrays(1, &m_vao_id);
+		glBindVertexArray(m_vao_id);
+		glGenBuffers(1, &m_quad_id);
+		glBindBuffer(GL_ARRAY_BUFFER, m_quad_id);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0); // 0 attrib. for quad corner (2 x 4 = 8)
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, VBO_BUFFER_OFFSET(0));
+		glGenBuffers(1, &m_vbo_id);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_id);
+		glEnableVertexAttribArray(5); // 5 attrib. for center and radius (4 x 4 = 16)
+		glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), VBO_BUFFER_OFFSET(0));
+		glVertexAttribDivisor(5, 1);
+		glEnableVertexAttribArray(6); // 6 attrib. for atlas tile (4 x 4 = 16)
+		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), VBO_BUFFER_OFFSET(16));
+		glVertexAttribDivisor(6, 1);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+	size_t instances_n = m_instances.size() / 8;
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_id);
+	glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(GLfloat),
+				 &m_instances[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_instances.clear();
+
+	rs->setFrontMaterial(m_material);
+	shader->beforeDraw();
+	rs->addDrawCall(2 * instances_n);
+	glBindVertexArray(m_vao_id);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instances_n);
+	glBindVertexArray(0);
+}
+
+#undef VBO_BUFFER_OFFSET
@@ -0,0 +1,75 @@
+// -*-C++-*-
+#pragma once
+
+/**
+ * @brief Billboard impostors of geometry objects
+ *
+ * The impostor of a geometry object is an atlas with images of the object,
+ * seen from views_az x views_el directions (azimuths around the Y axis times
+ * elevations from the horizon to the top). The atlas is rendered once, the
+ * first time the impostor is drawn, with the current shader and lights.
+ *
+ * Far away instances of the object are drawn as camera-facing quads, which
+ * show the image of the view closest to the direction of the camera. Every
+ * frame, the instances are queued (addInstance) while the scene is drawn,
+ * and then all of them are drawn with one instanced draw call (draw).
+ *
+ * Note: instances must be rotated around the Y axis only (and uniformly
+ * scaled), as the quads are not rolled.
+ */
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include "vector3.h"
+#include "trfm3D.h"
+#include "gObject.h"
+#include "material.h"
+#include "texturert.h"
+
+class Impostor {
+
+public:
+
+	static const int views_az = 8; // azimuths
+	static const int views_el = 4; // elevations (0, 30, 60 and 90 degrees)
+	static const int tile_size = 128; // pixels of the image of a view
+
+	GObject *getGobject() const;
+	const std::string & getName() const;
+
+	/**
+	 * Queue an instance of the object, placed by T (local to world), seen
+	 * from E (world coordinates). Render the atlas if needed.
+	 */
+	void addInstance(const Trfm3D *T, const Vector3 & E);
+
+	/**
+	 * Draw the queued instances (and empty the queue)
+	 *
+	 * \note the instances are in world coordinates, so the current modelview
+	 * trfm must be the view trfm of the camera.
+	 */
+	void draw();
+
+	friend class ImpostorManager;
+
+private:
+	Impostor(const std::string & name, GObject *gobj);
+	~Impostor();
+	Impostor(const Impostor &);
+	Impostor & operator=(const Impostor &);
+
+	void bake(); // render the atlas
+
+	std::string m_name;
+	GObject *m_gObject;
+	Vector3 m_center; // center of the bounding sphere (local coords.)
+	float m_radius;   // radius of the bounding sphere (local coords.)
+	TextureRT *m_atlas; // 0 until rendered
+	Material *m_material;
+	std::vector<GLfloat> m_instances; // queued instances (center, radius, tile)
+	GLuint m_vao_id;
+	GLuint m_quad_id; // VBO with the quad corners
+	GLuint m_vbo_id;  // VBO with the instances
+};
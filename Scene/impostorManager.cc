@@ -0,0 +1,66 @@
+#include "impostorManager.h"
+#include "renderState.h"
+#include "shaderManager.h"
+
+using std::map;
+using std::string;
+
+ImpostorManager * ImpostorManager::instance() {
+	static ImpostorManager mgr;
+	return &mgr;
+}
+
+ImpostorManager::ImpostorManager() {}
+
+ImpostorManager::~ImpostorManager() {
+	for(map<string, Impostor *>::iterator it = m_hash.begin(), end = m_hash.end();
+		it != end; ++it)
+		delete it->second;
+}
+
+Impostor *ImpostorManager::create(GObject *gobj) {
+	const string & key = gobj->getName();
+	map<string, Impostor *>::iterator it = m_hash.find(key);
+	if (it != m_hash.end()) return it->second;
+	Impostor *newimp = new Impostor(key, gobj);
+	it = m_hash.insert(make_pair(key, newimp)).first;
+	return it->second;
+}
+
+Impostor *ImpostorManager::find(const std::string & key) const {
+	map<string, Impostor *>::const_iterator it = m_hash.find(key);
+	if (it == m_hash.end()) return 0;
+	return it->second;
+}
+
+void ImpostorManager::draw() {
+	if (m_hash.empty()) return;
+	ShaderManager *smgr = ShaderManager::instance();
+	ShaderProgram *shader = smgr->find("impostor");
+	if (!shader)
+		shader = smgr->create("impostor", "Shaders/impostor.vert", "Shaders/impostor.frag");
+	RenderState *rs = RenderState::instance();
+	ShaderProgram *prev_shader = rs->getShader();
+	rs->setShader(shader);
+	rs->push(RenderState::model);
+	rs->loadIdentity(RenderState::model);
+	for(map<string, Impostor *>::iterator it = m_hash.begin(), end = m_hash.end();
+		it != end; ++it)
+		it->second->draw();
+	rs->pop(RenderState::model);
+	if (prev_shader) rs->setShader(prev_shader);
+}
+
+void ImpostorManager::print() const {
+	for(map<string, Impostor *>::const_iterator it = m_hash.begin(), end = m_hash.end();
+		it != end; ++it)
+		printf ("Impostor: %s\n", it->first.c_str());
+}
+
+ImpostorManager::iterator ImpostorManager::begin() {
+	return ImpostorManager::iterator(m_hash.begin());
+}
+
+ImpostorManager::iterator ImpostorManager::end() {
+	return ImpostorManager::iterator(m_hash.end());
+}
@@ -0,0 +1,51 @@
+// -*-C++-*-
+
+#pragma once
+
+#include <string>
+#include <map>
+#include "mgriter.h"
+#include "impostor.h"
+
+class ImpostorManager {
+
+public:
+	static ImpostorManager * instance();
+
+	/**
+	 * Register the impostor of a geometry object
+	 *
+	 * If the object has no impostor, create it and register it.
+	 * If the impostor already exists, return it
+	 *
+	 */
+	Impostor *create(GObject *gobj);
+
+	/**
+	 * Get the impostor of a geometry object (given its name)
+	 *
+	 * Return the impostor or 0 if not found
+	 */
+	Impostor *find(const std::string & name) const;
+
+	/**
+	 * Draw the queued instances of all impostors, with the "impostor"
+	 * shader. Call it after drawing the scene.
+	 */
+	void draw();
+
+	void print() const;
+
+	// iterate over all impostors
+	typedef mgrIter<Impostor *> iterator;
+	iterator begin();
+	iterator end();
+
+private:
+	ImpostorManager();
+	~ImpostorManager();
+	ImpostorManager(const ImpostorManager &);
+	ImpostorManager & operator=(const ImpostorManager &);
+
+	std::map<std::string, Impostor *> m_hash;
+};
@@ -1,14 +1,27 @@
 #include <cstdio>
+#include <cmath>
 #include <cassert>
+#include <algorithm>
+#include <map>
+#include <vector>
 #include "node.h"
 #include "nodeManager.h"
 #include "intersect.h"
 #include "bboxGL.h"
 #include "renderState.h"
+#include "hlodBuilder.h"
+#include "impostorManager.h"
+#include "picker.h"
+#include "collisionGrid.h"
+#include "dynamicTree.h"
+#include "threadPool.h"
 
 using std::string;
 using std::list;
 using std::map;
+using std::vector;
+using std::pair;
+using std::make_pair;
 
 // Recipe 1: iterate through children:
 //
@@ -32,17 +45,35 @@ Node::Node(const string &name) :
 	m_gObject(0),
 	m_light(0),
 	m_shader(0),
-	m_placement(new Trfm3D),
-	m_placementWC(new Trfm3D),
+	m_placement(new Affine3D),
+	m_placementWC(new Affine3D),
+	m_trs(0),
+	m_trsDirty(false),
+	m_dirty(false),
 	m_containerWC(new BBox),
+	m_sphereWC(new BSphere),
+	m_obbWC(0),
 	m_checkCollision(true),
+	m_dynamic(false),
 	m_isCulled(false),
-	m_drawBBox(false) {}
+	m_drawBBox(false),
+	m_lod(0),
+	m_proxy(0),
+	m_proxyError(0.0f),
+	m_drawProxy(false),
+	m_impostor(0),
+	m_allImpostors(false),
+	m_batch(0),
+	m_batched(false) {}
 
 Node::~Node() {
 	delete m_placement;
 	delete m_placementWC;
+	delete m_trs;
 	delete m_containerWC;
+	delete m_sphereWC;
+	delete m_obbWC;
+	delete m_batch;
 }
 
 static string name_clone(const string & base) {
@@ -70,6 +101,15 @@ Node* Node::cloneParent(Node *theParent) {
 	newNode->m_light = m_light;
 	newNode->m_shader = m_shader;
 	newNode->m_placement->clone(m_placement);
+	if (m_trs) {
+		newNode->m_trs = new TRS(*m_trs);
+		newNode->m_trsDirty = m_trsDirty;
+	}
+	newNode->m_proxy = m_proxy;
+	newNode->m_proxyError = m_proxyError;
+	newNode->m_impostor = m_impostor;
+	newNode->m_allImpostors = m_allImpostors;
+	newNode->m_dynamic = m_dynamic; // (registered when attached)
 	newNode->m_parent = theParent;
 	for(list<Node *>::iterator it = m_children.begin(), end = m_children.end();
 		it != end; ++it) {
@@ -87,6 +127,8 @@ Node *Node::clone() {
 ///////////////////////////////////
 // transformations
 
+const std::string & Node::getName() const { return m_name; }
+
 void Node::attachGobject(GObject *gobj ) {
 	if (!gobj) {
 		fprintf(stderr, "[E] attachGobject: no gObject for node %s\n", m_name.c_str());
@@ -97,12 +139,21 @@ void Node::attachGobject(GObject *gobj ) {
 		exit(1);
 	}
 	m_gObject = gobj;
+	m_impostor = 0;
+	m_allImpostors = false;
 	propagateBBRoot();
+	CollisionGrid *grid = CollisionGrid::instance();
+	if (grid->indexes(this)) grid->insert(this);
 }
 
 GObject *Node::detachGobject() {
+	CollisionGrid::instance()->remove(this);
+	DynamicTree::instance()->remove(this);
+	m_dynamic = false;
 	GObject *res = m_gObject;
 	m_gObject = 0;
+	m_impostor = 0;
+	m_allImpostors = false;
 	return res;
 }
 
@@ -148,12 +199,49 @@ bool Node::getDrawBBox() const { return m_drawBBox; }
 void Node::setCheckCollision(bool b) { m_checkCollision = b; }
 bool Node::getCheckCollision() const { return m_checkCollision; }
 
+bool Node::collisionsEnabled() const {
+	for(const Node *node = this; node; node = node->m_parent)
+		if (!node->m_checkCollision) return false;
+	return true;
+}
+
+void Node::setDynamicLeaves(bool b) {
+	if (!m_gObject) {
+		for(list<Node *>::iterator it = m_children.begin(), end = m_children.end();
+			it != end; ++it)
+			(*it)->setDynamicLeaves(b);
+		return;
+	}
+	if (m_dynamic == b) return;
+	m_dynamic = b;
+	CollisionGrid *grid = CollisionGrid::instance();
+	if (b) {
+		grid->remove(this);
+		DynamicTree::instance()->insert(this);
+	} else {
+		DynamicTree::instance()->remove(this);
+		if (grid->indexes(this)) grid->insert(this);
+	}
+}
+
+void Node::setDynamic(bool b) {
+	setDynamicLeaves(b);
+	// BBoxes of the subtree and its ancestors, with or without the leaves
+	updateWC();
+	if (m_parent) m_parent->propagateBBRoot();
+}
+
+bool Node::getDynamic() const { return m_dynamic; }
+
 ///////////////////////////////////
 // transformations
 
 void Node::initTrfm() {
-	Trfm3D I;
-	m_placement->swap(I);
+	if (m_trs) {
+		m_trs->setUnit();
+		m_trsDirty = true;
+	} else
+		m_placement->setUnit();
 	// Update Geometric state
 	updateGS();
 }
@@ -163,7 +251,11 @@ void Node::setTrfm(const Trfm3D * M) {
 		fprintf(stderr, "[E] setTrfm: no trfm for node %s\n", m_name.c_str());
 		exit(1);
 	}
-	m_placement->clone(M);
+	if (m_trs) {
+		*m_trs = TRS(*M);
+		m_trsDirty = true;
+	} else
+		m_placement->clone(M);
 	// Update Geometric state
 	updateGS();
 }
@@ -173,41 +265,97 @@ void Node::addTrfm(const Trfm3D * M) {
 		fprintf(stderr, "[E] addTrfm: no trfm for node %s\n", m_name.c_str());
 		exit(1);
 	}
-	m_placement->add(M);
+	if (m_trs) {
+		m_trs->add(TRS(*M));
+		m_trsDirty = true;
+	} else
+		m_placement->add(M);
 	// Update Geometric state
 	updateGS();
 }
 
 void Node::translate(const Vector3 & P) {
-	static Trfm3D localT;
-	localT.setTrans(P);
-	addTrfm(&localT);
+	if (m_trs) {
+		m_trs->addTrans(P);
+		m_trsDirty = true;
+	} else {
+		Affine3D localT;
+		localT.setTrans(P);
+		m_placement->add(localT); // affine composition
+	}
+	updateGS();
 };
 
 void Node::rotateX(float angle ) {
-	static Trfm3D localT;
-	localT.setRotX(angle);
-	addTrfm(&localT);
+	if (m_trs) {
+		m_trs->addRotX(angle);
+		m_trsDirty = true;
+	} else {
+		Affine3D localT;
+		localT.setRotX(angle);
+		m_placement->add(localT);
+	}
+	updateGS();
 };
 
 void Node::rotateY(float angle ) {
-	static Trfm3D localT;
-	localT.setRotY(angle);
-	addTrfm(&localT);
+	if (m_trs) {
+		m_trs->addRotY(angle);
+		m_trsDirty = true;
+	} else {
+		Affine3D localT;
+		localT.setRotY(angle);
+		m_placement->add(localT);
+	}
+	updateGS();
 };
 
 void Node::rotateZ(float angle ) {
-	static Trfm3D localT;
-	localT.setRotZ(angle);
-	addTrfm(&localT);
+	if (m_trs) {
+		m_trs->addRotZ(angle);
+		m_trsDirty = true;
+	} else {
+		Affine3D localT;
+		localT.setRotZ(angle);
+		m_placement->add(localT);
+	}
+	updateGS();
 };
 
 void Node::scale(float factor ) {
-	static Trfm3D localT;
-	localT.setScale(factor);
-	addTrfm(&localT);
+	if (m_trs) {
+		m_trs->addScale(factor);
+		m_trsDirty = true;
+	} else {
+		Affine3D localT;
+		localT.setScale(factor);
+		m_placement->add(localT);
+	}
+	updateGS();
 };
 
+const Trfm3D *Node::getPlacementWC() const { return m_placementWC; }
+const BBox *Node::getContainerWC() const { return m_containerWC; }
+const BSphere *Node::getSphereWC() const { return m_sphereWC; }
+const OBB *Node::getOBBWC() const { return m_obbWC; }
+
+void Node::setTRS(const TRS & trs) {
+	if (m_trs) *m_trs = trs;
+	else m_trs = new TRS(trs);
+	m_trsDirty = true;
+	updateGS();
+}
+
+const TRS *Node::getTRS() const { return m_trs; }
+
+// rebuild the local matrix of a TRS placement, if it changed
+
+void Node::syncPlacement() {
+	if (!m_trsDirty) return;
+	m_trs->getTrfm(m_placement);
+	m_trsDirty = false;
+}
+
 ///////////////////////////////////
 // tree operations
 
@@ -274,6 +422,9 @@ void Node::addChild(Node *theChild) {
 		theChild->m_parent = this;
 		this->m_children.push_back(theChild);
 		theChild->updateGS();
+		CollisionGrid *grid = CollisionGrid::instance();
+		if (grid->indexes(this)) grid->insert(theChild);
+		DynamicTree::instance()->insert(theChild); // its dynamic leaves
 	}
 }
 
@@ -282,6 +433,8 @@ void Node::detach() {
 	Node *theParent;
 	theParent = m_parent;
 	if (theParent == 0) return; // already detached (or root node)
+	CollisionGrid::instance()->remove(this);
+	DynamicTree::instance()->remove(this);
 	m_parent = 0;
 	theParent->m_children.remove(this);
 	// Update bounding box of parent
@@ -299,12 +452,9 @@ void Node::detach() {
 //    - placementWC of node and parents are up-to-date
 
 void Node::propagateBBRoot() {
-	if(this == 0){
-		return;
-	}else{
-		this->updateBB();
-		this->m_parent->propagateBBRoot();
-	}
+	this->updateBB();
+	if (m_parent)
+		m_parent->propagateBBRoot();
 }
 
 // @@ TODO: auxiliary function
@@ -337,12 +487,51 @@ void Node::updateBB(){
 		//Copiar el container del objeto de nuevo y transformarlo
 		this->m_containerWC->clone(m_gObject->getContainer());
 		this->m_containerWC->transform(this->m_placementWC);
+		updateOBB();
+		updateLeafIndex();
 	}else{
+		// (from scratch, so that the BBox shrinks when children move away)
+		this->m_containerWC->init();
 		for (list<Node *>::const_iterator it = m_children.begin(), end = m_children.end(); it != end; ++it){
 			Node *theChild = *it;
+			if (theChild->m_dynamic) continue; // in DynamicTree
 			this->m_containerWC->include(theChild->m_containerWC);
 		}
+		updateSphere();
+	}
+}
+
+// the OBB and the sphere of a node with geometry (m_placementWC is
+// up-to-date)
+
+void Node::updateOBB() {
+	if (!m_obbWC) m_obbWC = new OBB;
+	m_obbWC->set(m_gObject->getContainer(), m_placementWC);
+	m_sphereWC->m_centre = m_obbWC->m_centre;
+	m_sphereWC->m_radius = m_obbWC->radius();
+}
+
+// the sphere of a node without geometry: the smaller of the sphere around
+// its BBox and the sphere around the spheres of its (static) children
+//
+// Precondition: m_containerWC is up-to-date
+
+void Node::updateSphere() {
+	const BBox *box = m_containerWC;
+	if (box->m_min[0] > box->m_max[0]) { // no static children
+		*m_sphereWC = BSphere();
+		return;
+	}
+	BSphere boxSphere((box->m_min + box->m_max) * 0.5f, 0.5f * (box->m_max - box->m_min).length());
+	bool first = true;
+	for (list<Node *>::const_iterator it = m_children.begin(), end = m_children.end(); it != end; ++it) {
+		const Node *theChild = *it;
+		if (theChild->m_dynamic) continue;
+		if (first) *m_sphereWC = *theChild->m_sphereWC;
+		else m_sphereWC->include(theChild->m_sphereWC);
+		first = false;
 	}
+	if (boxSphere.m_radius < m_sphereWC->m_radius) *m_sphereWC = boxSphere;
 }
 
 // @@ TODO: Update WC (world coordinates matrix) of a node and
@@ -360,18 +549,161 @@ void Node::updateBB(){
 // Note:
 //    See Recipe 1 in for knowing how to iterate through children.
 
+// The BBoxes of the leaf children are transformed and included in batches
+// (see updateLeavesWC) instead of one by one in updateBB. The batches of a
+// node with many children are run by the ThreadPool (see
+// updateChildrenWC).
+
+static const size_t leaf_batch = 8; // leaves updated together
+static const size_t leaf_grain = 256; // leaves per ThreadPool chunk
+
 void Node::updateWC() {
+	m_dirty = false;
+	syncPlacement();
 	if(this->m_parent == 0){
 		this->m_placementWC->clone(this->m_placement);
 	}else{
 		this->m_placementWC->clone(this->m_parent->m_placementWC);
 		this->m_placementWC->add(this->m_placement);
 	}
+	if (m_gObject) {
+		for (list<Node *>::const_iterator it = m_children.begin(), end = m_children.end(); it != end; ++it)
+			(*it)->updateWC();
+		this->updateBB();
+		return;
+	}
+	this->m_containerWC->init();
+	if (m_children.size() >= 2 * leaf_grain && ThreadPool::instance()->size() > 1) {
+		updateChildrenWC();
+		updateSphere();
+		return;
+	}
+	Node *leaves[leaf_batch];
+	size_t leaves_n = 0;
 	for (list<Node *>::const_iterator it = m_children.begin(), end = m_children.end(); it != end; ++it) {
-			Node *theChild = *it;
-			theChild->updateWC();
+		Node *theChild = *it;
+		if (theChild->m_gObject && theChild->m_children.empty()) {
+			leaves[leaves_n++] = theChild;
+			if (leaves_n == leaf_batch) {
+				updateLeavesWC(leaves, leaves_n, m_containerWC, true);
+				leaves_n = 0;
+			}
+			continue;
+		}
+		theChild->updateWC();
+		if (!theChild->m_dynamic) this->m_containerWC->include(theChild->m_containerWC);
+	}
+	updateLeavesWC(leaves, leaves_n, m_containerWC, true);
+	updateSphere();
+}
+
+// updateWC of the children of a node with many of them. The leaf children
+// are updated in batches by the ThreadPool, every batch including its
+// static BBoxes into a BBox of its own. Inner children, and the
+// DynamicTree/CollisionGrid entries of the leaves, are updated serially.
+
+void Node::updateChildrenWC() {
+	vector<Node *> leaves;
+	leaves.reserve(m_children.size());
+	for (list<Node *>::const_iterator it = m_children.begin(), end = m_children.end(); it != end; ++it) {
+		Node *theChild = *it;
+		if (theChild->m_gObject && theChild->m_children.empty()) {
+			leaves.push_back(theChild);
+			continue;
+		}
+		theChild->updateWC();
+		if (!theChild->m_dynamic) this->m_containerWC->include(theChild->m_containerWC);
+	}
+	size_t batches = (leaves.size() + leaf_batch - 1) / leaf_batch;
+	vector<BBox> boxes(batches);
+	ThreadPool::instance()->parallelFor(batches, leaf_grain / leaf_batch, [&](size_t begin, size_t end) {
+		for(size_t b = begin; b < end; ++b) {
+			size_t first = b * leaf_batch;
+			updateLeavesWC(&leaves[first], std::min(leaf_batch, leaves.size() - first), &boxes[b], false);
+		}
+	});
+	for(size_t b = 0; b < batches; ++b) m_containerWC->include(&boxes[b]);
+	for(size_t i = 0; i < leaves.size(); ++i) leaves[i]->updateLeafIndex();
+}
+
+// The TRS of the node was changed without updating the WC (see
+// AnimationManager). Mark the node and its ancestors as dirty, and return
+// the root of the tree if it was not dirty yet (0 otherwise).
+
+Node *Node::markDirty() {
+	m_trsDirty = true;
+	for(Node *n = this; ; n = n->m_parent) {
+		if (n->m_dirty) return 0;
+		n->m_dirty = true;
+		if (!n->m_parent) return n;
+	}
+}
+
+// Update the WC of the dirty nodes of the subtree (and their subtrees), and
+// the BBoxes of their ancestors.
+//
+// Precondition: m_placementWC of m_parent is up-to-date (or m_parent == 0)
+
+void Node::updateDirty() {
+	if (!m_dirty) return;
+	if (m_trsDirty) {
+		updateWC();
+		return;
+	}
+	m_dirty = false;
+	for (list<Node *>::const_iterator it = m_children.begin(), end = m_children.end(); it != end; ++it)
+		(*it)->updateDirty();
+	updateBB();
+}
+
+// Update the WC transformation and BBox of n (<= leaf_batch) leaf
+// children, and include the BBoxes of the static ones into box. If index,
+// also update their entries in the DynamicTree/CollisionGrid. Otherwise only
+// the leaves and box are written, so that several threads can update
+// different leaves of this node.
+
+void Node::updateLeavesWC(Node **leaves, size_t n, BBox *box, bool index) {
+	if (n == 0) return;
+	float bmin[3][leaf_batch], bmax[3][leaf_batch];
+	const Trfm3D *T[leaf_batch];
+	BBox::soa_t boxes = { { bmin[0], bmin[1], bmin[2] }, { bmax[0], bmax[1], bmax[2] } };
+	size_t static_n = 0;
+	for(size_t i = 0; i < n; ++i) {
+		Node *leaf = leaves[i];
+		leaf->m_dirty = false;
+		leaf->syncPlacement();
+		leaf->m_placementWC->clone(m_placementWC);
+		leaf->m_placementWC->add(leaf->m_placement);
+		const BBox *box = leaf->m_gObject->getContainer();
+		for(int k = 0; k < 3; ++k) {
+			bmin[k][i] = box->m_min[k];
+			bmax[k][i] = box->m_max[k];
+		}
+		T[i] = leaf->m_placementWC;
+		if (!leaf->m_dynamic) ++static_n;
 	}
-	this->updateBB();	
+	BBox::transform(boxes, T, n, boxes);
+	for(size_t i = 0; i < n; ++i) {
+		Node *leaf = leaves[i];
+		leaf->m_containerWC->m_min = Vector3(bmin[0][i], bmin[1][i], bmin[2][i]);
+		leaf->m_containerWC->m_max = Vector3(bmax[0][i], bmax[1][i], bmax[2][i]);
+		leaf->m_containerWC->m_vbo_uptodate = 0;
+		leaf->updateOBB();
+		if (index) leaf->updateLeafIndex();
+		if (static_n < n && !leaf->m_dynamic) box->include(leaf->m_containerWC);
+	}
+	// dynamic leaves are not in the BBoxes of their ancestors
+	if (static_n == n) box->include(boxes, n);
+}
+
+// the BBox of a leaf changed: update its entry in the DynamicTree or the
+// CollisionGrid
+
+void Node::updateLeafIndex() {
+	if (m_dynamic)
+		DynamicTree::instance()->update(this);
+	else
+		CollisionGrid::instance()->update(this); // if registered
 }
 
 // @@ TODO:
@@ -384,9 +716,82 @@ void Node::updateWC() {
 
 void Node::updateGS() {
 	this->updateWC();
-	this->propagateBBRoot();
+	// dynamic leaves are not in the BBoxes of their ancestors
+	if (!m_dynamic) this->propagateBBRoot();
+}
+
+
+// Select the LOD of the geometry object whose screen-space error (seen from
+// the RenderState camera) is below the LOD threshold.
+//
+// To avoid popping back and forth at the switching distance, nodes move to a
+// finer LOD as soon as the error goes over the threshold, but only move to a
+// coarser LOD when its error is clearly below it (hysteresis).
+
+static const float lod_hysteresis = 0.75f;
+
+static float distance_bbox(const BBox *box, const Vector3 & P) {
+	float d2 = 0.0f;
+	for(int i = 0; i < 3; ++i) {
+		float d = std::max(std::max(box->m_min[i] - P[i], P[i] - box->m_max[i]), 0.0f);
+		d2 += d * d;
+	}
+	return sqrtf(d2);
 }
 
+// scale from local to world coordinates (max. over the axes)
+
+float Node::scaleWC() const {
+	float scale = 0.0f;
+	for(int i = 0; i < 3; ++i) {
+		Vector3 axis(i == 0, i == 1, i == 2);
+		scale = std::max(scale, m_placementWC->transformVector(axis).length());
+	}
+	return scale;
+}
+
+size_t Node::selectLOD(const GObject *gobj) {
+	RenderState *rs = RenderState::instance();
+	Camera *cam = rs->getCamera();
+	float threshold = rs->getLODThreshold();
+	size_t lods_n = gobj->numLODs();
+	if (!cam || threshold <= 0.0f || lods_n < 2) return m_lod = 0;
+	float dist = distance_bbox(m_containerWC, cam->getPosition());
+	// errors are in object space
+	float scale = scaleWC();
+	size_t lod = std::min(m_lod, lods_n - 1);
+	while (lod > 0 &&
+		   cam->projectedSize(scale * gobj->lodError(lod), dist) > threshold)
+		--lod;
+	while (lod + 1 < lods_n &&
+		   cam->projectedSize(scale * gobj->lodError(lod + 1), dist) <= threshold * lod_hysteresis)
+		++lod;
+	return m_lod = lod;
+}
+
+// Whether to draw the HLOD proxy instead of the children (same hysteresis as
+// LODs)
+
+bool Node::selectProxy() {
+	RenderState *rs = RenderState::instance();
+	Camera *cam = rs->getCamera();
+	float threshold = rs->getLODThreshold();
+	if (!m_proxy || !cam || threshold <= 0.0f) return m_drawProxy = false;
+	float dist = distance_bbox(m_containerWC, cam->getPosition());
+	float size = cam->projectedSize(scaleWC() * m_proxyError, dist);
+	return m_drawProxy = size <= (m_drawProxy ? threshold : threshold * lod_hysteresis);
+}
+
+// Whether the node is beyond the impostor distance (and all the leaves have
+// impostors)
+
+bool Node::selectImpostor() const {
+	RenderState *rs = RenderState::instance();
+	Camera *cam = rs->getCamera();
+	float dist = rs->getImpostorDistance();
+	if (!m_allImpostors || !cam || dist <= 0.0f || rs->getPickPass()) return false;
+	return distance_bbox(m_containerWC, cam->getPosition()) > dist;
+}
 
 // @@ TODO:
 // Draw a (sub)tree.
@@ -410,28 +815,41 @@ void Node::draw() {
 	ShaderProgram *prev_shader = 0;
 	RenderState *rs = RenderState::instance();
 
-	if (m_isCulled) return;
+	bool pick = rs->getPickPass();
+	if (m_isCulled || (m_batched && rs->getStaticBatching() && !pick)) return;
 
 	// Set shader (save previous)
-	if (m_shader != 0) {
+	if (m_shader != 0 && !pick) {
 		prev_shader = rs->getShader();
 		rs->setShader(m_shader);
 	}
 	// Print BBoxes
-	if(rs->getBBoxDraw() || m_drawBBox)
+	if((rs->getBBoxDraw() || m_drawBBox) && !pick)
 		BBoxGL::draw( m_containerWC );
 		
 	//Version en modo global
-	if(this->m_gObject != 0){
+	if(this->m_gObject != 0 && selectImpostor()){
+		// drawn later, with all the instances of the impostor
+		m_impostor->addInstance(m_placementWC, rs->getCamera()->getPosition());
+	}else if(this->m_gObject != 0){
+		if (pick) rs->setPickId(Picker::instance()->addNode(this));
 		rs->push(RenderState::modelview);
 		rs->addTrfm(RenderState::modelview, this->m_placementWC);
 		rs->loadTrfm(RenderState::model, m_placementWC);
-		this->m_gObject->draw();
+		this->m_gObject->draw(selectLOD(m_gObject));
+		rs->pop(RenderState::modelview);
+	}else if (!pick && !selectImpostor() && selectProxy()) {
+		rs->push(RenderState::modelview);
+		rs->addTrfm(RenderState::modelview, this->m_placementWC);
+		rs->loadTrfm(RenderState::model, m_placementWC);
+		m_proxy->draw(selectLOD(m_proxy));
 		rs->pop(RenderState::modelview);
 	}else{
+		if (m_batch && rs->getStaticBatching() && !pick)
+			m_batch->draw(m_placementWC); // instead of the batched children
 		for (list<Node *>::const_iterator it = m_children.begin(), end = m_children.end(); it != end; ++it) {
 			Node *theChild = *it;
-			theChild->draw();
+			if (!theChild->m_dynamic) theChild->draw(); // (dynamic leaves: see DynamicTree::draw)
 		}	
 	}
 
@@ -462,7 +880,7 @@ void Node::setCulled(bool culled) {
 	for(list<Node *>::iterator it = m_children.begin(), end = m_children.end();
 		it != end; ++it) {
 		Node *theChild = *it;
-		theChild->setCulled(culled); // Recursive call
+		if (!theChild->m_dynamic) theChild->setCulled(culled); // Recursive call
 	}
 }
 
@@ -471,7 +889,7 @@ void Node::setCulled(bool culled) {
 
 void Node::frustumCull(Camera *cam)
 {
-	int colision = cam->checkFrustum(this->m_containerWC, NULL);
+	int colision = checkFrustum(cam);
 	switch (colision)
 	{
 	case 1: //Se encuentra totalmente fuera
@@ -489,12 +907,24 @@ void Node::frustumCull(Camera *cam)
 		for (list<Node *>::iterator it = m_children.begin(), end = m_children.end(); it != end; ++it)
 		{
 			Node *theChild = *it;
-			theChild->frustumCull(cam); // Recursive call
+			if (!theChild->m_dynamic) theChild->frustumCull(cam); // Recursive call
 		}
 		break;
 	}
 }
 
+// The bounding volumes of the node against the frustum, from the cheapest to
+// the tightest: the sphere, the BBox and (for geometry) the OBB. Returns as
+// Camera::checkFrustum.
+
+int Node::checkFrustum(Camera *cam) const {
+	int res = cam->checkFrustum(m_sphereWC);
+	if (res) return res;
+	res = cam->checkFrustum(m_containerWC, NULL);
+	if (res || !m_gObject || !m_obbWC) return res;
+	return cam->checkFrustum(m_obbWC);
+}
+
 // @@ TODO: Check whether a BSphere (in world coordinates) intersects with a
 // (sub)tree.
 //
@@ -508,13 +938,15 @@ void Node::frustumCull(Camera *cam)
 const Node *Node::checkCollision(const BSphere *bsph) const {
 	if (!m_checkCollision) return 0;//Si el nodo en Null no hay colision
 	//Compruebo si el avatar instersecta con el nodo actual
+	if (BSphereBSphereIntersect(bsph, m_sphereWC) == IREJECT) return 0;
 	if(BSphereBBoxIntersect(bsph, this->m_containerWC) == IINTERSECT){
-		if(this->m_gObject){//Caso de que sea un nodo hoja, hay interseccion con el objeto
-			return this;
+		if(this->m_gObject){//Caso de que sea un nodo hoja, compruebo los triangulos
+			return collideLeaf(bsph) ? this : 0;
 		}else{
 			//En caso contrario compruebo si sus hijos colisionan
 			for (list<Node *>::const_iterator it = m_children.begin(), end = m_children.end(); it != end; ++it) {
 				Node *theChild = *it;
+				if (theChild->m_dynamic) continue; // see DynamicTree
 				const Node *prueba = theChild->checkCollision(bsph);
 				if(prueba != 0){
 					return prueba;
@@ -528,3 +960,239 @@ const Node *Node::checkCollision(const BSphere *bsph) const {
 	
 	
 }
+
+// World to local coordinates of a placement (rotations, translations and
+// uniform scales)
+
+namespace {
+	struct local_t {
+		Vector3 X, Y, Z, O;
+		float inv_s2;
+
+		local_t(const Trfm3D *T) :
+			X(T->transformVector(Vector3::UNIT_X)),
+			Y(T->transformVector(Vector3::UNIT_Y)),
+			Z(T->transformVector(Vector3::UNIT_Z)),
+			O(T->transformPoint(Vector3::ZERO)),
+			inv_s2(1.0f / X.dot(X)) {}
+
+		Vector3 vector(const Vector3 & V) const {
+			return inv_s2 * Vector3(X.dot(V), Y.dot(V), Z.dot(V));
+		}
+		Vector3 point(const Vector3 & P) const { return vector(P - O); }
+		float length(float l) const { return l * sqrtf(inv_s2); }
+	};
+}
+
+bool Node::collideLeaf(const BSphere *bsph) const {
+	if (m_obbWC && BSphereOBBIntersect(bsph, m_obbWC) == IREJECT) return false;
+	local_t local(m_placementWC);
+	return m_gObject->intersectSphere(local.point(bsph->m_centre), local.length(bsph->m_radius));
+}
+
+bool Node::sweepLeaf(const BSphere *bsph, const Vector3 & d, sweep_t & hit) const {
+	local_t local(m_placementWC);
+	float t;
+	Vector3 N;
+	if (!m_gObject->sweepSphere(local.point(bsph->m_centre), local.vector(d),
+								local.length(bsph->m_radius), hit.t, t, N))
+		return false;
+	hit.t = t; // (the same in local coordinates)
+	hit.normal = m_placementWC->transformVector(N);
+	hit.normal.normalize();
+	return true;
+}
+
+// 'box' contains the sphere along the whole motion
+
+const Node *Node::sweepSphereWC(const BSphere *bsph, const Vector3 & d, const BBox & box,
+								sweep_t & hit) const {
+	if (!m_checkCollision || BBoxBBoxIntersect(&box, m_containerWC) == IREJECT) return 0;
+	if (m_gObject) return sweepLeaf(bsph, d, hit) ? this : 0;
+	const Node *res = 0;
+	for (list<Node *>::const_iterator it = m_children.begin(), end = m_children.end(); it != end; ++it) {
+		if ((*it)->m_dynamic) continue; // see DynamicTree
+		const Node *child = (*it)->sweepSphereWC(bsph, d, box, hit);
+		if (child) res = child;
+	}
+	return res;
+}
+
+const Node *Node::sweepSphere(const BSphere *bsph, const Vector3 & d, sweep_t & hit) const {
+	Vector3 R(bsph->m_radius, bsph->m_radius, bsph->m_radius);
+	BBox box(bsph->m_centre - R, bsph->m_centre + R);
+	box.add(bsph->m_centre + d - R);
+	box.add(bsph->m_centre + d + R);
+	hit.t = 1.0f;
+	return sweepSphereWC(bsph, d, box, hit);
+}
+
+const Node *Node::intersectRay(const Line & ray, hit_t & hit, float tmax) const {
+	float tnear;
+	hit.t = tmax;
+	if (IntersectBBoxRay(m_containerWC, &ray, hit.t, tnear) == IREJECT) return 0;
+	return intersectRayWC(ray, hit);
+}
+
+// The ray hits the BBox of the node, and hit.t holds the closest
+// intersection so far. Children are visited front to back, so that the
+// ones behind the closest intersection are skipped.
+//
+// Placements are similarities (M = s R + T), so the ray is brought to local
+// coordinates with the axes of M: R^t (P - T) / s = (X.(P - T), Y.(P - T),
+// Z.(P - T)) / s^2, where X = M (1, 0, 0) etc. The parameter of the ray stays
+// the same.
+
+const Node *Node::intersectRayWC(const Line & ray, hit_t & hit) const {
+	const Node *res = 0;
+	if (m_gObject) {
+		local_t trfm(m_placementWC);
+		Line local(trfm.point(ray.m_O), trfm.vector(ray.m_d));
+		int triangle;
+		Vector3 uvw;
+		const TriangleMesh *mesh = m_gObject->intersectRay(local, hit.t, triangle, uvw);
+		if (mesh) {
+			hit.mesh = mesh;
+			hit.triangle = triangle;
+			hit.u = uvw[0];
+			hit.v = uvw[1];
+			hit.t = uvw[2];
+			res = this;
+		}
+	}
+	if (m_children.empty()) return res;
+	// the boxes of the children are tested a chunk at a time (see
+	// IntersectBBoxesRay)
+	static const int chunk = 8;
+	float bmin[3][chunk], bmax[3][chunk], tnear[chunk];
+	BBox::soa_t boxes = { { bmin[0], bmin[1], bmin[2] }, { bmax[0], bmax[1], bmax[2] } };
+	const Node *nodes[chunk];
+	std::vector<std::pair<float, const Node *> > front;
+	for(list<Node *>::const_iterator it = m_children.begin(), end = m_children.end();
+		it != end; ) {
+		int n = 0;
+		for(; it != end && n < chunk; ++it) {
+			if ((*it)->m_dynamic) continue; // see DynamicTree
+			const BBox *box = (*it)->m_containerWC;
+			for(int i = 0; i < 3; ++i) {
+				bmin[i][n] = box->m_min[i];
+				bmax[i][n] = box->m_max[i];
+			}
+			nodes[n++] = *it;
+		}
+		if (!IntersectBBoxesRay(boxes, n, &ray, hit.t, tnear)) continue;
+		for(int i = 0; i < n; ++i)
+			if (tnear[i] != FLT_MAX) front.push_back(std::make_pair(tnear[i], nodes[i]));
+	}
+	std::sort(front.begin(), front.end());
+	for(size_t i = 0; i < front.size() && front[i].first < hit.t; ++i) {
+		const Node *child = front[i].second->intersectRayWC(ray, hit);
+		if (child) res = child;
+	}
+	return res;
+}
+
+// Group the leaf children in cells and build their HLOD proxies. Leaves with
+// a shader or a light, and dynamic leaves, are left as they are, as well as
+// cells with only one leaf.
+
+void Node::buildHLOD(float cellSize) {
+
+	static char buf[2048];
+	map<pair<int, int>, list<Node *> > cells;
+	list<Node *> children;
+
+	for(list<Node *>::iterator it = m_children.begin(), end = m_children.end();
+		it != end; ++it) {
+		Node *theChild = *it;
+		if (!theChild->m_gObject || theChild->m_shader || theChild->m_light || theChild->m_dynamic) {
+			children.push_back(theChild);
+			continue;
+		}
+		const BBox *box = theChild->m_containerWC;
+		int i = (int) floorf(0.5f * (box->m_min[0] + box->m_max[0]) / cellSize);
+		int j = (int) floorf(0.5f * (box->m_min[2] + box->m_max[2]) / cellSize);
+		cells[make_pair(i, j)].push_back(theChild);
+	}
+	m_children.swap(children);
+
+	HLODBuilder builder(m_name);
+	vector<Node *> cellNodes;
+	for(map<pair<int, int>, list<Node *> >::iterator it = cells.begin(), end = cells.end();
+		it != end; ++it) {
+		list<Node *> & leaves = it->second;
+		if (leaves.size() < 2) {
+			m_children.push_back(leaves.front());
+			continue;
+		}
+		sprintf(buf, "%s#hlod#%d#%d", m_name.c_str(), it->first.first, it->first.second);
+		Node *cellNode = NodeManager::instance()->create(buf);
+		addChild(cellNode);
+		size_t cluster = builder.addCluster();
+		for(list<Node *>::iterator lit = leaves.begin(), lend = leaves.end();
+			lit != lend; ++lit) {
+			Node *theLeaf = *lit;
+			cellNode->addChild(theLeaf); // the cell has the same placement as this
+			builder.add(cluster, theLeaf->m_gObject, theLeaf->m_placement);
+		}
+		cellNodes.push_back(cellNode);
+	}
+	builder.build();
+	for(size_t i = 0; i < cellNodes.size(); ++i) {
+		cellNodes[i]->m_proxy = builder.getProxy(i);
+		cellNodes[i]->m_proxyError = builder.getError(i);
+	}
+}
+
+bool Node::buildImpostors() {
+	if (m_gObject) {
+		m_impostor = ImpostorManager::instance()->create(m_gObject);
+		return m_allImpostors = true;
+	}
+	m_allImpostors = !m_children.empty();
+	for(list<Node *>::iterator it = m_children.begin(), end = m_children.end();
+		it != end; ++it) {
+		Node *theChild = *it;
+		if (!theChild->buildImpostors()) m_allImpostors = false;
+	}
+	return m_allImpostors;
+}
+
+// Add the geometry objects of the subtree to the batch, placed relative to
+// the node of the batch (T is the placement of this node relative to it).
+// Return whether the whole subtree is in the batch.
+
+bool Node::collectBatch(StaticBatch *batch, const Affine3D & T) {
+	if (m_dynamic) return m_batched = false;
+	if (m_gObject) {
+		batch->add(m_gObject, T);
+		return m_batched = true;
+	}
+	m_batched = !m_children.empty();
+	for(list<Node *>::iterator it = m_children.begin(), end = m_children.end();
+		it != end; ++it) {
+		Node *theChild = *it;
+		if (theChild->m_shader) {
+			m_batched = false;
+			continue;
+		}
+		Affine3D childT(T);
+		childT.add(theChild->m_placement);
+		if (!theChild->collectBatch(batch, childT)) m_batched = false;
+	}
+	return m_batched;
+}
+
+void Node::buildStaticBatch(float chunkSize) {
+	delete m_batch;
+	m_batch = new StaticBatch(m_name, chunkSize);
+	Affine3D I;
+	collectBatch(m_batch, I);
+	m_batched = false; // the batch is drawn by this node
+	m_batch->build();
+	const StaticBatch::stats_t & st = m_batch->getStats();
+	fprintf(stderr, "[I] static batch %s: %zu objects, %zu meshes -> %zu meshes in %zu chunks"
+			" (%zu triangles), GPU memory %.1f -> %.1f KB\n", m_name.c_str(),
+			st.objects, st.sources, st.meshes, st.chunks, st.triangles,
+			st.sourceBytes / 1024.0, st.bytes / 1024.0);
+}
@@ -4,14 +4,20 @@
 
 #include <string>
 #include <list>
+#include <cfloat>
 #include "vector3.h"
 #include "trfm3D.h"
+#include "affine3D.h"
+#include "trs.h"
 #include "bbox.h"
 #include "bsphere.h"
+#include "obb.h"
 #include "gObject.h"
 #include "camera.h"
 #include "light.h"
 #include "shader.h"
+#include "impostor.h"
+#include "staticBatch.h"
 
 
 class Node {
@@ -30,6 +36,8 @@ public:
 	 */
 	Node *clone();
 
+	const std::string & getName() const;
+
 	///////////////////////////////////
 	// attach/detach
 	void attachGobject(GObject * M); //!< Attach geometry
@@ -44,6 +52,17 @@ public:
 	bool getDrawBBox() const;
 	void setCheckCollision(bool b);
 	bool getCheckCollision() const;
+	bool collisionsEnabled() const; //!< neither the node nor its ancestors skip collisions
+
+	/**
+	 * Mark the leaves of a (sub)tree as dynamic (moving every frame), or
+	 * static again. The BBoxes of dynamic leaves are not included in the
+	 * BBoxes of their ancestors, so that moving them doesn't update the
+	 * BBoxes up to the root. They are culled, drawn and queried through
+	 * DynamicTree instead (see Scene).
+	 */
+	void setDynamic(bool b);
+	bool getDynamic() const; //!< whether a leaf is dynamic
 
 	///////////////////////////////////
 	// transformations
@@ -55,6 +74,28 @@ public:
 	void rotateY(float angle ); //!< add rotation Y
 	void rotateZ(float angle ); //!< add rotation Z
 	void scale(float factor ); //!< add uniform scale
+	const Trfm3D *getPlacementWC() const; //!< local to world trfm
+
+	/**
+	 * Bounding volumes in world coordinates: the BBox of the subtree, a
+	 * sphere including it (cheaper to test, see frustumCull and
+	 * checkCollision) and, for nodes with geometry, the BBox of the geometry
+	 * object placed as an oriented box (tighter than the BBox when the node
+	 * is rotated). The OBB is 0 if the node has no geometry.
+	 */
+	const BBox *getContainerWC() const;
+	const BSphere *getSphereWC() const;
+	const OBB *getOBBWC() const;
+
+	/**
+	 * Use a TRS placement (translation, rotation quaternion and scale) instead
+	 * of a matrix. The transformations above then compose onto the TRS
+	 * (setTrfm and addTrfm decompose M, which must have uniform scale), so
+	 * that repeated rotations do not drift, and the local matrix is only built
+	 * when the world trfm is updated.
+	 */
+	void setTRS(const TRS & trs);
+	const TRS *getTRS() const; //!< 0 if the placement is a matrix
 
 	///////////////////////////////////
 	// tree operations
@@ -84,14 +125,96 @@ public:
 	void frustumCull(Camera *cam);
 
 	/**
-	 * Check wether a BSphere (in woorld coord.) collides with a (sub)-tree
+	 * Check wether a BSphere (in woorld coord.) collides with a (sub)-tree.
+	 * The BBoxes only cull subtrees: leaves are tested against the triangles
+	 * of their geometry.
 	 *
 	 * @param bsp  Bounding Sphere in world coordinates
 	 * @return the Node which collided with the BSphere. 0 if not collision.
 	 */
 	const Node *checkCollision(const BSphere *bsp) const;
 
+	//! First contact of a moving sphere with the geometry of a (sub)tree
+	struct sweep_t {
+		float t;        //!< fraction of the motion before the contact
+		Vector3 normal; //!< normal of the contact, towards the sphere (world coords.)
+	};
+
+	/**
+	 * Move a BSphere (in world coord.) from its position to position + d, and
+	 * find its first contact with the triangles of a (sub)tree (see
+	 * sweepSphereTriangle). Unlike checkCollision, large motions can't go
+	 * through thin geometry.
+	 *
+	 * @param bsp  Bounding Sphere in world coordinates
+	 * @param d    motion of the sphere
+	 * @param hit  the first contact (if any)
+	 * @return the Node touched first. 0 if no contact.
+	 */
+	const Node *sweepSphere(const BSphere *bsp, const Vector3 & d, sweep_t & hit) const;
+
+	//! Closest intersection of a ray with the geometry of a (sub)tree
+	struct hit_t {
+		const TriangleMesh *mesh; //!< mesh intersected
+		int triangle;             //!< triangle of the mesh
+		float u, v;               //!< barycentric coordinates (see IntersectTriangleRay)
+		float t;                  //!< parameter of the ray
+	};
+
+	/**
+	 * Find the closest intersection of a ray with the geometry of a
+	 * (sub)tree. Subtrees whose BBox the ray misses are skipped, and the ray
+	 * is transformed to the local coordinates of every geometry object, so
+	 * that its meshes are tested with their BVH (see GObject::buildBVH).
+	 *
+	 * @param ray  the ray (in world coordinates)
+	 * @param hit  the intersection (if any)
+	 * @param tmax only intersections with parameter in (0, tmax) count
+	 * @return the Node intersected. 0 if no intersection.
+	 */
+	const Node *intersectRay(const Line & ray, hit_t & hit, float tmax = FLT_MAX) const;
+
+	/**
+	 * Build HLOD proxies for the leaf children of this node.
+	 *
+	 * Leaf children are grouped in cells of cellSize x cellSize (in the XZ
+	 * plane of world coordinates). Every cell becomes a new child node, with
+	 * the leaves of the cell as children, and a proxy which replaces all of
+	 * them when the cell is far away (see HLODBuilder).
+	 *
+	 * @param cellSize  size of the cells
+	 */
+	void buildHLOD(float cellSize);
+
+	/**
+	 * Create the impostors of the geometry objects of the (sub)tree (see
+	 * ImpostorManager). Nodes farther than the impostor distance (see
+	 * RenderState::setImpostorDistance) are drawn with impostors. Inner nodes
+	 * whose leaves all have impostors don't draw their HLOD proxy then.
+	 *
+	 * @return whether all the leaves of the subtree have impostors
+	 */
+	bool buildImpostors();
+
+	/**
+	 * Merge the geometry objects of the (sub)tree into a static batch (see
+	 * StaticBatch), with chunks of chunkSize x chunkSize. The batch is drawn
+	 * instead of the merged nodes (see RenderState::setStaticBatching).
+	 * Nodes with a shader, and their subtrees, are not merged, nor dynamic
+	 * leaves (see setDynamic).
+	 *
+	 * \note the merged nodes must not move relative to this node, as the
+	 * batch is not updated
+	 *
+	 * @param chunkSize  size of the chunks
+	 */
+	void buildStaticBatch(float chunkSize);
+
 	friend class NodeManager;
+	friend class CollisionGrid;
+	friend class DynamicTree;
+	friend class BatchQuery;
+	friend class AnimationManager;
 
 private:
 	Node(const std::string & name);
@@ -101,12 +224,32 @@ private:
 
 	// auxiliary functions
 	Node *cloneParent(Node *theParent);
+	void syncPlacement();
+	Node *markDirty();
+	void updateDirty();
 	void updateWC();
+	void updateChildrenWC();
+	void updateLeavesWC(Node **leaves, size_t n, BBox *box, bool index);
 	void updateGS();
 	void updateBB ();
+	void updateLeafIndex();
+	void updateOBB();
+	void updateSphere();
 	void propagateBBRoot();
+	void setDynamicLeaves(bool b);
 	void updateCull(Camera *cam, unsigned int *mask);
 	void setCulled(bool culled);
+	int checkFrustum(Camera *cam) const;
+	float scaleWC() const;
+	size_t selectLOD(const GObject *gobj);
+	bool selectProxy();
+	bool selectImpostor() const;
+	bool collectBatch(StaticBatch *batch, const Affine3D & T);
+	const Node *intersectRayWC(const Line & ray, hit_t & hit) const;
+	bool collideLeaf(const BSphere *bsp) const;
+	bool sweepLeaf(const BSphere *bsp, const Vector3 & d, sweep_t & hit) const;
+	const Node *sweepSphereWC(const BSphere *bsp, const Vector3 & d, const BBox & box,
+							  sweep_t & hit) const;
 
 	// member variables
 	std::string m_name;
@@ -115,10 +258,24 @@ private:
 	GObject *m_gObject;  // 0 if not geometry
 	Light   *m_light; // 0 if not light
 	ShaderProgram *m_shader; // 0 if not shader
-	Trfm3D *m_placement; // local transformation to parent node
-	Trfm3D *m_placementWC; // local transformation to world
+	Affine3D *m_placement; // local transformation to parent node
+	Affine3D *m_placementWC; // local transformation to world
+	TRS *m_trs; // TRS placement. 0 if the placement is a matrix
+	bool m_trsDirty; // whether m_placement has to be rebuilt from m_trs
+	bool m_dirty; // whether the WC of the node or of some node below it are out of date
 	BBox *m_containerWC; // BBox in world coordinates
+	BSphere *m_sphereWC; // sphere including m_containerWC (world coordinates)
+	OBB *m_obbWC; // BBox of gObject as an OBB (world coordinates). 0 if not geometry
 	bool m_checkCollision; // if false, don't check collision
+	bool m_dynamic; // leaf indexed by DynamicTree instead of the BBoxes of its ancestors
 	bool m_isCulled; // whether the node is culled
 	bool m_drawBBox; // whether BBox has to be drawn
+	size_t m_lod; // LOD of gObject (or proxy) drawn in the last frame
+	GObject *m_proxy; // HLOD proxy of the children. 0 if no proxy
+	float m_proxyError; // distance between proxy (LOD 0) and children (local coords.)
+	bool m_drawProxy; // whether the proxy was drawn in the last frame
+	Impostor *m_impostor; // impostor of gObject. 0 if no impostor
+	bool m_allImpostors; // whether all the leaves of the subtree have impostors
+	StaticBatch *m_batch; // static batch of the subtree. 0 if no batch
+	bool m_batched; // whether the subtree is drawn by the static batch of an ancestor
 };
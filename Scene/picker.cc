@@ -0,0 +1,177 @@
+#include "picker.h"
+#include "node.h"
+#include "renderState.h"
+#include "shaderManager.h"
+#include "textureManager.h"
+#include "dynamicTree.h"
+#include "tools.h"
+
+Picker * Picker::instance() {
+	static Picker mgr;
+	return &mgr;
+}
+
+Picker::Picker() :
+	m_head(0),
+	m_used(0),
+	m_frame(0),
+	m_target(0),
+	m_shader(0),
+	m_nodes(0) {
+	for(int i = 0; i < ring; ++i) {
+		m_slots[i].pbo = 0;
+		m_slots[i].query = 0;
+		m_slots[i].fence = 0;
+	}
+}
+
+Picker::~Picker() {}
+
+// GL objects are created on the first request (there must be a context)
+
+void Picker::init() {
+	if (m_target) return;
+	m_target = TextureManager::instance()->createColorMap("#picker", region, region, true);
+	ShaderManager *smgr = ShaderManager::instance();
+	m_shader = smgr->find("pick");
+	if (!m_shader)
+		m_shader = smgr->create("pick", "Shaders/pick.vert", "Shaders/pick.frag");
+	for(int i = 0; i < ring; ++i) {
+		glGenBuffers(1, &m_slots[i].pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_slots[i].pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, region * region * 4, 0, GL_STREAM_READ);
+		glGenQueries(1, &m_slots[i].query);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void Picker::request(int x, int y) {
+	request_t req;
+	req.x = x;
+	req.y = y;
+	req.time = pick_clock::now();
+	m_requests.push_back(req);
+}
+
+bool Picker::busy() const { return !m_requests.empty() || m_used; }
+
+unsigned int Picker::addNode(const Node *node) {
+	if (!m_nodes) return 0;
+	m_nodes->push_back(node);
+	return m_nodes->size();
+}
+
+void Picker::render(Camera *cam, Node *root) {
+	++m_frame;
+	if (m_requests.empty() || m_used == ring || !cam || !root) return;
+	pick_clock::time_point t0 = pick_clock::now();
+	init();
+	slot_t & slot = m_slots[(m_head + m_used) % ring];
+	slot.req = m_requests.front();
+	m_requests.pop_front();
+	slot.frame = m_frame;
+	slot.nodes.clear();
+
+	// Scale the projection so that the region around the pixel fills the
+	// target: NDC' = (NDC - C) * (viewport size / region)
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	float sx = (float) vp[2] / region;
+	float sy = (float) vp[3] / region;
+	float cx = 2.0f * (slot.req.x - vp[0] + 0.5f) / vp[2] - 1.0f;
+	float cy = 2.0f * (slot.req.y - vp[1] + 0.5f) / vp[3] - 1.0f;
+	Trfm3D S;
+	S.setLocal2World(Vector3(-cx * sx, -cy * sy, 0.0f),
+					 Vector3(sx, 0.0f, 0.0f), Vector3(0.0f, sy, 0.0f), Vector3::UNIT_Z);
+
+	RenderState *rs = RenderState::instance();
+	ShaderProgram *prev_shader = rs->getShader();
+	rs->push(RenderState::projection);
+	rs->loadTrfm(RenderState::projection, &S);
+	rs->addTrfm(RenderState::projection, cam->projectionTrfm());
+	rs->push(RenderState::modelview);
+	rs->loadTrfm(RenderState::modelview, cam->viewTrfm());
+	rs->push(RenderState::model);
+	rs->setShader(m_shader);
+	rs->setPickPass(true);
+	m_nodes = &slot.nodes;
+
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	GLfloat clear[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clear);
+	glDisable(GL_BLEND);
+	m_target->bind();
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f); // id 0 is the background
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearColor(clear[0], clear[1], clear[2], clear[3]);
+	glBeginQuery(GL_TIME_ELAPSED, slot.query);
+	root->draw();
+	DynamicTree::instance()->draw();
+	glEndQuery(GL_TIME_ELAPSED);
+	// asynchronous read back (glReadPixels returns at once with a PBO bound)
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	glReadPixels(0, 0, region, region, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_target->unbind();
+	if (blend) glEnable(GL_BLEND);
+
+	m_nodes = 0;
+	rs->setPickPass(false);
+	if (prev_shader) rs->setShader(prev_shader);
+	rs->pop(RenderState::model);
+	rs->pop(RenderState::modelview);
+	rs->pop(RenderState::projection);
+	++m_used;
+	slot.cpuTime = elapsed_ms(t0);
+}
+
+bool Picker::poll(result_t & res) {
+	if (!m_used) return false;
+	slot_t & slot = m_slots[m_head];
+	GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	// the id closest to the center of the region
+	pick_clock::time_point t0 = pick_clock::now();
+	unsigned int id = 0;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	const unsigned char *pixels = (const unsigned char *)
+		glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, region * region * 4, GL_MAP_READ_BIT);
+	if (pixels) {
+		int best = region * region;
+		for(int j = 0; j < region; ++j) {
+			for(int i = 0; i < region; ++i) {
+				const unsigned char *p = pixels + 4 * (j * region + i);
+				unsigned int pid = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+				int di = i - region / 2, dj = j - region / 2;
+				if (pid && di * di + dj * dj < best) {
+					best = di * di + dj * dj;
+					id = pid;
+				}
+			}
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	res.node = (id && id <= slot.nodes.size()) ? slot.nodes[id - 1] : 0;
+	res.x = slot.req.x;
+	res.y = slot.req.y;
+	res.frames = m_frame - slot.frame;
+	res.latency = elapsed_ms(slot.req.time);
+	res.cpuTime = slot.cpuTime + elapsed_ms(t0);
+	res.gpuTime = -1.0f;
+	GLint available = 0;
+	glGetQueryObjectiv(slot.query, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available) {
+		GLuint64 ns;
+		glGetQueryObjectui64v(slot.query, GL_QUERY_RESULT, &ns);
+		res.gpuTime = ns * 1e-6f;
+	}
+	m_head = (m_head + 1) % ring;
+	--m_used;
+	return true;
+}
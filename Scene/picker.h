@@ -0,0 +1,110 @@
+// -*-C++-*-
+
+#pragma once
+
+/**
+ * @brief GPU picking with an ID buffer
+ *
+ * A pick request is answered by drawing the scene once more, into a small
+ * region x region render target centered at the requested pixel, with the
+ * "pick" shader, which writes the id of every node instead of its color.
+ * The target is read back into a pixel buffer object (PBO), and the result
+ * is collected a few frames later, when the GPU is done with it, so that
+ * picking never stalls the pipeline. There are 'ring' PBOs, so that up to
+ * 'ring' requests are in flight. The picked node is the one closest to the
+ * center of the region, so clicks just next to thin geometry still hit it.
+ *
+ * Usage: request() on a mouse click, and once per frame (after drawing the
+ * scene) render() and poll().
+ */
+
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <GL/glew.h>
+#include "camera.h"
+#include "texturert.h"
+#include "shader.h"
+
+class Node;
+
+class Picker {
+
+public:
+	static Picker * instance();
+
+	static const int region = 9; // side of the render target (in pixels, odd)
+	static const int ring = 3;   // number of PBOs
+
+	struct result_t {
+		const Node *node; // 0 if nothing was picked
+		int x, y;         // requested pixel
+		size_t frames;    // frames since the request was rendered
+		float latency;    // milliseconds since the request
+		float cpuTime;    // milliseconds of CPU spent in the picking pass
+		float gpuTime;    // milliseconds of GPU spent in the picking pass (-1 if unknown)
+	};
+
+	/**
+	 * Request to pick the node at pixel (x, y) of the window (lower left is
+	 * (0, 0)). The result is available through poll() one or two frames
+	 * later.
+	 */
+	void request(int x, int y);
+
+	/**
+	 * Draw the picking pass of the oldest pending request (if any) and start
+	 * its read back. Call it once per frame, after drawing the scene with
+	 * camera 'cam' (the culling of that frame is reused). The dynamic leaves
+	 * (see DynamicTree) are drawn as well.
+	 */
+	void render(Camera *cam, Node *root);
+
+	/**
+	 * Get the result of the oldest request, if it is ready. Never waits for
+	 * the GPU.
+	 *
+	 * @return whether 'res' was filled
+	 */
+	bool poll(result_t & res);
+
+	// whether there are requests waiting for render() or poll()
+	bool busy() const;
+
+	// Id of a node drawn in the picking pass (used by Node::draw)
+	unsigned int addNode(const Node *node);
+
+private:
+	Picker();
+	~Picker();
+	Picker(const Picker &);
+	Picker & operator=(const Picker &);
+
+	typedef std::chrono::steady_clock pick_clock;
+
+	struct request_t {
+		int x, y;
+		pick_clock::time_point time;
+	};
+
+	struct slot_t {
+		GLuint pbo;
+		GLuint query;   // GL_TIME_ELAPSED of the pass
+		GLsync fence;   // 0 if the slot is free
+		request_t req;
+		size_t frame;   // frame the request was rendered in
+		float cpuTime;
+		std::vector<const Node *> nodes; // node of every id (id - 1)
+	};
+
+	void init();
+
+	std::deque<request_t> m_requests; // waiting for render()
+	slot_t m_slots[ring];
+	int m_head;  // oldest slot in flight
+	int m_used;  // slots in flight
+	size_t m_frame;
+	TextureRT *m_target;
+	ShaderProgram *m_shader;
+	std::vector<const Node *> *m_nodes; // of the slot being drawn
+};
@@ -13,7 +13,16 @@ RenderState::RenderState() :
 	m_backMaterial(0),
 	m_ambient(Vector3(0.05f, 0.05f, 0.05)),
 	m_activeShader(0),
-	m_drawBBox(false) {}
+	m_drawBBox(false),
+	m_camera(0),
+	m_lodThreshold(0.001f),
+	m_impostorDistance(200.0f),
+	m_clusterCulling(true),
+	m_staticBatching(true),
+	m_pickPass(false),
+	m_pickId(0),
+	m_drawCalls(0),
+	m_triangles(0) {}
 
 RenderState::~RenderState() {}
 
@@ -158,6 +167,86 @@ bool RenderState::getBBoxDraw() const {
 	return m_drawBBox;
 }
 
+///////////////////////////////////////////
+// Level of detail
+
+void RenderState::setCamera(Camera *cam) {
+	m_camera = cam;
+}
+
+Camera *RenderState::getCamera() {
+	return m_camera;
+}
+
+void RenderState::setLODThreshold(float threshold) {
+	m_lodThreshold = threshold;
+}
+
+float RenderState::getLODThreshold() const {
+	return m_lodThreshold;
+}
+
+void RenderState::setImpostorDistance(float dist) {
+	m_impostorDistance = dist;
+}
+
+float RenderState::getImpostorDistance() const {
+	return m_impostorDistance;
+}
+
+void RenderState::setClusterCulling(bool cull) {
+	m_clusterCulling = cull;
+}
+
+bool RenderState::getClusterCulling() const {
+	return m_clusterCulling;
+}
+
+void RenderState::setStaticBatching(bool batch) {
+	m_staticBatching = batch;
+}
+
+bool RenderState::getStaticBatching() const {
+	return m_staticBatching;
+}
+
+void RenderState::setPickPass(bool pick) {
+	m_pickPass = pick;
+}
+
+bool RenderState::getPickPass() const {
+	return m_pickPass;
+}
+
+void RenderState::setPickId(unsigned int id) {
+	m_pickId = id;
+}
+
+unsigned int RenderState::getPickId() const {
+	return m_pickId;
+}
+
+///////////////////////////////////////////
+// Statistics
+
+void RenderState::resetStats() {
+	m_drawCalls = 0;
+	m_triangles = 0;
+}
+
+void RenderState::addDrawCall(size_t triangles) {
+	++m_drawCalls;
+	m_triangles += triangles;
+}
+
+size_t RenderState::getDrawCalls() const {
+	return m_drawCalls;
+}
+
+size_t RenderState::getTriangles() const {
+	return m_triangles;
+}
+
 ///////////////////////////////////////////
 // Scene ambient light
 void RenderState::setSceneAmbient(const Vector3 &rgb) {
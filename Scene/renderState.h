@@ -18,6 +18,7 @@
 #include "light.h"
 #include "textureManager.h"
 #include "shader.h"
+#include "camera.h"
 
 // Possible matrix stacks
 
@@ -172,6 +173,81 @@ public:
 	 */
 	void setBackMaterial(Material *mat);
 
+	///////////////////////////////////////////
+	// Level of detail
+
+	/**
+	 * Set the camera the scene is rendered from (used to select LODs)
+	 *
+	 * @param cam the camera (0 if none)
+	 */
+	void setCamera(Camera *cam);
+	Camera *getCamera();
+
+	/**
+	 * Set the maximum screen-space error of the LODs, as a fraction of the
+	 * viewport height. 0 means always draw the full detail meshes.
+	 *
+	 * @param threshold the maximum error (default 0.001)
+	 */
+	void setLODThreshold(float threshold);
+	float getLODThreshold() const;
+
+	/**
+	 * Set the distance beyond which nodes with an impostor are drawn as
+	 * billboards (see Impostor). 0 means never draw impostors.
+	 *
+	 * @param dist the distance, in world coordinates (default 200)
+	 */
+	void setImpostorDistance(float dist);
+	float getImpostorDistance() const;
+
+	/**
+	 * Cull the clusters of meshes (see TriangleMesh::buildClusters) against
+	 * the view frustum and the eye, and draw only the visible ones.
+	 *
+	 * @param cull whether to cull clusters (default true)
+	 */
+	void setClusterCulling(bool cull);
+	bool getClusterCulling() const;
+
+	/**
+	 * Draw static batches (see Node::buildStaticBatch) instead of the nodes
+	 * they merge.
+	 *
+	 * @param batch whether to draw static batches (default true)
+	 */
+	void setStaticBatching(bool batch);
+	bool getStaticBatching() const;
+
+	/**
+	 * Draw the picking pass (see Picker): nodes keep the current shader and
+	 * draw their full geometry (no impostors, HLOD proxies, static batches
+	 * or BBoxes), with their pick id.
+	 *
+	 * @param pick whether the picking pass is being drawn (default false)
+	 */
+	void setPickPass(bool pick);
+	bool getPickPass() const;
+	void setPickId(unsigned int id); // pick id of the node being drawn
+	unsigned int getPickId() const;
+
+	///////////////////////////////////////////
+	// Statistics
+
+	/**
+	 * Reset the frame statistics (call it before rendering a frame)
+	 */
+	void resetStats();
+
+	/**
+	 * Count a draw call of 'triangles' triangles
+	 */
+	void addDrawCall(size_t triangles);
+
+	size_t getDrawCalls() const; // draw calls since last reset
+	size_t getTriangles() const; // triangles drawn since last reset
+
 	///////////////////////////////////////////
 	// Misc
 
@@ -230,6 +306,19 @@ private:
 	ShaderProgram *m_activeShader;
 	bool m_drawBBox;
 
+	// Level of detail
+	Camera *m_camera;
+	float m_lodThreshold;
+	float m_impostorDistance;
+	bool m_clusterCulling;
+	bool m_staticBatching;
+	bool m_pickPass;
+	unsigned int m_pickId;
+
+	// Statistics
+	size_t m_drawCalls;
+	size_t m_triangles;
+
 	float m_t;
 
 	//Sombras
@@ -5,6 +5,9 @@
 #include "renderState.h"
 #include "shaderManager.h"
 #include "nodeManager.h"
+#include "impostorManager.h"
+#include "collisionGrid.h"
+#include "dynamicTree.h"
 
 Scene * Scene::instance() {
 	static Scene inst;
@@ -42,5 +45,43 @@ void Scene::draw() {
 	if (m_rootNode) {
 		RenderState::instance()->setShader(m_rootNode->getShader());
 		m_rootNode->draw();
+		DynamicTree::instance()->draw();
+		// far away nodes with impostors were only queued
+		ImpostorManager::instance()->draw();
 	}
 }
+
+void Scene::frustumCull(Camera *cam) {
+	m_rootNode->frustumCull(cam);
+	DynamicTree::instance()->frustumCull(cam);
+}
+
+const Node *Scene::checkCollision(const BSphere *bsph) {
+	CollisionGrid *grid = CollisionGrid::instance();
+	const Node *res = grid->active() ? grid->checkCollision(bsph) : m_rootNode->checkCollision(bsph);
+	if (res) return res;
+	return DynamicTree::instance()->checkCollision(bsph);
+}
+
+const Node *Scene::sweepSphere(const BSphere *bsph, const Vector3 & d, Node::sweep_t & hit) {
+	CollisionGrid *grid = CollisionGrid::instance();
+	const Node *res = grid->active() ? grid->sweepSphere(bsph, d, hit) : m_rootNode->sweepSphere(bsph, d, hit);
+	Node::sweep_t dhit;
+	const Node *dres = DynamicTree::instance()->sweepSphere(bsph, d, dhit);
+	if (dres && dhit.t < hit.t) {
+		hit = dhit;
+		res = dres;
+	}
+	return res;
+}
+
+const Node *Scene::intersectRay(const Line & ray, Node::hit_t & hit, float tmax) {
+	const Node *res = m_rootNode->intersectRay(ray, hit, tmax);
+	Node::hit_t dhit;
+	const Node *dres = DynamicTree::instance()->intersectRay(ray, dhit, hit.t);
+	if (dres) {
+		hit = dhit;
+		res = dres;
+	}
+	return res;
+}
@@ -12,6 +12,16 @@ public:
 	void attach(Node *theChild);
 	void draw();
 
+	/**
+	 * Queries on the whole scene: the static part of the tree (through the
+	 * CollisionGrid, if there is one, for collisions) and the dynamic leaves
+	 * (see DynamicTree). As the Node functions of the same name.
+	 */
+	void frustumCull(Camera *cam);
+	const Node *checkCollision(const BSphere *bsph);
+	const Node *sweepSphere(const BSphere *bsph, const Vector3 & d, Node::sweep_t & hit);
+	const Node *intersectRay(const Line & ray, Node::hit_t & hit, float tmax = FLT_MAX);
+
 	/**
 	 * Set shading type to the scene
 	 *
@@ -0,0 +1,12 @@
+#version 120
+
+uniform sampler2D texture0;
+
+varying vec2 f_texCoord;
+
+void main() {
+	vec4 c = texture2D(texture0, f_texCoord);
+	if (c.a < 0.5) discard;
+	// the background is black, so filtered colors are premultiplied by alpha
+	gl_FragColor = vec4(c.rgb / c.a, 1.0);
+}
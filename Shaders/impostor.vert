@@ -0,0 +1,18 @@
+#version 120
+
+uniform mat4 modelToCameraMatrix;
+uniform mat4 cameraToClipMatrix;
+
+attribute vec2 v_position; // quad corner (-1 .. 1)
+attribute vec4 v_instance; // center (model space) and radius
+attribute vec4 v_tile;     // atlas tile: origin and size
+
+varying vec2 f_texCoord;
+
+void main() {
+	// camera-facing quad around the center
+	vec4 P = modelToCameraMatrix * vec4(v_instance.xyz, 1.0);
+	P.xy += v_instance.w * v_position;
+	gl_Position = cameraToClipMatrix * P;
+	f_texCoord = v_tile.xy + (0.5 * v_position + 0.5) * v_tile.zw;
+}
@@ -0,0 +1,7 @@
+#version 120
+
+uniform vec4 pickId; // id of the node, one byte per channel (see Picker)
+
+void main() {
+	gl_FragColor = pickId;
+}
@@ -49,6 +49,7 @@ void ShaderProgram::initUniforms() {
 	m_umodeltoClip = GetProgramUniform(name, m_program, "modelToClipMatrix");
 
 	m_utime = GetProgramUniform(name, m_program, "u_time");
+	m_upickId = glGetUniformLocation(m_program, "pickId"); // (no warning if missing)
 
 	///////////////////////////////////////////////////////////////////////////////Sombras
 	
@@ -133,6 +134,10 @@ void ShaderProgram::beforeDraw() {
 
 	shader_set_uniform_1f(m_utime, rs->getTime());
 
+	unsigned int id = rs->getPickId(); // one byte per channel
+	shader_set_uniform_4f(m_upickId, (id & 0xff) / 255.0f, ((id >> 8) & 0xff) / 255.0f,
+						  ((id >> 16) & 0xff) / 255.0f, ((id >> 24) & 0xff) / 255.0f);
+
 	int i = 0;
 	for(LightManager::iterator it = LightManager::instance()->begin(), end = LightManager::instance()->end();
 		it != end; ++it) {
@@ -78,6 +78,7 @@ private:
 	GLint m_utexCubemap;
 
 	GLint m_utime;
+	GLint m_upickId; // only in the picking shader
 
 	//Sombras
 	GLint m_modelToShadow;//Matriz
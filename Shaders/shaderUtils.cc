@@ -110,11 +110,14 @@ GLuint CreateProgramFromObjects(const char *programName, GLuint shaderOne, GLuin
 	// 32-43 (TBN tangent, 3x4)
 	// 44-55 (TBN bitangent, 3x4)
 	// 56-67 (TBN normal, 3x4)
+	// 5 and 6 are per instance (instanced drawing, see Impostor)
 	SetProgramAttribute(program, 0, "v_position");
 	SetProgramAttribute(program, 1, "v_normal");
 	SetProgramAttribute(program, 2, "v_texCoord");
 	SetProgramAttribute(program, 3, "v_TBN_t");
 	SetProgramAttribute(program, 4, "v_TBN_b");
+	SetProgramAttribute(program, 5, "v_instance");
+	SetProgramAttribute(program, 6, "v_tile");
 
 	glLinkProgram(program);
 	test_shader_link(program, programName);
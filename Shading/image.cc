@@ -19,6 +19,15 @@ Image::Image(const std::string &fname) :
 	load_jpg();
 }
 
+// Image from RGB pixels in memory (not from a file)
+
+Image::Image(const std::string &name, int width, int height, const unsigned char *rgb) :
+	m_fileName(name),
+	m_width(width),
+	m_height(height),
+	m_size(width * height * 3),
+	m_data(rgb, rgb + width * height * 3) {}
+
 Image::~Image() {}
 
 const string &Image::getName() const { return m_fileName; }
@@ -23,6 +23,7 @@ public:
 
 private:
 	Image(const std::string &fname);
+	Image(const std::string &name, int width, int height, const unsigned char *rgb);
 	~Image();
 	Image(const Image &);
 	Image & operator =(const Image &);
@@ -28,6 +28,17 @@ Image *ImageManager::create(const std::string &fName) {
 	return it->second;
 }
 
+Image *ImageManager::create(const std::string &name, int width, int height, const unsigned char *rgb) {
+	map<string, Image *>::iterator it = m_hash.find(name);
+	if (it != m_hash.end()) {
+		fprintf(stderr, "[W] duplicate image %s\n", name.c_str());
+		return it->second;
+	}
+	Image * newimg = new Image(name, width, height, rgb);
+	it = m_hash.insert(make_pair(name, newimg)).first;
+	return it->second;
+}
+
 Image *ImageManager::find(const std::string &fName) {
 	map<string, Image *>::const_iterator it = m_hash.find(fName);
 	if (it == m_hash.end()) return 0;
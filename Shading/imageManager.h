@@ -13,6 +13,8 @@ public:
 	static ImageManager *instance();
 
 	Image *create(const std::string &fname);
+	// create image 'name' from width x height RGB pixels
+	Image *create(const std::string &name, int width, int height, const unsigned char *rgb);
 	Image *find(const std::string &fname);
 
 	void print() const;
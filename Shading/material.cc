@@ -27,6 +27,8 @@ const Vector3 &Material::getSpecular() const { return m_specular; }
 float  Material::getShininess() const { return m_shininess; }
 Texture *Material::getTexture() { return m_tex; }
 Texture *Material::getBumpMap() { return m_bump; }
+Texture *Material::getTexture() const { return m_tex; }
+Texture *Material::getBumpMap() const { return m_bump; }
 
 //Texture *Material::getTextureMaterial() const { return m_tex; }
 // Texture *Material::getBumpMap() const { return m_bump; }
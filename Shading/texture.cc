@@ -54,8 +54,13 @@ Texture::Texture(const std::string & name) :
 }
 
 Texture::type_t Texture::getType() const { return m_type; }
+const Image *Texture::getImage() const { return m_img; }
 
 void Texture::setImage(const string &FileName) {
+	setImage(ImageManager::instance()->create(FileName));
+}
+
+void Texture::setImage(Image *img) {
 
 	if(m_img) {
 		//remove image data from openGL
@@ -65,7 +70,7 @@ void Texture::setImage(const string &FileName) {
 	}
 
 	m_type = tex;
-	m_img = ImageManager::instance()->create(FileName);
+	m_img = img;
 	m_size = m_img->getSize();
 	m_height = m_img->getHeight();
 	m_width = m_img->getWidth();
@@ -355,8 +360,8 @@ void Texture::sendImageGL() {
 
 static const char *TT_string(Texture::type_t e) {
 
-	static Texture::type_t N[] = {Texture::empty, Texture::tex, Texture::rt_depth, Texture::rt_color, Texture::cubemap, Texture::bumpmap, Texture::proj};
-	static const char *T[]  = {"empty", "tex", "rt_depth", "rt_color", "cubemap", "bumpmap", "proj"};
+	static Texture::type_t N[] = {Texture::empty, Texture::tex, Texture::rt_depth, Texture::rt_color, Texture::rt_rgba, Texture::cubemap, Texture::bumpmap, Texture::proj};
+	static const char *T[]  = {"empty", "tex", "rt_depth", "rt_color", "rt_rgba", "cubemap", "bumpmap", "proj"};
 
 	int i;
 	int m;
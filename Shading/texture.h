@@ -16,15 +16,18 @@ public:
 		tex,      // texture (from JPG)
 		rt_depth, // Depth texture (render texture)
 		rt_color, // Color texture (render testure)
+		rt_rgba,  // Color texture with alpha (render texture)
 		cubemap,  // Cubemap texture (from JPG)
 		bumpmap,  // Bump map (normal) texture (from JPG)
 		proj	  // Underlying texture of projection textures
 	};
 
 	type_t getType() const;
+	const Image *getImage() const; // image of the texture (0 if none)
 
 	// Texture map types
 	void setImage(const std::string &img_fname); // image texture (jpg)
+	void setImage(Image *img); // image texture (image already in memory)
 	void setBumpMap(const std::string &img_fname);  // bump texture (jpg)
 	void setProj(const std::string &img_fname);  // projective texture (jpg)
 	void setCubeMap(const std::string &xpos, const std::string &xneg,
@@ -41,6 +41,18 @@ Texture *TextureManager::create(const std::string & fName) {
 	return it->second;
 }
 
+Texture *TextureManager::create(const std::string & texName, Image *img) {
+	map<string, Texture *>::iterator it = m_hash.find(texName);
+	if (it != m_hash.end()) {
+		fprintf(stderr, "[W] duplicate texture %s\n", texName.c_str());
+		return it->second;
+	}
+	Texture * newtex = new Texture(texName);
+	newtex->setImage(img);
+	it = m_hash.insert(make_pair(texName, newtex)).first;
+	return it->second;
+}
+
 Texture *TextureManager::createBumpMap(const std::string & fName) {
 	map<string, Texture *>::iterator it = m_hash.find(fName);
 	if (it != m_hash.end()) {
@@ -96,13 +108,14 @@ TextureRT *TextureManager::createDepthMap(const std::string & texName, int h, in
 	return newtex;
 }
 
-TextureRT *TextureManager::createColorMap(const std::string & texName, int h, int w) {
+TextureRT *TextureManager::createColorMap(const std::string & texName, int h, int w,
+										  bool alpha) {
 	map<string, Texture *>::iterator it = m_hash.find(texName);
 	if (it != m_hash.end()) {
 		fprintf(stderr, "[W] duplicate texture %s\n", texName.c_str());
 		return 0;
 	}
-	TextureRT *newtex = new TextureRT(Texture::rt_color, h, w);
+	TextureRT *newtex = new TextureRT(alpha ? Texture::rt_rgba : Texture::rt_color, h, w);
 	it = m_hash.insert(make_pair(texName, newtex)).first;
 	return newtex;
 }
@@ -24,6 +24,9 @@ public:
 	 */
 	Texture *create(const std::string & fName);
 
+	// create texture 'texName' from an image in memory
+	Texture *create(const std::string & texName, Image *img);
+
 	// create bump texture
 	Texture *createBumpMap(const std::string & fName);
 
@@ -43,8 +46,9 @@ public:
 	// create depth map
 	TextureRT *createDepthMap(const std::string & texName, int height, int width);
 
-	// create color map
-	TextureRT *createColorMap(const std::string & texName, int height, int width);
+	// create color map (RGBA if alpha is true)
+	TextureRT *createColorMap(const std::string & texName, int height, int width,
+							  bool alpha = false);
 
 	/**
 	 * Get a registered texture
@@ -8,7 +8,8 @@ using std::map;
 
 TextureRT::TextureRT(Texture::type_t mode, int h, int w) :
 	m_fbo(0),
-	m_rbo(0) {
+	m_rbo(0),
+	m_oldFbo(0) {
 	// set Render Target (RT) texture:
 	//  - properly set filters and anti-aliasing setings
 	//  - reclaim memory in OpenGL for storing the texture
@@ -23,6 +24,9 @@ TextureRT::TextureRT(Texture::type_t mode, int h, int w) :
 	if (m_type == Texture::rt_depth) {
 		m_components = 1;
 		m_format = GL_DEPTH_COMPONENT;
+	} else if (m_type == Texture::rt_rgba) {
+		m_components = 4;
+		m_format = GL_RGBA;
 	} else {
 		m_components = 3;
 		m_format = GL_RGB;
@@ -41,6 +45,7 @@ TextureRT::TextureRT(Texture::type_t mode, int h, int w) :
 				 0);
 	Texture::unbindGL();
 	// Set texture fbo
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_oldFbo);
 	glGenFramebuffers(1, &m_fbo);
 	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
 	if (m_type == Texture::rt_depth) {
@@ -78,8 +83,8 @@ TextureRT::TextureRT(Texture::type_t mode, int h, int w) :
 		fprintf(stderr, "[E] This GPU does not support FBOs\n");
 		exit(1);
 	}
-	// switch back to window-system-provided framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// switch back to the previous render target
+	glBindFramebuffer(GL_FRAMEBUFFER, m_oldFbo);
 }
 
 TextureRT::~TextureRT() {
@@ -89,8 +94,9 @@ TextureRT::~TextureRT() {
 
 // Set this texture as render target
 void TextureRT::bind() {
-	// Save old viewport
+	// Save old viewport and render target
 	glGetIntegerv(GL_VIEWPORT, &(m_oldViewport[0]));
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_oldFbo);
 	//set the viewport to be the size of the texture
 	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
 	if(m_type != Texture::rt_depth) {
@@ -100,10 +106,10 @@ void TextureRT::bind() {
 }
 
 void TextureRT::unbind() {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_oldFbo);
 	if(m_type != Texture::rt_depth) {
 		glBindRenderbuffer(GL_RENDERBUFFER, 0);
-	} else {
+	} else if (!m_oldFbo) {
 		glDrawBuffer(GL_BACK);
 		glReadBuffer(GL_BACK);
 	}
@@ -111,3 +117,12 @@ void TextureRT::unbind() {
 	glViewport(m_oldViewport[0],m_oldViewport[1],
 			   m_oldViewport[2], m_oldViewport[3]);
 }
+
+void TextureRT::buildMipmap() {
+	if (m_type == Texture::rt_depth) return;
+	setMipmap(true);
+	Texture::bindGL();
+	glGenerateMipmap(m_target);
+	Texture::unbindGL();
+	setFilters(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+}
@@ -10,7 +10,8 @@ class TextureRT : public Texture {
 
 public:
 	void bind(); // Set this texture as render target
-	void unbind(); // Unbind texture and set framebuffer as render target
+	void unbind(); // Unbind texture and restore the previous render target
+	void buildMipmap(); // Build the mipmaps from the rendered image (color maps)
 
 	friend class TextureManager;
 
@@ -23,5 +24,6 @@ private:
 	// FrameBuffer objects
 	GLuint m_fbo; // for rendering to texture
 	GLuint m_rbo; // render buffer (for depth textures)
+	GLint m_oldFbo; // render target before bind (0 is the framebuffer)
 	int m_oldViewport[4]; // old viewport coordinates
 };
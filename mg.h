@@ -19,5 +19,6 @@
 #include "imageManager.h"
 #include "cameraManager.h"
 #include "avatarManager.h"
+#include "animationManager.h"
 #include "avatar.h"
 #include "parse_scene.h"